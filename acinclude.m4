@@ -838,6 +838,33 @@ case $host in
 esac
 ])
 
+AC_DEFUN([APACHE_CHECK_LIBURING], [
+dnl Check for liburing, used by the event MPM's io_uring engine.
+  AC_ARG_WITH(liburing,
+    APACHE_HELP_STRING(--with-liburing,Use liburing for the event MPM io_uring engine),
+    [ac_liburing="$withval"], [ac_liburing="check"])
+  ac_cv_liburing=no
+  if test "$ac_liburing" != "no"; then
+    case $host in
+    *-linux-*)
+      AC_CHECK_HEADERS(liburing.h, [
+        AC_CHECK_LIB(uring, io_uring_queue_init_params, [
+          AC_CHECK_DECL(io_uring_prep_multishot_accept, [ac_cv_liburing=yes], ,
+                        [#include <liburing.h>])
+        ])
+      ])
+      ;;
+    esac
+    if test "$ac_cv_liburing" = "yes"; then
+      AC_DEFINE(HAVE_LIBURING, 1, [Define if liburing is available])
+      APR_SETVAR(LIBURING_LIBS, [-luring])
+    elif test "$ac_liburing" = "yes"; then
+      AC_MSG_ERROR([liburing 2.2 or later is required for --with-liburing])
+    fi
+  fi
+  APACHE_SUBST(LIBURING_LIBS)
+])
+
 dnl
 dnl APACHE_EXPORT_ARGUMENTS
 dnl Export (via APACHE_SUBST) the various path-related variables that
@@ -123,6 +123,26 @@ AP_DECLARE(apr_status_t) ap_duplicate_listeners(apr_pool_t *p, server_rec *s,
                                                 ap_listen_rec ***buckets,
                                                 int *num_buckets);
 
+/**
+ * Bind the calling process, and the threads it creates thereafter, to the
+ * CPUs of the given listeners bucket (see ListenCoresBucketsAffinity).
+ * @param bucket The listeners bucket of the process.
+ * @return APR_SUCCESS, also if the buckets are not bound to any CPU, or
+ *         the error returned by the system.
+ * @remark To be called by the MPMs in the child process, before it starts
+ *         its threads.
+ */
+AP_DECLARE(apr_status_t) ap_listen_bucket_set_affinity(int bucket);
+
+/**
+ * Get the CPUs the given listeners bucket is bound to.
+ * @param p The pool to allocate from
+ * @param bucket The listeners bucket
+ * @return The list of CPUs (e.g. "0-3,8-11"), or NULL if the bucket is
+ *         not bound to any CPU.
+ */
+AP_DECLARE(const char *) ap_listen_bucket_cpus(apr_pool_t *p, int bucket);
+
 /**
  * Loop through the global ap_listen_rec list and close each of the sockets.
  */
@@ -148,6 +168,7 @@ AP_DECLARE_NONSTD(int) ap_close_selected_listeners(ap_slave_t *);
  */
 AP_DECLARE_NONSTD(const char *) ap_set_listenbacklog(cmd_parms *cmd, void *dummy, const char *arg);
 AP_DECLARE_NONSTD(const char *) ap_set_listencbratio(cmd_parms *cmd, void *dummy, const char *arg);
+AP_DECLARE_NONSTD(const char *) ap_set_listencbaffinity(cmd_parms *cmd, void *dummy, const char *arg);
 AP_DECLARE_NONSTD(const char *) ap_set_listener(cmd_parms *cmd, void *dummy,
                                                 int argc, char *const argv[]);
 AP_DECLARE_NONSTD(const char *) ap_set_send_buffer_size(cmd_parms *cmd, void *dummy,
@@ -165,6 +186,8 @@ AP_INIT_TAKE1("ListenBacklog", ap_set_listenbacklog, NULL, RSRC_CONF, \
   "Maximum length of the queue of pending connections, as used by listen(2)"), \
 AP_INIT_TAKE1("ListenCoresBucketsRatio", ap_set_listencbratio, NULL, RSRC_CONF, \
   "Ratio between the number of CPU cores (online) and the number of listeners buckets"), \
+AP_INIT_TAKE1("ListenCoresBucketsAffinity", ap_set_listencbaffinity, NULL, RSRC_CONF, \
+  "Whether to bind the listeners buckets to CPUs: off, cpu or numa"), \
 AP_INIT_TAKE_ARGV("Listen", ap_set_listener, NULL, RSRC_CONF, \
   "A port number or a numeric IP address and a port number, and an optional protocol"), \
 AP_INIT_TAKE1("SendBufferSize", ap_set_send_buffer_size, NULL, RSRC_CONF, \
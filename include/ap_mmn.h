@@ -632,6 +632,29 @@
  * 20200420.1 (2.5.1-dev)  Add ap_filter_adopt_brigade()
  * 20200420.2 (2.5.1-dev)  Add ap_proxy_worker_can_upgrade()
  * 20200420.3 (2.5.1-dev)  Add ap_parse_strict_length()
+ * 20200420.4 (2.5.1-dev)  Add ap_listen_bucket_set_affinity(),
+ *                         ap_listen_bucket_cpus(), ap_set_listencbaffinity()
+ *                         and bucket to process_score
+ * 20200420.5 (2.5.1-dev)  Add ap_escape_logitem_buf()
+ * 20200420.6 (2.5.1-dev)  Add ap_init_walk_cache()
+ * 20200420.7 (2.5.1-dev)  Add async_delay and async_delay_set to
+ *                         proxy_dir_conf
+ * 20200420.8 (2.5.1-dev)  Add AP_REG_JIT to ap_regex.h and AP_REG_DEFAULT
+ * 20200420.9 (2.5.1-dev)  Add dns_addrs to proxy_conn_rec, and dns_hits,
+ *                         dns_misses, dns_refreshes and dns_failures to
+ *                         proxy_worker_shared
+ * 20200420.10 (2.5.1-dev) Add response_time and flags to
+ *                         proxy_balancer_method, and response_ewma and
+ *                         response_stamp to proxy_worker_shared
+ * 20200420.11 (2.5.1-dev) Add warm, conns_idle, conns_new, conns_reused and
+ *                         conns_warmed to proxy_worker_shared, and
+ *                         ap_proxy_warm_connections()
+ * 20200420.12 (2.5.1-dev) Add body_indeterminate to request_rec
+ * 20200420.13 (2.5.1-dev) Add ap_mpm_register_worker_callback(), hook
+ *                         mpm_register_worker_callback, AP_MPMQ_CAN_DISPATCH
+ *                         and wkfunc to timer_event_t
+ * 20200420.14 (2.5.1-dev) Replace conns_idle of proxy_worker_shared with
+ *                         idle in proxy_conn_pool (per child)
  */
 
 #define MODULE_MAGIC_COOKIE 0x41503235UL /* "AP25" */
@@ -639,7 +662,7 @@
 #ifndef MODULE_MAGIC_NUMBER_MAJOR
 #define MODULE_MAGIC_NUMBER_MAJOR 20200420
 #endif
-#define MODULE_MAGIC_NUMBER_MINOR 3            /* 0...n */
+#define MODULE_MAGIC_NUMBER_MINOR 14           /* 0...n */
 
 /**
  * Determine if the server's current MODULE_MAGIC_NUMBER is at least a
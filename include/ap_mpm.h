@@ -182,6 +182,8 @@ AP_DECLARE(apr_status_t) ap_os_create_privileged_process(
 #define AP_MPMQ_CAN_SUSPEND          17
 /** MPM supports additional pollfds */
 #define AP_MPMQ_CAN_POLL             18
+/** MPM can run callbacks on its worker threads */
+#define AP_MPMQ_CAN_DISPATCH         19
 /** @} */
 
 /**
@@ -207,6 +209,23 @@ AP_DECLARE(apr_status_t) ap_mpm_resume_suspended(conn_rec *c);
 AP_DECLARE(apr_status_t) ap_mpm_register_timed_callback(
         apr_time_t t, ap_mpm_callback_fn_t *cbfn, void *baton);
 
+typedef void (ap_mpm_worker_callback_fn_t)(apr_thread_t *thd, void *baton);
+
+/**
+ * Run a callback on one of the MPM's worker threads, as soon as one is
+ * available, in turn with the connections waiting for a worker.
+ * @param cbfn The callback function
+ * @param baton userdata for the callback function
+ * @return APR_SUCCESS if the callback is queued, APR_ENOTIMPL if the MPM
+ * has no such worker threads (see AP_MPMQ_CAN_DISPATCH), APR_EOF once the
+ * workers are stopping.
+ * @remark A callback queued while the workers stop may never run.
+ * @remark The callback runs with the worker thread given, it should not
+ * block for long since it holds the worker from the connections meanwhile.
+ */
+AP_DECLARE(apr_status_t) ap_mpm_register_worker_callback(
+        ap_mpm_worker_callback_fn_t *cbfn, void *baton);
+
 /**
  * Register a callback on the readability or writability on a group of
  * sockets/pipes.
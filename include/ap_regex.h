@@ -89,9 +89,14 @@ extern "C" {
 
 #define AP_REG_NO_DEFAULT 0x400 /**< Don't implicitely add AP_REG_DEFAULT options */
 
+#define AP_REG_JIT 0x800 /**< JIT compile the pattern if supported (PCRE2),
+                          * taken from the default options regardless of
+                          * AP_REG_NO_DEFAULT since it does not change the
+                          * matching */
+
 #define AP_REG_MATCH "MATCH_" /**< suggested prefix for ap_regname */
 
-#define AP_REG_DEFAULT (AP_REG_DOTALL|AP_REG_DOLLAR_ENDONLY)
+#define AP_REG_DEFAULT (AP_REG_DOTALL|AP_REG_DOLLAR_ENDONLY|AP_REG_JIT)
 
 /* Arguments for ap_pcre_version_string */
 enum {
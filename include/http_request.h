@@ -228,6 +228,20 @@ AP_DECLARE(void) ap_clear_auth_internal(void);
  */
 AP_DECLARE(void) ap_setup_auth_internal(apr_pool_t *ptemp);
 
+/**
+ * Set up the per child cache of the merged per-directory configurations,
+ * shared by the requests matching the same sections.
+ * @param pchild The child pool, the cache lives as long as it
+ * @param s The main server
+ * @param size The maximum number of merges cached, 0 to disable the cache
+ * @remark A cached r->per_dir_config, and the module configurations in
+ * there, are shared by concurrent requests (and threads) hence must not be
+ * modified in place.  A request needing a different configuration should
+ * set r->per_dir_config to its own (merged or copied) vector.
+ */
+AP_DECLARE(void) ap_init_walk_cache(apr_pool_t *pchild, server_rec *s,
+                                    int size);
+
 /**
  * Register an authentication or authorization provider with the global
  * provider pool.
@@ -1097,6 +1097,11 @@ struct request_rec {
      *  TODO: compact elsewhere
      */
     unsigned int flushed:1;
+    /** Request body framed by the protocol (e.g. HTTP/2 DATA frames) with
+     *  no Content-Length: read until EOS, whatever the Transfer-Encoding
+     *  in headers_in says.
+     */
+    unsigned int body_indeterminate:1;
 };
 
 /**
@@ -1885,6 +1890,18 @@ AP_DECLARE(apr_size_t) ap_escape_errorlog_item(char *dest, const char *source,
                                                apr_size_t buflen)
                        AP_FN_ATTR_NONNULL((1));
 
+/**
+ * Escape a string for logging like ap_escape_logitem(), but into a buffer
+ * @param dest The buffer to write to
+ * @param source The string to escape
+ * @param buflen The size of the buffer
+ * @return The length of the escaped string (not NUL terminated), or
+ *         (apr_size_t)-1 if it does not fit in buflen bytes
+ */
+AP_DECLARE(apr_size_t) ap_escape_logitem_buf(char *dest, const char *source,
+                                             apr_size_t buflen)
+                       AP_FN_ATTR_NONNULL((1,2));
+
 /**
  * Construct a full hostname
  * @param p The pool to allocate from
@@ -422,6 +422,13 @@ AP_DECLARE_HOOK(int, mpm_query, (int query_code, int *result, apr_status_t *rv))
 AP_DECLARE_HOOK(apr_status_t, mpm_register_timed_callback,
                 (apr_time_t t, ap_mpm_callback_fn_t *cbfn, void *baton))
 
+/**
+ * register the specified callback to run on a worker thread
+ * @ingroup hooks
+ */
+AP_DECLARE_HOOK(apr_status_t, mpm_register_worker_callback,
+                (ap_mpm_worker_callback_fn_t *cbfn, void *baton))
+
 /**
  * register the specified callback
  * @ingroup hooks
@@ -113,6 +113,79 @@ int cache_create_entity(cache_request_rec *cache, request_rec *r,
     return DECLINED;
 }
 
+/*
+ * promote the entity served from the cache to the providers before
+ *
+ * Each provider listed before the one which hit is given the opportunity
+ * to create the entity, the first one which accepts it stores copies of
+ * the body's buckets, so that the next hits are served from it.
+ */
+int cache_promote_entity(cache_request_rec *cache, request_rec *r,
+                         apr_bucket_brigade *body)
+{
+    cache_provider_list *list;
+    apr_bucket_brigade *in, *out;
+    apr_bucket *e, *copy;
+    apr_off_t size;
+    apr_status_t rv;
+
+    if (!cache->promote || r->header_only) {
+        return DECLINED;
+    }
+
+    apr_brigade_length(body, 0, &size);
+
+    for (list = cache->providers; list && list != cache->promote;
+         list = list->next) {
+        cache_handle_t *h = apr_pcalloc(r->pool, sizeof(cache_handle_t));
+
+        if (list->provider->create_entity(h, r, cache->key, size,
+                                          body) != OK) {
+            continue;
+        }
+
+        in = apr_brigade_create(r->pool, r->connection->bucket_alloc);
+        out = apr_brigade_create(r->pool, r->connection->bucket_alloc);
+        rv = APR_SUCCESS;
+        for (e = APR_BRIGADE_FIRST(body);
+             e != APR_BRIGADE_SENTINEL(body) && rv == APR_SUCCESS;
+             e = APR_BUCKET_NEXT(e)) {
+            rv = apr_bucket_copy(e, &copy);
+            if (rv == APR_SUCCESS) {
+                APR_BRIGADE_INSERT_TAIL(in, copy);
+            }
+        }
+        APR_BRIGADE_INSERT_TAIL(in, apr_bucket_eos_create(in->bucket_alloc));
+
+        if (rv == APR_SUCCESS) {
+            rv = list->provider->store_headers(h, r,
+                                               &cache->handle->cache_obj->info);
+        }
+        while (rv == APR_SUCCESS && !APR_BRIGADE_EMPTY(in)) {
+            rv = list->provider->store_body(h, r, in, out);
+            apr_brigade_cleanup(out);
+        }
+        if (rv == APR_SUCCESS) {
+            rv = list->provider->commit_entity(h, r);
+        }
+        apr_brigade_destroy(in);
+        apr_brigade_destroy(out);
+
+        if (rv != APR_SUCCESS) {
+            ap_log_rerror(APLOG_MARK, APLOG_DEBUG, rv, r, APLOGNO(10260)
+                    "cache: could not promote %s from %s to %s", cache->key,
+                    cache->promote->provider_name, list->provider_name);
+            return DECLINED;
+        }
+        ap_log_rerror(APLOG_MARK, APLOG_DEBUG, 0, r, APLOGNO(10261)
+                "cache: promoted %s from %s to %s", cache->key,
+                cache->promote->provider_name, list->provider_name);
+        return OK;
+    }
+
+    return DECLINED;
+}
+
 static int filter_header_do(void *v, const char *key, const char *val)
 {
     if ((*key == 'W' || *key == 'w') && !ap_cstr_casecmp(key, "Warning")
@@ -213,6 +286,8 @@ void cache_accept_headers(cache_handle_t *h, request_rec *r, apr_table_t *top,
  */
 int cache_select(cache_request_rec *cache, request_rec *r)
 {
+    cache_server_conf *conf = ap_get_module_config(r->server->module_config,
+                                                   &cache_module);
     cache_provider_list *list;
     apr_status_t rv;
     cache_handle_t *h;
@@ -401,6 +476,9 @@ int cache_select(cache_request_rec *cache, request_rec *r)
             cache_accept_headers(h, r, h->resp_hdrs, r->headers_out, 0);
 
             cache->handle = h;
+            if (conf->promote && list != cache->providers) {
+                cache->promote = list;
+            }
             return OK;
         }
         case DECLINED: {
@@ -41,6 +41,19 @@ int cache_create_entity(cache_request_rec *cache, request_rec *r,
                         apr_off_t size, apr_bucket_brigade *in);
 int cache_select(cache_request_rec *cache, request_rec *r);
 
+/**
+ * promote the entity served from the cache to the providers listed before
+ * the one which hit (e.g. from disk to memory), if they accept it.
+ *
+ * This function returns OK if the entity was stored by one of them, and
+ * DECLINED otherwise.
+ * @param cache cache_request_rec
+ * @param r request_rec
+ * @param body the recalled body, left untouched
+ */
+int cache_promote_entity(cache_request_rec *cache, request_rec *r,
+                         apr_bucket_brigade *body);
+
 /**
  * invalidate a specific URL entity in all caches
  *
@@ -134,6 +134,8 @@ typedef struct {
     unsigned int quick:1;
     /* thundering herd lock */
     unsigned int lock:1;
+    /** promote entities to the providers listed before the one which hit */
+    unsigned int promote:1;
     unsigned int x_cache:1;
     unsigned int x_cache_detail:1;
     /* flag if CacheIgnoreHeader has been set */
@@ -149,6 +151,7 @@ typedef struct {
     unsigned int ignorequerystring_set:1;
     unsigned int quick_set:1;
     unsigned int lock_set:1;
+    unsigned int promote_set:1;
     unsigned int lockpath_set:1;
     unsigned int lockmaxage_set:1;
     unsigned int x_cache_set:1;
@@ -229,6 +232,10 @@ typedef struct {
     apr_off_t size;                     /* the content length from the headers, or -1 */
     apr_bucket_brigade *out;            /* brigade to reuse for upstream responses */
     cache_control_t control_in;         /* cache control incoming */
+    cache_provider_list *promote;       /* the provider which hit, if the
+                                         * entity should be promoted to the
+                                         * ones before it
+                                         */
 } cache_request_rec;
 
 /**
@@ -674,6 +674,11 @@ static apr_status_t cache_out_filter(ap_filter_t *f, apr_bucket_brigade *in)
 
             /* recall_headers() was called in cache_select() */
             cache->provider->recall_body(cache->handle, r->pool, bb);
+
+            /* hit in a lower tier, copy the entity in the upper ones */
+            if (cache->promote) {
+                cache_promote_entity(cache, r, bb);
+            }
             APR_BRIGADE_PREPEND(in, bb);
 
             /* This filter is done once it has served up its content */
@@ -2029,6 +2034,8 @@ static void * create_cache_config(apr_pool_t *p, server_rec *s)
     ps->ignore_session_id_set = CACHE_IGNORE_SESSION_ID_UNSET;
     ps->lock = 0; /* thundering herd lock defaults to off */
     ps->lock_set = 0;
+    ps->promote = 1; /* promotion to upper providers defaults to on */
+    ps->promote_set = 0;
     ps->lockpath = ap_runtime_dir_relative(p, DEFAULT_CACHE_LOCKPATH);
     ps->lockmaxage = apr_time_from_sec(DEFAULT_CACHE_MAXAGE);
     ps->x_cache = DEFAULT_X_CACHE;
@@ -2071,6 +2078,10 @@ static void * merge_cache_config(apr_pool_t *p, void *basev, void *overridesv)
         (overrides->lock_set == 0)
         ? base->lock
         : overrides->lock;
+    ps->promote =
+        (overrides->promote_set == 0)
+        ? base->promote
+        : overrides->promote;
     ps->lockpath =
         (overrides->lockpath_set == 0)
         ? base->lockpath
@@ -2394,6 +2405,19 @@ static const char *set_cache_lock(cmd_parms *parms, void *dummy,
     return NULL;
 }
 
+static const char *set_cache_promote(cmd_parms *parms, void *dummy,
+                                     int flag)
+{
+    cache_server_conf *conf;
+
+    conf =
+        (cache_server_conf *)ap_get_module_config(parms->server->module_config,
+                                                  &cache_module);
+    conf->promote = flag;
+    conf->promote_set = 1;
+    return NULL;
+}
+
 static const char *set_cache_lock_path(cmd_parms *parms, void *dummy,
                                     const char *arg)
 {
@@ -2579,6 +2603,10 @@ static const command_rec cache_cmds[] =
     AP_INIT_FLAG("CacheLock", set_cache_lock,
                  NULL, RSRC_CONF,
                  "Enable or disable the thundering herd lock."),
+    AP_INIT_FLAG("CachePromote", set_cache_promote,
+                 NULL, RSRC_CONF,
+                 "Copy the entities which hit in a provider to the ones "
+                 "enabled before it, default on"),
     AP_INIT_TAKE1("CacheLockPath", set_cache_lock_path, NULL, RSRC_CONF,
                   "The thundering herd lock path. Defaults to the '"
                   DEFAULT_CACHE_LOCKPATH "' directory relative to the "
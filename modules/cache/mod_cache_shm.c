@@ -0,0 +1,1557 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "apr_lib.h"
+#include "apr_atomic.h"
+#include "apr_strings.h"
+#include "apr_buckets.h"
+#include "apr_shm.h"
+#include "apr_global_mutex.h"
+#include "httpd.h"
+#include "http_config.h"
+#include "http_log.h"
+#include "http_core.h"
+#include "http_protocol.h"
+#include "ap_provider.h"
+#include "util_mutex.h"
+
+#include "mod_cache.h"
+#include "mod_status.h"
+
+/*
+ * mod_cache_shm: Shared Memory Based HTTP 1.1 Cache.
+ *
+ * An in-memory tier for small and hot objects, shared by all the children
+ * and usually enabled before mod_cache_disk (mod_cache then promotes the
+ * entities which hit on disk, see CachePromote).
+ *
+ * The shared memory segment is laid out as follows:
+ *
+ *   [ header | hash buckets | entries | blocks chains | sketch | blocks ]
+ *
+ * Each entry (key, response headers and body, consecutively) is stored in
+ * a chain of fixed size blocks.  The bodies are served by reference from
+ * the segment: the buckets hold a reference to the entry, which is freed
+ * only once evicted and unreferenced.  The data of an entry never changes
+ * once loaded, hence they can be read without the lock (which protects
+ * the index, the queues and the counters only).
+ *
+ * Eviction and admission follow W-TinyLFU: new entries enter a small LRU
+ * window, and the ones leaving the window are admitted in the main space
+ * (a segmented LRU made of a probation and a protected queue) only if
+ * their estimated frequency is higher than the main space's victim.  The
+ * frequencies of the keys are estimated by a count-min sketch, incremented
+ * on each lookup and halved periodically so that they age.
+ *
+ * The references held by a child which crashes are leaked until the next
+ * restart, the entries involved being evicted but not reused meanwhile.
+ */
+
+module AP_MODULE_DECLARE_DATA cache_shm_module;
+
+#define CACHE_SHM_BLOCK_SIZE 2048
+#define CACHE_SHM_NIL ((apr_uint32_t)-1)
+
+/* Maximum value of the sketch counters */
+#define CACHE_SHM_SKETCH_MAX 15
+#define CACHE_SHM_SKETCH_ROWS 4
+
+/* The queues of W-TinyLFU, then the other states of an entry */
+#define CACHE_SHM_WINDOW    0
+#define CACHE_SHM_PROBATION 1
+#define CACHE_SHM_PROTECTED 2
+#define CACHE_SHM_QUEUES    3
+#define CACHE_SHM_FREE      3
+#define CACHE_SHM_LOADING   4
+#define CACHE_SHM_DEAD      5
+
+typedef struct {
+    apr_uint32_t head;          /* most recently used */
+    apr_uint32_t tail;          /* least recently used */
+    apr_uint32_t blocks;        /* blocks used by the entries */
+} cache_shm_queue;
+
+typedef struct {
+    apr_uint64_t hash;
+    apr_uint32_t next;          /* next in the hash chain, or free list */
+    apr_uint32_t lru_prev;
+    apr_uint32_t lru_next;
+    apr_uint32_t first_block;
+    apr_uint32_t nblocks;
+    apr_uint32_t refcount;      /* references held by the children (atomic) */
+    apr_uint32_t state;
+    apr_uint32_t key_len;
+    apr_uint32_t hdrs_len;
+    apr_uint32_t body_len;
+    /* cache_info */
+    int status;
+    apr_time_t date;
+    apr_time_t expire;
+    apr_time_t request_time;
+    apr_time_t response_time;
+    cache_control_t control;
+} cache_shm_entry;
+
+typedef struct {
+    apr_uint32_t nbuckets;
+    apr_uint32_t nentries;
+    apr_uint32_t nblocks;
+    apr_uint32_t sketch_width;
+    apr_size_t buckets_offset;
+    apr_size_t entries_offset;
+    apr_size_t chains_offset;
+    apr_size_t sketch_offset;
+    apr_size_t data_offset;
+    apr_uint32_t free_entry;
+    apr_uint32_t dead_entry;    /* evicted but still referenced */
+    apr_uint32_t free_block;
+    apr_uint32_t free_blocks;
+    apr_uint32_t window_max;
+    apr_uint32_t main_max;
+    apr_uint32_t protected_max;
+    apr_uint32_t sketch_additions;
+    apr_uint32_t sketch_sample;
+    cache_shm_queue queues[CACHE_SHM_QUEUES];
+    /* Stats */
+    apr_uint32_t stat_entries;
+    unsigned long stat_hits;
+    unsigned long stat_misses;
+    unsigned long stat_stores;
+    unsigned long stat_rejected;
+    unsigned long stat_admitted;
+    unsigned long stat_evicted;
+} cache_shm_header;
+
+#define SHM_BUCKETS(hdr) \
+    ((apr_uint32_t *)((char *)(hdr) + (hdr)->buckets_offset))
+#define SHM_ENTRY(hdr, i) \
+    ((cache_shm_entry *)((char *)(hdr) + (hdr)->entries_offset) + (i))
+#define SHM_CHAINS(hdr) \
+    ((apr_uint32_t *)((char *)(hdr) + (hdr)->chains_offset))
+#define SHM_SKETCH(hdr) \
+    ((unsigned char *)(hdr) + (hdr)->sketch_offset)
+#define SHM_DATA(hdr) \
+    ((char *)(hdr) + (hdr)->data_offset)
+#define SHM_BLOCK(hdr, i) \
+    (SHM_DATA(hdr) + (apr_size_t)(i) * CACHE_SHM_BLOCK_SIZE)
+
+/*
+ * cache_shm_object_t
+ * Pointed to by cache_object_t::vobj
+ */
+typedef struct cache_shm_object_t
+{
+    const char *key;
+    apr_size_t key_len;
+    apr_uint64_t hash;
+    char *buffer;               /* key, headers and body to store */
+    apr_size_t hdrs_len;
+    apr_off_t body_len;
+    apr_off_t body_expected;
+    apr_bucket_brigade *body;   /* recalled body, if any */
+    unsigned int opened :1;     /* opened by open_entity() */
+    unsigned int newbody :1;    /* whether a new body is present */
+    unsigned int done :1;       /* is the attempt to cache complete? */
+} cache_shm_object_t;
+
+/* The reference to an entry held by the buckets of a child */
+typedef struct {
+    apr_bucket_refcount refcount;
+    cache_shm_header *header;
+    apr_uint32_t idx;
+    apr_bucket_alloc_t *list;
+} cache_shm_ref;
+
+/*
+ * mod_cache_shm configuration
+ */
+#define DEFAULT_MAX_SIZE 100*1024
+#define DEFAULT_MIN_HITS 2
+
+typedef struct cache_shm_dir_conf
+{
+    apr_off_t max; /* maximum entry size (headers and body) */
+    int min_hits;  /* lookups before an entity is admitted */
+    unsigned int max_set :1;
+    unsigned int min_hits_set :1;
+} cache_shm_dir_conf;
+
+/* Shared memory and mutex, for all the servers */
+static const char * const cache_shm_id = "cache-shm";
+static apr_size_t cache_shm_size;
+static apr_shm_t *cache_shm;
+static cache_shm_header *shm_header;
+static apr_global_mutex_t *cache_shm_mutex;
+
+/*
+ * Local static functions
+ */
+
+static apr_status_t read_table(request_rec *r, apr_table_t *table,
+        char *buffer, apr_size_t buffer_len, apr_size_t *slider)
+{
+    apr_size_t key = *slider, colon = 0, len = 0;
+
+    while (*slider < buffer_len) {
+        if (buffer[*slider] == ':') {
+            if (!colon) {
+                colon = *slider;
+            }
+            (*slider)++;
+        }
+        else if (buffer[*slider] == '\r') {
+            len = colon;
+            if (key == *slider) {
+                (*slider)++;
+                if (buffer[*slider] == '\n') {
+                    (*slider)++;
+                }
+                return APR_SUCCESS;
+            }
+            if (!colon || buffer[colon++] != ':') {
+                ap_log_rerror(APLOG_MARK, APLOG_ERR, 0, r, APLOGNO(10262)
+                        "Premature end of cache headers.");
+                return APR_EGENERAL;
+            }
+            /* Do not go past the \r from above as apr_isspace('\r') is true */
+            while (apr_isspace(buffer[colon]) && (colon < *slider)) {
+                colon++;
+            }
+            apr_table_addn(table, apr_pstrmemdup(r->pool, buffer + key,
+                    len - key), apr_pstrmemdup(r->pool, buffer + colon,
+                    *slider - colon));
+            (*slider)++;
+            if (buffer[*slider] == '\n') {
+                (*slider)++;
+            }
+            key = *slider;
+            colon = 0;
+        }
+        else {
+            (*slider)++;
+        }
+    }
+
+    return APR_EOF;
+}
+
+static apr_status_t store_table(apr_table_t *table, char *buffer,
+        apr_size_t buffer_len, apr_size_t *slider)
+{
+    int i, len;
+    apr_table_entry_t *elts;
+
+    elts = (apr_table_entry_t *) apr_table_elts(table)->elts;
+    for (i = 0; i < apr_table_elts(table)->nelts; ++i) {
+        if (elts[i].key != NULL) {
+            apr_size_t key_len = strlen(elts[i].key);
+            apr_size_t val_len = strlen(elts[i].val);
+            if (key_len + val_len + 5 >= buffer_len - *slider) {
+                return APR_EOF;
+            }
+            len = apr_snprintf(buffer ? buffer + *slider : NULL,
+                    buffer ? buffer_len - *slider : 0, "%s: %s" CRLF,
+                    elts[i].key, elts[i].val);
+            *slider += len;
+        }
+    }
+    if (3 >= buffer_len - *slider) {
+        return APR_EOF;
+    }
+    if (buffer) {
+        memcpy(buffer + *slider, CRLF, sizeof(CRLF) - 1);
+    }
+    *slider += sizeof(CRLF) - 1;
+
+    return APR_SUCCESS;
+}
+
+/* FNV-1a */
+static apr_uint64_t cache_shm_hash(const char *key, apr_size_t len)
+{
+    apr_uint64_t hash = APR_UINT64_C(0xcbf29ce484222325);
+    apr_size_t i;
+
+    for (i = 0; i < len; i++) {
+        hash ^= (unsigned char)key[i];
+        hash *= APR_UINT64_C(0x100000001b3);
+    }
+    return hash;
+}
+
+/*
+ * Count-min sketch, all called with the lock held
+ */
+
+static APR_INLINE apr_size_t sketch_index(cache_shm_header *hdr,
+                                          apr_uint64_t hash, int row)
+{
+    apr_uint32_t h1 = (apr_uint32_t)hash;
+    apr_uint32_t h2 = (apr_uint32_t)(hash >> 32) | 1;
+
+    return (apr_size_t)row * hdr->sketch_width
+           + ((h1 + row * h2) & (hdr->sketch_width - 1));
+}
+
+static int sketch_frequency(cache_shm_header *hdr, apr_uint64_t hash)
+{
+    unsigned char *sketch = SHM_SKETCH(hdr);
+    int row, freq = CACHE_SHM_SKETCH_MAX;
+
+    for (row = 0; row < CACHE_SHM_SKETCH_ROWS; row++) {
+        int c = sketch[sketch_index(hdr, hash, row)];
+        if (c < freq) {
+            freq = c;
+        }
+    }
+    return freq;
+}
+
+static void sketch_increment(cache_shm_header *hdr, apr_uint64_t hash)
+{
+    unsigned char *sketch = SHM_SKETCH(hdr);
+    int row, freq = sketch_frequency(hdr, hash);
+
+    /* conservative update: only the counters at the minimum */
+    if (freq < CACHE_SHM_SKETCH_MAX) {
+        for (row = 0; row < CACHE_SHM_SKETCH_ROWS; row++) {
+            unsigned char *c = &sketch[sketch_index(hdr, hash, row)];
+            if (*c == freq) {
+                (*c)++;
+            }
+        }
+    }
+
+    /* age the frequencies */
+    if (++hdr->sketch_additions >= hdr->sketch_sample) {
+        apr_size_t i, n = (apr_size_t)CACHE_SHM_SKETCH_ROWS
+                          * hdr->sketch_width;
+        for (i = 0; i < n; i++) {
+            sketch[i] >>= 1;
+        }
+        hdr->sketch_additions /= 2;
+    }
+}
+
+/*
+ * Queues, index and blocks, all called with the lock held
+ */
+
+static void queue_unlink(cache_shm_header *hdr, apr_uint32_t idx)
+{
+    cache_shm_entry *e = SHM_ENTRY(hdr, idx);
+    cache_shm_queue *q = &hdr->queues[e->state];
+
+    if (e->lru_prev != CACHE_SHM_NIL) {
+        SHM_ENTRY(hdr, e->lru_prev)->lru_next = e->lru_next;
+    }
+    else {
+        q->head = e->lru_next;
+    }
+    if (e->lru_next != CACHE_SHM_NIL) {
+        SHM_ENTRY(hdr, e->lru_next)->lru_prev = e->lru_prev;
+    }
+    else {
+        q->tail = e->lru_prev;
+    }
+    q->blocks -= e->nblocks;
+}
+
+static void queue_push(cache_shm_header *hdr, apr_uint32_t idx, int queue)
+{
+    cache_shm_entry *e = SHM_ENTRY(hdr, idx);
+    cache_shm_queue *q = &hdr->queues[queue];
+
+    e->state = queue;
+    e->lru_prev = CACHE_SHM_NIL;
+    e->lru_next = q->head;
+    if (q->head != CACHE_SHM_NIL) {
+        SHM_ENTRY(hdr, q->head)->lru_prev = idx;
+    }
+    else {
+        q->tail = idx;
+    }
+    q->head = idx;
+    q->blocks += e->nblocks;
+}
+
+/* Compare the key of an entry, which starts its data */
+static int entry_keycmp(cache_shm_header *hdr, cache_shm_entry *e,
+                        const char *key, apr_size_t len)
+{
+    apr_uint32_t *chains = SHM_CHAINS(hdr);
+    apr_uint32_t block = e->first_block;
+
+    while (len) {
+        apr_size_t n = len < CACHE_SHM_BLOCK_SIZE ? len : CACHE_SHM_BLOCK_SIZE;
+        if (memcmp(SHM_BLOCK(hdr, block), key, n)) {
+            return 1;
+        }
+        key += n;
+        len -= n;
+        block = chains[block];
+    }
+    return 0;
+}
+
+static apr_uint32_t index_find(cache_shm_header *hdr, apr_uint64_t hash,
+                               const char *key, apr_size_t len)
+{
+    apr_uint32_t idx = SHM_BUCKETS(hdr)[hash & (hdr->nbuckets - 1)];
+
+    while (idx != CACHE_SHM_NIL) {
+        cache_shm_entry *e = SHM_ENTRY(hdr, idx);
+        if (e->hash == hash && e->key_len == len
+                && !entry_keycmp(hdr, e, key, len)) {
+            break;
+        }
+        idx = e->next;
+    }
+    return idx;
+}
+
+static void index_insert(cache_shm_header *hdr, apr_uint32_t idx)
+{
+    cache_shm_entry *e = SHM_ENTRY(hdr, idx);
+    apr_uint32_t *bucket = &SHM_BUCKETS(hdr)[e->hash & (hdr->nbuckets - 1)];
+
+    e->next = *bucket;
+    *bucket = idx;
+}
+
+static void index_remove(cache_shm_header *hdr, apr_uint32_t idx)
+{
+    cache_shm_entry *e = SHM_ENTRY(hdr, idx);
+    apr_uint32_t *link = &SHM_BUCKETS(hdr)[e->hash & (hdr->nbuckets - 1)];
+
+    while (*link != CACHE_SHM_NIL) {
+        if (*link == idx) {
+            *link = e->next;
+            break;
+        }
+        link = &SHM_ENTRY(hdr, *link)->next;
+    }
+}
+
+static void entry_free(cache_shm_header *hdr, apr_uint32_t idx)
+{
+    cache_shm_entry *e = SHM_ENTRY(hdr, idx);
+    apr_uint32_t *chains = SHM_CHAINS(hdr);
+    apr_uint32_t last = e->first_block;
+
+    while (chains[last] != CACHE_SHM_NIL) {
+        last = chains[last];
+    }
+    chains[last] = hdr->free_block;
+    hdr->free_block = e->first_block;
+    hdr->free_blocks += e->nblocks;
+
+    e->state = CACHE_SHM_FREE;
+    e->next = hdr->free_entry;
+    hdr->free_entry = idx;
+}
+
+/*
+ * Remove a queued entry from the cache.  A referenced entry goes to the
+ * dead list, where it is freed by reap_dead() once unreferenced.  The
+ * references are only taken with the lock held, on indexed entries, so
+ * one that is seen unreferenced here can be freed right away.
+ */
+static void entry_evict(cache_shm_header *hdr, apr_uint32_t idx)
+{
+    cache_shm_entry *e = SHM_ENTRY(hdr, idx);
+
+    queue_unlink(hdr, idx);
+    index_remove(hdr, idx);
+    hdr->stat_entries--;
+    hdr->stat_evicted++;
+    if (apr_atomic_read32(&e->refcount)) {
+        e->state = CACHE_SHM_DEAD;
+        e->next = hdr->dead_entry;
+        hdr->dead_entry = idx;
+    }
+    else {
+        entry_free(hdr, idx);
+    }
+}
+
+/* Free the dead entries which are no longer referenced */
+static void reap_dead(cache_shm_header *hdr)
+{
+    apr_uint32_t *link = &hdr->dead_entry;
+
+    while (*link != CACHE_SHM_NIL) {
+        apr_uint32_t idx = *link;
+        cache_shm_entry *e = SHM_ENTRY(hdr, idx);
+
+        if (apr_atomic_read32(&e->refcount)) {
+            link = &e->next;
+        }
+        else {
+            *link = e->next;
+            entry_free(hdr, idx);
+        }
+    }
+}
+
+/*
+ * Release a reference, without the lock so that it can't be lost (the
+ * entry is freed by the next make_room() if evicted meanwhile).
+ */
+static void entry_release(cache_shm_header *hdr, apr_uint32_t idx)
+{
+    apr_atomic_dec32(&SHM_ENTRY(hdr, idx)->refcount);
+}
+
+/* Record a hit: window and protected entries become the most recently
+ * used, probation ones are promoted to the protected queue. */
+static void entry_touch(cache_shm_header *hdr, apr_uint32_t idx)
+{
+    cache_shm_entry *e = SHM_ENTRY(hdr, idx);
+    cache_shm_queue *protected = &hdr->queues[CACHE_SHM_PROTECTED];
+    int queue = e->state;
+
+    queue_unlink(hdr, idx);
+    if (queue == CACHE_SHM_PROBATION) {
+        queue = CACHE_SHM_PROTECTED;
+    }
+    queue_push(hdr, idx, queue);
+
+    while (protected->blocks > hdr->protected_max
+           && protected->tail != idx) {
+        apr_uint32_t demoted = protected->tail;
+        queue_unlink(hdr, demoted);
+        queue_push(hdr, demoted, CACHE_SHM_PROBATION);
+    }
+}
+
+/* The least recently used entry of the window moves to the main space,
+ * and if the latter is full it competes with its victim: the one with the
+ * lowest estimated frequency is evicted (TinyLFU admission). */
+static void window_evict(cache_shm_header *hdr)
+{
+    apr_uint32_t candidate = hdr->queues[CACHE_SHM_WINDOW].tail;
+    apr_uint32_t victim;
+    cache_shm_entry *e = SHM_ENTRY(hdr, candidate);
+
+    queue_unlink(hdr, candidate);
+    queue_push(hdr, candidate, CACHE_SHM_PROBATION);
+    if (hdr->queues[CACHE_SHM_PROBATION].blocks
+            + hdr->queues[CACHE_SHM_PROTECTED].blocks <= hdr->main_max) {
+        hdr->stat_admitted++;
+        return;
+    }
+
+    victim = hdr->queues[CACHE_SHM_PROBATION].tail;
+    if (victim == candidate) {
+        victim = hdr->queues[CACHE_SHM_PROTECTED].tail;
+    }
+    if (victim == CACHE_SHM_NIL
+            || sketch_frequency(hdr, e->hash)
+               > sketch_frequency(hdr, SHM_ENTRY(hdr, victim)->hash)) {
+        if (victim != CACHE_SHM_NIL) {
+            entry_evict(hdr, victim);
+        }
+        hdr->stat_admitted++;
+    }
+    else {
+        entry_evict(hdr, candidate);
+    }
+}
+
+/* Evict entries until nblocks blocks and an entry are free */
+static apr_status_t make_room(cache_shm_header *hdr, apr_uint32_t nblocks)
+{
+    cache_shm_queue *queues = hdr->queues;
+
+    reap_dead(hdr);
+    while (hdr->free_blocks < nblocks || hdr->free_entry == CACHE_SHM_NIL) {
+        apr_uint32_t victim;
+
+        if (queues[CACHE_SHM_WINDOW].tail != CACHE_SHM_NIL
+                && queues[CACHE_SHM_WINDOW].blocks + nblocks
+                   > hdr->window_max) {
+            window_evict(hdr);
+            continue;
+        }
+        victim = queues[CACHE_SHM_PROBATION].tail;
+        if (victim == CACHE_SHM_NIL) {
+            victim = queues[CACHE_SHM_PROTECTED].tail;
+        }
+        if (victim == CACHE_SHM_NIL) {
+            victim = queues[CACHE_SHM_WINDOW].tail;
+        }
+        if (victim == CACHE_SHM_NIL) {
+            /* what remains is referenced (or being loaded) */
+            return APR_ENOSPC;
+        }
+        entry_evict(hdr, victim);
+    }
+    return APR_SUCCESS;
+}
+
+static apr_uint32_t entry_alloc(cache_shm_header *hdr, apr_uint32_t nblocks)
+{
+    apr_uint32_t *chains = SHM_CHAINS(hdr);
+    apr_uint32_t idx = hdr->free_entry, last, i;
+    cache_shm_entry *e = SHM_ENTRY(hdr, idx);
+
+    hdr->free_entry = e->next;
+
+    e->first_block = last = hdr->free_block;
+    for (i = 1; i < nblocks; i++) {
+        last = chains[last];
+    }
+    hdr->free_block = chains[last];
+    chains[last] = CACHE_SHM_NIL;
+    hdr->free_blocks -= nblocks;
+
+    e->nblocks = nblocks;
+    apr_atomic_set32(&e->refcount, 0);
+    e->state = CACHE_SHM_LOADING;
+    return idx;
+}
+
+/*
+ * Access to the data of an entry, without the lock
+ */
+
+static void entry_read(cache_shm_header *hdr, cache_shm_entry *e,
+                       apr_size_t offset, char *dest, apr_size_t len)
+{
+    apr_uint32_t *chains = SHM_CHAINS(hdr);
+    apr_uint32_t block = e->first_block;
+
+    while (offset >= CACHE_SHM_BLOCK_SIZE) {
+        block = chains[block];
+        offset -= CACHE_SHM_BLOCK_SIZE;
+    }
+    while (len) {
+        apr_size_t n = CACHE_SHM_BLOCK_SIZE - offset;
+        if (n > len) {
+            n = len;
+        }
+        memcpy(dest, SHM_BLOCK(hdr, block) + offset, n);
+        dest += n;
+        len -= n;
+        offset = 0;
+        block = chains[block];
+    }
+}
+
+static void entry_write(cache_shm_header *hdr, cache_shm_entry *e,
+                        const char *src, apr_size_t len)
+{
+    apr_uint32_t *chains = SHM_CHAINS(hdr);
+    apr_uint32_t block = e->first_block;
+
+    while (len) {
+        apr_size_t n = len < CACHE_SHM_BLOCK_SIZE ? len : CACHE_SHM_BLOCK_SIZE;
+        memcpy(SHM_BLOCK(hdr, block), src, n);
+        src += n;
+        len -= n;
+        block = chains[block];
+    }
+}
+
+static apr_status_t cache_shm_lock(request_rec *r)
+{
+    apr_status_t rv = apr_global_mutex_lock(cache_shm_mutex);
+    if (rv != APR_SUCCESS) {
+        ap_log_rerror(APLOG_MARK, APLOG_ERR, rv, r, APLOGNO(10263)
+                "could not acquire the %s lock", cache_shm_id);
+    }
+    return rv;
+}
+
+static void cache_shm_unlock(void)
+{
+    apr_global_mutex_unlock(cache_shm_mutex);
+}
+
+/*
+ * The CACHE_SHM bucket, referencing the data of an entry in place
+ */
+
+static void cache_shm_bucket_destroy(void *data)
+{
+    cache_shm_ref *ref = data;
+
+    if (apr_bucket_shared_destroy(ref)) {
+        entry_release(ref->header, ref->idx);
+        apr_bucket_free(ref);
+    }
+}
+
+static apr_status_t cache_shm_bucket_read(apr_bucket *b, const char **str,
+                                          apr_size_t *len,
+                                          apr_read_type_e block)
+{
+    cache_shm_ref *ref = b->data;
+
+    *str = SHM_DATA(ref->header) + b->start;
+    *len = b->length;
+    return APR_SUCCESS;
+}
+
+static const apr_bucket_type_t bucket_type_cache_shm = {
+    "CACHE_SHM", 5, APR_BUCKET_DATA,
+    cache_shm_bucket_destroy,
+    cache_shm_bucket_read,
+    apr_bucket_setaside_noop,
+    apr_bucket_shared_split,
+    apr_bucket_shared_copy
+};
+
+/* Make the body brigade of an entry (referenced by the caller, the
+ * reference is given to the buckets), one bucket per run of contiguous
+ * blocks. */
+static apr_bucket_brigade *entry_body(cache_shm_header *hdr,
+                                      apr_uint32_t idx, apr_pool_t *p,
+                                      apr_bucket_alloc_t *list)
+{
+    cache_shm_entry *e = SHM_ENTRY(hdr, idx);
+    apr_uint32_t *chains = SHM_CHAINS(hdr);
+    apr_uint32_t block = e->first_block;
+    apr_size_t offset = e->key_len + e->hdrs_len;
+    apr_size_t len = e->body_len;
+    apr_bucket_brigade *bb = apr_brigade_create(p, list);
+    apr_bucket *first = NULL, *b;
+    cache_shm_ref *ref;
+
+    ref = apr_bucket_alloc(sizeof(*ref), list);
+    ref->header = hdr;
+    ref->idx = idx;
+    ref->list = list;
+
+    while (offset >= CACHE_SHM_BLOCK_SIZE) {
+        block = chains[block];
+        offset -= CACHE_SHM_BLOCK_SIZE;
+    }
+    while (len) {
+        apr_off_t start = (apr_off_t)block * CACHE_SHM_BLOCK_SIZE + offset;
+        apr_size_t n = CACHE_SHM_BLOCK_SIZE - offset;
+
+        while (n < len && chains[block] == block + 1) {
+            n += CACHE_SHM_BLOCK_SIZE;
+            block++;
+        }
+        if (n > len) {
+            n = len;
+        }
+        if (!first) {
+            b = first = apr_bucket_alloc(sizeof(*b), list);
+            APR_BUCKET_INIT(b);
+            b->free = apr_bucket_free;
+            b->list = list;
+            apr_bucket_shared_make(b, ref, start, n);
+            b->type = &bucket_type_cache_shm;
+        }
+        else {
+            apr_bucket_copy(first, &b);
+            b->start = start;
+            b->length = n;
+        }
+        APR_BRIGADE_INSERT_TAIL(bb, b);
+        len -= n;
+        offset = 0;
+        block = chains[block];
+    }
+    return bb;
+}
+
+/*
+ * Hook and mod_cache callback functions
+ */
+static int create_entity(cache_handle_t *h, request_rec *r, const char *key,
+        apr_off_t len, apr_bucket_brigade *bb)
+{
+    cache_shm_dir_conf *dconf =
+            ap_get_module_config(r->per_dir_config, &cache_shm_module);
+    cache_object_t *obj;
+    cache_shm_object_t *sobj;
+    apr_size_t key_len;
+    apr_uint64_t hash;
+    int freq;
+
+    if (!shm_header) {
+        return DECLINED;
+    }
+
+    /* we don't support caching of range requests nor HEAD requests */
+    if (r->status == HTTP_PARTIAL_CONTENT || r->header_only) {
+        ap_log_rerror(APLOG_MARK, APLOG_DEBUG, 0, r, APLOGNO(10264)
+                "URL %s partial content or HEAD response not cached",
+                key);
+        return DECLINED;
+    }
+
+    /* the variants are left to the next providers */
+    if (apr_table_get(r->headers_out, "Vary")
+            || apr_table_get(r->err_headers_out, "Vary")) {
+        ap_log_rerror(APLOG_MARK, APLOG_DEBUG, 0, r, APLOGNO(10265)
+                "URL '%s' has Vary, ignoring", key);
+        return DECLINED;
+    }
+
+    if (len < 0 || len > dconf->max) {
+        ap_log_rerror(APLOG_MARK, APLOG_DEBUG, 0, r, APLOGNO(10266)
+                "URL '%s' body size unknown or larger than limit, ignoring "
+                "(%" APR_OFF_T_FMT " > %" APR_OFF_T_FMT ")",
+                key, len, dconf->max);
+        return DECLINED;
+    }
+
+    /* Admit the entity only if it was looked up often enough */
+    key_len = strlen(key);
+    hash = cache_shm_hash(key, key_len);
+    if (cache_shm_lock(r) != APR_SUCCESS) {
+        return DECLINED;
+    }
+    freq = sketch_frequency(shm_header, hash);
+    if (freq < dconf->min_hits) {
+        shm_header->stat_rejected++;
+    }
+    cache_shm_unlock();
+    if (freq < dconf->min_hits) {
+        ap_log_rerror(APLOG_MARK, APLOG_DEBUG, 0, r, APLOGNO(10267)
+                "URL '%s' not looked up often enough (%d < %d), ignoring",
+                key, freq, dconf->min_hits);
+        return DECLINED;
+    }
+
+    /* Allocate and initialize cache_object_t and cache_shm_object_t */
+    h->cache_obj = obj = apr_pcalloc(r->pool, sizeof(*obj));
+    obj->vobj = sobj = apr_pcalloc(r->pool, sizeof(*sobj));
+
+    obj->key = sobj->key = apr_pstrdup(r->pool, key);
+    sobj->key_len = key_len;
+    sobj->hash = hash;
+    sobj->body_expected = len;
+
+    return OK;
+}
+
+static apr_status_t sobj_body_cleanup(void *baton)
+{
+    cache_shm_object_t *sobj = baton;
+
+    sobj->body = NULL;
+    return APR_SUCCESS;
+}
+
+static int open_entity(cache_handle_t *h, request_rec *r, const char *key)
+{
+    cache_object_t *obj;
+    cache_info *info;
+    cache_shm_object_t *sobj;
+    cache_shm_entry *e;
+    apr_size_t key_len, slider = 0;
+    apr_uint64_t hash;
+    apr_uint32_t idx;
+    char *hdrs;
+
+    h->cache_obj = NULL;
+
+    if (!shm_header) {
+        return DECLINED;
+    }
+
+    key_len = strlen(key);
+    hash = cache_shm_hash(key, key_len);
+
+    if (cache_shm_lock(r) != APR_SUCCESS) {
+        return DECLINED;
+    }
+    sketch_increment(shm_header, hash);
+    idx = index_find(shm_header, hash, key, key_len);
+    if (idx == CACHE_SHM_NIL) {
+        shm_header->stat_misses++;
+        cache_shm_unlock();
+        ap_log_rerror(APLOG_MARK, APLOG_DEBUG, 0, r, APLOGNO(10268)
+                "Key not found in cache: %s", key);
+        return DECLINED;
+    }
+    e = SHM_ENTRY(shm_header, idx);
+    apr_atomic_inc32(&e->refcount);
+    entry_touch(shm_header, idx);
+    shm_header->stat_hits++;
+    cache_shm_unlock();
+
+    /* Referenced, the entry's data can't change until released */
+    obj = apr_pcalloc(r->pool, sizeof(cache_object_t));
+    sobj = apr_pcalloc(r->pool, sizeof(cache_shm_object_t));
+    info = &obj->info;
+
+    obj->key = sobj->key = key;
+    sobj->key_len = key_len;
+    sobj->hash = hash;
+    sobj->opened = 1;
+
+    info->status = e->status;
+    info->date = e->date;
+    info->expire = e->expire;
+    info->request_time = e->request_time;
+    info->response_time = e->response_time;
+    memcpy(&info->control, &e->control, sizeof(cache_control_t));
+
+    h->req_hdrs = apr_table_make(r->pool, 1);
+    h->resp_hdrs = apr_table_make(r->pool, 20);
+
+    hdrs = apr_palloc(r->pool, e->hdrs_len + 1);
+    entry_read(shm_header, e, e->key_len, hdrs, e->hdrs_len);
+    hdrs[e->hdrs_len] = '\0';
+    if (read_table(r, h->resp_hdrs, hdrs, e->hdrs_len,
+                   &slider) != APR_SUCCESS) {
+        ap_log_rerror(APLOG_MARK, APLOG_ERR, 0, r, APLOGNO(10269)
+                "Cache entry for key '%s' response headers unreadable, "
+                "ignoring", key);
+        e = NULL;
+    }
+
+    if (e && e->body_len) {
+        /* The buckets hold the reference from now on, the brigade is
+         * cleaned up with r->pool if recall_body() is never called. */
+        sobj->body = entry_body(shm_header, idx, r->pool,
+                                r->connection->bucket_alloc);
+        apr_pool_cleanup_register(r->pool, sobj, sobj_body_cleanup,
+                                  apr_pool_cleanup_null);
+    }
+    else {
+        entry_release(shm_header, idx);
+        if (!e) {
+            return DECLINED;
+        }
+    }
+
+    /* make the configuration stick */
+    h->cache_obj = obj;
+    obj->vobj = sobj;
+
+    return OK;
+}
+
+static int remove_entity(cache_handle_t *h)
+{
+    /* Null out the cache object pointer so next time we start from scratch  */
+    h->cache_obj = NULL;
+    return OK;
+}
+
+static int remove_url(cache_handle_t *h, request_rec *r)
+{
+    cache_shm_object_t *sobj;
+    apr_uint32_t idx;
+
+    sobj = (cache_shm_object_t *) h->cache_obj->vobj;
+    if (!sobj || !shm_header) {
+        return DECLINED;
+    }
+
+    /* Remove the key from the cache */
+    if (cache_shm_lock(r) != APR_SUCCESS) {
+        return DECLINED;
+    }
+    idx = index_find(shm_header, sobj->hash, sobj->key, sobj->key_len);
+    if (idx != CACHE_SHM_NIL) {
+        entry_evict(shm_header, idx);
+    }
+    cache_shm_unlock();
+
+    return OK;
+}
+
+static apr_status_t recall_headers(cache_handle_t *h, request_rec *r)
+{
+    /* we recalled the headers during open_entity, so do nothing */
+    return APR_SUCCESS;
+}
+
+static apr_status_t recall_body(cache_handle_t *h, apr_pool_t *p,
+        apr_bucket_brigade *bb)
+{
+    cache_shm_object_t *sobj = (cache_shm_object_t*) h->cache_obj->vobj;
+
+    if (sobj->body) {
+        APR_BRIGADE_CONCAT(bb, sobj->body);
+    }
+
+    return APR_SUCCESS;
+}
+
+static apr_status_t store_headers(cache_handle_t *h, request_rec *r,
+        cache_info *info)
+{
+    cache_shm_dir_conf *dconf =
+            ap_get_module_config(r->per_dir_config, &cache_shm_module);
+    cache_object_t *obj = h->cache_obj;
+    cache_shm_object_t *sobj = (cache_shm_object_t*) obj->vobj;
+    apr_table_t *headers_out;
+    apr_size_t hdrs_len = 0;
+    apr_off_t body_len;
+
+    memcpy(&obj->info, info, sizeof(cache_info));
+
+    headers_out = ap_cache_cacheable_headers_out(r);
+    if (apr_table_get(headers_out, "Vary")) {
+        ap_log_rerror(APLOG_MARK, APLOG_DEBUG, 0, r, APLOGNO(10270)
+                "URL '%s' has Vary, not caching", sobj->key);
+        return APR_EGENERAL;
+    }
+
+    /* revalidated entities keep their body */
+    if (sobj->opened) {
+        body_len = 0;
+        if (sobj->body) {
+            apr_brigade_length(sobj->body, 0, &body_len);
+        }
+        sobj->body_expected = body_len;
+    }
+
+    if (store_table(headers_out, NULL, dconf->max, &hdrs_len) != APR_SUCCESS
+            || sobj->key_len + hdrs_len + sobj->body_expected > dconf->max) {
+        ap_log_rerror(APLOG_MARK, APLOG_DEBUG, 0, r, APLOGNO(10271)
+                "URL '%s' headers and body larger than limit, not caching",
+                sobj->key);
+        return APR_EGENERAL;
+    }
+
+    sobj->buffer = apr_palloc(r->pool, sobj->key_len + hdrs_len + 1
+                                       + sobj->body_expected);
+    memcpy(sobj->buffer, sobj->key, sobj->key_len);
+    sobj->hdrs_len = 0;
+    store_table(headers_out, sobj->buffer + sobj->key_len, hdrs_len + 1,
+                &sobj->hdrs_len);
+
+    return APR_SUCCESS;
+}
+
+static apr_status_t store_body(cache_handle_t *h, request_rec *r,
+        apr_bucket_brigade *in, apr_bucket_brigade *out)
+{
+    cache_shm_object_t *sobj = (cache_shm_object_t *) h->cache_obj->vobj;
+    apr_bucket *e;
+    apr_status_t rv = APR_SUCCESS;
+    int seen_eos = 0;
+
+    if (!sobj->newbody) {
+        sobj->body_len = 0;
+        sobj->newbody = 1;
+    }
+
+    while (!APR_BRIGADE_EMPTY(in)) {
+        const char *str;
+        apr_size_t length;
+
+        e = APR_BRIGADE_FIRST(in);
+        APR_BUCKET_REMOVE(e);
+        APR_BRIGADE_INSERT_TAIL(out, e);
+
+        /* are we done completely? if so, pass any trailing buckets */
+        if (sobj->done || !sobj->buffer) {
+            continue;
+        }
+
+        if (APR_BUCKET_IS_EOS(e)) {
+            seen_eos = 1;
+            sobj->done = 1;
+            break;
+        }
+        if (APR_BUCKET_IS_FLUSH(e)) {
+            break;
+        }
+        if (APR_BUCKET_IS_METADATA(e)) {
+            continue;
+        }
+
+        rv = apr_bucket_read(e, &str, &length, APR_BLOCK_READ);
+        if (rv != APR_SUCCESS) {
+            ap_log_rerror(APLOG_MARK, APLOG_ERR, rv, r, APLOGNO(10272)
+                    "Error when reading bucket for URL %s",
+                    h->cache_obj->key);
+            sobj->buffer = NULL;
+            return rv;
+        }
+        if (length > sobj->body_expected - sobj->body_len) {
+            ap_log_rerror(APLOG_MARK, APLOG_DEBUG, 0, r, APLOGNO(10273)
+                    "URL %s body longer than expected, not caching",
+                    h->cache_obj->key);
+            sobj->buffer = NULL;
+            return APR_EGENERAL;
+        }
+        memcpy(sobj->buffer + sobj->key_len + sobj->hdrs_len
+               + sobj->body_len, str, length);
+        sobj->body_len += length;
+    }
+
+    if (seen_eos) {
+        if (r->connection->aborted || r->no_cache
+                || sobj->body_len != sobj->body_expected) {
+            ap_log_rerror(APLOG_MARK, APLOG_DEBUG, 0, r, APLOGNO(10274)
+                    "URL %s didn't receive complete response, not caching",
+                    h->cache_obj->key);
+            sobj->buffer = NULL;
+            return APR_EGENERAL;
+        }
+    }
+
+    return APR_SUCCESS;
+}
+
+static apr_status_t commit_entity(cache_handle_t *h, request_rec *r)
+{
+    cache_object_t *obj = h->cache_obj;
+    cache_shm_object_t *sobj = (cache_shm_object_t *) obj->vobj;
+    apr_size_t total;
+    apr_uint32_t nblocks, idx, old;
+    cache_shm_entry *e;
+    apr_status_t rv;
+
+    if (!sobj->buffer || !shm_header) {
+        return APR_EGENERAL;
+    }
+
+    /* headers update of a revalidated entity, copy its body */
+    if (sobj->opened && !sobj->newbody && sobj->body_expected) {
+        apr_size_t len = (apr_size_t)sobj->body_expected;
+
+        if (!sobj->body
+                || apr_brigade_flatten(sobj->body, sobj->buffer
+                                       + sobj->key_len + sobj->hdrs_len,
+                                       &len) != APR_SUCCESS
+                || len != (apr_size_t)sobj->body_expected) {
+            return APR_EGENERAL;
+        }
+        sobj->body_len = sobj->body_expected;
+    }
+
+    total = sobj->key_len + sobj->hdrs_len + (apr_size_t)sobj->body_len;
+    nblocks = (apr_uint32_t)((total + CACHE_SHM_BLOCK_SIZE - 1)
+                             / CACHE_SHM_BLOCK_SIZE);
+    if (!nblocks || nblocks > shm_header->nblocks / 2) {
+        return APR_ENOSPC;
+    }
+
+    if ((rv = cache_shm_lock(r)) != APR_SUCCESS) {
+        return rv;
+    }
+    rv = make_room(shm_header, nblocks);
+    if (rv != APR_SUCCESS) {
+        cache_shm_unlock();
+        ap_log_rerror(APLOG_MARK, APLOG_DEBUG, rv, r, APLOGNO(10275)
+                "no room to cache URL %s", sobj->key);
+        return rv;
+    }
+    idx = entry_alloc(shm_header, nblocks);
+    cache_shm_unlock();
+
+    /* loading, not visible to the others nor evictable */
+    e = SHM_ENTRY(shm_header, idx);
+    e->hash = sobj->hash;
+    e->key_len = (apr_uint32_t)sobj->key_len;
+    e->hdrs_len = (apr_uint32_t)sobj->hdrs_len;
+    e->body_len = (apr_uint32_t)sobj->body_len;
+    e->status = obj->info.status;
+    e->date = obj->info.date;
+    e->expire = obj->info.expire;
+    e->request_time = obj->info.request_time;
+    e->response_time = obj->info.response_time;
+    memcpy(&e->control, &obj->info.control, sizeof(cache_control_t));
+    entry_write(shm_header, e, sobj->buffer, total);
+
+    if ((rv = cache_shm_lock(r)) != APR_SUCCESS) {
+        /* leaked until restart, unlikely since we just locked */
+        return rv;
+    }
+    old = index_find(shm_header, sobj->hash, sobj->key, sobj->key_len);
+    if (old != CACHE_SHM_NIL) {
+        entry_evict(shm_header, old);
+    }
+    index_insert(shm_header, idx);
+    queue_push(shm_header, idx, CACHE_SHM_WINDOW);
+    shm_header->stat_entries++;
+    shm_header->stat_stores++;
+    while (shm_header->queues[CACHE_SHM_WINDOW].blocks
+               > shm_header->window_max
+           && shm_header->queues[CACHE_SHM_WINDOW].tail != idx) {
+        window_evict(shm_header);
+    }
+    cache_shm_unlock();
+
+    ap_log_rerror(APLOG_MARK, APLOG_DEBUG, 0, r, APLOGNO(10276)
+            "commit_entity: Headers and body for URL %s cached in %u blocks",
+            sobj->key, nblocks);
+
+    sobj->buffer = NULL;
+    return APR_SUCCESS;
+}
+
+static apr_status_t invalidate_entity(cache_handle_t *h, request_rec *r)
+{
+    /* the entity must be revalidated, forget it */
+    h->cache_obj->info.control.invalidated = 1;
+    remove_url(h, r);
+
+    return APR_SUCCESS;
+}
+
+/*
+ * Shared memory initialization
+ */
+
+static apr_status_t cache_shm_cleanup(void *data)
+{
+    cache_shm = NULL;
+    shm_header = NULL;
+    cache_shm_mutex = NULL;
+    return APR_SUCCESS;
+}
+
+static apr_size_t cache_shm_layout(cache_shm_header *hdr,
+                                   apr_uint32_t nblocks)
+{
+    apr_size_t offset = APR_ALIGN_DEFAULT(sizeof(cache_shm_header));
+
+    hdr->nblocks = hdr->nentries = nblocks;
+    hdr->nbuckets = hdr->sketch_width = 1;
+    while (hdr->nbuckets < nblocks) {
+        hdr->nbuckets <<= 1;
+    }
+    hdr->sketch_width = hdr->nbuckets < 1024 ? 1024 : hdr->nbuckets;
+
+    hdr->buckets_offset = offset;
+    offset += APR_ALIGN_DEFAULT(hdr->nbuckets * sizeof(apr_uint32_t));
+    hdr->entries_offset = offset;
+    offset += APR_ALIGN_DEFAULT(hdr->nentries * sizeof(cache_shm_entry));
+    hdr->chains_offset = offset;
+    offset += APR_ALIGN_DEFAULT(hdr->nblocks * sizeof(apr_uint32_t));
+    hdr->sketch_offset = offset;
+    offset += APR_ALIGN_DEFAULT((apr_size_t)CACHE_SHM_SKETCH_ROWS
+                                * hdr->sketch_width);
+    hdr->data_offset = offset;
+    offset += (apr_size_t)hdr->nblocks * CACHE_SHM_BLOCK_SIZE;
+
+    return offset;
+}
+
+static apr_status_t cache_shm_init(server_rec *s, apr_pool_t *pconf)
+{
+    cache_shm_header *hdr, layout;
+    apr_uint32_t nblocks, i;
+    apr_status_t rv;
+
+    rv = ap_global_mutex_create(&cache_shm_mutex, NULL, cache_shm_id, NULL,
+                                s, pconf, 0);
+    if (rv != APR_SUCCESS) {
+        ap_log_error(APLOG_MARK, APLOG_CRIT, rv, s, APLOGNO(10277)
+                     "failed to create %s mutex", cache_shm_id);
+        return rv;
+    }
+
+    /* Fit as many blocks as possible, with their entries and index */
+    nblocks = (apr_uint32_t)(cache_shm_size
+                             / (CACHE_SHM_BLOCK_SIZE + sizeof(cache_shm_entry)
+                                + 4 * sizeof(apr_uint32_t)
+                                + 2 * CACHE_SHM_SKETCH_ROWS));
+    while (nblocks > 2 && cache_shm_layout(&layout, nblocks)
+                          > cache_shm_size) {
+        nblocks--;
+    }
+    if (nblocks <= 2) {
+        ap_log_error(APLOG_MARK, APLOG_CRIT, 0, s, APLOGNO(10278)
+                     "CacheShmSize %" APR_SIZE_T_FMT " is too small",
+                     cache_shm_size);
+        return APR_ENOSPC;
+    }
+
+    rv = apr_shm_create(&cache_shm, cache_shm_size, NULL, pconf);
+    if (APR_STATUS_IS_ENOTIMPL(rv)) {
+        const char *fname = ap_runtime_dir_relative(pconf, cache_shm_id);
+
+        if (fname) {
+            apr_shm_remove(fname, pconf);
+            rv = apr_shm_create(&cache_shm, cache_shm_size, fname, pconf);
+        }
+    }
+    if (rv != APR_SUCCESS) {
+        ap_log_error(APLOG_MARK, APLOG_CRIT, rv, s, APLOGNO(10279)
+                     "could not allocate the %s shared memory", cache_shm_id);
+        return rv;
+    }
+    apr_pool_cleanup_register(pconf, NULL, cache_shm_cleanup,
+                              apr_pool_cleanup_null);
+
+    hdr = apr_shm_baseaddr_get(cache_shm);
+    memset(hdr, 0, sizeof(*hdr));
+    cache_shm_layout(hdr, nblocks);
+
+    memset(SHM_BUCKETS(hdr), 0xff, hdr->nbuckets * sizeof(apr_uint32_t));
+    memset(SHM_SKETCH(hdr), 0, (apr_size_t)CACHE_SHM_SKETCH_ROWS
+                               * hdr->sketch_width);
+    for (i = 0; i < nblocks; i++) {
+        cache_shm_entry *e = SHM_ENTRY(hdr, i);
+        memset(e, 0, sizeof(*e));
+        e->state = CACHE_SHM_FREE;
+        e->next = i + 1 < nblocks ? i + 1 : CACHE_SHM_NIL;
+        SHM_CHAINS(hdr)[i] = i + 1 < nblocks ? i + 1 : CACHE_SHM_NIL;
+    }
+    hdr->free_entry = hdr->free_block = 0;
+    hdr->dead_entry = CACHE_SHM_NIL;
+    hdr->free_blocks = nblocks;
+    for (i = 0; i < CACHE_SHM_QUEUES; i++) {
+        hdr->queues[i].head = hdr->queues[i].tail = CACHE_SHM_NIL;
+    }
+
+    /* 1% for the window, 80% of the main space for the protected queue */
+    hdr->window_max = nblocks / 100 ? nblocks / 100 : 1;
+    hdr->main_max = nblocks - hdr->window_max;
+    hdr->protected_max = hdr->main_max / 5 * 4;
+    hdr->sketch_sample = 10 * nblocks;
+
+    shm_header = hdr;
+
+    ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, s, APLOGNO(10280)
+                 "%s initialised: %u blocks of %d bytes in %" APR_SIZE_T_FMT
+                 " bytes of shared memory", cache_shm_id, nblocks,
+                 CACHE_SHM_BLOCK_SIZE, cache_shm_size);
+    return APR_SUCCESS;
+}
+
+static void *create_dir_config(apr_pool_t *p, char *dummy)
+{
+    cache_shm_dir_conf *dconf = apr_pcalloc(p, sizeof(cache_shm_dir_conf));
+
+    dconf->max = DEFAULT_MAX_SIZE;
+    dconf->min_hits = DEFAULT_MIN_HITS;
+
+    return dconf;
+}
+
+static void *merge_dir_config(apr_pool_t *p, void *basev, void *addv)
+{
+    cache_shm_dir_conf *new = apr_pcalloc(p, sizeof(cache_shm_dir_conf));
+    cache_shm_dir_conf *add = (cache_shm_dir_conf *) addv;
+    cache_shm_dir_conf *base = (cache_shm_dir_conf *) basev;
+
+    new->max = (add->max_set == 0) ? base->max : add->max;
+    new->max_set = add->max_set || base->max_set;
+    new->min_hits = (add->min_hits_set == 0) ? base->min_hits : add->min_hits;
+    new->min_hits_set = add->min_hits_set || base->min_hits_set;
+
+    return new;
+}
+
+/*
+ * mod_cache_shm configuration directives handlers.
+ */
+static const char *set_cache_shm_size(cmd_parms *cmd, void *dummy,
+        const char *arg)
+{
+    apr_off_t size;
+    const char *err = ap_check_cmd_context(cmd, GLOBAL_ONLY);
+
+    if (err != NULL) {
+        return err;
+    }
+    if (apr_strtoff(&size, arg, NULL, 10) != APR_SUCCESS
+            || size < 1024 * 1024 || (apr_uint64_t)size > APR_SIZE_MAX) {
+        return "CacheShmSize argument must be the size of the shared memory "
+               "in bytes, at least 1048576";
+    }
+    cache_shm_size = (apr_size_t)size;
+    return NULL;
+}
+
+static const char *set_cache_max(cmd_parms *parms, void *in_struct_ptr,
+        const char *arg)
+{
+    cache_shm_dir_conf *dconf = (cache_shm_dir_conf *) in_struct_ptr;
+
+    if (apr_strtoff(&dconf->max, arg, NULL, 10) != APR_SUCCESS
+            || dconf->max < 1024 || dconf->max > APR_UINT32_MAX) {
+        return "CacheShmMaxSize argument must be a integer representing "
+               "the max size of a cached entry (headers and body), at least 1024 "
+               "and at most " APR_STRINGIFY(APR_UINT32_MAX);
+    }
+    dconf->max_set = 1;
+    return NULL;
+}
+
+static const char *set_cache_min_hits(cmd_parms *parms, void *in_struct_ptr,
+        const char *arg)
+{
+    cache_shm_dir_conf *dconf = (cache_shm_dir_conf *) in_struct_ptr;
+
+    dconf->min_hits = atoi(arg);
+    if (dconf->min_hits < 0 || dconf->min_hits > CACHE_SHM_SKETCH_MAX) {
+        return "CacheShmMinHits argument must be the number of lookups "
+               "before an entity is cached, between 0 and "
+               APR_STRINGIFY(CACHE_SHM_SKETCH_MAX);
+    }
+    dconf->min_hits_set = 1;
+    return NULL;
+}
+
+static int cache_shm_status_hook(request_rec *r, int flags)
+{
+    cache_shm_header stats;
+    apr_uint32_t used;
+
+    if (!shm_header) {
+        return DECLINED;
+    }
+
+    if (cache_shm_lock(r) != APR_SUCCESS) {
+        return DECLINED;
+    }
+    memcpy(&stats, shm_header, sizeof(stats));
+    cache_shm_unlock();
+    used = stats.nblocks - stats.free_blocks;
+
+    if (!(flags & AP_STATUS_SHORT)) {
+        ap_rputs("<hr>\n"
+                 "<table cellspacing=0 cellpadding=0>\n"
+                 "<tr><td bgcolor=\"#000000\">\n"
+                 "<b><font color=\"#ffffff\" face=\"Arial,Helvetica\">"
+                 "mod_cache_shm Status:</font></b>\n"
+                 "</td></tr>\n"
+                 "<tr><td bgcolor=\"#ffffff\">\n", r);
+        ap_rprintf(r, "shared memory: <b>%" APR_SIZE_T_FMT "</b> bytes, "
+                   "current entries: <b>%u</b><br>",
+                   cache_shm_size, stats.stat_entries);
+        ap_rprintf(r, "blocks: <b>%u</b> of <b>%d</b> bytes, used: "
+                   "<b>%u</b> (window: <b>%u</b>, probation: <b>%u</b>, "
+                   "protected: <b>%u</b>)<br>", stats.nblocks,
+                   CACHE_SHM_BLOCK_SIZE, used,
+                   stats.queues[CACHE_SHM_WINDOW].blocks,
+                   stats.queues[CACHE_SHM_PROBATION].blocks,
+                   stats.queues[CACHE_SHM_PROTECTED].blocks);
+        ap_rprintf(r, "lookups since starting: <b>%lu</b> hit, "
+                   "<b>%lu</b> miss<br>", stats.stat_hits, stats.stat_misses);
+        ap_rprintf(r, "entries stored since starting: <b>%lu</b>, "
+                   "rejected (not frequent enough): <b>%lu</b><br>",
+                   stats.stat_stores, stats.stat_rejected);
+        ap_rprintf(r, "entries admitted in the main space: <b>%lu</b>, "
+                   "evicted: <b>%lu</b><br>",
+                   stats.stat_admitted, stats.stat_evicted);
+        ap_rputs("</td></tr>\n</table>\n", r);
+    }
+    else {
+        ap_rputs("ModCacheShmStatus\n", r);
+        ap_rprintf(r, "CacheSharedMemory: %" APR_SIZE_T_FMT "\n",
+                   cache_shm_size);
+        ap_rprintf(r, "CacheCurrentEntries: %u\n", stats.stat_entries);
+        ap_rprintf(r, "CacheBlocks: %u\n", stats.nblocks);
+        ap_rprintf(r, "CacheBlocksUsed: %u\n", used);
+        ap_rprintf(r, "CacheWindowBlocks: %u\n",
+                   stats.queues[CACHE_SHM_WINDOW].blocks);
+        ap_rprintf(r, "CacheProbationBlocks: %u\n",
+                   stats.queues[CACHE_SHM_PROBATION].blocks);
+        ap_rprintf(r, "CacheProtectedBlocks: %u\n",
+                   stats.queues[CACHE_SHM_PROTECTED].blocks);
+        ap_rprintf(r, "CacheRetrieveHitCount: %lu\n", stats.stat_hits);
+        ap_rprintf(r, "CacheRetrieveMissCount: %lu\n", stats.stat_misses);
+        ap_rprintf(r, "CacheStoreCount: %lu\n", stats.stat_stores);
+        ap_rprintf(r, "CacheRejectCount: %lu\n", stats.stat_rejected);
+        ap_rprintf(r, "CacheAdmitCount: %lu\n", stats.stat_admitted);
+        ap_rprintf(r, "CacheEvictCount: %lu\n", stats.stat_evicted);
+    }
+    return OK;
+}
+
+static int cache_shm_precfg(apr_pool_t *pconf, apr_pool_t *plog,
+                            apr_pool_t *ptmp)
+{
+    apr_status_t rv = ap_mutex_register(pconf, cache_shm_id, NULL,
+                                        APR_LOCK_DEFAULT, 0);
+    if (rv != APR_SUCCESS) {
+        ap_log_perror(APLOG_MARK, APLOG_CRIT, rv, plog, APLOGNO(10281)
+                "failed to register %s mutex", cache_shm_id);
+        return 500; /* An HTTP status would be a misnomer! */
+    }
+    cache_shm_size = 0;
+
+    /* Register to handle mod_status status page generation */
+    APR_OPTIONAL_HOOK(ap, status_hook, cache_shm_status_hook, NULL, NULL,
+                      APR_HOOK_MIDDLE);
+
+    return OK;
+}
+
+static int cache_shm_post_config(apr_pool_t *pconf, apr_pool_t *plog,
+        apr_pool_t *ptmp, server_rec *s)
+{
+    if (!cache_shm_size) {
+        return OK;
+    }
+    if (cache_shm_init(s, pconf) != APR_SUCCESS) {
+        return 500; /* An HTTP status would be a misnomer! */
+    }
+    return OK;
+}
+
+static void cache_shm_child_init(apr_pool_t *p, server_rec *s)
+{
+    const char *lock;
+    apr_status_t rv;
+
+    if (!cache_shm_mutex) {
+        return;
+    }
+    lock = apr_global_mutex_lockfile(cache_shm_mutex);
+    rv = apr_global_mutex_child_init(&cache_shm_mutex, lock, p);
+    if (rv != APR_SUCCESS) {
+        ap_log_error(APLOG_MARK, APLOG_CRIT, rv, s, APLOGNO(10282)
+                "failed to initialise mutex in child_init");
+    }
+}
+
+static const command_rec cache_shm_cmds[] =
+{
+    AP_INIT_TAKE1("CacheShmSize", set_cache_shm_size, NULL, RSRC_CONF,
+            "The size of the shared memory to store cached entities"),
+    AP_INIT_TAKE1("CacheShmMaxSize", set_cache_max, NULL, RSRC_CONF | ACCESS_CONF,
+            "The maximum cache entry size (headers and body) to cache a document"),
+    AP_INIT_TAKE1("CacheShmMinHits", set_cache_min_hits, NULL, RSRC_CONF | ACCESS_CONF,
+            "The number of lookups of a document before it is cached"),
+    { NULL }
+};
+
+static const cache_provider cache_shm_provider =
+{
+    &remove_entity, &store_headers, &store_body, &recall_headers, &recall_body,
+    &create_entity, &open_entity, &remove_url, &commit_entity,
+    &invalidate_entity
+};
+
+static void cache_shm_register_hook(apr_pool_t *p)
+{
+    /* cache initializer */
+    ap_register_provider(p, CACHE_PROVIDER_GROUP, "shm", "0",
+            &cache_shm_provider);
+    ap_hook_pre_config(cache_shm_precfg, NULL, NULL, APR_HOOK_MIDDLE);
+    ap_hook_post_config(cache_shm_post_config, NULL, NULL, APR_HOOK_MIDDLE);
+    ap_hook_child_init(cache_shm_child_init, NULL, NULL, APR_HOOK_MIDDLE);
+}
+
+AP_DECLARE_MODULE(cache_shm) = { STANDARD20_MODULE_STUFF,
+    create_dir_config,  /* create per-directory config structure */
+    merge_dir_config, /* merge per-directory config structures */
+    NULL, /* create per-server config structure */
+    NULL, /* merge per-server config structures */
+    cache_shm_cmds, /* command apr_table_t */
+    cache_shm_register_hook /* register hooks */
+};
@@ -32,6 +32,21 @@
 #if APR_HAVE_LIMITS_H
 #include <limits.h>
 #endif
+#if APR_HAVE_ERRNO_H
+#include <errno.h>
+#endif
+
+/* Where the platform has robust process-shared mutexes, each subcache is
+ * protected by its own lock living in the shared memory segment, hence
+ * accesses to different subcaches don't serialize and the callers need no
+ * global mutex (the provider is not AP_SOCACHE_FLAG_NOTMPSAFE).
+ */
+#if APR_HAS_PROC_PTHREAD_SERIALIZE && defined(HAVE_PTHREAD_MUTEXATTR_SETROBUST)
+#include <pthread.h>
+#define SHMCB_SUBCACHE_LOCKS 1
+#else
+#define SHMCB_SUBCACHE_LOCKS 0
+#endif
 
 #include "ap_socache.h"
 
@@ -56,15 +71,6 @@
  * Header structure - the start of the shared-mem segment
  */
 typedef struct {
-    /* Stats for cache operations */
-    unsigned long stat_stores;
-    unsigned long stat_replaced;
-    unsigned long stat_expiries;
-    unsigned long stat_scrolled;
-    unsigned long stat_retrieves_hit;
-    unsigned long stat_retrieves_miss;
-    unsigned long stat_removes_hit;
-    unsigned long stat_removes_miss;
     /* Number of subcaches */
     unsigned int subcache_num;
     /* How many indexes each subcache's queue has */
@@ -82,10 +88,26 @@ typedef struct {
  * indexes then data
  */
 typedef struct {
+#if SHMCB_SUBCACHE_LOCKS
+    /* Serializes the accesses to this subcache (process-shared, robust) */
+    pthread_mutex_t lock;
+    /* Acquisitions of the lock, and those which had to wait for it */
+    unsigned long stat_locks;
+    unsigned long stat_locks_contended;
+#endif
     /* The start position and length of the cyclic buffer of indexes */
     unsigned int idx_pos, idx_used;
     /* Same for the data area */
     unsigned int data_pos, data_used;
+    /* Stats for cache operations, summed by socache_shmcb_status() */
+    unsigned long stat_stores;
+    unsigned long stat_replaced;
+    unsigned long stat_expiries;
+    unsigned long stat_scrolled;
+    unsigned long stat_retrieves_hit;
+    unsigned long stat_retrieves_miss;
+    unsigned long stat_removes_hit;
+    unsigned long stat_removes_miss;
 } SHMCBSubcache;
 
 /*
@@ -160,15 +182,10 @@ struct ap_socache_instance_t {
                         ALIGNED_HEADER_SIZE + \
                         (num) * ((pHeader)->subcache_size))
 
-/* This macro takes a pointer to the header and an id and returns a
- * pointer to the corresponding subcache. */
-#define SHMCB_MASK(pHeader, id) \
-                SHMCB_SUBCACHE((pHeader), *(id) & ((pHeader)->subcache_num - 1))
-
-/* This macro takes the same params as the last, generating two outputs for use
- * in ap_log_error(...). */
-#define SHMCB_MASK_DBG(pHeader, id) \
-                *(id), (*(id) & ((pHeader)->subcache_num - 1))
+/* This macro takes a pointer to the header and an id and returns the
+ * zero-based index of the corresponding subcache. */
+#define SHMCB_MASK(pHeader, id, idlen) \
+                (shmcb_hash((id), (idlen)) & ((pHeader)->subcache_num - 1))
 
 /* This macro takes a pointer to a subcache and a zero-based index and returns
  * a pointer to the corresponding SHMCBIndex. */
@@ -182,6 +199,89 @@ struct ap_socache_instance_t {
 #define SHMCB_DATA(pHeader, pSubcache) \
                 ((unsigned char *)(pSubcache) + (pHeader)->subcache_data_offset)
 
+/* FNV-1a hash of an id, used to select its subcache.  The first byte alone
+ * is fine for random ids (TLS sessions) but not for others (e.g. the URL
+ * keys of mod_cache_socache) which would all land in the same subcache. */
+static APR_INLINE unsigned int shmcb_hash(const unsigned char *id,
+                                          unsigned int idlen)
+{
+    apr_uint32_t hash = 0x811c9dc5;
+    unsigned int i;
+
+    for (i = 0; i < idlen; i++) {
+        hash ^= id[i];
+        hash *= 0x01000193;
+    }
+    return hash ^ (hash >> 16);
+}
+
+/*
+ * Subcache locking
+ */
+
+#if SHMCB_SUBCACHE_LOCKS
+
+static apr_status_t shmcb_subcache_lock_init(SHMCBSubcache *subcache)
+{
+    pthread_mutexattr_t attr;
+    int rc;
+
+    if ((rc = pthread_mutexattr_init(&attr))) {
+        return APR_FROM_OS_ERROR(rc);
+    }
+    if (!(rc = pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED))
+            && !(rc = pthread_mutexattr_setrobust(&attr,
+                                                  PTHREAD_MUTEX_ROBUST))) {
+        rc = pthread_mutex_init(&subcache->lock, &attr);
+    }
+    pthread_mutexattr_destroy(&attr);
+    return APR_FROM_OS_ERROR(rc);
+}
+
+static apr_status_t shmcb_subcache_lock(server_rec *s,
+                                        SHMCBSubcache *subcache)
+{
+    int rc, contended = 0;
+
+    rc = pthread_mutex_trylock(&subcache->lock);
+    if (rc == EBUSY) {
+        contended = 1;
+        rc = pthread_mutex_lock(&subcache->lock);
+    }
+    if (rc == EOWNERDEAD) {
+        /* The owner died with the lock held, so the subcache may be in an
+         * inconsistent state. This is a cache, just empty it. */
+        ap_log_error(APLOG_MARK, APLOG_WARNING, 0, s, APLOGNO(10257)
+                     "shmcb subcache lock owner died, emptying the subcache");
+        subcache->idx_pos = subcache->idx_used = 0;
+        subcache->data_pos = subcache->data_used = 0;
+        rc = pthread_mutex_consistent(&subcache->lock);
+    }
+    if (rc) {
+        ap_log_error(APLOG_MARK, APLOG_ERR, APR_FROM_OS_ERROR(rc), s,
+                     APLOGNO(10258) "Failed to lock shmcb subcache");
+        return APR_FROM_OS_ERROR(rc);
+    }
+    subcache->stat_locks++;
+    if (contended) {
+        subcache->stat_locks_contended++;
+    }
+    return APR_SUCCESS;
+}
+
+static APR_INLINE void shmcb_subcache_unlock(SHMCBSubcache *subcache)
+{
+    pthread_mutex_unlock(&subcache->lock);
+}
+
+#else /* SHMCB_SUBCACHE_LOCKS */
+
+/* Accesses are serialized by the caller's global mutex */
+#define shmcb_subcache_lock(s, subcache) APR_SUCCESS
+#define shmcb_subcache_unlock(subcache)
+
+#endif /* SHMCB_SUBCACHE_LOCKS */
+
 /*
  * Cyclic functions - assists in "wrap-around"/modulo logic
  */
@@ -423,14 +523,6 @@ static apr_status_t socache_shmcb_init(ap_socache_instance_t *ctx,
     }
     /* OK, we're sorted */
     ctx->header = header = shm_segment;
-    header->stat_stores = 0;
-    header->stat_replaced = 0;
-    header->stat_expiries = 0;
-    header->stat_scrolled = 0;
-    header->stat_retrieves_hit = 0;
-    header->stat_retrieves_miss = 0;
-    header->stat_removes_hit = 0;
-    header->stat_removes_miss = 0;
     header->subcache_num = num_subcache;
     /* Convert the subcache size (in bytes) to a value that is suitable for
      * structure alignment on the host platform, by rounding down if necessary. */
@@ -461,8 +553,15 @@ static apr_status_t socache_shmcb_init(ap_socache_instance_t *ctx,
     /* The header is done, make the caches empty */
     for (loop = 0; loop < header->subcache_num; loop++) {
         SHMCBSubcache *subcache = SHMCB_SUBCACHE(header, loop);
-        subcache->idx_pos = subcache->idx_used = 0;
-        subcache->data_pos = subcache->data_used = 0;
+        memset(subcache, 0, sizeof(*subcache));
+#if SHMCB_SUBCACHE_LOCKS
+        rv = shmcb_subcache_lock_init(subcache);
+        if (rv != APR_SUCCESS) {
+            ap_log_error(APLOG_MARK, APLOG_ERR, rv, s, APLOGNO(10259)
+                         "Could not initialize the shmcb subcache locks");
+            return rv;
+        }
+#endif
     }
     ap_log_error(APLOG_MARK, APLOG_INFO, 0, s, APLOGNO(00830)
                  "Shared memory socache initialised");
@@ -473,6 +572,8 @@ static apr_status_t socache_shmcb_init(ap_socache_instance_t *ctx,
 
 static void socache_shmcb_destroy(ap_socache_instance_t *ctx, server_rec *s)
 {
+    /* The subcache locks are not destroyed, children of the previous
+     * generation may still use them (and the segment) until they exit. */
     if (ctx && ctx->shm) {
         apr_shm_destroy(ctx->shm);
         ctx->shm = NULL;
@@ -487,31 +588,37 @@ static apr_status_t socache_shmcb_store(ap_socache_instance_t *ctx,
                                         apr_pool_t *p)
 {
     SHMCBHeader *header = ctx->header;
-    SHMCBSubcache *subcache = SHMCB_MASK(header, id);
+    unsigned int num = SHMCB_MASK(header, id, idlen);
+    SHMCBSubcache *subcache = SHMCB_SUBCACHE(header, num);
+    apr_status_t rv;
     int tryreplace;
 
     ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, s, APLOGNO(00831)
-                 "socache_shmcb_store (0x%02x -> subcache %d)",
-                 SHMCB_MASK_DBG(header, id));
+                 "socache_shmcb_store (0x%02x -> subcache %d)", *id, num);
     /* XXX: Says who?  Why shouldn't this be acceptable, or padded if not? */
     if (idlen < 4) {
         ap_log_error(APLOG_MARK, APLOG_ERR, 0, s, APLOGNO(00832) "unusably short id provided "
                 "(%u bytes)", idlen);
         return APR_EINVAL;
     }
+    if ((rv = shmcb_subcache_lock(s, subcache)) != APR_SUCCESS) {
+        return rv;
+    }
     tryreplace = shmcb_subcache_remove(s, header, subcache, id, idlen);
     if (shmcb_subcache_store(s, header, subcache, encoded,
                              len_encoded, id, idlen, expiry)) {
+        shmcb_subcache_unlock(subcache);
         ap_log_error(APLOG_MARK, APLOG_ERR, 0, s, APLOGNO(00833)
                      "can't store an socache entry!");
         return APR_ENOSPC;
     }
     if (tryreplace == 0) {
-        header->stat_replaced++;
+        subcache->stat_replaced++;
     }
     else {
-        header->stat_stores++;
+        subcache->stat_stores++;
     }
+    shmcb_subcache_unlock(subcache);
     ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, s, APLOGNO(00834)
                  "leaving socache_shmcb_store successfully");
     return APR_SUCCESS;
@@ -524,20 +631,25 @@ static apr_status_t socache_shmcb_retrieve(ap_socache_instance_t *ctx,
                                            apr_pool_t *p)
 {
     SHMCBHeader *header = ctx->header;
-    SHMCBSubcache *subcache = SHMCB_MASK(header, id);
+    unsigned int num = SHMCB_MASK(header, id, idlen);
+    SHMCBSubcache *subcache = SHMCB_SUBCACHE(header, num);
+    apr_status_t status;
     int rv;
 
     ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, s, APLOGNO(00835)
-                 "socache_shmcb_retrieve (0x%02x -> subcache %d)",
-                 SHMCB_MASK_DBG(header, id));
+                 "socache_shmcb_retrieve (0x%02x -> subcache %d)", *id, num);
 
+    if ((status = shmcb_subcache_lock(s, subcache)) != APR_SUCCESS) {
+        return status;
+    }
     /* Get the entry corresponding to the id, if it exists. */
     rv = shmcb_subcache_retrieve(s, header, subcache, id, idlen,
                                  dest, destlen);
     if (rv == 0)
-        header->stat_retrieves_hit++;
+        subcache->stat_retrieves_hit++;
     else
-        header->stat_retrieves_miss++;
+        subcache->stat_retrieves_miss++;
+    shmcb_subcache_unlock(subcache);
     ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, s, APLOGNO(00836)
                  "leaving socache_shmcb_retrieve successfully");
 
@@ -549,49 +661,67 @@ static apr_status_t socache_shmcb_remove(ap_socache_instance_t *ctx,
                                          unsigned int idlen, apr_pool_t *p)
 {
     SHMCBHeader *header = ctx->header;
-    SHMCBSubcache *subcache = SHMCB_MASK(header, id);
+    unsigned int num = SHMCB_MASK(header, id, idlen);
+    SHMCBSubcache *subcache = SHMCB_SUBCACHE(header, num);
     apr_status_t rv;
 
     ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, s, APLOGNO(00837)
-                 "socache_shmcb_remove (0x%02x -> subcache %d)",
-                 SHMCB_MASK_DBG(header, id));
+                 "socache_shmcb_remove (0x%02x -> subcache %d)", *id, num);
     if (idlen < 4) {
         ap_log_error(APLOG_MARK, APLOG_ERR, 0, s, APLOGNO(00838) "unusably short id provided "
                 "(%u bytes)", idlen);
         return APR_EINVAL;
     }
+    if ((rv = shmcb_subcache_lock(s, subcache)) != APR_SUCCESS) {
+        return rv;
+    }
     if (shmcb_subcache_remove(s, header, subcache, id, idlen) == 0) {
-        header->stat_removes_hit++;
+        subcache->stat_removes_hit++;
         rv = APR_SUCCESS;
     } else {
-        header->stat_removes_miss++;
+        subcache->stat_removes_miss++;
         rv = APR_NOTFOUND;
     }
+    shmcb_subcache_unlock(subcache);
     ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, s, APLOGNO(00839)
                  "leaving socache_shmcb_remove successfully");
 
     return rv;
 }
 
+/* Number of the most contended subcaches reported by the HTML status */
+#define SHMCB_STATUS_CONTENDED 5
+
 static void socache_shmcb_status(ap_socache_instance_t *ctx,
                                  request_rec *r, int flags)
 {
     server_rec *s = r->server;
     SHMCBHeader *header = ctx->header;
+    SHMCBSubcache totals;
     unsigned int loop, total = 0, cache_total = 0, non_empty_subcaches = 0;
     apr_time_t idx_expiry, min_expiry = 0, max_expiry = 0;
     apr_time_t now = apr_time_now();
     double expiry_total = 0;
     int index_pct, cache_pct;
+#if SHMCB_SUBCACHE_LOCKS
+    unsigned long *contended;
+    int contended_pct;
+#endif
 
     AP_DEBUG_ASSERT(header->subcache_num > 0);
     ap_log_rerror(APLOG_MARK, APLOG_DEBUG, 0, r, APLOGNO(00840) "inside shmcb_status");
-    /* Perform the iteration inside the mutex to avoid corruption or invalid
-     * pointer arithmetic. The rest of our logic uses read-only header data so
-     * doesn't need the lock. */
-    /* Iterate over the subcaches */
+    memset(&totals, 0, sizeof(totals));
+#if SHMCB_SUBCACHE_LOCKS
+    contended = apr_pcalloc(r->pool, header->subcache_num * sizeof(*contended));
+#endif
+    /* Iterate over the subcaches, each one inside its lock to avoid
+     * corruption or invalid pointer arithmetic. The rest of our logic uses
+     * read-only header data so doesn't need the locks. */
     for (loop = 0; loop < header->subcache_num; loop++) {
         SHMCBSubcache *subcache = SHMCB_SUBCACHE(header, loop);
+        if (shmcb_subcache_lock(s, subcache) != APR_SUCCESS) {
+            continue;
+        }
         shmcb_subcache_expire(s, header, subcache, now);
         total += subcache->idx_used;
         cache_total += subcache->data_used;
@@ -606,11 +736,31 @@ static void socache_shmcb_status(ap_socache_instance_t *ctx,
             else
                 min_expiry = ((idx_expiry < min_expiry) ? idx_expiry : min_expiry);
         }
+        totals.stat_stores += subcache->stat_stores;
+        totals.stat_replaced += subcache->stat_replaced;
+        totals.stat_expiries += subcache->stat_expiries;
+        totals.stat_scrolled += subcache->stat_scrolled;
+        totals.stat_retrieves_hit += subcache->stat_retrieves_hit;
+        totals.stat_retrieves_miss += subcache->stat_retrieves_miss;
+        totals.stat_removes_hit += subcache->stat_removes_hit;
+        totals.stat_removes_miss += subcache->stat_removes_miss;
+#if SHMCB_SUBCACHE_LOCKS
+        totals.stat_locks += subcache->stat_locks;
+        totals.stat_locks_contended += subcache->stat_locks_contended;
+        contended[loop] = subcache->stat_locks_contended;
+#endif
+        shmcb_subcache_unlock(subcache);
     }
     index_pct = (100 * total) / (header->index_num *
                                  header->subcache_num);
     cache_pct = (100 * cache_total) / (header->subcache_data_size *
                                        header->subcache_num);
+#if SHMCB_SUBCACHE_LOCKS
+    contended_pct = totals.stat_locks
+                    ? (int)((100.0 * totals.stat_locks_contended)
+                            / totals.stat_locks)
+                    : 0;
+#endif
     /* Generate Output */
     if (!(flags & AP_STATUS_SHORT)) {
         ap_rprintf(r, "cache type: <b>SHMCB</b>, shared memory: <b>%" APR_SIZE_T_FMT "</b> "
@@ -633,19 +783,46 @@ static void socache_shmcb_status(ap_socache_instance_t *ctx,
         ap_rprintf(r, "index usage: <b>%d%%</b>, cache usage: <b>%d%%</b><br>",
                    index_pct, cache_pct);
         ap_rprintf(r, "total entries stored since starting: <b>%lu</b><br>",
-                   header->stat_stores);
+                   totals.stat_stores);
         ap_rprintf(r, "total entries replaced since starting: <b>%lu</b><br>",
-                   header->stat_replaced);
+                   totals.stat_replaced);
         ap_rprintf(r, "total entries expired since starting: <b>%lu</b><br>",
-                   header->stat_expiries);
+                   totals.stat_expiries);
         ap_rprintf(r, "total (pre-expiry) entries scrolled out of the cache: "
-                   "<b>%lu</b><br>", header->stat_scrolled);
+                   "<b>%lu</b><br>", totals.stat_scrolled);
         ap_rprintf(r, "total retrieves since starting: <b>%lu</b> hit, "
-                   "<b>%lu</b> miss<br>", header->stat_retrieves_hit,
-                   header->stat_retrieves_miss);
+                   "<b>%lu</b> miss<br>", totals.stat_retrieves_hit,
+                   totals.stat_retrieves_miss);
         ap_rprintf(r, "total removes since starting: <b>%lu</b> hit, "
-                   "<b>%lu</b> miss<br>", header->stat_removes_hit,
-                   header->stat_removes_miss);
+                   "<b>%lu</b> miss<br>", totals.stat_removes_hit,
+                   totals.stat_removes_miss);
+#if SHMCB_SUBCACHE_LOCKS
+        ap_rprintf(r, "subcache locks since starting: <b>%lu</b>, "
+                   "contended: <b>%lu</b> (<b>%d%%</b>)<br>",
+                   totals.stat_locks, totals.stat_locks_contended,
+                   contended_pct);
+        if (totals.stat_locks_contended) {
+            int i;
+
+            ap_rputs("most contended subcaches:", r);
+            for (i = 0; i < SHMCB_STATUS_CONTENDED; i++) {
+                unsigned int max = 0;
+
+                for (loop = 1; loop < header->subcache_num; loop++) {
+                    if (contended[loop] > contended[max]) {
+                        max = loop;
+                    }
+                }
+                if (!contended[max]) {
+                    break;
+                }
+                ap_rprintf(r, "%s #%u: <b>%lu</b>", i ? "," : "", max,
+                           contended[max]);
+                contended[max] = 0;
+            }
+            ap_rputs("<br>", r);
+        }
+#endif
     }
     else {
         ap_rputs("CacheType: SHMCB\n", r);
@@ -665,14 +842,26 @@ static void socache_shmcb_status(ap_socache_instance_t *ctx,
 
         ap_rprintf(r, "CacheIndexUsage: %d%%\n", index_pct);
         ap_rprintf(r, "CacheUsage: %d%%\n", cache_pct);
-        ap_rprintf(r, "CacheStoreCount: %lu\n", header->stat_stores);
-        ap_rprintf(r, "CacheReplaceCount: %lu\n", header->stat_replaced);
-        ap_rprintf(r, "CacheExpireCount: %lu\n", header->stat_expiries);
-        ap_rprintf(r, "CacheDiscardCount: %lu\n", header->stat_scrolled);
-        ap_rprintf(r, "CacheRetrieveHitCount: %lu\n", header->stat_retrieves_hit);
-        ap_rprintf(r, "CacheRetrieveMissCount: %lu\n", header->stat_retrieves_miss);
-        ap_rprintf(r, "CacheRemoveHitCount: %lu\n", header->stat_removes_hit);
-        ap_rprintf(r, "CacheRemoveMissCount: %lu\n", header->stat_removes_miss);
+        ap_rprintf(r, "CacheStoreCount: %lu\n", totals.stat_stores);
+        ap_rprintf(r, "CacheReplaceCount: %lu\n", totals.stat_replaced);
+        ap_rprintf(r, "CacheExpireCount: %lu\n", totals.stat_expiries);
+        ap_rprintf(r, "CacheDiscardCount: %lu\n", totals.stat_scrolled);
+        ap_rprintf(r, "CacheRetrieveHitCount: %lu\n", totals.stat_retrieves_hit);
+        ap_rprintf(r, "CacheRetrieveMissCount: %lu\n", totals.stat_retrieves_miss);
+        ap_rprintf(r, "CacheRemoveHitCount: %lu\n", totals.stat_removes_hit);
+        ap_rprintf(r, "CacheRemoveMissCount: %lu\n", totals.stat_removes_miss);
+#if SHMCB_SUBCACHE_LOCKS
+        ap_rprintf(r, "CacheLockCount: %lu\n", totals.stat_locks);
+        ap_rprintf(r, "CacheLockContendedCount: %lu\n",
+                   totals.stat_locks_contended);
+        ap_rprintf(r, "CacheLockContention: %d%%\n", contended_pct);
+        /* One value per subcache, in order */
+        ap_rputs("CacheSubcacheLockContended:", r);
+        for (loop = 0; loop < header->subcache_num; loop++) {
+            ap_rprintf(r, " %lu", contended[loop]);
+        }
+        ap_rputs("\n", r);
+#endif
     }
     ap_log_rerror(APLOG_MARK, APLOG_DEBUG, 0, r, APLOGNO(00841) "leaving shmcb_status");
 }
@@ -689,14 +878,19 @@ static apr_status_t socache_shmcb_iterate(ap_socache_instance_t *instance,
     apr_size_t buflen = 0;
     unsigned char *buf = NULL;
 
-    /* Perform the iteration inside the mutex to avoid corruption or invalid
-     * pointer arithmetic. The rest of our logic uses read-only header data so
-     * doesn't need the lock. */
+    /* Perform the iteration inside the subcaches' locks to avoid corruption
+     * or invalid pointer arithmetic (thus the iterator must not call back
+     * into this cache). The rest of our logic uses read-only header data so
+     * doesn't need the locks. */
     /* Iterate over the subcaches */
     for (loop = 0; loop < header->subcache_num && rv == APR_SUCCESS; loop++) {
         SHMCBSubcache *subcache = SHMCB_SUBCACHE(header, loop);
+        if ((rv = shmcb_subcache_lock(s, subcache)) != APR_SUCCESS) {
+            break;
+        }
         rv = shmcb_subcache_iterate(instance, s, userctx, header, subcache,
                                     iterator, &buf, &buflen, pool, now);
+        shmcb_subcache_unlock(subcache);
     }
     return rv;
 }
@@ -746,7 +940,7 @@ static void shmcb_subcache_expire(server_rec *s, SHMCBHeader *header,
         subcache->data_used -= diff;
         subcache->data_pos = idx->data_pos;
     }
-    header->stat_expiries += expired;
+    subcache->stat_expiries += expired;
     ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, s, APLOGNO(00843)
                  "we now have %u socache entries", subcache->idx_used);
 }
@@ -802,7 +996,7 @@ static int shmcb_subcache_store(server_rec *s, SHMCBHeader *header,
                                                       header->subcache_data_size);
             subcache->data_pos = idx2->data_pos;
             /* Stats */
-            header->stat_scrolled++;
+            subcache->stat_scrolled++;
             /* Loop admin */
             idx = idx2;
             loop++;
@@ -902,7 +1096,7 @@ static int shmcb_subcache_retrieve(server_rec *s, SHMCBHeader *header,
             else {
                 /* Already stale, quietly remove and treat as not-found */
                 idx->removed = 1;
-                header->stat_expiries++;
+                subcache->stat_expiries++;
                 ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, s, APLOGNO(00850)
                              "shmcb_subcache_retrieve discarding expired entry");
                 return -1;
@@ -1026,7 +1220,7 @@ static apr_status_t shmcb_subcache_iterate(ap_socache_instance_t *instance,
             else {
                 /* Already stale, quietly remove and treat as not-found */
                 idx->removed = 1;
-                header->stat_expiries++;
+                subcache->stat_expiries++;
                 ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, s, APLOGNO(00856)
                              "shmcb_subcache_iterate discarding expired entry");
             }
@@ -1041,7 +1235,11 @@ static apr_status_t shmcb_subcache_iterate(ap_socache_instance_t *instance,
 
 static const ap_socache_provider_t socache_shmcb = {
     "shmcb",
+#if SHMCB_SUBCACHE_LOCKS
+    0,
+#else
     AP_SOCACHE_FLAG_NOTMPSAFE,
+#endif
     socache_shmcb_create,
     socache_shmcb_init,
     socache_shmcb_destroy,
@@ -162,6 +162,12 @@ static dav_error * dav_dbm_open(apr_pool_t * p, const dav_resource *resource,
     const char *fname;
     const char *pathname;
 
+    /* Nothing to open read-only if a walk found no state dir */
+    if (ro && dav_fs_no_state_dir(resource)) {
+        *pdb = NULL;
+        return NULL;
+    }
+
     /* Get directory and filename for resource */
     /* ### should test this result value... */
     (void) dav_fs_dir_file_name(resource, &dirpath, &fname);
@@ -16,6 +16,7 @@
 
 #include "httpd.h"
 #include "http_config.h"
+#include "http_log.h"
 #include "apr_strings.h"
 #if !defined(_MSC_VER) && !defined(NETWARE)
 #include "ap_config_auto.h"
@@ -24,6 +25,12 @@
 #include "mod_dav.h"
 #include "repos.h"
 
+#if APR_HAS_THREADS
+/* threads helping walks to stat directory members (DAVStatThreads) */
+static int stat_nthreads = 0;
+static apr_thread_pool_t *stat_threads = NULL;
+#endif
+
 /* per-server configuration */
 typedef struct {
     const char *lockdb_path;
@@ -44,6 +51,14 @@ const char *dav_get_lockdb_path(const request_rec *r)
     return conf->lockdb_path;
 }
 
+#if APR_HAS_THREADS
+apr_thread_pool_t *dav_fs_get_stat_threads(int *nthreads)
+{
+    *nthreads = stat_nthreads;
+    return stat_threads;
+}
+#endif
+
 static void *dav_fs_create_server_config(apr_pool_t *p, server_rec *s)
 {
     return apr_pcalloc(p, sizeof(dav_fs_server_conf));
@@ -64,6 +79,15 @@ static void *dav_fs_merge_server_config(apr_pool_t *p,
     return newconf;
 }
 
+static int dav_fs_pre_config(apr_pool_t *pconf, apr_pool_t *plog,
+                             apr_pool_t *ptemp)
+{
+#if APR_HAS_THREADS
+    stat_nthreads = 0;
+#endif
+    return OK;
+}
+
 static apr_status_t dav_fs_post_config(apr_pool_t *p, apr_pool_t *plog,
                                        apr_pool_t *ptemp, server_rec *base_server)
 {
@@ -82,6 +106,24 @@ static apr_status_t dav_fs_post_config(apr_pool_t *p, apr_pool_t *plog,
     return OK;
 }
 
+static void dav_fs_child_init(apr_pool_t *p, server_rec *s)
+{
+#if APR_HAS_THREADS
+    if (stat_nthreads > 0) {
+        apr_status_t rv;
+
+        rv = apr_thread_pool_create(&stat_threads, 0, stat_nthreads, p);
+        if (rv != APR_SUCCESS) {
+            /* walks can stat without the threads */
+            ap_log_error(APLOG_MARK, APLOG_WARNING, rv, s, APLOGNO(10304)
+                         "DAVStatThreads: can't create %d threads",
+                         stat_nthreads);
+            stat_threads = NULL;
+        }
+    }
+#endif
+}
+
 /*
  * Command handler for the DAVLockDB directive, which is TAKE1
  */
@@ -101,18 +143,53 @@ static const char *dav_fs_cmd_davlockdb(cmd_parms *cmd, void *config,
     return NULL;
 }
 
+/*
+ * Command handler for the DAVStatThreads directive, which is TAKE1
+ */
+static const char *dav_fs_cmd_davstatthreads(cmd_parms *cmd, void *config,
+                                             const char *arg1)
+{
+    const char *err = ap_check_cmd_context(cmd, GLOBAL_ONLY);
+    char *end;
+    long n;
+
+    if (err != NULL) {
+        return err;
+    }
+
+    n = strtol(arg1, &end, 10);
+    if (*end || n < 0 || n > 256) {
+        return "DAVStatThreads must be a number of threads between 0 "
+               "and 256";
+    }
+#if APR_HAS_THREADS
+    stat_nthreads = (int)n;
+#else
+    if (n > 0) {
+        return "DAVStatThreads is not supported without threads";
+    }
+#endif
+
+    return NULL;
+}
+
 static const command_rec dav_fs_cmds[] =
 {
     /* per server */
     AP_INIT_TAKE1("DAVLockDB", dav_fs_cmd_davlockdb, NULL, RSRC_CONF,
                   "specify a lock database"),
+    AP_INIT_TAKE1("DAVStatThreads", dav_fs_cmd_davstatthreads, NULL, RSRC_CONF,
+                  "number of threads to stat the members of collections "
+                  "with, in PROPFIND and other walks (0 to stat serially)"),
 
     { NULL }
 };
 
 static void register_hooks(apr_pool_t *p)
 {
+    ap_hook_pre_config(dav_fs_pre_config, NULL, NULL, APR_HOOK_MIDDLE);
     ap_hook_post_config(dav_fs_post_config, NULL, NULL, APR_HOOK_MIDDLE);
+    ap_hook_child_init(dav_fs_child_init, NULL, NULL, APR_HOOK_MIDDLE);
 
     dav_hook_gather_propsets(dav_fs_gather_propsets, NULL, NULL,
                              APR_HOOK_MIDDLE);
@@ -19,9 +19,14 @@
 */
 
 #include "apr.h"
+#include "apr_atomic.h"
 #include "apr_file_io.h"
 #include "apr_strings.h"
 #include "apr_buckets.h"
+#if APR_HAS_THREADS
+#include "apr_thread_cond.h"
+#include "apr_thread_mutex.h"
+#endif
 
 #if APR_HAVE_UNISTD_H
 #include <unistd.h>             /* for getpid() */
@@ -47,6 +52,7 @@ struct dav_resource_private {
     const char *pathname;   /* full pathname to resource */
     apr_finfo_t finfo;       /* filesystem info */
     request_rec *r;
+    int no_state_dir;        /* walked file whose directory has no .DAV */
 };
 
 /* private context for doing a filesystem walk */
@@ -69,8 +75,42 @@ typedef struct {
 
     dav_buffer locknull_buf;
 
+    /* for what the walk function allocates from the resource's pool */
+    apr_pool_t *scratch;
+
+#if APR_HAS_THREADS
+    /* threads helping to stat the members of collections, if configured */
+    apr_thread_pool_t *stat_threads;
+    int stat_nthreads;
+    apr_thread_mutex_t *stat_lock;
+    apr_thread_cond_t *stat_cond;
+    int stat_running;           /* number of threads stat'ing members */
+    int stat_done;              /* the walker is done with the batch */
+#endif
+
 } dav_fs_walker_context;
 
+/* a directory member, read and stat'ed before the walk function is called */
+typedef struct {
+    const char *path;
+    const char *name;           /* the last part of the path */
+    apr_size_t len;
+    apr_finfo_t finfo;
+    apr_status_t status;
+} dav_fs_member;
+
+/* directory members to stat, by the walker and possibly by helper threads */
+typedef struct {
+    dav_fs_member *members;
+    int nelts;
+    apr_uint32_t next;          /* the next member to stat */
+} dav_fs_stat_batch;
+
+typedef struct {
+    dav_fs_walker_context *fsctx;
+    dav_fs_stat_batch *batch;
+} dav_fs_stat_task;
+
 typedef struct {
     int is_move;                /* is this a MOVE? */
     dav_buffer work_buf;        /* handy buffer for copymove_file() */
@@ -90,6 +130,12 @@ typedef struct {
 /* an internal WALKTYPE to call collections (again) after their contents */
 #define DAV_WALKTYPE_POSTFIX    0x8000
 
+/* number of directory members the walker reads (and stats) at once */
+#define DAV_FS_WALK_BATCH       256
+
+/* minimum number of members to stat for each thread helping the walker */
+#define DAV_FS_STAT_PER_THREAD  32
+
 #define DAV_CALLTYPE_POSTFIX    1000    /* a private call type */
 
 
@@ -234,6 +280,11 @@ const char *dav_fs_pathname(const dav_resource *resource)
     return resource->info->pathname;
 }
 
+int dav_fs_no_state_dir(const dav_resource *resource)
+{
+    return resource->info->no_state_dir;
+}
+
 dav_error * dav_fs_dir_file_name(
     const dav_resource *resource,
     const char **dirpath_p,
@@ -1483,6 +1534,129 @@ static dav_error * dav_fs_remove_resource(dav_resource *resource,
     return dav_fs_deleteset(info->pool, resource);
 }
 
+/* Call the walk function on the current resource. Whatever it allocates
+ * from the resource's pool (properties, etags, ...) is not needed once it
+ * returned, unless that is an error.
+ */
+static dav_error * dav_fs_walk_func(dav_fs_walker_context *fsctx,
+                                    int calltype)
+{
+    apr_pool_t *pool = fsctx->info1.pool;
+    dav_error *err;
+
+    fsctx->info1.pool = fsctx->scratch;
+    err = (*fsctx->params->func)(&fsctx->wres, calltype);
+    fsctx->info1.pool = pool;
+    if (err == NULL) {
+        apr_pool_clear(fsctx->scratch);
+    }
+    return err;
+}
+
+static void dav_fs_stat_members(dav_fs_stat_batch *batch, apr_pool_t *pool)
+{
+    apr_uint32_t i;
+
+    while ((i = apr_atomic_inc32(&batch->next)) < (apr_uint32_t)batch->nelts) {
+        dav_fs_member *m = &batch->members[i];
+
+        m->status = apr_stat(&m->finfo, m->path, DAV_FINFO_MASK, pool);
+    }
+}
+
+#if APR_HAS_THREADS
+static void * APR_THREAD_FUNC dav_fs_stat_thread(apr_thread_t *thd,
+                                                 void *data)
+{
+    dav_fs_stat_task *task = data;
+    dav_fs_walker_context *fsctx = task->fsctx;
+    apr_allocator_t *allocator;
+    apr_pool_t *pool;
+
+    apr_thread_mutex_lock(fsctx->stat_lock);
+    if (fsctx->stat_done) {
+        /* started too late, the walker did it all */
+        apr_thread_mutex_unlock(fsctx->stat_lock);
+        return NULL;
+    }
+    ++fsctx->stat_running;
+    apr_thread_mutex_unlock(fsctx->stat_lock);
+
+    /* The walker keeps allocating from the request's pools meanwhile, so
+     * stat with a pool (and allocator) of our own.
+     */
+    if (apr_allocator_create(&allocator) == APR_SUCCESS) {
+        if (apr_pool_create_unmanaged_ex(&pool, NULL,
+                                         allocator) == APR_SUCCESS) {
+            apr_allocator_owner_set(allocator, pool);
+            apr_pool_tag(pool, "dav_fs_stat");
+            dav_fs_stat_members(task->batch, pool);
+            apr_pool_destroy(pool);
+        }
+        else {
+            apr_allocator_destroy(allocator);
+        }
+    }
+
+    apr_thread_mutex_lock(fsctx->stat_lock);
+    if (--fsctx->stat_running == 0 && fsctx->stat_done) {
+        apr_thread_cond_signal(fsctx->stat_cond);
+    }
+    apr_thread_mutex_unlock(fsctx->stat_lock);
+    return NULL;
+}
+#endif
+
+/* Stat the members of a batch, with the help of the stat threads when
+ * configured and there are enough members. On slow or cold storage (NFS,
+ * large directories not in the cache) the stats are most of the walk.
+ */
+static void dav_fs_stat_batch_run(dav_fs_walker_context *fsctx,
+                                  dav_fs_stat_batch *batch, apr_pool_t *pool)
+{
+#if APR_HAS_THREADS
+    int i, nhelpers = 0;
+
+    if (fsctx->stat_threads != NULL) {
+        nhelpers = batch->nelts / DAV_FS_STAT_PER_THREAD - 1;
+        if (nhelpers > fsctx->stat_nthreads) {
+            nhelpers = fsctx->stat_nthreads;
+        }
+    }
+    if (nhelpers > 0) {
+        /* no helper from a previous batch is left */
+        fsctx->stat_done = 0;
+        for (i = 0; i < nhelpers; ++i) {
+            dav_fs_stat_task *task = apr_palloc(pool, sizeof(*task));
+
+            task->fsctx = fsctx;
+            task->batch = batch;
+            if (apr_thread_pool_push(fsctx->stat_threads, dav_fs_stat_thread,
+                                     task, APR_THREAD_TASK_PRIORITY_NORMAL,
+                                     batch) != APR_SUCCESS) {
+                break;
+            }
+        }
+    }
+#endif
+
+    dav_fs_stat_members(batch, pool);
+
+#if APR_HAS_THREADS
+    if (nhelpers > 0) {
+        /* wait for the helpers still stat'ing, and drop those which did
+         * not start (they would not find anything to do anyway) */
+        apr_thread_mutex_lock(fsctx->stat_lock);
+        fsctx->stat_done = 1;
+        while (fsctx->stat_running) {
+            apr_thread_cond_wait(fsctx->stat_cond, fsctx->stat_lock);
+        }
+        apr_thread_mutex_unlock(fsctx->stat_lock);
+        apr_thread_pool_tasks_cancel(fsctx->stat_threads, batch);
+    }
+#endif
+}
+
 /* ### move this to dav_util? */
 /* Walk recursively down through directories, *
  * including lock-null resources as we go.    */
@@ -1495,12 +1669,15 @@ static dav_error * dav_fs_walker(dav_fs_walker_context *fsctx, int depth)
     int isdir = fsctx->res1.collection;
     apr_finfo_t dirent;
     apr_dir_t *dirp;
+    apr_pool_t *dpool, *bpool;
+    dav_fs_stat_batch batch;
+    int more = 1, has_state_dir = 0, state_known = 0, no_state_dir = 0;
 
     /* ensure the context is prepared properly, then call the func */
-    err = (*params->func)(&fsctx->wres,
-                          isdir
-                          ? DAV_CALLTYPE_COLLECTION
-                          : DAV_CALLTYPE_MEMBER);
+    err = dav_fs_walk_func(fsctx,
+                           isdir
+                           ? DAV_CALLTYPE_COLLECTION
+                           : DAV_CALLTYPE_MEMBER);
     if (err != NULL) {
         return err;
     }
@@ -1531,117 +1708,184 @@ static dav_error * dav_fs_walker(dav_fs_walker_context *fsctx, int depth)
     fsctx->res1.collection = 0;
     fsctx->res2.collection = 0;
 
-    /* open and scan the directory */
-    if ((status = apr_dir_open(&dirp, fsctx->path1.buf, pool)) != APR_SUCCESS) {
+    /* open and scan the directory, from a pool of its own (the walk's
+     * pool lasts for the request) */
+    apr_pool_create(&dpool, pool);
+    apr_pool_tag(dpool, "dav_fs_walk");
+    if ((status = apr_dir_open(&dirp, fsctx->path1.buf, dpool)) != APR_SUCCESS) {
+        apr_pool_destroy(dpool);
         /* ### need a better error */
         return dav_new_error(pool, HTTP_NOT_FOUND, 0, status, NULL);
     }
-    while ((apr_dir_read(&dirent, APR_FINFO_DIRENT, dirp)) == APR_SUCCESS) {
-        apr_size_t len;
+    apr_pool_create(&bpool, dpool);
 
-        len = strlen(dirent.name);
+    /* read the members in batches, stat them (possibly in parallel),
+     * then call the function for each */
+    do {
+        int i;
+
+        apr_pool_clear(bpool);
+        batch.members = apr_palloc(bpool,
+                                   DAV_FS_WALK_BATCH * sizeof(dav_fs_member));
+        batch.nelts = 0;
+        batch.next = 0;
+
+        while (batch.nelts < DAV_FS_WALK_BATCH
+               && (more = (apr_dir_read(&dirent, APR_FINFO_DIRENT,
+                                        dirp) == APR_SUCCESS))) {
+            dav_fs_member *m;
+            apr_size_t len;
+            char *path;
+
+            len = strlen(dirent.name);
+
+            /* avoid recursing into our current, parent, or state directories */
+            if (dirent.name[0] == '.'
+                  && (len == 1 || (dirent.name[1] == '.' && len == 2))) {
+                continue;
+            }
 
-        /* avoid recursing into our current, parent, or state directories */
-        if (dirent.name[0] == '.'
-              && (len == 1 || (dirent.name[1] == '.' && len == 2))) {
-            continue;
-        }
+            if (!strcmp(dirent.name, DAV_FS_STATE_DIR)) {
+                has_state_dir = 1;
+            }
 
-        if (params->walk_type & DAV_WALKTYPE_AUTH) {
-            /* ### need to authorize each file */
-            /* ### example: .htaccess is normally configured to fail auth */
+            if (params->walk_type & DAV_WALKTYPE_AUTH) {
+                /* ### need to authorize each file */
+                /* ### example: .htaccess is normally configured to fail auth */
 
-            /* stuff in the state directory and temp files are never authorized! */
-            if (!strcmp(dirent.name, DAV_FS_STATE_DIR) ||
-                !strncmp(dirent.name, DAV_FS_TMP_PREFIX,
-                         strlen(DAV_FS_TMP_PREFIX))) {
+                /* stuff in the state directory and temp files are never authorized! */
+                if (!strcmp(dirent.name, DAV_FS_STATE_DIR) ||
+                    !strncmp(dirent.name, DAV_FS_TMP_PREFIX,
+                             strlen(DAV_FS_TMP_PREFIX))) {
+                    continue;
+                }
+            }
+            /* skip the state dir and temp files unless a HIDDEN is performed */
+            if (!(params->walk_type & DAV_WALKTYPE_HIDDEN)
+                && (!strcmp(dirent.name, DAV_FS_STATE_DIR) ||
+                    !strncmp(dirent.name, DAV_FS_TMP_PREFIX,
+                             strlen(DAV_FS_TMP_PREFIX)))) {
                 continue;
             }
-        }
-        /* skip the state dir and temp files unless a HIDDEN is performed */
-        if (!(params->walk_type & DAV_WALKTYPE_HIDDEN)
-            && (!strcmp(dirent.name, DAV_FS_STATE_DIR) ||
-                !strncmp(dirent.name, DAV_FS_TMP_PREFIX,
-                         strlen(DAV_FS_TMP_PREFIX)))) {
-            continue;
-        }
 
-        /* append this file onto the path buffer (copy null term) */
-        dav_buffer_place_mem(pool, &fsctx->path1, dirent.name, len + 1, 0);
+            /* the path buffer holds the directory with its trailing slash */
+            path = apr_palloc(bpool, fsctx->path1.cur_len + len + 1);
+            memcpy(path, fsctx->path1.buf, fsctx->path1.cur_len);
+            memcpy(path + fsctx->path1.cur_len, dirent.name, len + 1);
 
-        status = apr_stat(&fsctx->info1.finfo, fsctx->path1.buf,
-                          DAV_FINFO_MASK, pool);
-        if (status != APR_SUCCESS && status != APR_INCOMPLETE) {
-            /* woah! where'd it go? */
-            /* ### should have a better error here */
-            err = dav_new_error(pool, HTTP_NOT_FOUND, 0, status, NULL);
-            break;
+            m = &batch.members[batch.nelts++];
+            m->path = path;
+            m->name = path + fsctx->path1.cur_len;
+            m->len = len;
         }
 
-        /* copy the file to the URI, too. NOTE: we will pad an extra byte
-           for the trailing slash later. */
-        dav_buffer_place_mem(pool, &fsctx->uri_buf, dirent.name, len + 1, 1);
-
-        /* if there is a secondary path, then do that, too */
-        if (fsctx->path2.buf != NULL) {
-            dav_buffer_place_mem(pool, &fsctx->path2, dirent.name, len + 1, 0);
+        /* Without a state directory, no file here has dead properties:
+         * spare the walk function to look for each of their databases.
+         */
+        if (!state_known) {
+            if (!has_state_dir && more) {
+                apr_finfo_t finfo;
+                char *path = apr_palloc(bpool, fsctx->path1.cur_len
+                                        + sizeof(DAV_FS_STATE_DIR));
+
+                memcpy(path, fsctx->path1.buf, fsctx->path1.cur_len);
+                memcpy(path + fsctx->path1.cur_len, DAV_FS_STATE_DIR,
+                       sizeof(DAV_FS_STATE_DIR));
+                status = apr_stat(&finfo, path, APR_FINFO_TYPE, bpool);
+                has_state_dir = (status == APR_SUCCESS
+                                 || status == APR_INCOMPLETE);
+            }
+            no_state_dir = !has_state_dir;
+            state_known = 1;
         }
 
-        /* set up the (internal) pathnames for the two resources */
-        fsctx->info1.pathname = fsctx->path1.buf;
-        fsctx->info2.pathname = fsctx->path2.buf;
+        dav_fs_stat_batch_run(fsctx, &batch, bpool);
 
-        /* set up the URI for the current resource */
-        fsctx->res1.uri = fsctx->uri_buf.buf;
+        for (i = 0; i < batch.nelts; ++i) {
+            dav_fs_member *m = &batch.members[i];
+            apr_size_t len = m->len;
 
-        /* ### for now, only process regular files (e.g. skip symlinks) */
-        if (fsctx->info1.finfo.filetype == APR_REG) {
-            /* call the function for the specified dir + file */
-            if ((err = (*params->func)(&fsctx->wres,
-                                       DAV_CALLTYPE_MEMBER)) != NULL) {
-                /* ### maybe add a higher-level description? */
+            /* append this file onto the path buffer (copy null term) */
+            dav_buffer_place_mem(pool, &fsctx->path1, m->name, len + 1, 0);
+
+            fsctx->info1.finfo = m->finfo;
+            fsctx->info1.finfo.fname = fsctx->path1.buf;
+            fsctx->info1.finfo.pool = pool;
+            if (m->status != APR_SUCCESS && m->status != APR_INCOMPLETE) {
+                /* woah! where'd it go? */
+                /* ### should have a better error here */
+                err = dav_new_error(pool, HTTP_NOT_FOUND, 0, m->status, NULL);
                 break;
             }
-        }
-        else if (fsctx->info1.finfo.filetype == APR_DIR) {
-            apr_size_t save_path_len = fsctx->path1.cur_len;
-            apr_size_t save_uri_len = fsctx->uri_buf.cur_len;
-            apr_size_t save_path2_len = fsctx->path2.cur_len;
-
-            /* adjust length to incorporate the subdir name */
-            fsctx->path1.cur_len += len;
-            fsctx->path2.cur_len += len;
-
-            /* adjust URI length to incorporate subdir and a slash */
-            fsctx->uri_buf.cur_len += len + 1;
-            fsctx->uri_buf.buf[fsctx->uri_buf.cur_len - 1] = '/';
-            fsctx->uri_buf.buf[fsctx->uri_buf.cur_len] = '\0';
-
-            /* switch over to a collection */
-            fsctx->res1.collection = 1;
-            fsctx->res2.collection = 1;
-
-            /* recurse on the subdir */
-            /* ### don't always want to quit on error from single child */
-            if ((err = dav_fs_walker(fsctx, depth - 1)) != NULL) {
-                /* ### maybe add a higher-level description? */
-                break;
+
+            /* copy the file to the URI, too. NOTE: we will pad an extra byte
+               for the trailing slash later. */
+            dav_buffer_place_mem(pool, &fsctx->uri_buf, m->name, len + 1, 1);
+
+            /* if there is a secondary path, then do that, too */
+            if (fsctx->path2.buf != NULL) {
+                dav_buffer_place_mem(pool, &fsctx->path2, m->name, len + 1, 0);
+            }
+
+            /* set up the (internal) pathnames for the two resources */
+            fsctx->info1.pathname = fsctx->path1.buf;
+            fsctx->info2.pathname = fsctx->path2.buf;
+
+            /* set up the URI for the current resource */
+            fsctx->res1.uri = fsctx->uri_buf.buf;
+
+            /* ### for now, only process regular files (e.g. skip symlinks) */
+            if (fsctx->info1.finfo.filetype == APR_REG) {
+                /* call the function for the specified dir + file */
+                fsctx->info1.no_state_dir = no_state_dir;
+                err = dav_fs_walk_func(fsctx, DAV_CALLTYPE_MEMBER);
+                fsctx->info1.no_state_dir = 0;
+                if (err != NULL) {
+                    /* ### maybe add a higher-level description? */
+                    break;
+                }
             }
+            else if (fsctx->info1.finfo.filetype == APR_DIR) {
+                apr_size_t save_path_len = fsctx->path1.cur_len;
+                apr_size_t save_uri_len = fsctx->uri_buf.cur_len;
+                apr_size_t save_path2_len = fsctx->path2.cur_len;
+
+                /* adjust length to incorporate the subdir name */
+                fsctx->path1.cur_len += len;
+                fsctx->path2.cur_len += len;
+
+                /* adjust URI length to incorporate subdir and a slash */
+                fsctx->uri_buf.cur_len += len + 1;
+                fsctx->uri_buf.buf[fsctx->uri_buf.cur_len - 1] = '/';
+                fsctx->uri_buf.buf[fsctx->uri_buf.cur_len] = '\0';
+
+                /* switch over to a collection */
+                fsctx->res1.collection = 1;
+                fsctx->res2.collection = 1;
+
+                /* recurse on the subdir */
+                /* ### don't always want to quit on error from single child */
+                if ((err = dav_fs_walker(fsctx, depth - 1)) != NULL) {
+                    /* ### maybe add a higher-level description? */
+                    break;
+                }
 
-            /* put the various information back */
-            fsctx->path1.cur_len = save_path_len;
-            fsctx->path2.cur_len = save_path2_len;
-            fsctx->uri_buf.cur_len = save_uri_len;
+                /* put the various information back */
+                fsctx->path1.cur_len = save_path_len;
+                fsctx->path2.cur_len = save_path2_len;
+                fsctx->uri_buf.cur_len = save_uri_len;
 
-            fsctx->res1.collection = 0;
-            fsctx->res2.collection = 0;
+                fsctx->res1.collection = 0;
+                fsctx->res2.collection = 0;
 
-            /* assert: res1.exists == 1 */
+                /* assert: res1.exists == 1 */
+            }
         }
-    }
+    } while (more && err == NULL);
 
     /* ### check the return value of this? */
     apr_dir_close(dirp);
+    apr_pool_destroy(dpool);
 
     if (err != NULL)
         return err;
@@ -1732,8 +1976,8 @@ static dav_error * dav_fs_walker(dav_fs_walker_context *fsctx, int depth)
 
             /* call the function for the specified dir + file */
             if (locks != NULL &&
-                (err = (*params->func)(&fsctx->wres,
-                                       DAV_CALLTYPE_LOCKNULL)) != NULL) {
+                (err = dav_fs_walk_func(fsctx,
+                                        DAV_CALLTYPE_LOCKNULL)) != NULL) {
                 /* ### maybe add a higher-level description? */
                 return err;
             }
@@ -1756,7 +2000,7 @@ static dav_error * dav_fs_walker(dav_fs_walker_context *fsctx, int depth)
         /* this is a collection which exists */
         fsctx->res1.collection = 1;
 
-        return (*params->func)(&fsctx->wres, DAV_CALLTYPE_POSTFIX);
+        return dav_fs_walk_func(fsctx, DAV_CALLTYPE_POSTFIX);
     }
 
     return NULL;
@@ -1784,6 +2028,22 @@ static dav_error * dav_fs_internal_walk(const dav_walk_params *params,
     fsctx.wres.walk_ctx = params->walk_ctx;
     fsctx.wres.pool = params->pool;
 
+    apr_pool_create(&fsctx.scratch, params->pool);
+    apr_pool_tag(fsctx.scratch, "dav_fs_walk_scratch");
+
+#if APR_HAS_THREADS
+    fsctx.stat_threads = dav_fs_get_stat_threads(&fsctx.stat_nthreads);
+    if (fsctx.stat_threads != NULL
+        && (apr_thread_mutex_create(&fsctx.stat_lock,
+                                    APR_THREAD_MUTEX_DEFAULT,
+                                    params->pool) != APR_SUCCESS
+            || apr_thread_cond_create(&fsctx.stat_cond,
+                                      params->pool) != APR_SUCCESS)) {
+        /* stat serially then */
+        fsctx.stat_threads = NULL;
+    }
+#endif
+
     /* ### zero out versioned, working, baselined? */
 
     fsctx.res1 = *params->root;
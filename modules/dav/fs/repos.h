@@ -25,6 +25,10 @@
 #ifndef _DAV_FS_REPOS_H_
 #define _DAV_FS_REPOS_H_
 
+#if APR_HAS_THREADS
+#include "apr_thread_pool.h"
+#endif
+
 /* the subdirectory to hold all DAV-related information for a directory */
 #define DAV_FS_STATE_DIR                ".DAV"
 #define DAV_FS_STATE_FILE_FOR_DIR       ".state_for_dir"
@@ -40,6 +44,9 @@ apr_pool_t *dav_fs_pool(const dav_resource *resource);
 /* return the full pathname for a resource */
 const char *dav_fs_pathname(const dav_resource *resource);
 
+/* is the state directory of a resource known not to exist (during a walk)? */
+int dav_fs_no_state_dir(const dav_resource *resource);
+
 /* return the directory and filename for a resource */
 dav_error * dav_fs_dir_file_name(const dav_resource *resource,
                                  const char **dirpath,
@@ -67,6 +74,11 @@ void dav_dbm_close(dav_db *db);
 /* where is the lock database located? */
 const char *dav_get_lockdb_path(const request_rec *r);
 
+#if APR_HAS_THREADS
+/* the threads helping walks to stat directory members, or NULL */
+apr_thread_pool_t *dav_fs_get_stat_threads(int *nthreads);
+#endif
+
 const dav_hooks_locks *dav_fs_get_lock_hooks(request_rec *r);
 const dav_hooks_propdb *dav_fs_get_propdb_hooks(request_rec *r);
 
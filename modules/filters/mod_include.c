@@ -21,6 +21,9 @@
 #include "apr_user.h"
 #include "apr_lib.h"
 #include "apr_optional.h"
+#include "apr_buckets.h"
+#include "apr_mmap.h"
+#include "apr_thread_mutex.h"
 
 #define APR_WANT_STRFUNC
 #define APR_WANT_MEMFUNC
@@ -120,6 +123,7 @@ typedef struct {
     signed char lastmodified;
     signed char etag;
     signed char legacy_expr;
+    signed char cache;
 } include_dir_config;
 
 typedef struct {
@@ -157,6 +161,35 @@ typedef struct arg_item {
     apr_size_t        value_len;
 } arg_item_t;
 
+/* a literal byte range, or a directive, of a pre-tokenized document */
+typedef struct {
+    apr_off_t     offset;        /* literal: range in the document */
+    apr_size_t    len;
+    char         *directive;     /* NULL for a literal */
+    apr_size_t    directive_len;
+    unsigned      argc;
+    arg_item_t   *argv;
+    int           error;         /* parse error, already logged */
+    const ap_expr_info_t *expr;  /* compiled if/elif expr, if any */
+} ssi_segment_t;
+
+/* a pre-tokenized document of the parsed documents cache, valid as long as
+ * the file has the same mtime, size (and inode) and the SSI tags are the
+ * same.
+ */
+typedef struct {
+    apr_pool_t   *pool;
+    const char   *key;
+    apr_time_t    mtime;
+    apr_off_t     size;
+    apr_ino_t     inode;
+    apr_dev_t     device;
+    apr_array_header_t *segments;
+    int           unfinished;    /* directive not finished at the end */
+    int           cacheable;     /* no parse error */
+    int           refs;          /* cache + requests using it */
+} ssi_doc_t;
+
 typedef struct {
     const char *source;
     const char *rexp;
@@ -202,6 +235,10 @@ struct ssi_internal_ctx {
     ap_expr_eval_ctx_t *expr_eval_ctx;  /* NULL if there wasn't an ap_expr yet */
     const char         *expr_vary_this; /* for use by ap_expr_eval_ctx */
     const char         *expr_err;       /* for use by ap_expr_eval_ctx */
+
+    ssi_doc_t            *doc;          /* from the cache, or NULL */
+    const ap_expr_info_t *cached_expr;  /* of the current directive */
+    const char           *cached_expr_str;
 #ifdef DEBUG_INCLUDE
     struct {
         ap_filter_t *f;
@@ -469,6 +506,20 @@ static const char lazy_eval_sentinel = '\0';
 
 #define UNSET -1
 
+/* Parsed documents cache limits (per child) */
+#ifndef SSI_CACHE_MAX_DOCS
+#define SSI_CACHE_MAX_DOCS 1024
+#endif
+#ifndef SSI_CACHE_MAX_SIZE
+#define SSI_CACHE_MAX_SIZE (1024 * 1024)
+#endif
+
+static apr_hash_t *ssi_cache;
+static apr_pool_t *ssi_cache_pool;
+#if APR_HAS_THREADS
+static apr_thread_mutex_t *ssi_cache_mutex;
+#endif
+
 #ifdef XBITHACK
 #define DEFAULT_XBITHACK XBITHACK_FULL
 #else
@@ -1589,24 +1640,30 @@ static int parse_expr(include_ctx_t *ctx, const char *expr, int *was_error)
 /* same as above, but use common ap_expr syntax / API */
 static int parse_ap_expr(include_ctx_t *ctx, const char *expr, int *was_error)
 {
-    ap_expr_info_t *expr_info = apr_pcalloc(ctx->pool, sizeof (*expr_info));
+    const ap_expr_info_t *expr_info = ctx->intern->cached_expr;
     const char *err;
     int ret;
     backref_t *re = ctx->intern->re;
     ap_expr_eval_ctx_t *eval_ctx = ctx->intern->expr_eval_ctx;
 
-    expr_info->filename = ctx->r->filename;
-    expr_info->line_number = 0;
-    expr_info->module_index = APLOG_MODULE_INDEX;
-    expr_info->flags = AP_EXPR_FLAG_RESTRICTED;
-    err = ap_expr_parse(ctx->r->pool, ctx->r->pool, expr_info, expr,
-                        include_expr_lookup);
-    if (err) {
-        ap_log_rerror(APLOG_MARK, APLOG_ERR, 0, ctx->r, APLOGNO(01337)
-                      "Could not parse expr \"%s\" in %s: %s", expr,
-                      ctx->r->filename, err);
-        *was_error = 1;
-        return 0;
+    /* compiled already if the document comes from the cache */
+    if (!expr_info || strcmp(expr, ctx->intern->cached_expr_str)) {
+        ap_expr_info_t *info = apr_pcalloc(ctx->pool, sizeof (*info));
+
+        info->filename = ctx->r->filename;
+        info->line_number = 0;
+        info->module_index = APLOG_MODULE_INDEX;
+        info->flags = AP_EXPR_FLAG_RESTRICTED;
+        err = ap_expr_parse(ctx->r->pool, ctx->r->pool, info, expr,
+                            include_expr_lookup);
+        if (err) {
+            ap_log_rerror(APLOG_MARK, APLOG_ERR, 0, ctx->r, APLOGNO(01337)
+                          "Could not parse expr \"%s\" in %s: %s", expr,
+                          ctx->r->filename, err);
+            *was_error = 1;
+            return 0;
+        }
+        expr_info = info;
     }
 
     if (!re) {
@@ -3382,6 +3439,597 @@ static apr_size_t find_argument(include_ctx_t *ctx, const char *data,
     return len; /* partial match of something */
 }
 
+/*
+ * run the handler of the parsed directive
+ */
+static apr_status_t execute_directive(include_ctx_t *ctx, ap_filter_t *f,
+                                      apr_bucket_brigade *pass_bb)
+{
+    struct ssi_internal_ctx *intern = ctx->intern;
+    request_rec *r = f->r;
+
+    /* if there was an error, it was already logged; just stop here */
+    if (intern->error) {
+        if (ctx->flags & SSI_FLAG_PRINTING) {
+            SSI_CREATE_ERROR_BUCKET(ctx, f, pass_bb);
+            intern->error = 0;
+        }
+    }
+    else {
+        include_handler_fn_t *handle_func;
+
+        handle_func =
+            (include_handler_fn_t *)apr_hash_get(include_handlers, intern->directive,
+                                                 intern->directive_len);
+
+        if (handle_func) {
+            DEBUG_INIT(ctx, f, pass_bb);
+            return handle_func(ctx, f, pass_bb);
+        }
+        else {
+            ap_log_rerror(APLOG_MARK, APLOG_ERR, 0, r, APLOGNO(01371)
+                          "unknown directive \"%s\" in parsed doc %s",
+                          apr_pstrmemdup(r->pool, intern->directive,
+                                         intern->directive_len),
+                                         r->filename);
+            if (ctx->flags & SSI_FLAG_PRINTING) {
+                SSI_CREATE_ERROR_BUCKET(ctx, f, pass_bb);
+            }
+        }
+    }
+
+    return APR_SUCCESS;
+}
+
+/*
+ * report what's left unfinished at the end of the document, and cleanup
+ */
+static void end_of_document(include_ctx_t *ctx, ap_filter_t *f,
+                            apr_bucket_brigade *pass_bb, int unfinished)
+{
+    request_rec *r = f->r;
+
+    if (unfinished) {
+        ap_log_rerror(APLOG_MARK, APLOG_ERR, 0, r, APLOGNO(01372)
+                      "SSI directive was not properly finished at the end "
+                      "of parsed document %s", r->filename);
+        if (ctx->flags & SSI_FLAG_PRINTING) {
+            SSI_CREATE_ERROR_BUCKET(ctx, f, pass_bb);
+        }
+    }
+
+    if (!(ctx->flags & SSI_FLAG_PRINTING)) {
+        ap_log_rerror(APLOG_MARK, APLOG_WARNING, 0, r, APLOGNO(01373)
+                      "missing closing endif directive in parsed document"
+                      " %s", r->filename);
+    }
+
+    /* cleanup our temporary memory */
+    apr_brigade_destroy(ctx->intern->tmp_bb);
+    apr_pool_destroy(ctx->dpool);
+}
+
+/*
+ * +-------------------------------------------------------+
+ * |                                                       |
+ * |                Parsed Documents Cache
+ * |                                                       |
+ * +-------------------------------------------------------+
+ */
+
+/*
+ * Documents which are files served as is (a single FILE bucket followed by
+ * EOS) are tokenized once by the same state machine as
+ * send_parsed_content(), with the whole file in one buffer, into literal
+ * byte ranges and directives (with their arguments and the compiled
+ * if/elif expressions). Later requests for the same file only replay the
+ * directives, the literal parts are copies of the file (or mmap) bucket.
+ */
+
+static void ssi_doc_add_literal(ssi_doc_t *doc, apr_off_t offset,
+                                apr_size_t len)
+{
+    ssi_segment_t *seg;
+
+    if (!len) {
+        return;
+    }
+    if (doc->segments->nelts) {
+        seg = &APR_ARRAY_IDX(doc->segments, doc->segments->nelts - 1,
+                             ssi_segment_t);
+        if (!seg->directive && seg->offset + (apr_off_t)seg->len == offset) {
+            seg->len += len;
+            return;
+        }
+    }
+    seg = apr_array_push(doc->segments);
+    memset(seg, 0, sizeof(*seg));
+    seg->offset = offset;
+    seg->len = len;
+}
+
+static void ssi_doc_add_directive(include_ctx_t *ctx, ssi_doc_t *doc)
+{
+    struct ssi_internal_ctx *intern = ctx->intern;
+    arg_item_t *arg, **next;
+    ssi_segment_t *seg;
+
+    seg = apr_array_push(doc->segments);
+    memset(seg, 0, sizeof(*seg));
+    seg->directive = apr_pstrmemdup(doc->pool, intern->directive
+                                               ? intern->directive : "",
+                                    intern->directive_len);
+    seg->directive_len = intern->directive_len;
+    seg->argc = ctx->argc;
+    seg->error = intern->error;
+    if (intern->error) {
+        doc->cacheable = 0;
+    }
+
+    for (next = &seg->argv, arg = intern->argv; arg; arg = arg->next) {
+        arg_item_t *copy = apr_palloc(doc->pool, sizeof(*copy));
+
+        copy->name = arg->name ? apr_pstrmemdup(doc->pool, arg->name,
+                                                arg->name_len) : NULL;
+        copy->name_len = arg->name_len;
+        copy->value = arg->value ? apr_pstrmemdup(doc->pool, arg->value,
+                                                  arg->value_len) : NULL;
+        copy->value_len = arg->value_len;
+        copy->next = NULL;
+        *next = copy;
+        next = &copy->next;
+    }
+
+    /* compile the expression now, errors are left to parse_ap_expr() */
+    if (!intern->legacy_expr && !seg->error && seg->argc == 1
+        && seg->argv->name && seg->argv->value
+        && !strcmp(seg->argv->name, "expr")
+        && (!strcmp(seg->directive, "if") || !strcmp(seg->directive, "elif"))) {
+        ap_expr_info_t *info = apr_pcalloc(doc->pool, sizeof(*info));
+
+        info->filename = apr_pstrdup(doc->pool, ctx->r->filename);
+        info->line_number = 0;
+        info->module_index = APLOG_MODULE_INDEX;
+        info->flags = AP_EXPR_FLAG_RESTRICTED;
+        if (!ap_expr_parse(doc->pool, ctx->dpool, info, seg->argv->value,
+                           include_expr_lookup)) {
+            seg->expr = info;
+        }
+    }
+}
+
+/*
+ * Tokenize the whole document, following the states and the (tmp_bb)
+ * token handling of send_parsed_content().
+ */
+static void ssi_doc_tokenize(include_ctx_t *ctx, ssi_doc_t *doc,
+                             const char *data, apr_size_t len)
+{
+    struct ssi_internal_ctx *intern = ctx->intern;
+    const char *token = NULL; /* start of the current token, like tmp_bb */
+    apr_size_t pos = 0, index;
+    char *magic; /* magic pointer for sentinel use */
+
+    intern->state = PARSE_PRE_HEAD;
+    intern->error = 0;
+
+    while (pos < len || PARSE_EXECUTE == intern->state ||
+           PARSE_DIRECTIVE_POSTTAIL == intern->state) {
+        char **store = &magic;
+        apr_size_t *store_len = NULL;
+
+        switch (intern->state) {
+        case PARSE_PRE_HEAD:
+            index = find_start_sequence(ctx, data + pos, len - pos);
+
+            if (PARSE_DIRECTIVE == intern->state) { /* full match */
+                ssi_doc_add_literal(doc, pos, index);
+                pos += index + intern->start_seq_pat->pattern_len;
+            }
+            else {
+                /* no match, or a partial one at the end of the document
+                 * which is released as is
+                 */
+                ssi_doc_add_literal(doc, pos, len - pos);
+                intern->state = PARSE_PRE_HEAD;
+                pos = len;
+            }
+            break;
+
+        case PARSE_DIRECTIVE:
+        case PARSE_DIRECTIVE_POSTNAME:
+        case PARSE_DIRECTIVE_TAIL:
+        case PARSE_DIRECTIVE_POSTTAIL:
+            index = find_directive(ctx, data + pos, len - pos,
+                                   &store, &store_len);
+            if (store) {
+                if (index && !token) {
+                    token = data + pos;
+                }
+                pos += index;
+
+                if (store != &magic) {
+                    *store_len = token ? data + pos - token : 0;
+                    *store = apr_pstrmemdup(ctx->dpool, token ? token : "",
+                                            *store_len);
+                    token = NULL;
+                }
+            }
+            else {
+                pos += index;
+            }
+            break;
+
+        case PARSE_PRE_ARG:
+            pos += find_arg_or_tail(ctx, data + pos, len - pos);
+            break;
+
+        case PARSE_ARG:
+        case PARSE_ARG_NAME:
+        case PARSE_ARG_POSTNAME:
+        case PARSE_ARG_EQ:
+        case PARSE_ARG_PREVAL:
+        case PARSE_ARG_VAL:
+        case PARSE_ARG_VAL_ESC:
+        case PARSE_ARG_POSTVAL:
+            index = find_argument(ctx, data + pos, len - pos,
+                                  &store, &store_len);
+            if (store) {
+                if (index && !token) {
+                    token = data + pos;
+                }
+                pos += index;
+
+                if (store != &magic) {
+                    *store_len = token ? data + pos - token : 0;
+                    *store = apr_pstrmemdup(ctx->dpool, token ? token : "",
+                                            *store_len);
+                    token = NULL;
+                }
+            }
+            else {
+                pos += index;
+            }
+            break;
+
+        case PARSE_TAIL:
+        case PARSE_TAIL_SEQ:
+            index = find_tail(ctx, data + pos, len - pos);
+
+            switch (intern->state) {
+            case PARSE_EXECUTE:  /* full match */
+                pos += index;
+                break;
+
+            case PARSE_ARG:      /* no match, reparse at the beginning */
+                if (token) {
+                    pos = token - data;
+                    token = NULL;
+                }
+                break;
+
+            default:             /* partial match */
+                if (!token) {
+                    token = data + pos;
+                }
+                pos += index;
+                break;
+            }
+            break;
+
+        case PARSE_EXECUTE:
+            ssi_doc_add_directive(ctx, doc);
+
+            apr_pool_clear(ctx->dpool);
+            token = NULL;
+            intern->error = 0;
+            intern->state = PARSE_PRE_HEAD;
+            break;
+
+        default:
+            break;
+        }
+    }
+
+    doc->unfinished = (PARSE_PRE_HEAD != intern->state);
+
+    /* back to the initial state for the replay */
+    apr_pool_clear(ctx->dpool);
+    intern->state = PARSE_PRE_HEAD;
+    intern->error = 0;
+    intern->argv = NULL;
+    ctx->argc = 0;
+}
+
+/* must be called with the ssi_cache_mutex held */
+static void ssi_doc_unref(ssi_doc_t *doc)
+{
+    if (!--doc->refs) {
+        apr_pool_destroy(doc->pool);
+    }
+}
+
+static apr_status_t ssi_doc_release(void *data)
+{
+#if APR_HAS_THREADS
+    apr_thread_mutex_lock(ssi_cache_mutex);
+#endif
+    ssi_doc_unref(data);
+#if APR_HAS_THREADS
+    apr_thread_mutex_unlock(ssi_cache_mutex);
+#endif
+    return APR_SUCCESS;
+}
+
+static ssi_doc_t *ssi_doc_create(include_ctx_t *ctx, apr_bucket *b,
+                                 const char *key)
+{
+    request_rec *r = ctx->r;
+    apr_allocator_t *allocator;
+    apr_bucket_brigade *tmp_bb;
+    apr_bucket *copy;
+    apr_pool_t *pool, *ptemp;
+    ssi_doc_t *doc;
+    char *data;
+    apr_size_t len;
+    apr_status_t rv;
+
+    /* the document outlives the request, and gets destroyed by whichever
+     * thread releases it last
+     */
+    if (apr_allocator_create(&allocator) != APR_SUCCESS) {
+        return NULL;
+    }
+    apr_pool_create_ex(&pool, NULL, NULL, allocator);
+    apr_allocator_owner_set(allocator, pool);
+    apr_pool_tag(pool, "includes_cache");
+
+    doc = apr_pcalloc(pool, sizeof(*doc));
+    doc->pool = pool;
+    doc->key = apr_pstrdup(pool, key);
+    doc->mtime = r->finfo.mtime;
+    doc->size = r->finfo.size;
+    if (r->finfo.valid & APR_FINFO_INODE) {
+        doc->inode = r->finfo.inode;
+    }
+    if (r->finfo.valid & APR_FINFO_DEV) {
+        doc->device = r->finfo.device;
+    }
+    doc->segments = apr_array_make(pool, 16, sizeof(ssi_segment_t));
+    doc->cacheable = 1;
+
+    /* read a copy, the file bucket is still needed for the literals */
+    apr_pool_create(&ptemp, r->pool);
+    tmp_bb = apr_brigade_create(ptemp, r->connection->bucket_alloc);
+    apr_bucket_copy(b, &copy);
+    APR_BRIGADE_INSERT_TAIL(tmp_bb, copy);
+    rv = apr_brigade_pflatten(tmp_bb, &data, &len, ptemp);
+    apr_brigade_destroy(tmp_bb);
+    if (rv != APR_SUCCESS || len != b->length) {
+        apr_pool_destroy(ptemp);
+        apr_pool_destroy(pool);
+        return NULL;
+    }
+
+    ssi_doc_tokenize(ctx, doc, data, len);
+    apr_pool_destroy(ptemp);
+
+    ap_log_rerror(APLOG_MARK, APLOG_DEBUG, 0, r, APLOGNO(10302)
+                  "parsed document %s tokenized into %d parts%s",
+                  r->filename, doc->segments->nelts,
+                  doc->cacheable ? "" : " (not cached, parse errors)");
+    return doc;
+}
+
+static int ssi_doc_is_valid(ssi_doc_t *doc, request_rec *r)
+{
+    return doc->mtime == r->finfo.mtime
+           && doc->size == r->finfo.size
+           && (!(r->finfo.valid & APR_FINFO_INODE)
+               || doc->inode == r->finfo.inode)
+           && (!(r->finfo.valid & APR_FINFO_DEV)
+               || doc->device == r->finfo.device);
+}
+
+/*
+ * Get the tokenized document from the cache, or tokenize it, when the
+ * brigade is the whole file; NULL to parse the brigade as usual.
+ */
+static ssi_doc_t *ssi_cache_get(include_ctx_t *ctx, apr_bucket_brigade *bb)
+{
+    struct ssi_internal_ctx *intern = ctx->intern;
+    request_rec *r = ctx->r;
+    apr_bucket *b = APR_BRIGADE_FIRST(bb);
+    ssi_doc_t *doc, *old;
+    const char *key;
+
+    if (!ssi_cache
+        || r->finfo.filetype != APR_REG
+        || (r->finfo.valid & (APR_FINFO_MTIME | APR_FINFO_SIZE))
+               != (APR_FINFO_MTIME | APR_FINFO_SIZE)
+        || r->finfo.size <= 0 || r->finfo.size > SSI_CACHE_MAX_SIZE
+        || b == APR_BRIGADE_SENTINEL(bb) || !APR_BUCKET_IS_FILE(b)
+        || b->length != (apr_size_t)r->finfo.size
+        || APR_BUCKET_NEXT(b) != APR_BRIGADE_LAST(bb)
+        || !APR_BUCKET_IS_EOS(APR_BRIGADE_LAST(bb))) {
+        return NULL;
+    }
+
+    key = apr_pstrcat(r->pool, r->filename, "\n", intern->start_seq, "\n",
+                      intern->end_seq, NULL);
+
+#if APR_HAS_THREADS
+    apr_thread_mutex_lock(ssi_cache_mutex);
+#endif
+    doc = apr_hash_get(ssi_cache, key, APR_HASH_KEY_STRING);
+    if (doc && ssi_doc_is_valid(doc, r)) {
+        if (doc->cacheable) {
+            ++doc->refs;
+        }
+        else {
+            doc = NULL;
+        }
+#if APR_HAS_THREADS
+        apr_thread_mutex_unlock(ssi_cache_mutex);
+#endif
+        if (doc) {
+            apr_pool_cleanup_register(r->pool, doc, ssi_doc_release,
+                                      apr_pool_cleanup_null);
+        }
+        return doc;
+    }
+#if APR_HAS_THREADS
+    apr_thread_mutex_unlock(ssi_cache_mutex);
+#endif
+
+    doc = ssi_doc_create(ctx, b, key);
+    if (!doc) {
+        return NULL;
+    }
+
+    /* documents with parse errors are cached too, so that they are parsed
+     * (and the errors logged) by send_parsed_content() from now on.
+     */
+    doc->refs = 2;
+#if APR_HAS_THREADS
+    apr_thread_mutex_lock(ssi_cache_mutex);
+#endif
+    old = apr_hash_get(ssi_cache, doc->key, APR_HASH_KEY_STRING);
+    if (!old && apr_hash_count(ssi_cache) >= SSI_CACHE_MAX_DOCS) {
+        void *val;
+
+        apr_hash_this(apr_hash_first(NULL, ssi_cache), NULL, NULL, &val);
+        old = val;
+    }
+    if (old) {
+        apr_hash_set(ssi_cache, old->key, APR_HASH_KEY_STRING, NULL);
+        ssi_doc_unref(old);
+    }
+    apr_hash_set(ssi_cache, doc->key, APR_HASH_KEY_STRING, doc);
+#if APR_HAS_THREADS
+    apr_thread_mutex_unlock(ssi_cache_mutex);
+#endif
+
+    apr_pool_cleanup_register(r->pool, doc, ssi_doc_release,
+                              apr_pool_cleanup_null);
+    return doc;
+}
+
+/*
+ * The bucket which the literals are copied from: the whole file mapped
+ * once if mmap is enabled (rather than each literal mapped by its own file
+ * bucket), or the file bucket itself.
+ */
+static apr_bucket *cached_content_source(ap_filter_t *f, apr_bucket *b)
+{
+#if APR_HAS_MMAP
+    apr_bucket_file *a = b->data;
+    apr_mmap_t *mm;
+
+    if (a->can_mmap
+        && apr_mmap_create(&mm, a->fd, b->start, b->length, APR_MMAP_READ,
+                           f->r->pool) == APR_SUCCESS) {
+        return apr_bucket_mmap_create(mm, 0, b->length, f->c->bucket_alloc);
+    }
+#endif
+    return b;
+}
+
+/*
+ * Replay a tokenized document, as send_parsed_content() would have parsed
+ * and executed it.
+ */
+static apr_status_t send_cached_content(ap_filter_t *f, apr_bucket_brigade *bb)
+{
+    include_ctx_t *ctx = f->ctx;
+    struct ssi_internal_ctx *intern = ctx->intern;
+    ssi_doc_t *doc = intern->doc;
+    apr_bucket *b = APR_BRIGADE_FIRST(bb), *src, *e;
+    apr_bucket_brigade *pass_bb;
+    apr_status_t rv = APR_SUCCESS;
+    int i;
+
+    pass_bb = apr_brigade_create(ctx->pool, f->c->bucket_alloc);
+    src = cached_content_source(f, b);
+    intern->seen_eos = 1;
+
+    for (i = 0; i < doc->segments->nelts; ++i) {
+        ssi_segment_t *seg = &APR_ARRAY_IDX(doc->segments, i, ssi_segment_t);
+        arg_item_t *arg, **next;
+
+        if (!seg->directive) {
+            if (ctx->flags & SSI_FLAG_PRINTING) {
+                apr_bucket_copy(src, &e);
+                e->start += seg->offset;
+                e->length = seg->len;
+                APR_BRIGADE_INSERT_TAIL(pass_bb, e);
+            }
+            continue;
+        }
+
+        /* pass pre-tag stuff */
+        if (!APR_BRIGADE_EMPTY(pass_bb)) {
+            rv = ap_pass_brigade(f->next, pass_bb);
+            if (rv != APR_SUCCESS) {
+                break;
+            }
+        }
+
+        /* the handlers may modify the arguments (in place) */
+        intern->directive = apr_pstrmemdup(ctx->dpool, seg->directive,
+                                           seg->directive_len);
+        intern->directive_len = seg->directive_len;
+        ctx->argc = seg->argc;
+        for (next = &intern->argv, arg = seg->argv; arg; arg = arg->next) {
+            arg_item_t *copy = apr_pmemdup(ctx->dpool, arg, sizeof(*arg));
+
+            if (arg->name) {
+                copy->name = apr_pstrmemdup(ctx->dpool, arg->name,
+                                            arg->name_len);
+            }
+            if (arg->value) {
+                copy->value = apr_pstrmemdup(ctx->dpool, arg->value,
+                                             arg->value_len);
+            }
+            *next = copy;
+            next = &copy->next;
+        }
+        *next = NULL;
+        if (seg->error) {
+            intern->error = 1;
+        }
+        if (seg->expr && !intern->legacy_expr) {
+            intern->cached_expr = seg->expr;
+            intern->cached_expr_str = seg->argv->value;
+        }
+
+        rv = execute_directive(ctx, f, pass_bb);
+
+        intern->cached_expr = NULL;
+        apr_pool_clear(ctx->dpool);
+        if (rv != APR_SUCCESS) {
+            break;
+        }
+    }
+
+    if (src != b) {
+        apr_bucket_destroy(src);
+    }
+    apr_bucket_delete(b);
+    if (rv != APR_SUCCESS) {
+        apr_brigade_destroy(pass_bb);
+        return rv;
+    }
+
+    /* End of stream. Final cleanup */
+    end_of_document(ctx, f, pass_bb, doc->unfinished);
+
+    /* don't forget to finally insert the EOS bucket */
+    APR_BRIGADE_CONCAT(pass_bb, bb);
+
+    return ap_pass_brigade(f->next, pass_bb);
+}
+
 /*
  * This is the main loop over the current bucket brigade.
  */
@@ -3407,6 +4055,11 @@ static apr_status_t send_parsed_content(ap_filter_t *f, apr_bucket_brigade *bb)
         return ap_pass_brigade(f->next, bb);
     }
 
+    /* tokenized already */
+    if (intern->doc) {
+        return send_cached_content(f, bb);
+    }
+
     /* All stuff passed along has to be put into that brigade */
     pass_bb = apr_brigade_create(ctx->pool, f->c->bucket_alloc);
 
@@ -3698,38 +4351,10 @@ static apr_status_t send_parsed_content(ap_filter_t *f, apr_bucket_brigade *bb)
          * start again with PARSE_PRE_HEAD
          */
         case PARSE_EXECUTE:
-            /* if there was an error, it was already logged; just stop here */
-            if (intern->error) {
-                if (ctx->flags & SSI_FLAG_PRINTING) {
-                    SSI_CREATE_ERROR_BUCKET(ctx, f, pass_bb);
-                    intern->error = 0;
-                }
-            }
-            else {
-                include_handler_fn_t *handle_func;
-
-                handle_func =
-                    (include_handler_fn_t *)apr_hash_get(include_handlers, intern->directive,
-                                                         intern->directive_len);
-
-                if (handle_func) {
-                    DEBUG_INIT(ctx, f, pass_bb);
-                    rv = handle_func(ctx, f, pass_bb);
-                    if (rv != APR_SUCCESS) {
-                        apr_brigade_destroy(pass_bb);
-                        return rv;
-                    }
-                }
-                else {
-                    ap_log_rerror(APLOG_MARK, APLOG_ERR, 0, r, APLOGNO(01371)
-                                  "unknown directive \"%s\" in parsed doc %s",
-                                  apr_pstrmemdup(r->pool, intern->directive,
-                                                 intern->directive_len),
-                                                 r->filename);
-                    if (ctx->flags & SSI_FLAG_PRINTING) {
-                        SSI_CREATE_ERROR_BUCKET(ctx, f, pass_bb);
-                    }
-                }
+            rv = execute_directive(ctx, f, pass_bb);
+            if (rv != APR_SUCCESS) {
+                apr_brigade_destroy(pass_bb);
+                return rv;
             }
 
             /* cleanup */
@@ -3757,24 +4382,9 @@ static apr_status_t send_parsed_content(ap_filter_t *f, apr_bucket_brigade *bb)
                                         f->c->bucket_alloc));
             }
         }
-        else if (PARSE_PRE_HEAD != intern->state) {
-            ap_log_rerror(APLOG_MARK, APLOG_ERR, 0, r, APLOGNO(01372)
-                          "SSI directive was not properly finished at the end "
-                          "of parsed document %s", r->filename);
-            if (ctx->flags & SSI_FLAG_PRINTING) {
-                SSI_CREATE_ERROR_BUCKET(ctx, f, pass_bb);
-            }
-        }
-
-        if (!(ctx->flags & SSI_FLAG_PRINTING)) {
-            ap_log_rerror(APLOG_MARK, APLOG_WARNING, 0, r, APLOGNO(01373)
-                          "missing closing endif directive in parsed document"
-                          " %s", r->filename);
-        }
 
-        /* cleanup our temporary memory */
-        apr_brigade_destroy(intern->tmp_bb);
-        apr_pool_destroy(ctx->dpool);
+        end_of_document(ctx, f, pass_bb, PARSE_HEAD != intern->state &&
+                                         PARSE_PRE_HEAD != intern->state);
 
         /* don't forget to finally insert the EOS bucket */
         APR_BRIGADE_INSERT_TAIL(pass_bb, b);
@@ -3885,6 +4495,8 @@ static apr_status_t includes_filter(ap_filter_t *f, apr_bucket_brigade *b)
         intern->undefined_echo = conf->undefined_echo ? conf->undefined_echo :
                                  DEFAULT_UNDEFINED_ECHO;
         intern->undefined_echo_len = strlen(intern->undefined_echo);
+        intern->cached_expr = NULL;
+        intern->doc = (conf->cache > 0) ? ssi_cache_get(ctx, b) : NULL;
     }
 
     if ((parent = ap_get_module_config(r->request_config, &include_module))) {
@@ -4028,6 +4640,7 @@ static void *create_includes_dir_config(apr_pool_t *p, char *dummy)
     result->lastmodified      = UNSET;
     result->etag              = UNSET;
     result->legacy_expr       = UNSET;
+    result->cache             = UNSET;
 
     return result;
 }
@@ -4045,6 +4658,7 @@ static void *merge_includes_dir_config(apr_pool_t *p, void *basev, void *overrid
     MERGE(base, over, new, lastmodified,      UNSET);
     MERGE(base, over, new, etag,              UNSET);
     MERGE(base, over, new, legacy_expr,       UNSET);
+    MERGE(base, over, new, cache,             UNSET);
     return new;
 }
 
@@ -4180,6 +4794,26 @@ static int include_post_config(apr_pool_t *p, apr_pool_t *plog,
     return OK;
 }
 
+static void include_child_init(apr_pool_t *p, server_rec *s)
+{
+    apr_allocator_t *allocator;
+
+    /* the cache is only accessed with ssi_cache_mutex held */
+    if (apr_allocator_create(&allocator) != APR_SUCCESS) {
+        return;
+    }
+    apr_pool_create_ex(&ssi_cache_pool, p, NULL, allocator);
+    apr_allocator_owner_set(allocator, ssi_cache_pool);
+    apr_pool_tag(ssi_cache_pool, "includes_cache");
+#if APR_HAS_THREADS
+    if (apr_thread_mutex_create(&ssi_cache_mutex, APR_THREAD_MUTEX_DEFAULT,
+                                ssi_cache_pool) != APR_SUCCESS) {
+        return;
+    }
+#endif
+    ssi_cache = apr_hash_make(ssi_cache_pool);
+}
+
 static const command_rec includes_cmds[] =
 {
     AP_INIT_TAKE1("XBitHack", set_xbithack, NULL, OR_OPTIONS,
@@ -4207,6 +4841,10 @@ static const command_rec includes_cmds[] =
                   (void *)APR_OFFSETOF(include_dir_config, etag),
                   OR_LIMIT, "Whether to allow the generation of ETags within the server. "
                   "Existing ETags will be preserved. Limited to 'on' or 'off'"),
+    AP_INIT_FLAG("SSICache", ap_set_flag_slot_char,
+                  (void *)APR_OFFSETOF(include_dir_config, cache),
+                  OR_LIMIT, "Whether to cache the parsed documents. "
+                  "Limited to 'on' or 'off'"),
     {NULL}
 };
 
@@ -4221,6 +4859,7 @@ static void register_hooks(apr_pool_t *p)
     APR_REGISTER_OPTIONAL_FN(ap_ssi_parse_string);
     APR_REGISTER_OPTIONAL_FN(ap_register_include_handler);
     ap_hook_post_config(include_post_config, NULL, NULL, APR_HOOK_REALLY_FIRST);
+    ap_hook_child_init(include_child_init, NULL, NULL, APR_HOOK_MIDDLE);
     ap_hook_fixups(include_fixup, NULL, NULL, APR_HOOK_LAST);
     ap_register_output_filter("INCLUDES", includes_filter, includes_setup,
                               AP_FTYPE_RESOURCE);
@@ -65,6 +65,7 @@
 #include "scoreboard.h"
 #include "http_log.h"
 #include "mod_status.h"
+#include "ap_listen.h"
 #if APR_HAVE_UNISTD_H
 #include <unistd.h>
 #endif
@@ -642,6 +643,38 @@ static int status_handler(request_rec *r)
         }
     }
 
+    if (ap_num_listen_buckets > 1) {
+        int *bucket_procs = apr_pcalloc(r->pool,
+                                        ap_num_listen_buckets * sizeof(int));
+
+        for (i = 0; i < server_limit; ++i) {
+            ps_record = ap_get_scoreboard_process(i);
+            if (ps_record->pid && !ps_record->quiescing
+                    && ps_record->bucket >= 0
+                    && ps_record->bucket < ap_num_listen_buckets) {
+                bucket_procs[ps_record->bucket]++;
+            }
+        }
+        if (!short_report)
+            ap_rputs("\n\n<table rules=\"all\" cellpadding=\"1%\">\n"
+                     "<tr><th>Listeners bucket</th><th>CPUs</th>"
+                         "<th>Processes</th></tr>\n", r);
+        else
+            ap_rprintf(r, "ListenBuckets: %d\n", ap_num_listen_buckets);
+        for (i = 0; i < ap_num_listen_buckets; ++i) {
+            const char *cpus = ap_listen_bucket_cpus(r->pool, i);
+            if (!short_report)
+                ap_rprintf(r, "<tr><td>%d</td><td>%s</td><td>%d</td></tr>\n",
+                           i, cpus ? cpus : "any", bucket_procs[i]);
+            else
+                ap_rprintf(r, "ListenBucket%dCPUs: %s\n"
+                              "ListenBucket%dProcesses: %d\n",
+                           i, cpus ? cpus : "any", i, bucket_procs[i]);
+        }
+        if (!short_report)
+            ap_rputs("</table>\n", r);
+    }
+
     /* send the scoreboard 'table' out */
     if (!short_report)
         ap_rputs("<pre>", r);
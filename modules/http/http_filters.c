@@ -337,6 +337,13 @@ apr_status_t ap_http_filter(ap_filter_t *f, apr_bucket_brigade *b,
         tenc = apr_table_get(f->r->headers_in, "Transfer-Encoding");
         lenp = apr_table_get(f->r->headers_in, "Content-Length");
 
+        /* The protocol frames the body itself, read it until EOS
+         * (as BODY_NONE does for the proxied responses).
+         */
+        if (f->r->body_indeterminate) {
+            tenc = lenp = NULL;
+        }
+
         if (tenc) {
             if (ap_is_chunked(f->r->pool, tenc)) {
                 ctx->state = BODY_CHUNK;
@@ -401,7 +408,8 @@ apr_status_t ap_http_filter(ap_filter_t *f, apr_bucket_brigade *b,
          * Note that since the proxy uses this filter to handle the
          * proxied *response*, proxy responses MUST be exempt.
          */
-        if (ctx->state == BODY_NONE && f->r->proxyreq != PROXYREQ_RESPONSE) {
+        if (ctx->state == BODY_NONE && f->r->proxyreq != PROXYREQ_RESPONSE
+                && !f->r->body_indeterminate) {
             e = apr_bucket_eos_create(f->c->bucket_alloc);
             APR_BRIGADE_INSERT_TAIL(b, e);
             ctx->eos_sent = 1;
@@ -409,9 +417,11 @@ apr_status_t ap_http_filter(ap_filter_t *f, apr_bucket_brigade *b,
         }
 
         /* Since we're about to read data, send 100-Continue if needed.
-         * Only valid on chunked and C-L bodies where the C-L is > 0. */
+         * Only valid on chunked, indeterminate and C-L bodies where the
+         * C-L is > 0. */
         if ((ctx->state == BODY_CHUNK
-                || (ctx->state == BODY_LENGTH && ctx->remaining > 0))
+                || (ctx->state == BODY_LENGTH && ctx->remaining > 0)
+                || (ctx->state == BODY_NONE && f->r->body_indeterminate))
                 && f->r->expecting_100 && f->r->proto_num >= HTTP_VERSION(1,1)
                 && !(f->r->eos_sent || f->r->bytes_sent)) {
             if (!ap_is_HTTP_SUCCESS(f->r->status)) {
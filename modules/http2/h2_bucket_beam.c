@@ -269,24 +269,61 @@ static void report_prod_io(h2_bucket_beam *beam, int force, h2_beam_lock *pbl)
     }
 }
 
-static apr_size_t calc_buffered(h2_bucket_beam *beam)
+/* The memory footprint of a bucket in the send_list */
+static apr_size_t bucket_buffered(apr_bucket *b)
 {
-    apr_size_t len = 0;
-    apr_bucket *b;
-    for (b = H2_BLIST_FIRST(&beam->send_list); 
-         b != H2_BLIST_SENTINEL(&beam->send_list);
-         b = APR_BUCKET_NEXT(b)) {
-        if (b->length == ((apr_size_t)-1)) {
-            /* do not count */
-        }
-        else if (APR_BUCKET_IS_FILE(b)) {
-            /* if unread, has no real mem footprint. */
-        }
-        else {
-            len += b->length;
-        }
+    if (b->length == ((apr_size_t)-1)) {
+        /* do not count */
+        return 0;
+    }
+    else if (APR_BUCKET_IS_FILE(b)) {
+        /* if unread, has no real mem footprint. */
+        return 0;
     }
-    return len;
+    return b->length;
+}
+
+static void send_list_append(h2_bucket_beam *beam, apr_bucket *b)
+{
+    H2_BLIST_INSERT_TAIL(&beam->send_list, b);
+    beam->send_mem += bucket_buffered(b);
+}
+
+static void send_list_remove(h2_bucket_beam *beam, apr_bucket *b)
+{
+    beam->send_mem -= bucket_buffered(b);
+    APR_BUCKET_REMOVE(b);
+}
+
+static void send_list_cleanup(h2_bucket_beam *beam)
+{
+    while (!H2_BLIST_EMPTY(&beam->send_list)) {
+        apr_bucket_delete(H2_BLIST_FIRST(&beam->send_list));
+    }
+    beam->send_mem = 0;
+}
+
+/* Wake up the other side, if it waits for it */
+static void notify_change(h2_bucket_beam *beam)
+{
+    if (beam->waiters) {
+        apr_thread_cond_broadcast(beam->change);
+    }
+}
+
+static apr_status_t wait_change(h2_bucket_beam *beam, apr_thread_mutex_t *lock)
+{
+    apr_status_t rv;
+
+    ++beam->waiters;
+    if (beam->timeout > 0) {
+        rv = apr_thread_cond_timedwait(beam->change, lock, beam->timeout);
+    }
+    else {
+        rv = apr_thread_cond_wait(beam->change, lock);
+    }
+    --beam->waiters;
+    return rv;
 }
 
 static void r_purge_sent(h2_bucket_beam *beam)
@@ -303,7 +340,7 @@ static void r_purge_sent(h2_bucket_beam *beam)
 static apr_size_t calc_space_left(h2_bucket_beam *beam)
 {
     if (beam->max_buf_size > 0) {
-        apr_size_t len = calc_buffered(beam);
+        apr_size_t len = beam->send_mem;
         return (beam->max_buf_size > len? (beam->max_buf_size - len) : 0);
     }
     return APR_SIZE_MAX;
@@ -324,11 +361,8 @@ static apr_status_t wait_empty(h2_bucket_beam *beam, apr_read_type_e block,
         if (APR_BLOCK_READ != block || !lock) {
             rv = APR_EAGAIN;
         }
-        else if (beam->timeout > 0) {
-            rv = apr_thread_cond_timedwait(beam->change, lock, beam->timeout);
-        }
         else {
-            rv = apr_thread_cond_wait(beam->change, lock);
+            rv = wait_change(beam, lock);
         }
     }
     return rv;
@@ -349,11 +383,8 @@ static apr_status_t wait_not_empty(h2_bucket_beam *beam, apr_read_type_e block,
         else if (APR_BLOCK_READ != block || !lock) {
             rv = APR_EAGAIN;
         }
-        else if (beam->timeout > 0) {
-            rv = apr_thread_cond_timedwait(beam->change, lock, beam->timeout);
-        }
         else {
-            rv = apr_thread_cond_wait(beam->change, lock);
+            rv = wait_change(beam, lock);
         }
     }
     return rv;
@@ -373,12 +404,7 @@ static apr_status_t wait_not_full(h2_bucket_beam *beam, apr_read_type_e block,
             rv = APR_EAGAIN;
         }
         else {
-            if (beam->timeout > 0) {
-                rv = apr_thread_cond_timedwait(beam->change, bl->mutex, beam->timeout);
-            }
-            else {
-                rv = apr_thread_cond_wait(beam->change, bl->mutex);
-            }
+            rv = wait_change(beam, bl->mutex);
         }
     }
     *pspace_left = left;
@@ -446,7 +472,7 @@ static void h2_beam_emitted(h2_bucket_beam *beam, h2_beam_proxy *proxy)
             r_purge_sent(beam);
         }
         else {
-            apr_thread_cond_broadcast(beam->change);
+            notify_change(beam);
         }
         leave_yellow(beam, &bl);
     }
@@ -466,7 +492,7 @@ static apr_status_t beam_close(h2_bucket_beam *beam)
 {
     if (!beam->closed) {
         beam->closed = 1;
-        apr_thread_cond_broadcast(beam->change);
+        notify_change(beam);
     }
     return APR_SUCCESS;
 }
@@ -509,7 +535,7 @@ static apr_status_t beam_send_cleanup(void *data)
     h2_bucket_beam *beam = data;
     /* sender is going away, clear up all references to its memory */
     r_purge_sent(beam);
-    h2_blist_cleanup(&beam->send_list);
+    send_list_cleanup(beam);
     report_consumption(beam, NULL);
     while (!H2_BPROXY_LIST_EMPTY(&beam->proxies)) {
         h2_beam_proxy *proxy = H2_BPROXY_LIST_FIRST(&beam->proxies);
@@ -551,7 +577,7 @@ static void recv_buffer_cleanup(h2_bucket_beam *beam, h2_beam_lock *bl)
         apr_brigade_destroy(bb);
         if (bl) enter_yellow(beam, bl);
         
-        apr_thread_cond_broadcast(beam->change);
+        notify_change(beam);
         if (beam->cons_ev_cb) { 
             beam->cons_ev_cb(beam->cons_ctx, beam);
         }
@@ -711,9 +737,9 @@ void h2_beam_abort(h2_bucket_beam *beam)
     if (beam && enter_yellow(beam, &bl) == APR_SUCCESS) {
         beam->aborted = 1;
         r_purge_sent(beam);
-        h2_blist_cleanup(&beam->send_list);
+        send_list_cleanup(beam);
         report_consumption(beam, &bl);
-        apr_thread_cond_broadcast(beam->change);
+        notify_change(beam);
         leave_yellow(beam, &bl);
     }
 }
@@ -763,7 +789,7 @@ static void move_to_hold(h2_bucket_beam *beam,
     while (sender_bb && !APR_BRIGADE_EMPTY(sender_bb)) {
         b = APR_BRIGADE_FIRST(sender_bb);
         APR_BUCKET_REMOVE(b);
-        H2_BLIST_INSERT_TAIL(&beam->send_list, b);
+        send_list_append(beam, b);
     }
 }
 
@@ -789,7 +815,7 @@ static apr_status_t append_bucket(h2_bucket_beam *beam,
             beam->closed = 1;
         }
         APR_BUCKET_REMOVE(b);
-        H2_BLIST_INSERT_TAIL(&beam->send_list, b);
+        send_list_append(beam, b);
         return APR_SUCCESS;
     }
     else if (APR_BUCKET_IS_FILE(b)) {
@@ -884,7 +910,7 @@ static apr_status_t append_bucket(h2_bucket_beam *beam,
     }
     
     APR_BUCKET_REMOVE(b);
-    H2_BLIST_INSERT_TAIL(&beam->send_list, b);
+    send_list_append(beam, b);
     beam->sent_bytes += b->length;
 
     return APR_SUCCESS;
@@ -937,7 +963,7 @@ apr_status_t h2_beam_send(h2_bucket_beam *beam,
             }
             
             report_prod_io(beam, force_report, &bl);
-            apr_thread_cond_broadcast(beam->change);
+            notify_change(beam);
         }
         report_consumption(beam, &bl);
         leave_yellow(beam, &bl);
@@ -1011,7 +1037,7 @@ transfer:
                 }
             }
             else if (bsender->length == 0) {
-                APR_BUCKET_REMOVE(bsender);
+                send_list_remove(beam, bsender);
                 H2_BLIST_INSERT_TAIL(&beam->hold_list, bsender);
                 continue;
             }
@@ -1038,9 +1064,12 @@ transfer:
                  * been handed out. See also PR 59348 */
                 apr_bucket_file_enable_mmap(ng, 0);
 #endif
-                APR_BUCKET_REMOVE(bsender);
-                H2_BLIST_INSERT_TAIL(&beam->hold_list, bsender);
+                /* The file is handed over, no receiver bucket refers to
+                 * the sender one which can go with the next purge. */
+                send_list_remove(beam, bsender);
+                H2_BLIST_INSERT_TAIL(&beam->purge_list, bsender);
 
+                beam->received_bytes += bsender->length;
                 remain -= bsender->length;
                 ++transferred;
                 ++transferred_buckets;
@@ -1058,7 +1087,7 @@ transfer:
             
             /* Place the sender bucket into our hold, to be destroyed when no
              * receiver bucket references it any more. */
-            APR_BUCKET_REMOVE(bsender);
+            send_list_remove(beam, bsender);
             H2_BLIST_INSERT_TAIL(&beam->hold_list, bsender);
             
             beam->received_bytes += bsender->length;
@@ -1119,7 +1148,7 @@ transfer:
         }
         
         if (transferred) {
-            apr_thread_cond_broadcast(beam->change);
+            notify_change(beam);
             status = APR_SUCCESS;
         }
         else {
@@ -88,7 +88,8 @@ typedef struct {
  *   - transient buckets are converted to heap ones on send
  *   - heap and pool buckets require no extra handling
  *   - buckets with indeterminate length are read on send
- *   - file buckets will transfer the file itself into a new bucket, if allowed
+ *   - file buckets will transfer the file itself into a new bucket, if allowed,
+ *     the sender bucket is then purged without waiting for the receiver
  *   - all other buckets are read on send to make sure data is present
  *
  * This assures that when the sender thread sends its sender buckets, the data
@@ -174,6 +175,7 @@ struct h2_bucket_beam {
     apr_pool_t *recv_pool;
     
     apr_size_t max_buf_size;
+    apr_size_t send_mem;      /* memory footprint of the send_list */
     apr_interval_time_t timeout;
 
     apr_off_t sent_bytes;     /* amount of bytes send */
@@ -189,6 +191,7 @@ struct h2_bucket_beam {
 
     struct apr_thread_mutex_t *lock;
     struct apr_thread_cond_t *change;
+    int waiters;              /* # of threads waiting for a change */
     
     apr_off_t cons_bytes_reported;    /* amount of bytes reported as consumed */
     h2_beam_ev_callback *cons_ev_cb;
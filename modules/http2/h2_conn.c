@@ -108,12 +108,16 @@ static void check_modules(int force)
     }
 }
 
+/* Default number of h2 threads kept with H2MpmWorkers */
+#define H2_MPM_RESERVE_WORKERS  2
+
 apr_status_t h2_conn_child_init(apr_pool_t *pool, server_rec *s)
 {
     apr_status_t status = APR_SUCCESS;
     int minw, maxw;
     int max_threads_per_child = 0;
     int idle_secs = 0;
+    int use_mpm, can_dispatch = 0;
 
     check_modules(1);
     ap_mpm_query(AP_MPMQ_MAX_THREADS, &max_threads_per_child);
@@ -129,11 +133,46 @@ apr_status_t h2_conn_child_init(apr_pool_t *pool, server_rec *s)
     
     h2_get_num_workers(s, &minw, &maxw);
     
+    use_mpm = h2_config_sgeti(s, H2_CONF_MPM_WORKERS) > 0;
+    if (use_mpm) {
+#ifdef AP_MPMQ_CAN_DISPATCH
+        if (ap_mpm_query(AP_MPMQ_CAN_DISPATCH, &can_dispatch) != APR_SUCCESS) {
+            can_dispatch = 0;
+        }
+#endif
+        if (!can_dispatch) {
+            ap_log_error(APLOG_MARK, APLOG_WARNING, 0, s, APLOGNO(10303)
+                         "H2MpmWorkers: the %s MPM can not run tasks on its "
+                         "workers, using own h2 worker threads",
+                         h2_conn_mpm_name());
+            use_mpm = 0;
+        }
+        else {
+            if (h2_config_sgeti(s, H2_CONF_MAX_WORKERS) <= 0) {
+                /* Leave room for the connections themselves, including the
+                 * HTTP/2 ones waiting for their streams */
+                maxw = max_threads_per_child / 2;
+                if (maxw < 1) {
+                    maxw = 1;
+                }
+            }
+            /* Our own threads are only a reserve for when the MPM workers
+             * are all taken (or stopping), H2MinWorkers of them */
+            if (h2_config_sgeti(s, H2_CONF_MIN_WORKERS) <= 0) {
+                minw = H2_MPM_RESERVE_WORKERS;
+            }
+            if (minw > maxw) {
+                minw = maxw;
+            }
+        }
+    }
+
     idle_secs = h2_config_sgeti(s, H2_CONF_MAX_WORKER_IDLE_SECS);
     ap_log_error(APLOG_MARK, APLOG_TRACE3, 0, s,
-                 "h2_workers: min=%d max=%d, mthrpchild=%d, idle_secs=%d", 
-                 minw, maxw, max_threads_per_child, idle_secs);
-    workers = h2_workers_create(s, pool, minw, maxw, idle_secs);
+                 "h2_workers: min=%d max=%d, mthrpchild=%d, idle_secs=%d, "
+                 "mpm=%d", minw, maxw, max_threads_per_child, idle_secs,
+                 use_mpm);
+    workers = h2_workers_create(s, pool, minw, maxw, idle_secs, use_mpm);
  
     ap_register_input_filter("H2_IN", h2_filter_core_input,
                              NULL, AP_FTYPE_CONNECTION);
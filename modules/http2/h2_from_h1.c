@@ -164,7 +164,10 @@ static int copy_header(void *ctx, const char *name, const char *value)
 {
     apr_table_t *headers = ctx;
     
-    apr_table_add(headers, name, value);
+    /* connection specific fields are never sent in HTTP/2 */
+    if (!h2_util_ignore_header(name)) {
+        apr_table_add(headers, name, value);
+    }
     return 1;
 }
 
@@ -206,18 +209,18 @@ static h2_headers *create_response(h2_task *task, request_rec *r)
         apr_table_unset(r->headers_out, "ETag");
     }
     
-    /* determine the protocol and whether we should use keepalives. */
-    ap_set_keepalive(r);
-    
+    /* The response goes into the HEADERS and DATA frames of the stream
+     * as is: there is no keepalive to determine (ap_set_keepalive()) and
+     * no body to chunk, the stream ends with the response.
+     */
     if (AP_STATUS_IS_HEADER_ONLY(r->status)) {
-        apr_table_unset(r->headers_out, "Transfer-Encoding");
         apr_table_unset(r->headers_out, "Content-Length");
         r->content_type = r->content_encoding = NULL;
         r->content_languages = NULL;
         r->clength = r->chunked = 0;
     }
     else if (r->chunked) {
-        apr_table_mergen(r->headers_out, "Transfer-Encoding", "chunked");
+        /* length unknown to the handler */
         apr_table_unset(r->headers_out, "Content-Length");
     }
 
@@ -763,7 +766,11 @@ apr_status_t h2_filter_request_in(ap_filter_t* f,
 
     ap_log_rerror(APLOG_MARK, APLOG_TRACE2, 0, f->r,
                   "h2_task(%s): request filter, exp=%d", task->id, r->expecting_100);
+#if AP_MODULE_MAGIC_AT_LEAST(20200420, 12)
+    if (!task->request->chunked || r->body_indeterminate) {
+#else
     if (!task->request->chunked) {
+#endif
         status = ap_get_brigade(f->next, bb, mode, block, readbytes);
         /* pipe data through, just take care of trailers */
         for (b = APR_BRIGADE_FIRST(bb); 
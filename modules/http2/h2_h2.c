@@ -686,8 +686,9 @@ static void check_push(request_rec *r, const char *tag)
     apr_array_header_t *push_list = h2_config_push_list(r);
 
     if (!r->expecting_100 && push_list && push_list->nelts > 0) {
-        int i, old_status;
-        const char *old_line;
+        apr_bucket_brigade *bb;
+        h2_headers *headers;
+        int i;
         
         ap_log_rerror(APLOG_MARK, APLOG_TRACE1, 0, r, 
                       "%s, early announcing %d resources for push",
@@ -698,13 +699,17 @@ static void check_push(request_rec *r, const char *tag)
                            apr_psprintf(r->pool, "<%s>; rel=preload%s", 
                                         push->uri_ref, push->critical? "; critical" : ""));
         }
-        old_status = r->status;
-        old_line = r->status_line;
-        r->status = 103;
-        r->status_line = "103 Early Hints";
-        ap_send_interim_response(r, 1);
-        r->status = old_status;
-        r->status_line = old_line;
+        /* like ap_send_interim_response(r, 1), without the HTTP/1.1
+         * serialization that H2_PARSE_H1 would have to parse again */
+        headers = h2_headers_rcreate(r, 103, r->headers_out, r->pool);
+        apr_table_clear(r->headers_out);
+        bb = apr_brigade_create(r->pool, r->connection->bucket_alloc);
+        APR_BRIGADE_INSERT_TAIL(bb, h2_bucket_headers_create(
+                                    r->connection->bucket_alloc, headers));
+        APR_BRIGADE_INSERT_TAIL(bb, apr_bucket_flush_create(
+                                    r->connection->bucket_alloc));
+        ap_pass_brigade(r->connection->output_filters, bb);
+        apr_brigade_destroy(bb);
     }
 }
 
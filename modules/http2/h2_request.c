@@ -281,6 +281,11 @@ request_rec *h2_request_create_rec(const h2_request *req, conn_rec *c)
     r->the_request = apr_psprintf(r->pool, "%s %s HTTP/2.0", 
                                   req->method, req->path ? req->path : "");
     r->headers_in = apr_table_clone(r->pool, req->headers);
+#if AP_MODULE_MAGIC_AT_LEAST(20200420, 12)
+    /* The Transfer-Encoding "chunked" tells the modules that there is a
+     * body, the HTTP_IN filter reads it as it comes, without chunks. */
+    r->body_indeterminate = req->chunked;
+#endif
 
     /* Start with r->hostname = NULL, ap_check_request_header() will get it
      * form Host: header, otherwise we get complains about port numbers.
@@ -109,14 +109,36 @@ static void cleanup_unprocessed_streams(h2_session *session)
     h2_mplx_stream_do(session->mplx, rst_unprocessed_stream, session);
 }
 
+/* Number of cleared stream pools a session keeps for new streams */
+#define H2_SPARE_STREAM_POOLS   16
+
+void h2_session_stream_pool_release(h2_session *session, apr_pool_t *pool)
+{
+    if (session->spare_pools->nelts < H2_SPARE_STREAM_POOLS) {
+        apr_pool_clear(pool);
+        APR_ARRAY_PUSH(session->spare_pools, apr_pool_t*) = pool;
+    }
+    else {
+        apr_pool_destroy(pool);
+    }
+}
+
 static h2_stream *h2_session_open_stream(h2_session *session, int stream_id,
                                          int initiated_on)
 {
     h2_stream * stream;
-    apr_pool_t *stream_pool;
+    apr_pool_t *stream_pool, **pspare;
     
-    apr_pool_create(&stream_pool, session->pool);
-    apr_pool_tag(stream_pool, "h2_stream");
+    /* streams come and go by the hundreds on busy connections, reuse the
+     * pools of the ones gone instead of creating a new one each time */
+    pspare = (apr_pool_t **)apr_array_pop(session->spare_pools);
+    if (pspare) {
+        stream_pool = *pspare;
+    }
+    else {
+        apr_pool_create(&stream_pool, session->pool);
+        apr_pool_tag(stream_pool, "h2_stream");
+    }
     
     stream = h2_stream_create(stream_id, stream_pool, session, 
                               session->monitor, initiated_on);
@@ -883,6 +905,9 @@ apr_status_t h2_session_create(h2_session **psession, conn_rec *c, request_rec *
         return APR_ENOMEM;
     }
     
+    session->spare_pools = apr_array_make(session->pool, H2_SPARE_STREAM_POOLS,
+                                          sizeof(apr_pool_t*));
+    
     session->monitor = apr_pcalloc(pool, sizeof(h2_stream_monitor));
     if (session->monitor == NULL) {
         apr_pool_destroy(pool);
@@ -133,6 +133,7 @@ typedef struct h2_session {
     
     struct h2_iqueue *in_pending;   /* all streams with input pending */
     struct h2_iqueue *in_process;   /* all streams ready for processing on slave */
+    apr_array_header_t *spare_pools;/* cleared pools of destroyed streams */
 
 } h2_session;
 
@@ -181,6 +182,14 @@ void h2_session_abort(h2_session *session, apr_status_t reason);
  */
 void h2_session_close(h2_session *session);
 
+/**
+ * Take back the pool of a destroyed stream. The pool is kept for a new
+ * stream, cleared, or destroyed when the session has enough spare ones.
+ * @param session the session the stream belonged to
+ * @param pool the pool of the stream
+ */
+void h2_session_stream_pool_release(h2_session *session, apr_pool_t *pool);
+
 /**
  * Returns if client settings have push enabled.
  * @param != 0 iff push is enabled in client settings
@@ -573,7 +573,7 @@ void h2_stream_destroy(h2_stream *stream)
     ap_assert(stream);
     ap_log_cerror(APLOG_MARK, APLOG_TRACE3, 0, stream->session->c, 
                   H2_STRM_MSG(stream, "destroy"));
-    apr_pool_destroy(stream->pool);
+    h2_session_stream_pool_release(stream->session, stream->pool);
 }
 
 apr_status_t h2_stream_prep_processing(h2_stream *stream)
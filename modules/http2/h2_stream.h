@@ -127,7 +127,7 @@ h2_stream *h2_stream_create(int id, apr_pool_t *pool,
                             int initiated_on);
 
 /**
- * Destroy memory pool if still owned by the stream.
+ * Destroy the stream, its memory pool is given back to the session.
  */
 void h2_stream_destroy(h2_stream *stream);
 
@@ -48,6 +48,9 @@
 #include "h2_task.h"
 #include "h2_util.h"
 
+/* pool userdata of a slave connection holding a spare task pool */
+#define H2_TASK_POOL_KEY   "h2_task_pool"
+
 static void H2_TASK_OUT_LOG(int lvl, h2_task *task, apr_bucket_brigade *bb, 
                             const char *tag)
 {
@@ -377,6 +380,18 @@ static apr_status_t h2_filter_parse_h1(ap_filter_t* f, apr_bucket_brigade* bb)
     apr_status_t status;
     
     ap_assert(task);
+    /* Responses in h2_headers buckets (H2_RESPONSE filter, interim
+     * responses of mod_http2) need no parsing. */
+    if (bb && !task->output.sent_response && !APR_BRIGADE_EMPTY(bb)
+        && H2_BUCKET_IS_HEADERS(APR_BRIGADE_FIRST(bb))) {
+        h2_headers *headers = h2_bucket_headers_get(APR_BRIGADE_FIRST(bb));
+        
+        if (headers->status >= 200) {
+            task->output.sent_response = 1;
+        }
+        return ap_pass_brigade(f->next, bb);
+    }
+    
     /* There are cases where we need to parse a serialized http/1.1 
      * response. One example is a 100-continue answer in serialized mode
      * or via a mod_proxy setup */
@@ -512,8 +527,15 @@ h2_task *h2_task_create(conn_rec *slave, int stream_id,
     ap_assert(slave);
     ap_assert(req);
 
-    apr_pool_create(&pool, slave->pool);
-    apr_pool_tag(pool, "h2_task");
+    /* a reused slave keeps the cleared pool of its previous task */
+    apr_pool_userdata_get((void **)&pool, H2_TASK_POOL_KEY, slave->pool);
+    if (pool) {
+        apr_pool_userdata_setn(NULL, H2_TASK_POOL_KEY, NULL, slave->pool);
+    }
+    else {
+        apr_pool_create(&pool, slave->pool);
+        apr_pool_tag(pool, "h2_task");
+    }
     task = apr_pcalloc(pool, sizeof(h2_task));
     if (task == NULL) {
         return NULL;
@@ -543,7 +565,12 @@ void h2_task_destroy(h2_task *task)
         apr_bucket_destroy(task->eor);
     }
     if (task->pool) {
-        apr_pool_destroy(task->pool);
+        /* goes with the slave, when that is not reused */
+        apr_pool_t *pool = task->pool;
+        conn_rec *slave = task->c;
+        
+        apr_pool_clear(pool);
+        apr_pool_userdata_setn(pool, H2_TASK_POOL_KEY, NULL, slave->pool);
     }
 }
 
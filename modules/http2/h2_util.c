@@ -230,79 +230,160 @@ const char *h2_util_base64url_encode(const char *data,
 /*******************************************************************************
  * ihash - hash for structs with int identifier
  ******************************************************************************/
+/* Open addressing with linear probing over a power of 2 number of slots,
+ * a NULL val marks an empty slot. Stream ids are all odd (or all even), so
+ * the slot is taken from the high bits of a multiplicative (Fibonacci)
+ * hash of the id. Removals shift the following entries back into place,
+ * so that lookups never need to look past the first empty slot.
+ */
+typedef struct {
+    int id;
+    void *val;
+} ihash_entry;
+
 struct h2_ihash_t {
-    apr_hash_t *hash;
+    apr_pool_t *pool;
+    ihash_entry *slots;
+    size_t count;
+    unsigned int mask;
+    unsigned int shift;
     size_t ioff;
 };
 
-static unsigned int ihash(const char *key, apr_ssize_t *klen)
+#define IHASH_MIN_SLOTS     16
+
+#define IHASH_ID(ih, val)   (*((int*)((char *)(val) + (ih)->ioff)))
+
+static APR_INLINE unsigned int ihash_slot(h2_ihash_t *ih, int id)
 {
-    return (unsigned int)(*((int*)key));
+    return (unsigned int)(((apr_uint32_t)id * 0x9e3779b1U) >> ih->shift);
+}
+
+static void ihash_alloc(h2_ihash_t *ih, unsigned int nslots)
+{
+    ih->slots = apr_pcalloc(ih->pool, nslots * sizeof(ihash_entry));
+    ih->mask = nslots - 1;
+    ih->shift = 32 - h2_log2((int)nslots);
+}
+
+static void ihash_put(h2_ihash_t *ih, int id, void *val)
+{
+    unsigned int i = ihash_slot(ih, id);
+    
+    while (ih->slots[i].val && ih->slots[i].id != id) {
+        i = (i + 1) & ih->mask;
+    }
+    if (!ih->slots[i].val) {
+        ++ih->count;
+        ih->slots[i].id = id;
+    }
+    ih->slots[i].val = val;
+}
+
+static void ihash_grow(h2_ihash_t *ih)
+{
+    ihash_entry *old = ih->slots;
+    unsigned int i, nold = ih->mask + 1;
+    
+    /* the old slots stay in the pool, as apr_hash does when it expands */
+    ihash_alloc(ih, nold * 2);
+    ih->count = 0;
+    for (i = 0; i < nold; ++i) {
+        if (old[i].val) {
+            ihash_put(ih, old[i].id, old[i].val);
+        }
+    }
 }
 
 h2_ihash_t *h2_ihash_create(apr_pool_t *pool, size_t offset_of_int)
 {
     h2_ihash_t *ih = apr_pcalloc(pool, sizeof(h2_ihash_t));
-    ih->hash = apr_hash_make_custom(pool, ihash);
+    ih->pool = pool;
     ih->ioff = offset_of_int;
+    ihash_alloc(ih, IHASH_MIN_SLOTS);
     return ih;
 }
 
 size_t h2_ihash_count(h2_ihash_t *ih)
 {
-    return apr_hash_count(ih->hash);
+    return ih->count;
 }
 
 int h2_ihash_empty(h2_ihash_t *ih)
 {
-    return apr_hash_count(ih->hash) == 0;
+    return ih->count == 0;
 }
 
 void *h2_ihash_get(h2_ihash_t *ih, int id)
 {
-    return apr_hash_get(ih->hash, &id, sizeof(id));
-}
-
-typedef struct {
-    h2_ihash_iter_t *iter;
-    void *ctx;
-} iter_ctx;
-
-static int ihash_iter(void *ctx, const void *key, apr_ssize_t klen, 
-                     const void *val)
-{
-    iter_ctx *ictx = ctx;
-    return ictx->iter(ictx->ctx, (void*)val); /* why is this passed const?*/
+    unsigned int i = ihash_slot(ih, id);
+    
+    while (ih->slots[i].val) {
+        if (ih->slots[i].id == id) {
+            return ih->slots[i].val;
+        }
+        i = (i + 1) & ih->mask;
+    }
+    return NULL;
 }
 
 int h2_ihash_iter(h2_ihash_t *ih, h2_ihash_iter_t *fn, void *ctx)
 {
-    iter_ctx ictx;
-    ictx.iter = fn;
-    ictx.ctx = ctx;
-    return apr_hash_do(ihash_iter, &ictx, ih->hash);
+    unsigned int i;
+    
+    for (i = 0; i <= ih->mask; ++i) {
+        if (ih->slots[i].val && !fn(ctx, ih->slots[i].val)) {
+            return 0;
+        }
+    }
+    return 1;
 }
 
 void h2_ihash_add(h2_ihash_t *ih, void *val)
 {
-    apr_hash_set(ih->hash, ((char *)val + ih->ioff), sizeof(int), val);
+    if ((ih->count + 1) * 4 > (size_t)(ih->mask + 1) * 3) {
+        ihash_grow(ih);
+    }
+    ihash_put(ih, IHASH_ID(ih, val), val);
 }
 
 void h2_ihash_remove(h2_ihash_t *ih, int id)
 {
-    apr_hash_set(ih->hash, &id, sizeof(id), NULL);
+    unsigned int i = ihash_slot(ih, id), j, k;
+    
+    while (ih->slots[i].val && ih->slots[i].id != id) {
+        i = (i + 1) & ih->mask;
+    }
+    if (!ih->slots[i].val) {
+        return;
+    }
+    --ih->count;
+    /* shift back the entries of the cluster that would not be found
+     * any more with slot i empty */
+    for (j = i;;) {
+        ih->slots[i].val = NULL;
+        do {
+            j = (j + 1) & ih->mask;
+            if (!ih->slots[j].val) {
+                return;
+            }
+            k = ihash_slot(ih, ih->slots[j].id);
+        } while ((i <= j)? (i < k && k <= j) : (i < k || k <= j));
+        ih->slots[i] = ih->slots[j];
+        i = j;
+    }
 }
 
 void h2_ihash_remove_val(h2_ihash_t *ih, void *val)
 {
-    int id = *((int*)((char *)val + ih->ioff));
-    apr_hash_set(ih->hash, &id, sizeof(id), NULL);
+    h2_ihash_remove(ih, IHASH_ID(ih, val));
 }
 
 
 void h2_ihash_clear(h2_ihash_t *ih)
 {
-    apr_hash_clear(ih->hash);
+    memset(ih->slots, 0, (ih->mask + 1) * sizeof(ihash_entry));
+    ih->count = 0;
 }
 
 typedef struct {
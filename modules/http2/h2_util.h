@@ -55,7 +55,8 @@ void *h2_ihash_get(h2_ihash_t *ih, int id);
 
 /**
  * Iterate over the hash members (without defined order) and invoke
- * fn for each member until 0 is returned.
+ * fn for each member until 0 is returned. The hash may only be modified
+ * by an invocation that returns 0.
  * @param ih the hash to iterate over
  * @param fn the function to invoke on each member
  * @param ctx user supplied data passed into each iteration call
@@ -19,6 +19,7 @@
 #include <apr_thread_mutex.h>
 #include <apr_thread_cond.h>
 
+#include <ap_mpm.h>
 #include <mpm_common.h>
 #include <httpd.h>
 #include <http_core.h>
@@ -72,6 +73,50 @@ static void push_slot(h2_slot **phead, h2_slot *slot)
 }
 
 static void* APR_THREAD_FUNC slot_run(apr_thread_t *thread, void *wctx);
+static void* APR_THREAD_FUNC reserve_run(apr_thread_t *thread, void *wctx);
+static void mpm_slot_run(apr_thread_t *thread, void *baton);
+
+/* How long the reserve threads let the MPM workers pick up the tasks */
+#define H2_MPM_STALL_TIMEOUT    apr_time_from_msec(100)
+
+static void wake_reserve(h2_workers *workers)
+{
+    apr_thread_mutex_lock(workers->lock);
+    apr_thread_cond_broadcast(workers->reserve_wait);
+    apr_thread_mutex_unlock(workers->lock);
+}
+
+/* Get a free slot to the MPM workers queue, this fails when max_workers
+ * tasks are already running there (the slot freed next will come back).
+ * Once the MPM refuses the slots (e.g. its workers are stopping), the
+ * reserve threads take over.
+ */
+static apr_status_t dispatch_slot(h2_workers *workers)
+{
+    apr_status_t rv;
+    h2_slot *slot;
+
+    if (workers->aborted) {
+        return APR_EOF;
+    }
+    slot = pop_slot(&workers->free);
+    if (!slot) {
+        return APR_EAGAIN;
+    }
+    slot->workers = workers;
+    slot->task = NULL;
+#if AP_MODULE_MAGIC_AT_LEAST(20200420, 13)
+    rv = ap_mpm_register_worker_callback(mpm_slot_run, slot);
+#else
+    rv = APR_ENOTIMPL;
+#endif
+    if (rv != APR_SUCCESS) {
+        push_slot(&workers->free, slot);
+        workers->mpm_stopped = 1;
+        wake_reserve(workers);
+    }
+    return rv;
+}
 
 static apr_status_t activate_slot(h2_workers *workers, h2_slot *slot) 
 {
@@ -103,7 +148,8 @@ static apr_status_t activate_slot(h2_workers *workers, h2_slot *slot)
                  "h2_workers: new thread for slot %d", slot->id); 
     /* thread will either immediately start work or add itself
      * to the idle queue */
-    apr_thread_create(&slot->thread, workers->thread_attr, slot_run, slot, 
+    apr_thread_create(&slot->thread, workers->thread_attr,
+                      workers->mpm ? reserve_run : slot_run, slot,
                       workers->pool);
     if (!slot->thread) {
         push_slot(&workers->free, slot);
@@ -125,7 +171,13 @@ static apr_status_t add_worker(h2_workers *workers)
 
 static void wake_idle_worker(h2_workers *workers) 
 {
-    h2_slot *slot = pop_slot(&workers->idle);
+    h2_slot *slot;
+
+    if (workers->mpm) {
+        dispatch_slot(workers);
+        return;
+    }
+    slot = pop_slot(&workers->idle);
     if (slot) {
         apr_thread_mutex_lock(slot->lock);
         apr_thread_cond_signal(slot->not_idle);
@@ -218,6 +270,25 @@ static void slot_done(h2_slot *slot)
 }
 
 
+static void slot_do_tasks(h2_slot *slot, apr_thread_t *thread)
+{
+    while (slot->task) {
+    
+        h2_task_do(slot->task, thread, slot->id);
+        
+        /* Report the task as done. If stickyness is left, offer the
+         * mplx the opportunity to give us back a new task right away.
+         */
+        if (!slot->aborted && (--slot->sticks > 0)) {
+            h2_mplx_task_done(slot->task->mplx, slot->task, &slot->task);
+        }
+        else {
+            h2_mplx_task_done(slot->task->mplx, slot->task, NULL);
+            slot->task = NULL;
+        }
+    }
+}
+
 static void* APR_THREAD_FUNC slot_run(apr_thread_t *thread, void *wctx)
 {
     h2_slot *slot = wctx;
@@ -226,20 +297,41 @@ static void* APR_THREAD_FUNC slot_run(apr_thread_t *thread, void *wctx)
 
         /* Get a h2_task from the mplxs queue. */
         get_next(slot);
-        while (slot->task) {
-        
-            h2_task_do(slot->task, thread, slot->id);
-            
-            /* Report the task as done. If stickyness is left, offer the
-             * mplx the opportunity to give us back a new task right away.
-             */
-            if (!slot->aborted && (--slot->sticks > 0)) {
-                h2_mplx_task_done(slot->task->mplx, slot->task, &slot->task);
-            }
-            else {
-                h2_mplx_task_done(slot->task->mplx, slot->task, NULL);
-                slot->task = NULL;
-            }
+        slot_do_tasks(slot, thread);
+    }
+
+    slot_done(slot);
+    return NULL;
+}
+
+/* A reserve thread with H2MpmWorkers: the h2 master connections run on
+ * the MPM workers too, and may hold all of them while waiting for their
+ * streams.  When none of the slots dispatched to the MPM ran during
+ * H2_MPM_STALL_TIMEOUT, or the MPM does not take them anymore, the
+ * reserve threads take the tasks themselves.
+ */
+static void* APR_THREAD_FUNC reserve_run(apr_thread_t *thread, void *wctx)
+{
+    h2_slot *slot = wctx;
+    h2_workers *workers = slot->workers;
+    apr_uint32_t runs;
+    
+    while (!workers->aborted) {
+        runs = apr_atomic_read32(&workers->mpm_runs);
+
+        apr_thread_mutex_lock(workers->lock);
+        if (!workers->aborted) {
+            apr_thread_cond_timedwait(workers->reserve_wait, workers->lock,
+                                      H2_MPM_STALL_TIMEOUT);
+        }
+        apr_thread_mutex_unlock(workers->lock);
+
+        if (!workers->aborted
+            && (workers->mpm_stopped
+                || apr_atomic_read32(&workers->mpm_runs) == runs)) {
+            slot->task = NULL;
+            h2_fifo_try_peek(workers->mplxs, mplx_peek, slot);
+            slot_do_tasks(slot, thread);
         }
     }
 
@@ -247,6 +339,34 @@ static void* APR_THREAD_FUNC slot_run(apr_thread_t *thread, void *wctx)
     return NULL;
 }
 
+/* A slot running on a MPM worker thread: it takes the first task of the
+ * first h2_mplx registered, which goes back to the end of the queue if
+ * it has more, so that all connections get their turn.  The h2_mplx hands
+ * out its tasks by stream priority.  Only one task is run before the
+ * worker thread is given back to the MPM.
+ */
+static void mpm_slot_run(apr_thread_t *thread, void *baton)
+{
+    h2_slot *slot = baton;
+    h2_workers *workers = slot->workers;
+
+    apr_atomic_inc32(&workers->mpm_runs);
+    if (!workers->aborted) {
+        h2_fifo_try_peek(workers->mplxs, mplx_peek, slot);
+    }
+    if (slot->task) {
+        h2_task_do(slot->task, thread, slot->id);
+        h2_mplx_task_done(slot->task->mplx, slot->task, NULL);
+        slot->task = NULL;
+    }
+    push_slot(&workers->free, slot);
+
+    /* Some mplx may have been registered while no slot was free */
+    if (!workers->aborted && h2_fifo_count(workers->mplxs) > 0) {
+        dispatch_slot(workers);
+    }
+}
+
 static apr_status_t workers_pool_cleanup(void *data)
 {
     h2_workers *workers = data;
@@ -268,6 +388,10 @@ static apr_status_t workers_pool_cleanup(void *data)
             }
         }
 
+        if (workers->mpm) {
+            wake_reserve(workers);
+        }
+
         h2_fifo_term(workers->mplxs);
 
         cleanup_zombies(workers);
@@ -277,7 +401,7 @@ static apr_status_t workers_pool_cleanup(void *data)
 
 h2_workers *h2_workers_create(server_rec *s, apr_pool_t *server_pool,
                               int min_workers, int max_workers,
-                              int idle_secs)
+                              int idle_secs, int use_mpm)
 {
     apr_status_t status;
     h2_workers *workers;
@@ -304,6 +428,7 @@ h2_workers *h2_workers_create(server_rec *s, apr_pool_t *server_pool,
     workers->min_workers = min_workers;
     workers->max_workers = max_workers;
     workers->max_idle_secs = (idle_secs > 0)? idle_secs : 10;
+    workers->mpm = use_mpm;
 
     /* FIXME: the fifo set we use here has limited capacity. Once the
      * set is full, connections with new requests do a wait. Unfortunately,
@@ -337,8 +462,16 @@ h2_workers *h2_workers_create(server_rec *s, apr_pool_t *server_pool,
     status = apr_thread_mutex_create(&workers->lock,
                                      APR_THREAD_MUTEX_DEFAULT,
                                      workers->pool);
+    if (status == APR_SUCCESS && workers->mpm) {
+        status = apr_thread_cond_create(&workers->reserve_wait,
+                                        workers->pool);
+    }
     if (status == APR_SUCCESS) {        
         n = workers->nslots = workers->max_workers;
+        if (workers->mpm) {
+            /* the reserve threads come on top */
+            n = workers->nslots += workers->min_workers;
+        }
         workers->slots = apr_pcalloc(workers->pool, n * sizeof(h2_slot));
         if (workers->slots == NULL) {
             workers->nslots = 0;
@@ -348,7 +481,17 @@ h2_workers *h2_workers_create(server_rec *s, apr_pool_t *server_pool,
             workers->slots[i].id = i;
         }
     }
-    if (status == APR_SUCCESS) {
+    if (status == APR_SUCCESS && workers->mpm) {
+        /* the max_workers first slots are dispatched on demand, the
+         * others are our reserve threads */
+        for (i = workers->max_workers - 1; i >= 0; --i) {
+            push_slot(&workers->free, &workers->slots[i]);
+        }
+        for (i = workers->max_workers; i < workers->nslots; ++i) {
+            status = activate_slot(workers, &workers->slots[i]);
+        }
+    }
+    else if (status == APR_SUCCESS) {
         /* we activate all for now, TODO: support min_workers again.
          * do this in reverse for vanity reasons so slot 0 will most
          * likely be at head of idle queue. */
@@ -21,6 +21,10 @@
  * number of workers it creates. Starts with minimum workers and adds
  * some on load, reduces the number again when idle.
  *
+ * Or, with H2MpmWorkers, the tasks are dispatched to the MPM worker
+ * threads, at most max_workers at a time, in turn with the connections
+ * waiting there.  Only min_workers threads of its own are kept in reserve,
+ * they take the tasks which the MPM workers do not pick up.
  */
 struct apr_thread_mutex_t;
 struct apr_thread_cond_t;
@@ -44,6 +48,9 @@ struct h2_workers {
     
     int aborted;
     int dynamic;
+    int mpm;
+    int mpm_stopped;              /* the MPM takes no more callbacks */
+    volatile apr_uint32_t mpm_runs; /* slots run by the MPM workers */
 
     apr_threadattr_t *thread_attr;
     int nslots;
@@ -58,14 +65,18 @@ struct h2_workers {
     struct h2_fifo *mplxs;
     
     struct apr_thread_mutex_t *lock;
+    struct apr_thread_cond_t *reserve_wait;
 };
 
 
 /* Create a worker pool with the given minimum and maximum number of
- * threads.
+ * threads, or of tasks running on the MPM worker threads if use_mpm is
+ * set (the MPM must support AP_MPMQ_CAN_DISPATCH), with min_size reserve
+ * threads then.
  */
 h2_workers *h2_workers_create(server_rec *s, apr_pool_t *pool,
-                              int min_size, int max_size, int idle_secs);
+                              int min_size, int max_size, int idle_secs,
+                              int use_mpm);
 
 /**
  * Registers a h2_mplx for task scheduling. If this h2_mplx runs
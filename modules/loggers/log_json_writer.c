@@ -0,0 +1,277 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "apr_strings.h"
+
+#define APR_WANT_STRFUNC
+#include "apr_want.h"
+
+#include "log_json_writer.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define LOG_JSON_SSE2 1
+#else
+#define LOG_JSON_SSE2 0
+#endif
+
+static const char hex_digits[] = "0123456789ABCDEF";
+
+void log_json_buf_init(log_json_buf *b, char *mem, apr_size_t size,
+                       apr_pool_t *p)
+{
+    b->data = mem;
+    b->len = 0;
+    b->size = mem ? size : 0;
+    b->pool = p;
+}
+
+void log_json_buf_grow(log_json_buf *b, apr_size_t len)
+{
+    if (b->size - b->len < len) {
+        apr_size_t size = b->size ? b->size * 2 : 256;
+        char *data;
+
+        while (size - b->len < len) {
+            size *= 2;
+        }
+        data = apr_palloc(b->pool, size);
+        if (b->len) {
+            memcpy(data, b->data, b->len);
+        }
+        b->data = data;
+        b->size = size;
+    }
+}
+
+void log_json_add_raw(log_json_buf *b, const char *s, apr_size_t len)
+{
+    log_json_buf_grow(b, len);
+    memcpy(b->data + b->len, s, len);
+    b->len += len;
+}
+
+void log_json_add_int(log_json_buf *b, apr_int64_t n)
+{
+    char tmp[24];
+    char *t = tmp + sizeof(tmp);
+    apr_uint64_t u = (n < 0) ? -(apr_uint64_t)n : (apr_uint64_t)n;
+
+    do {
+        *--t = '0' + (char)(u % 10);
+        u /= 10;
+    } while (u);
+    if (n < 0) {
+        *--t = '-';
+    }
+    log_json_add_raw(b, t, (tmp + sizeof(tmp)) - t);
+}
+
+/* ASCII which needs no escaping */
+#define JSON_PLAIN(c) ((c) >= 0x20 && (c) < 0x80 && (c) != '"' && (c) != '\\')
+
+/*
+ * Length of the leading run of plain characters, checking 16 (SSE2) or 8
+ * (word at a time) bytes per iteration since most of the log values
+ * have nothing to escape.
+ */
+static apr_size_t json_plain_run(const unsigned char *s, apr_size_t len)
+{
+    apr_size_t i = 0;
+
+#if LOG_JSON_SSE2
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i bslash = _mm_set1_epi8('\\');
+    const __m128i space = _mm_set1_epi8(0x20);
+
+    while (len - i >= 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(s + i));
+        /* signed compare: the bytes >= 0x80 are below 0x20 too */
+        __m128i m = _mm_or_si128(_mm_cmplt_epi8(v, space),
+                                 _mm_cmpeq_epi8(v, quote));
+        int mask;
+
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(v, bslash));
+        mask = _mm_movemask_epi8(m);
+        if (mask) {
+#if defined(__GNUC__)
+            return i + __builtin_ctz(mask);
+#else
+            break;
+#endif
+        }
+        i += 16;
+    }
+#else
+#define ONES  APR_UINT64_C(0x0101010101010101)
+#define HIGHS APR_UINT64_C(0x8080808080808080)
+#define HAS_ZERO(v) (((v) - ONES) & ~(v) & HIGHS)
+    while (len - i >= 8) {
+        apr_uint64_t v;
+
+        memcpy(&v, s + i, 8);
+        if ((v & HIGHS)
+                || (((v - ONES * 0x20) & ~v) & HIGHS)
+                || HAS_ZERO(v ^ (ONES * '"'))
+                || HAS_ZERO(v ^ (ONES * '\\'))) {
+            break;
+        }
+        i += 8;
+    }
+#undef HAS_ZERO
+#undef HIGHS
+#undef ONES
+#endif
+
+    while (i < len && JSON_PLAIN(s[i])) {
+        ++i;
+    }
+    return i;
+}
+
+/*
+ * Length of the valid UTF-8 sequence at s, or 0, with its code point
+ * in *cp.
+ */
+static apr_size_t json_utf8_len(const unsigned char *s, apr_size_t len,
+                                apr_uint32_t *cp)
+{
+    unsigned char c = s[0];
+    apr_size_t n, i;
+
+    if (c >= 0xc2 && c <= 0xdf) {
+        n = 2;
+        *cp = c & 0x1f;
+    }
+    else if (c >= 0xe0 && c <= 0xef) {
+        n = 3;
+        *cp = c & 0x0f;
+    }
+    else if (c >= 0xf0 && c <= 0xf4) {
+        n = 4;
+        *cp = c & 0x07;
+    }
+    else {
+        return 0;
+    }
+    if (len < n) {
+        return 0;
+    }
+    for (i = 1; i < n; ++i) {
+        if ((s[i] & 0xc0) != 0x80) {
+            return 0;
+        }
+        *cp = (*cp << 6) | (s[i] & 0x3f);
+    }
+    /* overlongs, surrogates and above U+10FFFF */
+    if ((c == 0xe0 && s[1] < 0xa0) || (c == 0xed && s[1] > 0x9f)
+            || (c == 0xf0 && s[1] < 0x90) || (c == 0xf4 && s[1] > 0x8f)) {
+        return 0;
+    }
+    return n;
+}
+
+static char *json_add_u(char *d, apr_uint32_t u)
+{
+    *d++ = '\\';
+    *d++ = 'u';
+    *d++ = hex_digits[(u >> 12) & 0xf];
+    *d++ = hex_digits[(u >> 8) & 0xf];
+    *d++ = hex_digits[(u >> 4) & 0xf];
+    *d++ = hex_digits[u & 0xf];
+    return d;
+}
+
+apr_status_t log_json_add_string(log_json_buf *b, const char *str,
+                                 apr_size_t len)
+{
+    const unsigned char *s = (const unsigned char *)str;
+    apr_uint32_t cp;
+    apr_size_t i = 0, n;
+    char *d;
+
+    log_json_buf_grow(b, len + 2);
+    b->data[b->len++] = '"';
+
+    while (i < len) {
+        n = json_plain_run(s + i, len - i);
+        if (n) {
+            log_json_add_raw(b, (const char *)s + i, n);
+            i += n;
+            if (i == len) {
+                break;
+            }
+        }
+
+        if (s[i] >= 0x80) {
+            if (!(n = json_utf8_len(s + i, len - i, &cp))) {
+                return APR_EINVAL;
+            }
+            log_json_buf_grow(b, 12);
+            d = b->data + b->len;
+            if (cp < 0x10000) {
+                d = json_add_u(d, cp);
+            }
+            else {
+                /* UTF-16 surrogate pair */
+                cp -= 0x10000;
+                d = json_add_u(d, 0xd800 | (cp >> 10));
+                d = json_add_u(d, 0xdc00 | (cp & 0x3ff));
+            }
+            b->len = d - b->data;
+            i += n;
+            continue;
+        }
+
+        log_json_buf_grow(b, 6);
+        d = b->data + b->len;
+        switch (s[i]) {
+        case '"':
+        case '\\':
+            *d++ = '\\';
+            *d++ = s[i];
+            break;
+        case '\b':
+            *d++ = '\\';
+            *d++ = 'b';
+            break;
+        case '\f':
+            *d++ = '\\';
+            *d++ = 'f';
+            break;
+        case '\n':
+            *d++ = '\\';
+            *d++ = 'n';
+            break;
+        case '\r':
+            *d++ = '\\';
+            *d++ = 'r';
+            break;
+        case '\t':
+            *d++ = '\\';
+            *d++ = 't';
+            break;
+        default:
+            d = json_add_u(d, s[i]);
+            break;
+        }
+        b->len = d - b->data;
+        ++i;
+    }
+
+    log_json_add_raw(b, "\"", 1);
+    return APR_SUCCESS;
+}
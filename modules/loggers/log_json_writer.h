@@ -0,0 +1,93 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * @file  log_json_writer.h
+ * @brief Streaming JSON output for mod_log_json
+ *
+ * The JSON text is written directly into a caller provided buffer (usually
+ * on the stack), which is moved to the pool only if it needs to grow.
+ */
+
+#ifndef LOG_JSON_WRITER_H
+#define LOG_JSON_WRITER_H
+
+#include "apr.h"
+#include "apr_errno.h"
+#include "apr_pools.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    char *data;
+    apr_size_t len;
+    apr_size_t size;
+    apr_pool_t *pool;
+} log_json_buf;
+
+/**
+ * Initialize a JSON buffer
+ * @param b The buffer
+ * @param mem The initial memory, may be NULL
+ * @param size The size of mem
+ * @param p The pool to allocate from when mem is exhausted
+ */
+void log_json_buf_init(log_json_buf *b, char *mem, apr_size_t size,
+                       apr_pool_t *p);
+
+/**
+ * Make sure that len more bytes can be written in the buffer
+ * @param b The buffer
+ * @param len The number of bytes
+ */
+void log_json_buf_grow(log_json_buf *b, apr_size_t len);
+
+/**
+ * Append raw bytes (e.g. punctuation or a precompiled key)
+ * @param b The buffer
+ * @param s The bytes
+ * @param len The number of bytes
+ */
+void log_json_add_raw(log_json_buf *b, const char *s, apr_size_t len);
+
+/**
+ * Append a string value, quoted and escaped.  The output is ASCII only,
+ * non ASCII characters are escaped as \\uXXXX (UTF-16), like jansson's
+ * JSON_ENSURE_ASCII.
+ * @param b The buffer
+ * @param s The string, in UTF-8
+ * @param len The length of the string
+ * @return APR_EINVAL if s is not valid UTF-8, in which case the
+ *         buffer is left with a partial value that the caller should
+ *         discard
+ */
+apr_status_t log_json_add_string(log_json_buf *b, const char *s,
+                                 apr_size_t len);
+
+/**
+ * Append an integer value
+ * @param b The buffer
+ * @param n The integer
+ */
+void log_json_add_int(log_json_buf *b, apr_int64_t n);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LOG_JSON_WRITER_H */
@@ -150,7 +150,10 @@
 #include "apr_lib.h"
 #include "apr_hash.h"
 #include "apr_optional.h"
-#include "apr_anylock.h"
+#include "apr_atomic.h"
+#include "apr_thread_proc.h"
+#include "apr_thread_mutex.h"
+#include "apr_thread_cond.h"
 
 #define APR_WANT_STRFUNC
 #include "apr_want.h"
@@ -204,6 +207,8 @@ static ap_log_writer *log_writer = ap_default_log_writer;
 static ap_log_writer_init *log_writer_init = ap_default_log_writer_init;
 static int buffered_logs = 0; /* default unbuffered */
 static apr_array_header_t *all_buffered_logs = NULL;
+static apr_size_t buffered_logs_size; /* 0 for LOG_BUFSIZE */
+static apr_interval_time_t buffered_logs_interval; /* see log_pre_config */
 
 /* POSIX.1 defines PIPE_BUF as the maximum number of bytes that is
  * guaranteed to be atomic when writing a pipe.  And PIPE_BUF >= 512
@@ -220,6 +225,18 @@ static apr_array_header_t *all_buffered_logs = NULL;
 #define LOG_BUFSIZE     (512)
 #endif
 
+/* Default and bounds of BufferedLogsFlushInterval and BufferedLogsSize */
+#define LOG_FLUSH_INTERVAL      apr_time_from_sec(1)
+#define LOG_MAX_BUFSIZE         (1024 * 1024)
+
+/* Size of the (stack) buffer where log lines are formatted, longer lines
+ * are formatted item by item in the request pool.
+ */
+#define LOG_LINE_BUFSIZE        HUGE_STRING_LEN
+
+/* Maximum number of shard buffers written by a single writev() */
+#define LOG_FLUSH_IOVECS        64
+
 /*
  * multi_log_state is our per-(virtual)-server configuration. We store
  * an array of the logs we are going to use, each of type config_log_state.
@@ -253,13 +270,6 @@ typedef struct {
  * set to a opaque structure (usually a fd) after it is opened.
 
  */
-typedef struct {
-    apr_file_t *handle;
-    apr_size_t outcnt;
-    char outbuf[LOG_BUFSIZE];
-    apr_anylock_t mutex;
-} buffered_log;
-
 typedef struct {
     const char *fname;
     const char *format_string;
@@ -285,12 +295,41 @@ typedef struct {
  * Note that many of these could have ap_sprintfs replaced with static buffers.
  */
 
+/*
+ * Unescaped value of an item, for the items handled by a function which
+ * returns ap_escape_logitem(r->pool, value).
+ */
+typedef const char *log_item_raw_fn(request_rec *r, char *a);
+
+/*
+ * How an item is formatted in the log line buffer (see compile_log_item()),
+ * either with a dedicated code or by calling its function (GENERIC).
+ */
+typedef enum {
+    LOG_ITEM_GENERIC = 0,
+    LOG_ITEM_CONSTANT,          /* arg of arg_len bytes */
+    LOG_ITEM_ESCAPED,           /* raw value escaped */
+    LOG_ITEM_REMOTE_USER,
+    LOG_ITEM_STATUS,
+    LOG_ITEM_BYTES,
+    LOG_ITEM_CLF_BYTES,
+    LOG_ITEM_KEEPALIVES,
+    LOG_ITEM_TIME,              /* time_fmt of the begin/end time */
+    LOG_ITEM_DURATION           /* time_fmt of the duration */
+} log_item_type;
+
 typedef struct {
     ap_log_handler_fn_t *func;
     char *arg;
     int condition_sense;
     int want_orig;
     apr_array_header_t *conditions;
+    /* precompiled plan */
+    log_item_type type;
+    apr_size_t arg_len;
+    log_item_raw_fn *raw;
+    int time_fmt;
+    int time_end;
 } log_format_item;
 
 /*
@@ -322,6 +361,46 @@ typedef struct {
     void *log_writer;
 } default_log_writer;
 
+/*
+ * With BufferedLogs, each log is split into shards, one per MPM thread
+ * (a thread picks its shard the first time it logs), so that the threads
+ * don't contend with each other when appending log entries.  A shard is
+ * owned by whoever sets its busy flag: either the thread appending to it,
+ * or the flusher thread which swaps the pending buffer with the spare one
+ * and writes it outside the shard.  An entry whose shard is busy (more
+ * threads than shards, or the flusher taking it) is written directly
+ * rather than waiting, so no thread ever blocks on another.
+ *
+ * Single threaded children have no flusher, their (only) shard is written
+ * by the next entry logged once BufferedLogsFlushInterval has elapsed.
+ */
+typedef struct {
+    apr_uint32_t busy;
+    apr_size_t outcnt;
+    char *outbuf;
+    char *spare;                /* only used by the flusher */
+    apr_time_t flushed;         /* last write, without a flusher */
+} buffered_log_shard;
+
+typedef struct {
+    default_log_writer *handle;
+    int piped;                  /* writes must stay below PIPE_BUF */
+    apr_size_t bufsize;
+    int nshards;
+    buffered_log_shard *shards; /* created by init_child */
+} buffered_log;
+
+static int buffered_log_sync_flush;
+
+#if APR_HAS_THREADS
+static apr_threadkey_t *buffered_log_shard_key;
+static apr_uint32_t buffered_log_next_shard;
+static apr_thread_t *buffered_log_flusher;
+static apr_thread_mutex_t *buffered_log_flusher_mutex;
+static apr_thread_cond_t *buffered_log_flusher_cond;
+static int buffered_log_flusher_stop;
+#endif
+
 static char *pfmt(apr_pool_t *p, int i)
 {
     if (i <= 0) {
@@ -337,17 +416,20 @@ static const char *constant_item(request_rec *dummy, char *stuff)
     return stuff;
 }
 
-static const char *log_remote_host(request_rec *r, char *a)
+static const char *raw_remote_host(request_rec *r, char *a)
 {
-    const char *remote_host;
     if (a && !strcmp(a, "c")) {
-        remote_host = ap_get_remote_host(r->connection, r->per_dir_config,
-                                         REMOTE_NAME, NULL);
+        return ap_get_remote_host(r->connection, r->per_dir_config,
+                                  REMOTE_NAME, NULL);
     }
     else {
-        remote_host = ap_get_useragent_host(r, REMOTE_NAME, NULL);
+        return ap_get_useragent_host(r, REMOTE_NAME, NULL);
     }
-    return ap_escape_logitem(r->pool, remote_host);
+}
+
+static const char *log_remote_host(request_rec *r, char *a)
+{
+    return ap_escape_logitem(r->pool, raw_remote_host(r, a));
 }
 
 static const char *log_remote_address(request_rec *r, char *a)
@@ -387,21 +469,24 @@ static const char *log_remote_user(request_rec *r, char *a)
     return rvalue;
 }
 
-static const char *log_request_line(request_rec *r, char *a)
+static const char *raw_request_line(request_rec *r, char *a)
 {
     /* NOTE: If the original request contained a password, we
      * re-write the request line here to contain XXXXXX instead:
      * (note the truncation before the protocol string for HTTP/0.9 requests)
      * (note also that r->the_request contains the unmodified request)
      */
-    return ap_escape_logitem(r->pool,
-                             (r->parsed_uri.password)
-                               ? apr_pstrcat(r->pool, r->method, " ",
-                                             apr_uri_unparse(r->pool,
-                                                             &r->parsed_uri, 0),
-                                             r->assbackwards ? NULL : " ",
-                                             r->protocol, NULL)
-                               : r->the_request);
+    return (r->parsed_uri.password)
+             ? apr_pstrcat(r->pool, r->method, " ",
+                           apr_uri_unparse(r->pool, &r->parsed_uri, 0),
+                           r->assbackwards ? NULL : " ",
+                           r->protocol, NULL)
+             : r->the_request;
+}
+
+static const char *log_request_line(request_rec *r, char *a)
+{
+    return ap_escape_logitem(r->pool, raw_request_line(r, a));
 }
 
 static const char *log_request_file(request_rec *r, char *a)
@@ -547,21 +632,22 @@ static APR_INLINE char *find_multiple_headers(apr_pool_t *pool,
     return NULL;
 }
 
-static const char *log_header_out(request_rec *r, char *a)
+static const char *raw_header_out(request_rec *r, char *a)
 {
-    const char *cp = NULL;
-
     if (!ap_cstr_casecmp(a, "Content-type") && r->content_type) {
-        cp = ap_field_noparam(r->pool, r->content_type);
+        return ap_field_noparam(r->pool, r->content_type);
     }
     else if (!ap_cstr_casecmp(a, "Set-Cookie")) {
-        cp = find_multiple_headers(r->pool, r->headers_out, a);
+        return find_multiple_headers(r->pool, r->headers_out, a);
     }
     else {
-        cp = apr_table_get(r->headers_out, a);
+        return apr_table_get(r->headers_out, a);
     }
+}
 
-    return ap_escape_logitem(r->pool, cp);
+static const char *log_header_out(request_rec *r, char *a)
+{
+    return ap_escape_logitem(r->pool, raw_header_out(r, a));
 }
 
 static const char *log_trailer_out(request_rec *r, char *a)
@@ -659,7 +745,7 @@ typedef struct {
 #define TIME_CACHE_MASK 3
 static cached_request_time request_time_cache[TIME_CACHE_SIZE];
 
-static apr_time_t get_request_end_time(request_rec *r)
+static apr_time_t ap_log_get_request_end_time(request_rec *r)
 {
     log_request_state *state = (log_request_state *)ap_get_module_config(r->request_config,
                                                                          &log_config_module);
@@ -674,13 +760,17 @@ static apr_time_t get_request_end_time(request_rec *r)
 }
 
 
-static const char *log_request_time(request_rec *r, char *a)
+/*
+ * Parse the argument of %t into one of the TIME_FMT_* types, and whether
+ * the end time of the request is asked.  For TIME_FMT_CUSTOM, *a is
+ * updated to point to the strftime() format.
+ */
+static int request_time_format(char **a, int *end)
 {
-    apr_time_exp_t xt;
-    apr_time_t request_time = r->request_time;
     int fmt_type = TIME_FMT_CUSTOM;
-    char *fmt = a;
+    char *fmt = *a;
 
+    *end = 0;
     if (fmt && *fmt) {
         if (!strncmp(fmt, "begin", 5)) {
             fmt += 5;
@@ -689,19 +779,19 @@ static const char *log_request_time(request_rec *r, char *a)
             }
             else if (*fmt == ':') {
                 fmt++;
-                a = fmt;
+                *a = fmt;
             }
         }
         else if (!strncmp(fmt, "end", 3)) {
             fmt += 3;
             if (!*fmt) {
-                request_time = get_request_end_time(r);
+                *end = 1;
                 fmt_type = TIME_FMT_CLF;
             }
             else if (*fmt == ':') {
                 fmt++;
-                a = fmt;
-                request_time = get_request_end_time(r);
+                *a = fmt;
+                *end = 1;
             }
         }
         if (!strncmp(fmt, "msec", 4)) {
@@ -733,28 +823,94 @@ static const char *log_request_time(request_rec *r, char *a)
         fmt_type = TIME_FMT_CLF;
     }
 
+    return fmt_type;
+}
+
+/* The value of the absolute (micro-/milli-)second or fraction time formats */
+static apr_time_t request_time_abs(apr_time_t request_time, int fmt_type)
+{
+    switch (fmt_type) {
+    case TIME_FMT_ABS_SEC:
+        return apr_time_sec(request_time);
+    case TIME_FMT_ABS_MSEC:
+        return apr_time_as_msec(request_time);
+    case TIME_FMT_ABS_MSEC_FRAC:
+        return apr_time_msec(request_time);
+    case TIME_FMT_ABS_USEC_FRAC:
+        return apr_time_usec(request_time);
+    default:
+        return request_time;
+    }
+}
+
+static void request_time_clf(apr_time_t request_time,
+                             cached_request_time *cached_time)
+{
+    /* This code uses the same technique as ap_explode_recent_localtime():
+     * optimistic caching with logic to detect and correct race conditions.
+     * See the comments in server/util_time.c for more information.
+     */
+    unsigned t_seconds = (unsigned)apr_time_sec(request_time);
+    unsigned i = t_seconds & TIME_CACHE_MASK;
+    *cached_time = request_time_cache[i];
+    if ((t_seconds != cached_time->t) ||
+        (t_seconds != cached_time->t_validate)) {
+
+        /* Invalid or old snapshot, so compute the proper time string
+         * and store it in the cache
+         */
+        apr_time_exp_t xt;
+        char sign;
+        int timz;
+
+        ap_explode_recent_localtime(&xt, request_time);
+        timz = xt.tm_gmtoff;
+        if (timz < 0) {
+            timz = -timz;
+            sign = '-';
+        }
+        else {
+            sign = '+';
+        }
+        cached_time->t = t_seconds;
+        apr_snprintf(cached_time->timestr, DEFAULT_REQUEST_TIME_SIZE,
+                     "[%02d/%s/%d:%02d:%02d:%02d %c%.2d%.2d]",
+                     xt.tm_mday, apr_month_snames[xt.tm_mon],
+                     xt.tm_year+1900, xt.tm_hour, xt.tm_min, xt.tm_sec,
+                     sign, timz / (60*60), (timz % (60*60)) / 60);
+        cached_time->t_validate = t_seconds;
+        request_time_cache[i] = *cached_time;
+    }
+}
+
+static const char *log_request_time(request_rec *r, char *a)
+{
+    apr_time_exp_t xt;
+    apr_time_t request_time = r->request_time;
+    int fmt_type, end;
+
+    fmt_type = request_time_format(&a, &end);
+    if (end) {
+        request_time = ap_log_get_request_end_time(r);
+    }
+
     if (fmt_type >= TIME_FMT_ABS_SEC) {      /* Absolute (micro-/milli-)second time
                                               * or msec/usec fraction
                                               */
         char* buf = apr_palloc(r->pool, 20);
         switch (fmt_type) {
-        case TIME_FMT_ABS_SEC:
-            apr_snprintf(buf, 20, "%" APR_TIME_T_FMT, apr_time_sec(request_time));
-            break;
-        case TIME_FMT_ABS_MSEC:
-            apr_snprintf(buf, 20, "%" APR_TIME_T_FMT, apr_time_as_msec(request_time));
-            break;
-        case TIME_FMT_ABS_USEC:
-            apr_snprintf(buf, 20, "%" APR_TIME_T_FMT, request_time);
-            break;
         case TIME_FMT_ABS_MSEC_FRAC:
-            apr_snprintf(buf, 20, "%03" APR_TIME_T_FMT, apr_time_msec(request_time));
+            apr_snprintf(buf, 20, "%03" APR_TIME_T_FMT,
+                         request_time_abs(request_time, fmt_type));
             break;
         case TIME_FMT_ABS_USEC_FRAC:
-            apr_snprintf(buf, 20, "%06" APR_TIME_T_FMT, apr_time_usec(request_time));
+            apr_snprintf(buf, 20, "%06" APR_TIME_T_FMT,
+                         request_time_abs(request_time, fmt_type));
             break;
         default:
-            return "-";
+            apr_snprintf(buf, 20, "%" APR_TIME_T_FMT,
+                         request_time_abs(request_time, fmt_type));
+            break;
         }
         return buf;
     }
@@ -769,42 +925,9 @@ static const char *log_request_time(request_rec *r, char *a)
         return log_request_time_custom(r, a, &xt);
     }
     else {                                   /* CLF format */
-        /* This code uses the same technique as ap_explode_recent_localtime():
-         * optimistic caching with logic to detect and correct race conditions.
-         * See the comments in server/util_time.c for more information.
-         */
         cached_request_time* cached_time = apr_palloc(r->pool,
                                                       sizeof(*cached_time));
-        unsigned t_seconds = (unsigned)apr_time_sec(request_time);
-        unsigned i = t_seconds & TIME_CACHE_MASK;
-        *cached_time = request_time_cache[i];
-        if ((t_seconds != cached_time->t) ||
-            (t_seconds != cached_time->t_validate)) {
-
-            /* Invalid or old snapshot, so compute the proper time string
-             * and store it in the cache
-             */
-            char sign;
-            int timz;
-
-            ap_explode_recent_localtime(&xt, request_time);
-            timz = xt.tm_gmtoff;
-            if (timz < 0) {
-                timz = -timz;
-                sign = '-';
-            }
-            else {
-                sign = '+';
-            }
-            cached_time->t = t_seconds;
-            apr_snprintf(cached_time->timestr, DEFAULT_REQUEST_TIME_SIZE,
-                         "[%02d/%s/%d:%02d:%02d:%02d %c%.2d%.2d]",
-                         xt.tm_mday, apr_month_snames[xt.tm_mon],
-                         xt.tm_year+1900, xt.tm_hour, xt.tm_min, xt.tm_sec,
-                         sign, timz / (60*60), (timz % (60*60)) / 60);
-            cached_time->t_validate = t_seconds;
-            request_time_cache[i] = *cached_time;
-        }
+        request_time_clf(request_time, cached_time);
         return cached_time->timestr;
     }
 }
@@ -812,12 +935,12 @@ static const char *log_request_time(request_rec *r, char *a)
 static const char *log_request_duration_microseconds(request_rec *r, char *a)
 {    
     return apr_psprintf(r->pool, "%" APR_TIME_T_FMT,
-                        (get_request_end_time(r) - r->request_time));
+                        (ap_log_get_request_end_time(r) - r->request_time));
 }
 
 static const char *log_request_duration_scaled(request_rec *r, char *a)
 {
-    apr_time_t duration = get_request_end_time(r) - r->request_time;
+    apr_time_t duration = ap_log_get_request_end_time(r) - r->request_time;
     if (*a == '\0' || !strcasecmp(a, "s")) {
         duration = apr_time_sec(duration);
     }
@@ -913,6 +1036,315 @@ static const char *log_requests_on_connection(request_rec *r, char *a)
     return apr_itoa(r->pool, num);
 }
 
+/*****************************************************************
+ *
+ * Precompiled formatting: the common items are formatted directly in
+ * the log line buffer, without allocating from the request pool.
+ */
+
+static const char *raw_remote_logname(request_rec *r, char *a)
+{
+    return ap_get_remote_logname(r);
+}
+static const char *raw_request_file(request_rec *r, char *a)
+{
+    return r->filename;
+}
+static const char *raw_request_uri(request_rec *r, char *a)
+{
+    return r->uri;
+}
+static const char *raw_request_method(request_rec *r, char *a)
+{
+    return r->method;
+}
+static const char *raw_request_protocol(request_rec *r, char *a)
+{
+    return r->protocol;
+}
+static const char *raw_handler(request_rec *r, char *a)
+{
+    return r->handler;
+}
+static const char *raw_header_in(request_rec *r, char *a)
+{
+    return apr_table_get(r->headers_in, a);
+}
+static const char *raw_trailer_in(request_rec *r, char *a)
+{
+    return apr_table_get(r->trailers_in, a);
+}
+static const char *raw_trailer_out(request_rec *r, char *a)
+{
+    return apr_table_get(r->trailers_out, a);
+}
+static const char *raw_note(request_rec *r, char *a)
+{
+    return apr_table_get(r->notes, a);
+}
+static const char *raw_env_var(request_rec *r, char *a)
+{
+    return apr_table_get(r->subprocess_env, a);
+}
+static const char *raw_virtual_host(request_rec *r, char *a)
+{
+    return r->server->server_hostname;
+}
+static const char *raw_server_name(request_rec *r, char *a)
+{
+    return ap_get_server_name(r);
+}
+
+static const struct {
+    ap_log_handler_fn_t *func;
+    log_item_raw_fn *raw;
+} log_raw_items[] = {
+    { log_remote_host,      raw_remote_host },
+    { log_remote_logname,   raw_remote_logname },
+    { log_request_line,     raw_request_line },
+    { log_request_file,     raw_request_file },
+    { log_request_uri,      raw_request_uri },
+    { log_request_method,   raw_request_method },
+    { log_request_protocol, raw_request_protocol },
+    { log_handler,          raw_handler },
+    { log_header_in,        raw_header_in },
+    { log_trailer_in,       raw_trailer_in },
+    { log_header_out,       raw_header_out },
+    { log_trailer_out,      raw_trailer_out },
+    { log_note,             raw_note },
+    { log_env_var,          raw_env_var },
+    { log_virtual_host,     raw_virtual_host },
+    { log_server_name,      raw_server_name },
+    { NULL, NULL }
+};
+
+/*
+ * Choose how to format an item, once its handler is known.  Items whose
+ * handler was replaced by another module (or registered by one) are
+ * GENERIC.
+ */
+static void compile_log_item(log_format_item *it)
+{
+    ap_log_handler_fn_t *func = it->func;
+    int i;
+
+    it->type = LOG_ITEM_GENERIC;
+    it->raw = NULL;
+
+    if (func == constant_item) {
+        it->type = LOG_ITEM_CONSTANT;
+        it->arg_len = strlen(it->arg);
+    }
+    else if (func == log_status) {
+        it->type = LOG_ITEM_STATUS;
+    }
+    else if (func == log_bytes_sent) {
+        it->type = LOG_ITEM_BYTES;
+    }
+    else if (func == clf_log_bytes_sent) {
+        it->type = LOG_ITEM_CLF_BYTES;
+    }
+    else if (func == log_requests_on_connection) {
+        it->type = LOG_ITEM_KEEPALIVES;
+    }
+    else if (func == log_remote_user) {
+        it->type = LOG_ITEM_REMOTE_USER;
+    }
+    else if (func == log_request_time) {
+        char *a = it->arg;
+        int fmt_type = request_time_format(&a, &it->time_end);
+        if (fmt_type != TIME_FMT_CUSTOM) {
+            it->type = LOG_ITEM_TIME;
+            it->time_fmt = fmt_type;
+        }
+    }
+    else if (func == log_request_duration_microseconds) {
+        it->type = LOG_ITEM_DURATION;
+        it->time_fmt = TIME_FMT_ABS_USEC;
+    }
+    else if (func == log_request_duration_scaled) {
+        if (*it->arg == '\0' || !strcasecmp(it->arg, "s")) {
+            it->type = LOG_ITEM_DURATION;
+            it->time_fmt = TIME_FMT_ABS_SEC;
+        }
+        else if (!strcasecmp(it->arg, "ms")) {
+            it->type = LOG_ITEM_DURATION;
+            it->time_fmt = TIME_FMT_ABS_MSEC;
+        }
+        else if (!strcasecmp(it->arg, "us")) {
+            it->type = LOG_ITEM_DURATION;
+            it->time_fmt = TIME_FMT_ABS_USEC;
+        }
+    }
+    else {
+        for (i = 0; log_raw_items[i].func; ++i) {
+            if (func == log_raw_items[i].func) {
+                it->type = LOG_ITEM_ESCAPED;
+                it->raw = log_raw_items[i].raw;
+                break;
+            }
+        }
+    }
+}
+
+#define LOG_NOROOM ((apr_size_t)-1)
+
+static APR_INLINE apr_size_t log_copy(char *d, apr_size_t room,
+                                      const char *s, apr_size_t len)
+{
+    if (len > room) {
+        return LOG_NOROOM;
+    }
+    memcpy(d, s, len);
+    return len;
+}
+
+/* Decimal representation of n, zero padded to width digits */
+static apr_size_t log_number(char *d, apr_size_t room, apr_int64_t n,
+                             int width)
+{
+    char tmp[24];
+    char *t = tmp + sizeof(tmp);
+    apr_uint64_t u = (n < 0) ? -(apr_uint64_t)n : (apr_uint64_t)n;
+
+    do {
+        *--t = '0' + (char)(u % 10);
+        u /= 10;
+    } while (u || (tmp + sizeof(tmp)) - t < width);
+    if (n < 0) {
+        *--t = '-';
+    }
+    return log_copy(d, room, t, (tmp + sizeof(tmp)) - t);
+}
+
+static int log_item_skipped(request_rec *r, log_format_item *item)
+{
+    if (item->conditions && item->conditions->nelts != 0) {
+        int i;
+        int *conds = (int *) item->conditions->elts;
+        int in_list = 0;
+
+        for (i = 0; i < item->conditions->nelts; ++i) {
+            if (r->status == conds[i]) {
+                in_list = 1;
+                break;
+            }
+        }
+
+        if ((item->condition_sense && in_list)
+            || (!item->condition_sense && !in_list)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Format an item at d, returning the number of bytes written or LOG_NOROOM
+ * if it does not fit in room bytes.
+ */
+static apr_size_t format_log_item(request_rec *r, request_rec *orig,
+                                  log_format_item *item,
+                                  char *d, apr_size_t room)
+{
+    const char *cp;
+    apr_time_t t;
+
+    if (item->type == LOG_ITEM_CONSTANT) {
+        return log_copy(d, room, item->arg, item->arg_len);
+    }
+    if (log_item_skipped(r, item)) {
+        return log_copy(d, room, "-", 1);
+    }
+    if (item->want_orig) {
+        r = orig;
+    }
+
+    switch (item->type) {
+    case LOG_ITEM_ESCAPED:
+        cp = item->raw(r, item->arg);
+        if (!cp) {
+            break;
+        }
+        return ap_escape_logitem_buf(d, cp, room);
+
+    case LOG_ITEM_REMOTE_USER:
+        cp = r->user;
+        if (!cp) {
+            break;
+        }
+        if (!*cp) {
+            return log_copy(d, room, "\"\"", 2);
+        }
+        return ap_escape_logitem_buf(d, cp, room);
+
+    case LOG_ITEM_STATUS:
+        if (r->status <= 0) {
+            break;
+        }
+        return log_number(d, room, r->status, 0);
+
+    case LOG_ITEM_BYTES:
+    case LOG_ITEM_CLF_BYTES:
+        if (!r->sent_bodyct || !r->bytes_sent) {
+            return log_copy(d, room,
+                            item->type == LOG_ITEM_BYTES ? "0" : "-", 1);
+        }
+        return log_number(d, room, r->bytes_sent, 0);
+
+    case LOG_ITEM_KEEPALIVES:
+        return log_number(d, room, r->connection->keepalives
+                                   ? r->connection->keepalives - 1 : 0, 0);
+
+    case LOG_ITEM_TIME:
+        t = item->time_end ? ap_log_get_request_end_time(r) : r->request_time;
+        if (item->time_fmt == TIME_FMT_CLF) {
+            cached_request_time cached_time;
+            request_time_clf(t, &cached_time);
+            return log_copy(d, room, cached_time.timestr,
+                            strlen(cached_time.timestr));
+        }
+        return log_number(d, room, request_time_abs(t, item->time_fmt),
+                          item->time_fmt == TIME_FMT_ABS_MSEC_FRAC ? 3 :
+                          item->time_fmt == TIME_FMT_ABS_USEC_FRAC ? 6 : 0);
+
+    case LOG_ITEM_DURATION:
+        t = ap_log_get_request_end_time(r) - r->request_time;
+        return log_number(d, room, request_time_abs(t, item->time_fmt), 0);
+
+    default:
+        cp = (*item->func) (r, item->arg);
+        if (!cp) {
+            break;
+        }
+        return log_copy(d, room, cp, strlen(cp));
+    }
+
+    return log_copy(d, room, "-", 1);
+}
+
+/*
+ * Format the whole log line in buf, returning its length or LOG_NOROOM
+ * if it does not fit in bufsize bytes.
+ */
+static apr_size_t format_log_line(request_rec *r, request_rec *orig,
+                                  apr_array_header_t *format,
+                                  char *buf, apr_size_t bufsize)
+{
+    log_format_item *items = (log_format_item *) format->elts;
+    apr_size_t len = 0, n;
+    int i;
+
+    for (i = 0; i < format->nelts; ++i) {
+        n = format_log_item(r, orig, &items[i], buf + len, bufsize - len);
+        if (n == LOG_NOROOM) {
+            return LOG_NOROOM;
+        }
+        len += n;
+    }
+    return len;
+}
+
 /*****************************************************************
  *
  * Parsing the log format string
@@ -1083,6 +1515,38 @@ static char *parse_log_item(apr_pool_t *p, log_format_item *it, const char **sa)
     return "Ran off end of LogFormat parsing args to some directive";
 }
 
+/*
+ * Compile the items of a parsed format, merging the consecutive constant
+ * ones (like "%%" or the final EOL) with their predecessor.
+ */
+static void compile_log_format(apr_pool_t *p, apr_array_header_t *a)
+{
+    log_format_item *items = (log_format_item *) a->elts;
+    int i, n = 0;
+
+    for (i = 0; i < a->nelts; ++i) {
+        log_format_item *it = &items[i];
+
+        compile_log_item(it);
+        if (n > 0 && it->type == LOG_ITEM_CONSTANT
+                && items[n - 1].type == LOG_ITEM_CONSTANT) {
+            log_format_item *prev = &items[n - 1];
+            char *arg = apr_palloc(p, prev->arg_len + it->arg_len + 1);
+
+            memcpy(arg, prev->arg, prev->arg_len);
+            memcpy(arg + prev->arg_len, it->arg, it->arg_len + 1);
+            prev->arg = arg;
+            prev->arg_len += it->arg_len;
+            continue;
+        }
+        if (n != i) {
+            items[n] = *it;
+        }
+        ++n;
+    }
+    a->nelts = n;
+}
+
 static apr_array_header_t *parse_log_string(apr_pool_t *p, const char *s, const char **err)
 {
     apr_array_header_t *a = apr_array_make(p, 30, sizeof(log_format_item));
@@ -1097,6 +1561,8 @@ static apr_array_header_t *parse_log_string(apr_pool_t *p, const char *s, const
 
     s = APR_EOL_STR;
     parse_log_item(p, (log_format_item *) apr_array_push(a), &s);
+
+    compile_log_format(p, a);
     return a;
 }
 
@@ -1112,22 +1578,8 @@ static const char *process_item(request_rec *r, request_rec *orig,
 
     /* First, see if we need to process this thing at all... */
 
-    if (item->conditions && item->conditions->nelts != 0) {
-        int i;
-        int *conds = (int *) item->conditions->elts;
-        int in_list = 0;
-
-        for (i = 0; i < item->conditions->nelts; ++i) {
-            if (r->status == conds[i]) {
-                in_list = 1;
-                break;
-            }
-        }
-
-        if ((item->condition_sense && in_list)
-            || (!item->condition_sense && !in_list)) {
-            return "-";
-        }
+    if (log_item_skipped(r, item)) {
+        return "-";
     }
 
     /* We do.  Do it... */
@@ -1136,12 +1588,76 @@ static const char *process_item(request_rec *r, request_rec *orig,
     return cp ? cp : "-";
 }
 
-static void flush_log(buffered_log *buf)
+static void write_log_shards(buffered_log *buf, struct iovec *vec,
+                             buffered_log_shard **taken, int n)
+{
+    apr_file_t *fd = buf->handle->log_writer;
+    int i;
+
+    /* XXX: error handling */
+    if (buf->piped) {
+        /* Keep each write atomic (below PIPE_BUF) */
+        for (i = 0; i < n; ++i) {
+            apr_file_write_full(fd, vec[i].iov_base, vec[i].iov_len, NULL);
+        }
+    }
+    else {
+        apr_size_t nbytes;
+        apr_file_writev_full(fd, vec, n, &nbytes);
+    }
+
+    /* The written buffers are the shards' spare ones now */
+    for (i = 0; i < n; ++i) {
+        taken[i]->spare = vec[i].iov_base;
+    }
+}
+
+/*
+ * Write all the pending entries of a buffered log, with a single writev()
+ * for up to LOG_FLUSH_IOVECS shards.  Shards currently busy are skipped,
+ * unless "wait" is set where we try a bit harder (final flush).
+ */
+static void flush_log(buffered_log *buf, int wait)
 {
-    if (buf->outcnt && buf->handle != NULL) {
-        /* XXX: error handling */
-        apr_file_write_full(buf->handle, buf->outbuf, buf->outcnt, NULL);
-        buf->outcnt = 0;
+    struct iovec vec[LOG_FLUSH_IOVECS];
+    buffered_log_shard *taken[LOG_FLUSH_IOVECS];
+    int i, n = 0;
+
+    for (i = 0; i < buf->nshards; ++i) {
+        buffered_log_shard *shard = &buf->shards[i];
+        int tries = wait ? 100 : 1;
+
+        if (!shard->outcnt || !shard->spare) {
+            continue;
+        }
+        while (apr_atomic_cas32(&shard->busy, 1, 0) != 0) {
+            if (!--tries) {
+                break;
+            }
+#if APR_HAS_THREADS
+            apr_thread_yield();
+#endif
+        }
+        if (!tries) {
+            continue;
+        }
+        if (shard->outcnt) {
+            vec[n].iov_base = shard->outbuf;
+            vec[n].iov_len = shard->outcnt;
+            taken[n++] = shard;
+            shard->outbuf = shard->spare;
+            shard->spare = NULL;
+            shard->outcnt = 0;
+        }
+        apr_atomic_set32(&shard->busy, 0);
+
+        if (n == LOG_FLUSH_IOVECS) {
+            write_log_shards(buf, vec, taken, n);
+            n = 0;
+        }
+    }
+    if (n) {
+        write_log_shards(buf, vec, taken, n);
     }
 }
 
@@ -1149,12 +1665,13 @@ static void flush_log(buffered_log *buf)
 static int config_log_transaction(request_rec *r, config_log_state *cls,
                                   apr_array_header_t *default_format)
 {
+    char line[LOG_LINE_BUFSIZE];
     log_format_item *items;
     const char **strs;
     int *strl;
     request_rec *orig;
-    int i;
-    apr_size_t len = 0;
+    int i, nelts;
+    apr_size_t len;
     apr_array_header_t *format;
     char *envar;
     apr_status_t rv;
@@ -1192,10 +1709,6 @@ static int config_log_transaction(request_rec *r, config_log_state *cls,
 
     format = cls->format ? cls->format : default_format;
 
-    strs = apr_palloc(r->pool, sizeof(char *) * (format->nelts));
-    strl = apr_palloc(r->pool, sizeof(int) * (format->nelts));
-    items = (log_format_item *) format->elts;
-
     orig = r;
     while (orig->prev) {
         orig = orig->prev;
@@ -1204,19 +1717,39 @@ static int config_log_transaction(request_rec *r, config_log_state *cls,
         r = r->next;
     }
 
-    for (i = 0; i < format->nelts; ++i) {
-        strs[i] = process_item(r, orig, &items[i]);
-    }
-
-    for (i = 0; i < format->nelts; ++i) {
-        len += strl[i] = strlen(strs[i]);
-    }
     if (!log_writer) {
         ap_log_rerror(APLOG_MARK, APLOG_ERR, 0, r, APLOGNO(00645)
                 "log writer isn't correctly setup");
         return HTTP_INTERNAL_SERVER_ERROR;
     }
-    rv = log_writer(r, cls->log_writer, strs, strl, format->nelts, len);
+
+    /* Common case, the line fits in the stack buffer */
+    len = format_log_line(r, orig, format, line, sizeof(line));
+    if (len != LOG_NOROOM) {
+        const char *str = line;
+        int l = (int)len;
+
+        nelts = 1;
+        strs = &str;
+        strl = &l;
+        rv = log_writer(r, cls->log_writer, strs, strl, nelts, len);
+    }
+    else {
+        strs = apr_palloc(r->pool, sizeof(char *) * (format->nelts));
+        strl = apr_palloc(r->pool, sizeof(int) * (format->nelts));
+        items = (log_format_item *) format->elts;
+
+        for (i = 0; i < format->nelts; ++i) {
+            strs[i] = process_item(r, orig, &items[i]);
+        }
+
+        len = 0;
+        for (i = 0; i < format->nelts; ++i) {
+            len += strl[i] = strlen(strs[i]);
+        }
+        nelts = format->nelts;
+        rv = log_writer(r, cls->log_writer, strs, strl, nelts, len);
+    }
     if (rv != APR_SUCCESS) {
         ap_log_rerror(APLOG_MARK, APLOG_WARNING, rv, r, APLOGNO(00646)
                       "Error writing to %s", cls->fname);
@@ -1427,6 +1960,44 @@ static const char *set_buffered_logs_on(cmd_parms *parms, void *dummy, int flag)
     }
     return NULL;
 }
+
+static const char *set_buffered_logs_size(cmd_parms *cmd, void *dummy,
+                                          const char *arg)
+{
+    apr_off_t size;
+    const char *err = ap_check_cmd_context(cmd, GLOBAL_ONLY);
+
+    if (err) {
+        return err;
+    }
+    if (apr_strtoff(&size, arg, NULL, 10) != APR_SUCCESS
+            || size < LOG_BUFSIZE || size > LOG_MAX_BUFSIZE) {
+        return apr_psprintf(cmd->pool, "%s must be a number of bytes "
+                            "between %d and %d", cmd->cmd->name,
+                            (int)LOG_BUFSIZE, LOG_MAX_BUFSIZE);
+    }
+    buffered_logs_size = (apr_size_t)size;
+    return NULL;
+}
+
+static const char *set_buffered_logs_interval(cmd_parms *cmd, void *dummy,
+                                              const char *arg)
+{
+    apr_interval_time_t interval;
+    const char *err = ap_check_cmd_context(cmd, GLOBAL_ONLY);
+
+    if (err) {
+        return err;
+    }
+    if (ap_timeout_parameter_parse(arg, &interval, "s") != APR_SUCCESS
+            || interval < 0) {
+        return apr_psprintf(cmd->pool, "%s has an invalid time value",
+                            cmd->cmd->name);
+    }
+    buffered_logs_interval = interval;
+    return NULL;
+}
+
 static const command_rec config_log_cmds[] =
 {
 AP_INIT_TAKE23("CustomLog", add_custom_log, NULL, RSRC_CONF,
@@ -1440,6 +2011,12 @@ AP_INIT_TAKE12("LogFormat", log_format, NULL, RSRC_CONF,
      "a log format string (see docs) and an optional format name"),
 AP_INIT_FLAG("BufferedLogs", set_buffered_logs_on, NULL, RSRC_CONF,
                  "Enable Buffered Logging (experimental)"),
+AP_INIT_TAKE1("BufferedLogsSize", set_buffered_logs_size, NULL, RSRC_CONF,
+     "the size of the per thread buffers of BufferedLogs, in bytes"),
+AP_INIT_TAKE1("BufferedLogsFlushInterval", set_buffered_logs_interval, NULL,
+     RSRC_CONF, "the maximum time BufferedLogs entries stay in memory "
+     "(in seconds, or milliseconds with the ms suffix, 0 to flush only "
+     "full buffers)"),
     {NULL}
 };
 
@@ -1523,34 +2100,58 @@ static int open_multi_logs(server_rec *s, apr_pool_t *p)
 }
 
 
-static apr_status_t flush_all_logs(void *data)
+#if APR_HAS_THREADS
+static void * APR_THREAD_FUNC log_flusher_thread(apr_thread_t *thd,
+                                                 void *data)
 {
-    server_rec *s = data;
-    multi_log_state *mls;
-    apr_array_header_t *log_list;
-    config_log_state *clsarray;
-    buffered_log *buf;
+    buffered_log **array = (buffered_log **)all_buffered_logs->elts;
     int i;
 
-    if (!buffered_logs)
-        return APR_SUCCESS;
-
-    for (; s; s = s->next) {
-        mls = ap_get_module_config(s->module_config, &log_config_module);
-        log_list = NULL;
-        if (mls->config_logs->nelts) {
-            log_list = mls->config_logs;
-        }
-        else if (mls->server_config_logs) {
-            log_list = mls->server_config_logs;
+    apr_thread_mutex_lock(buffered_log_flusher_mutex);
+    while (!buffered_log_flusher_stop) {
+        apr_thread_cond_timedwait(buffered_log_flusher_cond,
+                                  buffered_log_flusher_mutex,
+                                  buffered_logs_interval);
+        if (buffered_log_flusher_stop) {
+            break;
         }
-        if (log_list) {
-            clsarray = (config_log_state *) log_list->elts;
-            for (i = 0; i < log_list->nelts; ++i) {
-                buf = clsarray[i].log_writer;
-                flush_log(buf);
-            }
+        apr_thread_mutex_unlock(buffered_log_flusher_mutex);
+
+        for (i = 0; i < all_buffered_logs->nelts; ++i) {
+            flush_log(array[i], 0);
         }
+
+        apr_thread_mutex_lock(buffered_log_flusher_mutex);
+    }
+    apr_thread_mutex_unlock(buffered_log_flusher_mutex);
+
+    apr_thread_exit(thd, APR_SUCCESS);
+    return NULL;
+}
+#endif
+
+static apr_status_t flush_all_logs(void *data)
+{
+    buffered_log **array = (buffered_log **)all_buffered_logs->elts;
+    int i;
+
+#if APR_HAS_THREADS
+    /* Stop the flusher first, then flush what remains from here */
+    if (buffered_log_flusher) {
+        apr_status_t rv;
+
+        apr_thread_mutex_lock(buffered_log_flusher_mutex);
+        buffered_log_flusher_stop = 1;
+        apr_thread_cond_signal(buffered_log_flusher_cond);
+        apr_thread_mutex_unlock(buffered_log_flusher_mutex);
+
+        apr_thread_join(&rv, buffered_log_flusher);
+        buffered_log_flusher = NULL;
+    }
+#endif
+
+    for (i = 0; i < all_buffered_logs->nelts; ++i) {
+        flush_log(array[i], 1);
     }
     return APR_SUCCESS;
 }
@@ -1581,42 +2182,89 @@ static int init_config_log(apr_pool_t *pc, apr_pool_t *p, apr_pool_t *pt, server
 
 static void init_child(apr_pool_t *p, server_rec *s)
 {
-    int mpm_threads;
+    buffered_log **array;
+    int mpm_threads, nshards = 1;
+    int i, j;
+    apr_time_t now;
+
+    if (!buffered_logs) {
+        return;
+    }
 
     ap_mpm_query(AP_MPMQ_MAX_THREADS, &mpm_threads);
 
-    /* Now register the last buffer flush with the cleanup engine */
-    if (buffered_logs) {
-        int i;
-        buffered_log **array = (buffered_log **)all_buffered_logs->elts;
+#if APR_HAS_THREADS
+    if (mpm_threads > 1) {
+        apr_status_t rv;
+
+        rv = apr_threadkey_private_create(&buffered_log_shard_key, NULL, p);
+        if (rv != APR_SUCCESS) {
+            /* Still works with a single shard, contended writers falling
+             * back to direct writes.
+             */
+            ap_log_error(APLOG_MARK, APLOG_ERR, rv, s, APLOGNO(10305)
+                         "could not create the buffered log thread key, "
+                         "buffering won't scale with threads");
+        }
+        else {
+            nshards = mpm_threads;
+        }
+    }
+    buffered_log_next_shard = 0;
+#endif
 
-        apr_pool_cleanup_register(p, s, flush_all_logs, flush_all_logs);
+    /* Memory is bounded by two buffers (pending and spare) per shard */
+    now = apr_time_now();
+    array = (buffered_log **)all_buffered_logs->elts;
+    for (i = 0; i < all_buffered_logs->nelts; ++i) {
+        buffered_log *this = array[i];
+
+        this->nshards = nshards;
+        this->shards = apr_pcalloc(p, nshards * sizeof(buffered_log_shard));
+        for (j = 0; j < nshards; ++j) {
+            this->shards[j].outbuf = apr_palloc(p, this->bufsize);
+            this->shards[j].spare = apr_palloc(p, this->bufsize);
+            this->shards[j].flushed = now;
+        }
+    }
 
-        for (i = 0; i < all_buffered_logs->nelts; i++) {
-            buffered_log *this = array[i];
+    /* No thread to flush for a single one, the writes do it */
+    buffered_log_sync_flush = (buffered_logs_interval > 0);
 
 #if APR_HAS_THREADS
-            if (mpm_threads > 1) {
-                apr_status_t rv;
-
-                this->mutex.type = apr_anylock_threadmutex;
-                rv = apr_thread_mutex_create(&this->mutex.lock.tm,
-                                             APR_THREAD_MUTEX_DEFAULT,
-                                             p);
-                if (rv != APR_SUCCESS) {
-                    ap_log_error(APLOG_MARK, APLOG_CRIT, rv, s, APLOGNO(00647)
-                                 "could not initialize buffered log mutex, "
-                                 "transfer log may become corrupted");
-                    this->mutex.type = apr_anylock_none;
-                }
-            }
-            else
-#endif
-            {
-                this->mutex.type = apr_anylock_none;
-            }
+    buffered_log_flusher = NULL;
+    buffered_log_flusher_stop = 0;
+    if (buffered_logs_interval > 0 && all_buffered_logs->nelts
+        && mpm_threads > 1) {
+        apr_status_t rv;
+
+        rv = apr_thread_mutex_create(&buffered_log_flusher_mutex,
+                                     APR_THREAD_MUTEX_DEFAULT, p);
+        if (rv == APR_SUCCESS) {
+            rv = apr_thread_cond_create(&buffered_log_flusher_cond, p);
+        }
+        if (rv == APR_SUCCESS) {
+            rv = apr_thread_create(&buffered_log_flusher, NULL,
+                                   log_flusher_thread, NULL, p);
+        }
+        if (rv != APR_SUCCESS) {
+            ap_log_error(APLOG_MARK, APLOG_ERR, rv, s, APLOGNO(10256)
+                         "could not start the buffered log flusher thread, "
+                         "buffered entries will be written by the requests "
+                         "logged after the flush interval");
+            buffered_log_flusher = NULL;
+        }
+        else {
+            buffered_log_sync_flush = 0;
         }
     }
+#endif
+
+    /* Now register the last buffer flush with the cleanup engine, as a
+     * pre-cleanup to stop the flusher thread before its pool goes away.
+     * Not in forked children though, which would duplicate the entries.
+     */
+    apr_pool_pre_cleanup_register(p, s, flush_all_logs);
 }
 
 static void ap_register_log_handler(apr_pool_t *p, char *tag,
@@ -1653,7 +2301,7 @@ static apr_status_t ap_default_log_writer( request_rec *r,
 
 {
     default_log_writer *log_writer = handle;
-    char *str;
+    const char *str;
     char *s;
     int i;
     apr_status_t rv;
@@ -1662,11 +2310,16 @@ static apr_status_t ap_default_log_writer( request_rec *r,
      * We do this memcpy dance because write() is atomic for len < PIPE_BUF,
      * while writev() need not be.
      */
-    str = apr_palloc(r->pool, len + 1);
-
-    for (i = 0, s = str; i < nelts; ++i) {
-        memcpy(s, strs[i], strl[i]);
-        s += strl[i];
+    if (nelts == 1) {
+        str = strs[0];
+    }
+    else {
+        char *buf = apr_palloc(r->pool, len + 1);
+        for (i = 0, s = buf; i < nelts; ++i) {
+            memcpy(s, strs[i], strl[i]);
+            s += strl[i];
+        }
+        str = buf;
     }
 
     if (log_writer->type == LOG_WRITER_FD) {
@@ -1774,12 +2427,41 @@ static void *ap_buffered_log_writer_init(apr_pool_t *p, server_rec *s,
     b->handle = ap_default_log_writer_init(p, s, name);
 
     if (b->handle) {
-        *(buffered_log **)apr_array_push(all_buffered_logs) = b;
+        /* Providers get their entries unbuffered */
+        if (b->handle->type == LOG_WRITER_FD) {
+            b->piped = (*name == '|');
+            b->bufsize = buffered_logs_size ? buffered_logs_size
+                                            : LOG_BUFSIZE;
+            if (b->piped && b->bufsize > LOG_BUFSIZE) {
+                b->bufsize = LOG_BUFSIZE;
+            }
+            *(buffered_log **)apr_array_push(all_buffered_logs) = b;
+        }
         return b;
     }
     else
         return NULL;
 }
+
+static buffered_log_shard *get_log_shard(buffered_log *buf)
+{
+#if APR_HAS_THREADS
+    if (buf->nshards > 1) {
+        void *id = NULL;
+
+        /* The shard id (+1) is stored in the thread's key on first use */
+        apr_threadkey_private_get(&id, buffered_log_shard_key);
+        if (!id) {
+            id = (void *)(apr_uintptr_t)
+                 (apr_atomic_inc32(&buffered_log_next_shard) + 1);
+            apr_threadkey_private_set(id, buffered_log_shard_key);
+        }
+        return &buf->shards[((apr_uintptr_t)id - 1) % buf->nshards];
+    }
+#endif
+    return &buf->shards[0];
+}
+
 static apr_status_t ap_buffered_log_writer(request_rec *r,
                                            void *handle,
                                            const char **strs,
@@ -1788,45 +2470,46 @@ static apr_status_t ap_buffered_log_writer(request_rec *r,
                                            apr_size_t len)
 
 {
-    char *str;
     char *s;
     int i;
-    apr_status_t rv;
+    apr_status_t rv = APR_SUCCESS;
     buffered_log *buf = (buffered_log*)handle;
+    buffered_log_shard *shard;
 
-    if ((rv = APR_ANYLOCK_LOCK(&buf->mutex)) != APR_SUCCESS) {
-        return rv;
+    if (!buf->shards || len >= buf->bufsize) {
+        return ap_default_log_writer(r, buf->handle, strs, strl, nelts, len);
     }
 
-    if (len + buf->outcnt > LOG_BUFSIZE) {
-        flush_log(buf);
+    shard = get_log_shard(buf);
+    if (apr_atomic_cas32(&shard->busy, 1, 0) != 0) {
+        /* Don't wait for the other owner, write the entry directly */
+        return ap_default_log_writer(r, buf->handle, strs, strl, nelts, len);
     }
-    if (len >= LOG_BUFSIZE) {
-        apr_size_t w;
-
-        /*
-         * We do this memcpy dance because write() is atomic for
-         * len < PIPE_BUF, while writev() need not be.
-         */
-        str = apr_palloc(r->pool, len + 1);
-        for (i = 0, s = str; i < nelts; ++i) {
-            memcpy(s, strs[i], strl[i]);
-            s += strl[i];
-        }
-        w = len;
-        rv = apr_file_write_full(buf->handle, str, w, NULL);
 
+    if (len + shard->outcnt > buf->bufsize) {
+        /* Full, write this shard only */
+        rv = apr_file_write_full(buf->handle->log_writer, shard->outbuf,
+                                 shard->outcnt, NULL);
+        shard->outcnt = 0;
     }
-    else {
-        for (i = 0, s = &buf->outbuf[buf->outcnt]; i < nelts; ++i) {
-            memcpy(s, strs[i], strl[i]);
-            s += strl[i];
+    for (i = 0, s = &shard->outbuf[shard->outcnt]; i < nelts; ++i) {
+        memcpy(s, strs[i], strl[i]);
+        s += strl[i];
+    }
+    shard->outcnt += len;
+
+    if (buffered_log_sync_flush) {
+        apr_time_t now = apr_time_now();
+
+        if (now - shard->flushed >= buffered_logs_interval) {
+            rv = apr_file_write_full(buf->handle->log_writer, shard->outbuf,
+                                     shard->outcnt, NULL);
+            shard->outcnt = 0;
+            shard->flushed = now;
         }
-        buf->outcnt += len;
-        rv = APR_SUCCESS;
     }
 
-    APR_ANYLOCK_UNLOCK(&buf->mutex);
+    apr_atomic_set32(&shard->busy, 0);
     return rv;
 }
 
@@ -1877,6 +2560,8 @@ static int log_pre_config(apr_pool_t *p, apr_pool_t *plog, apr_pool_t *ptemp)
     ap_log_set_writer_init(ap_default_log_writer_init);
     ap_log_set_writer(ap_default_log_writer);
     buffered_logs = 0;
+    buffered_logs_size = 0;
+    buffered_logs_interval = LOG_FLUSH_INTERVAL;
 
     return OK;
 }
@@ -1948,6 +2633,7 @@ static void register_hooks(apr_pool_t *p)
     APR_REGISTER_OPTIONAL_FN(ap_register_log_handler);
     APR_REGISTER_OPTIONAL_FN(ap_log_set_writer_init);
     APR_REGISTER_OPTIONAL_FN(ap_log_set_writer);
+    APR_REGISTER_OPTIONAL_FN(ap_log_get_request_end_time);
 }
 
 AP_DECLARE_MODULE(log_config) =
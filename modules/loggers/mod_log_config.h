@@ -68,6 +68,11 @@ APR_DECLARE_OPTIONAL_FN(ap_log_writer_init*, ap_log_set_writer_init,(ap_log_writ
  * you should probably set the writer at the same time (ie..before open_logs)
  */
 APR_DECLARE_OPTIONAL_FN(ap_log_writer*, ap_log_set_writer, (ap_log_writer* func));
+/**
+ * the end time of the request, as logged by %D, %T and %{end:...}t
+ */
+APR_DECLARE_OPTIONAL_FN(apr_time_t, ap_log_get_request_end_time,
+                        (request_rec *r));
 
 #endif /* MOD_LOG_CONFIG */
 /** @} */
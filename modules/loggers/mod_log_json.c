@@ -23,28 +23,10 @@
 
 #include <mod_ssl.h>
 #include "mod_log_config.h"
+#include "log_json_writer.h"
 
 #include "apr_strings.h"
 
-/* jansson thinks everyone compiles with the platform's cc in its fullest capabilities
- * when undefining their INLINEs, we get static, unused functions, arg 
- */
-#if defined(__GNUC__)
-#if __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 6)
-#pragma GCC diagnostic push
-#endif
-#pragma GCC diagnostic ignored "-Wunused-function"
-#pragma GCC diagnostic ignored "-Wunreachable-code"
-#elif defined(__clang__)
-#pragma clang diagnostic push
-#pragma clang diagnostic ignored "-Wunused-function"
-#endif
-
-#include <jansson_config.h>
-#undef  JSON_INLINE
-#define JSON_INLINE
-#include <jansson.h>
-
 APLOG_USE_MODULE(log_json);
 
 module AP_MODULE_DECLARE_DATA log_json_module;
@@ -52,99 +34,383 @@ module AP_MODULE_DECLARE_DATA log_json_module;
 static APR_OPTIONAL_FN_TYPE(ssl_var_lookup) *log_json_ssl_lookup = NULL;
 static APR_OPTIONAL_FN_TYPE(ssl_is_https) *log_json_ssl_is_https = NULL;
 static APR_OPTIONAL_FN_TYPE(ap_register_log_handler) *log_json_register = NULL;
+static APR_OPTIONAL_FN_TYPE(ap_log_get_request_end_time) *log_json_end_time = NULL;
 
-static const char *crit_error =
-    "{\"mod_log_json_error\": \"critical error during serialization: see error "
-    "log\"}";
+/* Lines are formatted on the stack up to this size */
+#define LOG_JSON_BUFSIZE HUGE_STRING_LEN
 
-static int
-log_json_dump_bb(const char *buffer, size_t size, void *baton)
+/* The fields logged when LogJSONFields is not configured */
+static const char * const default_fields[] = {
+    "log_id", "vhost", "status", "proto", "method", "uri", "srcip",
+    "bytes_sent", "user", "hdrs.user-agent=hdr:User-Agent",
+    "tls.v=ssl:SSL_PROTOCOL", "tls.cipher=ssl:SSL_CIPHER",
+    "tls.client_verify=ssl:SSL_CLIENT_VERIFY", "tls.sni=ssl:SSL_TLS_SNI",
+    NULL
+};
+
+/*
+ * Like the jansson object mod_log_json used to build, a field whose value
+ * is missing (or isn't valid UTF-8) is left out, except log_id which is
+ * null.  A group is always logged, possibly as an empty object, unless all
+ * its fields are ssl: lookups and the connection isn't TLS.
+ */
+typedef enum {
+    LOG_JSON_LOG_ID,
+    LOG_JSON_VHOST,
+    LOG_JSON_STATUS,
+    LOG_JSON_PROTO,
+    LOG_JSON_METHOD,
+    LOG_JSON_URI,
+    LOG_JSON_SRCIP,
+    LOG_JSON_BYTES_SENT,
+    LOG_JSON_TIME,
+    LOG_JSON_DURATION,
+    LOG_JSON_QUERY,
+    LOG_JSON_USER,
+    LOG_JSON_HDR,
+    LOG_JSON_RESP,
+    LOG_JSON_NOTE,
+    LOG_JSON_ENV,
+    LOG_JSON_SSL
+} log_json_source;
+
+static const struct {
+    const char *name;
+    log_json_source source;
+    int takes_arg;
+} log_json_sources[] = {
+    { "log_id",     LOG_JSON_LOG_ID,     0 },
+    { "vhost",      LOG_JSON_VHOST,      0 },
+    { "status",     LOG_JSON_STATUS,     0 },
+    { "proto",      LOG_JSON_PROTO,      0 },
+    { "method",     LOG_JSON_METHOD,     0 },
+    { "uri",        LOG_JSON_URI,        0 },
+    { "srcip",      LOG_JSON_SRCIP,      0 },
+    { "bytes_sent", LOG_JSON_BYTES_SENT, 0 },
+    { "time",       LOG_JSON_TIME,       0 },
+    { "duration",   LOG_JSON_DURATION,   0 },
+    { "query",      LOG_JSON_QUERY,      0 },
+    { "user",       LOG_JSON_USER,       0 },
+    { "hdr",        LOG_JSON_HDR,        1 },
+    { "resp",       LOG_JSON_RESP,       1 },
+    { "note",       LOG_JSON_NOTE,       1 },
+    { "env",        LOG_JSON_ENV,        1 },
+    { "ssl",        LOG_JSON_SSL,        1 },
+    { NULL }
+};
+
+/*
+ * A field of the JSON object, with its key already serialized.  Fields
+ * of the same group (one level of nested object) are kept contiguous.
+ */
+typedef struct {
+    log_json_source source;
+    const char *arg;
+    const char *key;            /* "key": */
+    apr_size_t key_len;
+    int group;                  /* index in groups or -1 */
+} log_json_field;
+
+typedef struct {
+    apr_array_header_t *fields; /* log_json_field */
+    apr_array_header_t *groups; /* serialized "group": */
+} log_json_schema;
+
+typedef struct {
+    log_json_schema *schema;
+} log_json_conf;
+
+static log_json_schema *default_schema;
+
+static const char *json_key(apr_pool_t *p, const char *name,
+                            apr_size_t len, apr_size_t *key_len)
 {
-    apr_bucket_brigade *bb = baton;
-    apr_brigade_write(bb, NULL, NULL, buffer, size);
-    return 0;
+    log_json_buf b;
+
+    log_json_buf_init(&b, NULL, 0, p);
+    log_json_add_string(&b, name, len);
+    log_json_add_raw(&b, ":", 1);
+    *key_len = b.len;
+    return b.data;
 }
 
-static const char *
-log_json(request_rec *r, char *a)
+static log_json_schema *make_schema(apr_pool_t *p)
 {
-    apr_size_t olen;
-    apr_status_t rv;
-    int err;
-    char *out;
-    apr_bucket_brigade *bb;
-    json_t *obj;
-    json_t *hdrs;
-
-    obj = json_object();
-
-    json_object_set_new_nocheck(obj, "log_id",
-        r->log_id != NULL ? json_string(r->log_id) : json_null());
-    json_object_set_new_nocheck(
-        obj, "vhost", json_string(r->server->server_hostname));
-    json_object_set_new_nocheck(
-        obj, "status", json_string(apr_itoa(r->pool, r->status)));
-    json_object_set_new_nocheck(obj, "proto", json_string(r->protocol));
-    json_object_set_new_nocheck(obj, "method", json_string(r->method));
-    json_object_set_new_nocheck(obj, "uri", json_string(r->uri));
-    json_object_set_new_nocheck(obj, "srcip", json_string(r->useragent_ip));
-    json_object_set_new_nocheck(obj, "bytes_sent", json_integer(r->bytes_sent));
-
-    if (r->user != NULL) {
-        json_object_set_new_nocheck(obj, "user", json_string(r->user));
+    log_json_schema *schema = apr_palloc(p, sizeof(*schema));
+    schema->fields = apr_array_make(p, 16, sizeof(log_json_field));
+    schema->groups = apr_array_make(p, 2, sizeof(const char *));
+    return schema;
+}
+
+/*
+ * Add a field given as "[group.]key=source[:arg]", or just "source[:arg]"
+ * where the key is the source name (or the arg).
+ */
+static const char *add_field(apr_pool_t *p, log_json_schema *schema,
+                             const char *spec)
+{
+    const char *eq = ap_strchr_c(spec, '=');
+    const char *src = eq ? eq + 1 : spec;
+    const char *colon = ap_strchr_c(src, ':');
+    const char *name, *dot, *key;
+    log_json_field field, *fields;
+    apr_size_t src_len = colon ? (apr_size_t)(colon - src) : strlen(src);
+    int i, at;
+
+    for (i = 0; log_json_sources[i].name; ++i) {
+        if (strlen(log_json_sources[i].name) == src_len
+                && !strncmp(log_json_sources[i].name, src, src_len)) {
+            break;
+        }
+    }
+    if (!log_json_sources[i].name
+            || !log_json_sources[i].takes_arg != !(colon && colon[1])) {
+        return apr_psprintf(p, "Invalid JSON log field source '%s'", src);
+    }
+    field.source = log_json_sources[i].source;
+    field.arg = colon ? apr_pstrdup(p, colon + 1) : NULL;
+
+    name = eq ? apr_pstrmemdup(p, spec, eq - spec)
+              : (field.arg ? field.arg : log_json_sources[i].name);
+    field.group = -1;
+    key = name;
+    if (eq && (dot = ap_strchr_c(name, '.')) != NULL) {
+        const char **groups = (const char **)schema->groups->elts;
+        apr_size_t len;
+        const char *group = json_key(p, name, dot - name, &len);
+
+        for (i = 0; i < schema->groups->nelts; ++i) {
+            if (!strcmp(groups[i], group)) {
+                break;
+            }
+        }
+        if (i == schema->groups->nelts) {
+            *(const char **)apr_array_push(schema->groups) = group;
+        }
+        field.group = i;
+        key = dot + 1;
     }
+    if (!*key) {
+        return apr_psprintf(p, "Empty JSON log field name in '%s'", spec);
+    }
+    field.key = json_key(p, key, strlen(key), &field.key_len);
+
+    /* Insert after the last field of the same group */
+    apr_array_push(schema->fields);
+    fields = (log_json_field *)schema->fields->elts;
+    at = schema->fields->nelts - 1;
+    if (field.group >= 0) {
+        for (i = at - 1; i >= 0; --i) {
+            if (fields[i].group == field.group) {
+                break;
+            }
+        }
+        if (i >= 0) {
+            at = i + 1;
+            memmove(&fields[at + 1], &fields[at],
+                    (schema->fields->nelts - 1 - at) * sizeof(*fields));
+        }
+    }
+    fields[at] = field;
+    return NULL;
+}
+
+static int is_https(request_rec *r)
+{
+    return log_json_ssl_is_https && log_json_ssl_lookup
+           && log_json_ssl_is_https(r->connection);
+}
+
+/* Add the value of a field, returning 0 if it should be omitted */
+static int add_value(request_rec *r, int https, const log_json_field *field,
+                     log_json_buf *b)
+{
+    const char *s = NULL;
 
-    hdrs = json_object();
-    json_object_set_new_nocheck(hdrs, "user-agent",
-        json_string(apr_table_get(r->headers_in, "User-Agent")));
-    json_object_set_new_nocheck(obj, "hdrs", hdrs);
-
-    if (log_json_ssl_is_https != NULL && log_json_ssl_lookup != NULL &&
-        log_json_ssl_is_https(r->connection)) {
-        json_t *tls = json_object();
-
-        json_object_set_new_nocheck(tls, "v",
-            json_string(log_json_ssl_lookup(
-                r->pool, r->server, r->connection, r, "SSL_PROTOCOL")));
-        json_object_set_new_nocheck(tls, "cipher",
-            json_string(log_json_ssl_lookup(
-                r->pool, r->server, r->connection, r, "SSL_CIPHER")));
-        json_object_set_new_nocheck(tls, "client_verify",
-            json_string(log_json_ssl_lookup(
-                r->pool, r->server, r->connection, r, "SSL_CLIENT_VERIFY")));
-        json_object_set_new_nocheck(tls, "sni",
-            json_string(log_json_ssl_lookup(
-                r->pool, r->server, r->connection, r, "SSL_TLS_SNI")));
-
-        json_object_set_new_nocheck(obj, "tls", tls);
+    switch (field->source) {
+    case LOG_JSON_LOG_ID:
+        if (!r->log_id) {
+            log_json_add_raw(b, "null", 4);
+            return 1;
+        }
+        s = r->log_id;
+        break;
+    case LOG_JSON_VHOST:
+        s = r->server->server_hostname;
+        break;
+    case LOG_JSON_STATUS:
+        /* a string, as always logged */
+        log_json_add_raw(b, "\"", 1);
+        log_json_add_int(b, r->status);
+        log_json_add_raw(b, "\"", 1);
+        return 1;
+    case LOG_JSON_PROTO:
+        s = r->protocol;
+        break;
+    case LOG_JSON_METHOD:
+        s = r->method;
+        break;
+    case LOG_JSON_URI:
+        s = r->uri;
+        break;
+    case LOG_JSON_SRCIP:
+        s = r->useragent_ip;
+        break;
+    case LOG_JSON_BYTES_SENT:
+        log_json_add_int(b, r->bytes_sent);
+        return 1;
+    case LOG_JSON_TIME:
+        log_json_add_int(b, r->request_time);
+        return 1;
+    case LOG_JSON_DURATION:
+        log_json_add_int(b, log_json_end_time(r) - r->request_time);
+        return 1;
+    case LOG_JSON_QUERY:
+        s = r->args;
+        break;
+    case LOG_JSON_USER:
+        s = r->user;
+        break;
+    case LOG_JSON_HDR:
+        s = apr_table_get(r->headers_in, field->arg);
+        break;
+    case LOG_JSON_RESP:
+        s = apr_table_get(r->headers_out, field->arg);
+        if (!s) {
+            s = apr_table_get(r->err_headers_out, field->arg);
+        }
+        break;
+    case LOG_JSON_NOTE:
+        s = apr_table_get(r->notes, field->arg);
+        break;
+    case LOG_JSON_ENV:
+        s = apr_table_get(r->subprocess_env, field->arg);
+        break;
+    case LOG_JSON_SSL:
+        if (https) {
+            s = log_json_ssl_lookup(r->pool, r->server, r->connection, r,
+                                    (char *)field->arg);
+        }
+        break;
     }
 
-    bb = apr_brigade_create(r->pool, r->connection->bucket_alloc);
-    err = json_dump_callback(
-        obj, log_json_dump_bb, bb, JSON_ENSURE_ASCII | JSON_COMPACT);
-    if (err != 0) {
-        ap_log_rerror(APLOG_MARK, APLOG_ERR, 0, r,
-            APLOGNO(10125) "json_dump_callback failed: %d", err);
-        apr_brigade_destroy(bb);
-        return crit_error;
+    return s && log_json_add_string(b, s, strlen(s)) == APR_SUCCESS;
+}
+
+static const char *
+log_json(request_rec *r, char *a)
+{
+    log_json_conf *conf = ap_get_module_config(r->server->module_config,
+                                               &log_json_module);
+    log_json_schema *schema = conf->schema ? conf->schema : default_schema;
+    const log_json_field *fields = (log_json_field *)schema->fields->elts;
+    const char **groups = (const char **)schema->groups->elts;
+    char mem[LOG_JSON_BUFSIZE];
+    log_json_buf b;
+    apr_size_t mark, group_mark = 0;
+    int i, n = 0, group_n = 0, group = -1, group_used = 0;
+    int https = is_https(r);
+
+    log_json_buf_init(&b, mem, sizeof(mem), r->pool);
+    log_json_add_raw(&b, "{", 1);
+
+    for (i = 0; i < schema->fields->nelts; ++i) {
+        const log_json_field *field = &fields[i];
+        int *count;
+
+        if (field->group != group) {
+            if (group >= 0) {
+                if (group_used) {
+                    log_json_add_raw(&b, "}", 1);
+                    ++n;
+                }
+                else {
+                    b.len = group_mark;
+                }
+            }
+            group = field->group;
+            if (group >= 0) {
+                group_mark = b.len;
+                group_n = 0;
+                group_used = 0;
+                if (n) {
+                    log_json_add_raw(&b, ",", 1);
+                }
+                log_json_add_raw(&b, groups[group], strlen(groups[group]));
+                log_json_add_raw(&b, "{", 1);
+            }
+        }
+        count = (group >= 0) ? &group_n : &n;
+        if (field->source != LOG_JSON_SSL || https) {
+            group_used = 1;
+        }
+
+        mark = b.len;
+        if (*count) {
+            log_json_add_raw(&b, ",", 1);
+        }
+        log_json_add_raw(&b, field->key, field->key_len);
+        if (add_value(r, https, field, &b)) {
+            ++*count;
+        }
+        else {
+            b.len = mark;
+        }
+    }
+    if (group >= 0) {
+        if (group_used) {
+            log_json_add_raw(&b, "}", 1);
+        }
+        else {
+            b.len = group_mark;
+        }
     }
+    log_json_add_raw(&b, "}", 1);
 
-    rv = apr_brigade_pflatten(bb, &out, &olen, r->pool);
-    if (rv != APR_SUCCESS) {
-        ap_log_rerror(APLOG_MARK, APLOG_ERR, rv, r,
-            APLOGNO(10126) "apr_brigade_pflatten failed");
-        apr_brigade_destroy(bb);
-        return crit_error;
+    /* Single allocation for the line (if it fit on the stack) */
+    return apr_pstrmemdup(r->pool, b.data, b.len);
+}
+
+static const char *set_fields(cmd_parms *cmd, void *dummy, const char *arg)
+{
+    log_json_conf *conf = ap_get_module_config(cmd->server->module_config,
+                                               &log_json_module);
+
+    if (!conf->schema) {
+        conf->schema = make_schema(cmd->pool);
     }
-    apr_brigade_destroy(bb);
-    return out;
+    return add_field(cmd->pool, conf->schema, arg);
+}
+
+static void *
+log_json_create_server_config(apr_pool_t *p, server_rec *s)
+{
+    return apr_pcalloc(p, sizeof(log_json_conf));
+}
+
+static void *
+log_json_merge_server_config(apr_pool_t *p, void *basev, void *addv)
+{
+    log_json_conf *base = basev, *add = addv;
+    log_json_conf *conf = apr_palloc(p, sizeof(*conf));
+
+    conf->schema = add->schema ? add->schema : base->schema;
+    return conf;
 }
 
 static int
 log_json_pre_config(apr_pool_t *p, apr_pool_t *plog, apr_pool_t *ptemp)
 {
+    int i;
+
     log_json_register = APR_RETRIEVE_OPTIONAL_FN(ap_register_log_handler);
     log_json_register(p, "^JS", log_json, 0);
+    log_json_end_time = APR_RETRIEVE_OPTIONAL_FN(ap_log_get_request_end_time);
+
+    default_schema = make_schema(p);
+    for (i = 0; default_fields[i]; ++i) {
+        add_field(p, default_schema, default_fields[i]);
+    }
     return OK;
 }
 
@@ -165,14 +431,14 @@ log_json_post_config(
     log_json_ssl_lookup = APR_RETRIEVE_OPTIONAL_FN(ssl_var_lookup);
     log_json_ssl_is_https = APR_RETRIEVE_OPTIONAL_FN(ssl_is_https);
 
-    /* http://jansson.readthedocs.io/en/2.8/portability.html#portability-thread-safety
-     */
-    json_object_seed(0);
-
     return OK;
 }
 
-static const command_rec directives[] = {{NULL}};
+static const command_rec directives[] = {
+    AP_INIT_ITERATE("LogJSONFields", set_fields, NULL, RSRC_CONF,
+        "The fields of the %^JS log item, as [group.]name=source[:arg]"),
+    {NULL}
+};
 
 static void
 register_hooks(apr_pool_t *pool)
@@ -182,4 +448,5 @@ register_hooks(apr_pool_t *pool)
 }
 
 module AP_MODULE_DECLARE_DATA log_json_module = {STANDARD20_MODULE_STUFF, NULL,
-    NULL, NULL, NULL, directives, register_hooks};
+    NULL, log_json_create_server_config, log_json_merge_server_config,
+    directives, register_hooks};
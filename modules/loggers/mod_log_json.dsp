@@ -43,7 +43,7 @@ RSC=rc.exe
 # PROP Ignore_Export_Lib 0
 # PROP Target_Dir ""
 # ADD BASE CPP /nologo /MD /W3 /O2 /D "WIN32" /D "NDEBUG" /D "_WINDOWS" /FD /c
-# ADD CPP /nologo /MD /W3 /O2 /Oy- /Zi /I "../ssl"/I "../../include" /I "../../srclib/apr/include" /I "../../srclib/apr-util/include" /I "../../srclib/jansson/include" /I "../../server" /D "NDEBUG" /D "WIN32" /D "_WINDOWS" /Fd"Release\mod_log_json_src" /FD /c
+# ADD CPP /nologo /MD /W3 /O2 /Oy- /Zi /I "../ssl"/I "../../include" /I "../../srclib/apr/include" /I "../../srclib/apr-util/include" /I "../../server" /D "NDEBUG" /D "WIN32" /D "_WINDOWS" /Fd"Release\mod_log_json_src" /FD /c
 # ADD BASE MTL /nologo /D "NDEBUG" /win32
 # ADD MTL /nologo /D "NDEBUG" /mktyplib203 /win32
 # ADD BASE RSC /l 0x409 /d "NDEBUG"
@@ -53,7 +53,7 @@ BSC32=bscmake.exe
 # ADD BSC32 /nologo
 LINK32=link.exe
 # ADD BASE LINK32 kernel32.lib /nologo /subsystem:windows /dll /out:".\Release\mod_log_json.so" /base:@..\..\os\win32\BaseAddr.ref,mod_log_json.so
-# ADD LINK32 kernel32.lib jansson.lib /libpath:"../../srclib/jansson/lib" /nologo /subsystem:windows /dll /incremental:no /debug /out:".\Release\mod_log_json.so" /base:@..\..\os\win32\BaseAddr.ref,mod_log_json.so /opt:ref
+# ADD LINK32 kernel32.lib /nologo /subsystem:windows /dll /incremental:no /debug /out:".\Release\mod_log_json.so" /base:@..\..\os\win32\BaseAddr.ref,mod_log_json.so /opt:ref
 # Begin Special Build Tool
 TargetPath=.\Release\mod_log_json.so
 SOURCE="$(InputPath)"
@@ -75,7 +75,7 @@ PostBuild_Cmds=if exist $(TargetPath).manifest mt.exe -manifest $(TargetPath).ma
 # PROP Ignore_Export_Lib 0
 # PROP Target_Dir ""
 # ADD BASE CPP /nologo /MDd /W3 /EHsc /Zi /Od /D "WIN32" /D "_DEBUG" /D "_WINDOWS" /FD /c
-# ADD CPP /nologo /MDd /W3 /EHsc /Zi /Od /I "../../include" /I "../../srclib/apr/include" /I "../../srclib/apr-util/include" /I "../../srclib/jansson/include"  /I "../../server" /D "_DEBUG" /D "WIN32" /D "_WINDOWS" /Fd"Debug\mod_log_json_src" /FD /c
+# ADD CPP /nologo /MDd /W3 /EHsc /Zi /Od /I "../../include" /I "../../srclib/apr/include" /I "../../srclib/apr-util/include"  /I "../../server" /D "_DEBUG" /D "WIN32" /D "_WINDOWS" /Fd"Debug\mod_log_json_src" /FD /c
 # ADD BASE MTL /nologo /D "_DEBUG" /win32
 # ADD MTL /nologo /D "_DEBUG" /mktyplib203 /win32
 # ADD BASE RSC /l 0x409 /d "_DEBUG"
@@ -85,7 +85,7 @@ BSC32=bscmake.exe
 # ADD BSC32 /nologo
 LINK32=link.exe
 # ADD BASE LINK32 kernel32.lib /nologo /subsystem:windows /dll /incremental:no /debug /out:".\Debug\mod_log_json.so" /base:@..\..\os\win32\BaseAddr.ref,mod_log_json.so
-# ADD LINK32 kernel32.lib jansson.lib /libpath:"../../srclib/jansson/lib" /nologo /subsystem:windows /dll /incremental:no /debug /out:".\Debug\mod_log_json.so" /base:@..\..\os\win32\BaseAddr.ref,mod_log_json.so
+# ADD LINK32 kernel32.lib /nologo /subsystem:windows /dll /incremental:no /debug /out:".\Debug\mod_log_json.so" /base:@..\..\os\win32\BaseAddr.ref,mod_log_json.so
 # Begin Special Build Tool
 TargetPath=.\Debug\mod_log_json.so
 SOURCE="$(InputPath)"
@@ -101,6 +101,14 @@ PostBuild_Cmds=if exist $(TargetPath).manifest mt.exe -manifest $(TargetPath).ma
 # Name "mod_log_json - Win32 Debug"
 # Begin Source File
 
+SOURCE=.\log_json_writer.c
+# End Source File
+# Begin Source File
+
+SOURCE=.\log_json_writer.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\mod_log_json.c
 # End Source File
 # Begin Source File
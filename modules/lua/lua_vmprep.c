@@ -60,6 +60,230 @@ void ap_lua_init_mutex(apr_pool_t *pool, server_rec *s)
 #endif
 }
 
+#ifndef lua_pushglobaltable
+#define lua_pushglobaltable(L) lua_pushvalue(L, LUA_GLOBALSINDEX)
+#endif
+
+/* Per-process cache of the compiled Lua files, dumped once and loaded
+ * as bytecode by all the lua_States running them, instead of each one
+ * parsing the files again.
+ */
+typedef struct {
+    apr_uint32_t refs;          /* lua_States loading it */
+    apr_size_t len;
+    apr_size_t size;
+    char data[1];
+} lua_bytecode_t;
+
+typedef struct {
+    apr_time_t modified;
+    apr_off_t size;
+    lua_bytecode_t *code;
+} lua_bytecode_entry;
+
+static apr_hash_t *lua_bytecode_cache;
+#if APR_HAS_THREADS
+static apr_thread_mutex_t *lua_bytecode_mutex;
+#endif
+
+void ap_lua_init_bytecode_cache(apr_pool_t *pool, server_rec *s)
+{
+#if APR_HAS_THREADS
+    apr_status_t rv;
+
+    rv = apr_thread_mutex_create(&lua_bytecode_mutex,
+                                 APR_THREAD_MUTEX_DEFAULT, pool);
+    if (rv != APR_SUCCESS) {
+        ap_log_error(APLOG_MARK, APLOG_ERR, rv, s, APLOGNO(10301)
+                     "mod_lua: Failed to create the bytecode cache mutex, "
+                     "Lua files won't be cached");
+        return;
+    }
+#endif
+    lua_bytecode_cache = apr_hash_make(pool);
+}
+
+static APR_INLINE void bytecode_lock(void)
+{
+#if APR_HAS_THREADS
+    apr_thread_mutex_lock(lua_bytecode_mutex);
+#endif
+}
+
+static APR_INLINE void bytecode_unlock(void)
+{
+#if APR_HAS_THREADS
+    apr_thread_mutex_unlock(lua_bytecode_mutex);
+#endif
+}
+
+static int bytecode_writer(lua_State *L, const void *b, size_t size, void *B)
+{
+    lua_bytecode_t **code = B;
+
+    (void) L;
+    if (!*code || (*code)->len + size > (*code)->size) {
+        apr_size_t len = *code ? (*code)->len : 0;
+        apr_size_t newsize = *code ? (*code)->size * 2 : 4096;
+        lua_bytecode_t *grown;
+
+        while (len + size > newsize) {
+            newsize *= 2;
+        }
+        grown = realloc(*code, sizeof(lua_bytecode_t) + newsize);
+        if (!grown) {
+            return 1;
+        }
+        grown->len = len;
+        grown->size = newsize;
+        *code = grown;
+    }
+    memcpy((*code)->data + (*code)->len, b, size);
+    (*code)->len += size;
+    return 0;
+}
+
+/* Must be called with the bytecode lock held */
+static void bytecode_release(lua_bytecode_entry *entry, lua_bytecode_t *code)
+{
+    if (code->refs == 0 && code != entry->code) {
+        free(code);
+    }
+}
+
+/**
+ * Load the given Lua file as a function on top of the stack, from the
+ * bytecode cache when it has an up to date dump of it (per codecache),
+ * otherwise compile and cache it.  Returns like luaL_loadfile().
+ */
+static int load_lua_file(lua_State *L, ap_lua_vm_spec *spec,
+                         apr_pool_t *pool)
+{
+    apr_finfo_t finfo;
+    lua_bytecode_entry *entry;
+    lua_bytecode_t *code = NULL, *old;
+    int rc;
+
+    if (!lua_bytecode_cache || spec->codecache == AP_LUA_CACHE_NEVER) {
+        return luaL_loadfile(L, spec->file);
+    }
+    if (spec->codecache == AP_LUA_CACHE_FOREVER) {
+        finfo.mtime = 0;
+        finfo.size = 0;
+    }
+    else if (apr_stat(&finfo, spec->file, APR_FINFO_MTIME | APR_FINFO_SIZE,
+                      pool) != APR_SUCCESS) {
+        /* let Lua report the error */
+        return luaL_loadfile(L, spec->file);
+    }
+
+    bytecode_lock();
+    entry = apr_hash_get(lua_bytecode_cache, spec->file, APR_HASH_KEY_STRING);
+    if (entry && entry->code
+            && (spec->codecache == AP_LUA_CACHE_FOREVER
+                || (entry->modified == finfo.mtime
+                    && entry->size == finfo.size))) {
+        code = entry->code;
+        code->refs++;
+    }
+    bytecode_unlock();
+
+    if (code) {
+        rc = luaL_loadbuffer(L, code->data, code->len, spec->file);
+        bytecode_lock();
+        code->refs--;
+        bytecode_release(entry, code);
+        bytecode_unlock();
+        return rc;
+    }
+
+    rc = luaL_loadfile(L, spec->file);
+    if (rc != 0) {
+        return rc;
+    }
+    if (lua_dump(L, bytecode_writer, &code) != 0 || !code) {
+        free(code);
+        return rc;
+    }
+    ap_log_perror(APLOG_MARK, APLOG_TRACE1, 0, pool,
+                  "caching %" APR_SIZE_T_FMT " bytes of bytecode for %s",
+                  code->len, spec->file);
+
+    bytecode_lock();
+    entry = apr_hash_get(lua_bytecode_cache, spec->file, APR_HASH_KEY_STRING);
+    if (!entry) {
+        apr_pool_t *cache_pool = apr_hash_pool_get(lua_bytecode_cache);
+
+        entry = apr_pcalloc(cache_pool, sizeof(*entry));
+        apr_hash_set(lua_bytecode_cache, apr_pstrdup(cache_pool, spec->file),
+                     APR_HASH_KEY_STRING, entry);
+    }
+    old = entry->code;
+    entry->code = code;
+    entry->modified = finfo.mtime;
+    entry->size = finfo.size;
+    if (old) {
+        bytecode_release(entry, old);
+    }
+    bytecode_unlock();
+
+    return rc;
+}
+
+/**
+ * Save a (shallow) copy of the globals of a pooled lua_State, once its
+ * file is loaded, for ap_lua_reset_state() to restore them.
+ */
+static void snapshot_globals(lua_State *L)
+{
+    lua_newtable(L);
+    lua_pushglobaltable(L);
+    lua_pushnil(L);
+    while (lua_next(L, -2)) {
+        lua_pushvalue(L, -2);
+        lua_insert(L, -2);
+        lua_rawset(L, -5);
+    }
+    lua_pop(L, 1);
+    lua_setfield(L, LUA_REGISTRYINDEX, "Apache2.Lua.globals");
+}
+
+void ap_lua_reset_state(lua_State *L)
+{
+    lua_settop(L, 0);
+    lua_getfield(L, LUA_REGISTRYINDEX, "Apache2.Lua.globals");
+    if (!lua_istable(L, 1)) {
+        lua_settop(L, 0);
+        return;
+    }
+    lua_pushglobaltable(L);
+
+    /* Drop the globals which were not there */
+    lua_pushnil(L);
+    while (lua_next(L, 2)) {
+        lua_pop(L, 1);
+        lua_pushvalue(L, -1);
+        lua_rawget(L, 1);
+        if (lua_isnil(L, -1)) {
+            lua_pushvalue(L, -2);
+            lua_pushnil(L);
+            lua_rawset(L, 2);
+        }
+        lua_pop(L, 1);
+    }
+
+    /* And put back the ones which were replaced or removed */
+    lua_pushnil(L);
+    while (lua_next(L, 1)) {
+        lua_pushvalue(L, -2);
+        lua_insert(L, -2);
+        lua_rawset(L, 2);
+    }
+
+    lua_settop(L, 0);
+    lua_gc(L, LUA_GCSTEP, 0);
+}
+
 /* forward dec'l from this file */
 
 #if 0
@@ -369,7 +593,7 @@ static apr_status_t vm_construct(lua_State **vm, void *params, apr_pool_t *lifec
         int rc;
         ap_log_perror(APLOG_MARK, APLOG_DEBUG, 0, lifecycle_pool, APLOGNO(01481)
             "loading lua file %s", spec->file);
-        rc = luaL_loadfile(L, spec->file);
+        rc = load_lua_file(L, spec, lifecycle_pool);
         if (rc != 0) {
             ap_log_perror(APLOG_MARK, APLOG_ERR, 0, lifecycle_pool, APLOGNO(01482)
                           "Error loading %s: %s", spec->file,
@@ -406,7 +630,7 @@ static ap_lua_vm_spec* copy_vm_spec(apr_pool_t* pool, ap_lua_vm_spec* spec)
     copied_spec->package_cpaths = apr_array_copy(pool, spec->package_cpaths);
     copied_spec->package_paths = apr_array_copy(pool, spec->package_paths);
     copied_spec->pool = pool;
-    copied_spec->scope = AP_LUA_SCOPE_SERVER;
+    copied_spec->scope = spec->scope;
     copied_spec->codecache = spec->codecache;
     return copied_spec;
 }
@@ -421,6 +645,9 @@ static apr_status_t server_vm_construct(lua_State **resource, void *params, apr_
         if (L != NULL) {
             spec->L = L;
             *resource = (void*) spec;
+            if (((ap_lua_vm_spec *) params)->scope == AP_LUA_SCOPE_POOL) {
+                snapshot_globals(L);
+            }
             lua_pushlightuserdata(L, spec);
             lua_setfield(L, LUA_REGISTRYINDEX, "Apache2.Lua.server_spec");
             return APR_SUCCESS;
@@ -440,11 +667,14 @@ lua_State *ap_lua_get_lua_state(apr_pool_t *lifecycle_pool,
     ap_lua_finfo *cache_info = NULL;
     int tryCache = 0;
     
-    if (spec->scope == AP_LUA_SCOPE_SERVER) {
+    if (spec->scope == AP_LUA_SCOPE_SERVER || spec->scope == AP_LUA_SCOPE_POOL) {
         char *hash;
         apr_reslist_t* reslist = NULL;
         ap_lua_server_spec* sspec = NULL;
-        hash = apr_psprintf(r->pool, "reslist:%s", spec->file);
+        hash = apr_psprintf(r->pool, "%s:%s",
+                            spec->scope == AP_LUA_SCOPE_POOL ? "pool"
+                                                             : "reslist",
+                            spec->file);
 #if APR_HAS_THREADS
         apr_thread_mutex_lock(ap_lua_mutex);
 #endif
@@ -505,7 +735,8 @@ lua_State *ap_lua_get_lua_state(apr_pool_t *lifecycle_pool,
     }
     else {
         char* mkey;
-        if (spec->scope != AP_LUA_SCOPE_SERVER) {
+        if (spec->scope != AP_LUA_SCOPE_SERVER
+                && spec->scope != AP_LUA_SCOPE_POOL) {
             mkey = apr_psprintf(r->pool, "ap_lua_modified:%s", spec->file);
             apr_pool_userdata_get((void **)&cache_info, mkey, lifecycle_pool);
             if (cache_info == NULL) {
@@ -537,7 +768,7 @@ lua_State *ap_lua_get_lua_state(apr_pool_t *lifecycle_pool,
         int rc;
         ap_log_perror(APLOG_MARK, APLOG_DEBUG, 0, lifecycle_pool, APLOGNO(02332)
             "(re)loading lua file %s", spec->file);
-        rc = luaL_loadfile(L, spec->file);
+        rc = load_lua_file(L, spec, lifecycle_pool);
         if (rc != 0) {
             ap_log_perror(APLOG_MARK, APLOG_ERR, 0, lifecycle_pool, APLOGNO(02333)
                           "Error loading %s: %s", spec->file,
@@ -546,6 +777,9 @@ lua_State *ap_lua_get_lua_state(apr_pool_t *lifecycle_pool,
             return 0;
         }
         lua_pcall(L, 0, LUA_MULTRET, 0);
+        if (spec->scope == AP_LUA_SCOPE_POOL) {
+            snapshot_globals(L);
+        }
     }
 
     return L;
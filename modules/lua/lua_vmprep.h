@@ -41,6 +41,7 @@
 #define AP_LUA_SCOPE_CONN          3
 #define AP_LUA_SCOPE_THREAD        4
 #define AP_LUA_SCOPE_SERVER        5
+#define AP_LUA_SCOPE_POOL          6
 
 #define AP_LUA_CACHE_UNSET         0
 #define AP_LUA_CACHE_NEVER         1
@@ -64,7 +65,7 @@ typedef struct
     /* name of base file to load in the vm */
     const char *file;
 
-    /* APL_SCOPE_ONCE | APL_SCOPE_REQUEST | APL_SCOPE_CONN | APL_SCOPE_THREAD | APL_SCOPE_SERVER */
+    /* APL_SCOPE_ONCE | APL_SCOPE_REQUEST | APL_SCOPE_CONN | APL_SCOPE_THREAD | APL_SCOPE_SERVER | APL_SCOPE_POOL */
     int scope;
     unsigned int vm_min;
     unsigned int vm_max;
@@ -85,6 +86,22 @@ typedef struct
     int codecache;
 } ap_lua_vm_spec;
 
+/* Execution time histogram buckets: below 16us, then doubling up to
+ * 262ms, and above.
+ */
+#define AP_LUA_STATS_BUCKETS       16
+#define AP_LUA_STATS_MIN_USEC      16
+
+typedef struct
+{
+    const char *phase;
+    const char *file_name;
+    const char *function_name;
+    apr_uint32_t calls;
+    apr_uint32_t errors;
+    apr_uint32_t buckets[AP_LUA_STATS_BUCKETS];
+} ap_lua_handler_stats;
+
 typedef struct
 {
     const char *function_name;
@@ -94,6 +111,7 @@ typedef struct
     const char *bytecode;
     apr_size_t bytecode_len;
     int codecache;
+    ap_lua_handler_stats *stats;
 } ap_lua_mapped_handler_spec;
 
 typedef struct
@@ -135,6 +153,21 @@ void ap_lua_load_apache2_lmodule(lua_State *L);
 lua_State *ap_lua_get_lua_state(apr_pool_t *lifecycle_pool,
                                                 ap_lua_vm_spec *spec, request_rec* r);
 
+/*
+ * Initialize the per-process cache of the compiled Lua files, shared by
+ * all the lua_States loading them.
+ * @pool pool for the cache
+ * @s server_rec for logging
+ */
+void ap_lua_init_bytecode_cache(apr_pool_t *pool, server_rec *s);
+
+/*
+ * Restore the globals of a pooled lua_State to what they were once its
+ * file was loaded, and drop what the last request left on its stack.
+ * @L the lua_State to reset
+ */
+void ap_lua_reset_state(lua_State *L);
+
 #if APR_HAS_THREADS || defined(DOXYGEN)
 /*
  * Initialize mod_lua mutex.
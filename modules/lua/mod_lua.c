@@ -27,6 +27,8 @@
 #include "mod_ssl.h"
 #include "mod_auth.h"
 #include "util_mutex.h"
+#include "mod_status.h"
+#include "apr_atomic.h"
 
 
 #ifdef APR_HAS_THREADS
@@ -83,6 +85,11 @@ typedef struct
     int broken;
 } lua_filter_ctx;
 
+/* Execution time histograms of the hooks and mapped handlers (per child),
+ * <ap_lua_handler_stats *>
+ */
+static apr_array_header_t *lua_handler_stats;
+
 #define DEFAULT_LUA_SHMFILE "lua_ivm_shm"
 
 apr_global_mutex_t *lua_ivm_mutex;
@@ -145,6 +152,8 @@ static const char *scope_to_string(unsigned int scope)
         return "thread";
     case AP_LUA_SCOPE_SERVER:
         return "server";
+    case AP_LUA_SCOPE_POOL:
+        return "pool";
 #endif
     default:
         ap_assert(0);
@@ -157,12 +166,21 @@ static void ap_lua_release_state(lua_State* L, ap_lua_vm_spec* spec, request_rec
     char *hash;
     apr_reslist_t* reslist = NULL;
 
-    if (spec->scope == AP_LUA_SCOPE_SERVER) {
+    if (L == NULL) {
+        return;
+    }
+    if (spec->scope == AP_LUA_SCOPE_SERVER || spec->scope == AP_LUA_SCOPE_POOL) {
         ap_lua_server_spec* sspec = NULL;
+        if (spec->scope == AP_LUA_SCOPE_POOL) {
+            ap_lua_reset_state(L);
+        }
         lua_settop(L, 0);
         lua_getfield(L, LUA_REGISTRYINDEX, "Apache2.Lua.server_spec");
         sspec = (ap_lua_server_spec*) lua_touserdata(L, 1);
-        hash = apr_psprintf(r->pool, "reslist:%s", spec->file);
+        hash = apr_psprintf(r->pool, "%s:%s",
+                            spec->scope == AP_LUA_SCOPE_POOL ? "pool"
+                                                             : "reslist",
+                            spec->file);
         if (apr_pool_userdata_get((void **)&reslist, hash,
                                 r->server->process->pool) == APR_SUCCESS) {
             AP_DEBUG_ASSERT(sspec != NULL);
@@ -229,6 +247,7 @@ static ap_lua_vm_spec *create_vm_spec(apr_pool_t **lifecycle_pool,
         pool = apr_thread_pool_get(r->connection->current_thread);
         break;
     case AP_LUA_SCOPE_SERVER:
+    case AP_LUA_SCOPE_POOL:
         pool = r->server->process->pool;
         break;
 #endif
@@ -660,11 +679,53 @@ static apr_status_t lua_input_filter_handle(ap_filter_t *f,
 
 /* ---------------- Configury stuff --------------- */
 
+static ap_lua_handler_stats *make_handler_stats(cmd_parms *cmd,
+                                                const char *phase,
+                                                const char *file,
+                                                const char *function)
+{
+    ap_lua_handler_stats *stats;
+
+    /* Not for .htaccess, whose configuration is per request */
+    if (!lua_handler_stats || cmd->pool != cmd->server->process->pconf) {
+        return NULL;
+    }
+    stats = apr_pcalloc(cmd->pool, sizeof(ap_lua_handler_stats));
+    stats->phase = phase;
+    stats->file_name = file;
+    stats->function_name = function;
+    APR_ARRAY_PUSH(lua_handler_stats, ap_lua_handler_stats *) = stats;
+    return stats;
+}
+
+static void update_handler_stats(ap_lua_handler_stats *stats,
+                                 apr_time_t start, int failed)
+{
+    apr_interval_time_t usec;
+    int i;
+
+    if (!stats) {
+        return;
+    }
+    usec = apr_time_now() - start;
+    for (i = 0; i < AP_LUA_STATS_BUCKETS - 1; ++i) {
+        if (usec < ((apr_interval_time_t)AP_LUA_STATS_MIN_USEC << i)) {
+            break;
+        }
+    }
+    apr_atomic_inc32(&stats->calls);
+    if (failed) {
+        apr_atomic_inc32(&stats->errors);
+    }
+    apr_atomic_inc32(&stats->buckets[i]);
+}
+
 /** harnesses for magic hooks **/
 
 static int lua_request_rec_hook_harness(request_rec *r, const char *name, int apr_hook_when)
 {
     int rc;
+    apr_time_t start;
     apr_pool_t *pool;
     lua_State *L;
     ap_lua_vm_spec *spec;
@@ -684,6 +745,7 @@ static int lua_request_rec_hook_harness(request_rec *r, const char *name, int ap
             if (hook_spec == NULL) {
                 continue;
             }
+            start = apr_time_now();
             spec = create_vm_spec(&pool, r, cfg, server_cfg,
                                   hook_spec->file_name,
                                   hook_spec->bytecode,
@@ -697,6 +759,7 @@ static int lua_request_rec_hook_harness(request_rec *r, const char *name, int ap
                 ap_log_rerror(APLOG_MARK, APLOG_CRIT, 0, r, APLOGNO(01477)
                     "lua: Failed to obtain lua interpreter for entry function '%s' in %s",
                               hook_spec->function_name, hook_spec->file_name);
+                update_handler_stats(hook_spec->stats, start, 1);
                 return HTTP_INTERNAL_SERVER_ERROR;
             }
 
@@ -708,6 +771,7 @@ static int lua_request_rec_hook_harness(request_rec *r, const char *name, int ap
                                   hook_spec->function_name,
                                   hook_spec->file_name);
                     ap_lua_release_state(L, spec, r);
+                    update_handler_stats(hook_spec->stats, start, 1);
                     return HTTP_INTERNAL_SERVER_ERROR;
                 }
 
@@ -725,8 +789,10 @@ static int lua_request_rec_hook_harness(request_rec *r, const char *name, int ap
             if (lua_pcall(L, 1, 1, 0)) {
                 report_lua_error(L, r);
                 ap_lua_release_state(L, spec, r);
+                update_handler_stats(hook_spec->stats, start, 1);
                 return HTTP_INTERNAL_SERVER_ERROR;
             }
+            update_handler_stats(hook_spec->stats, start, 0);
             rc = DECLINED;
             if (lua_isnumber(L, -1)) {
                 rc = lua_tointeger(L, -1);
@@ -779,6 +845,7 @@ static int lua_map_handler_fixups(request_rec *r)
 static int lua_map_handler(request_rec *r)
 {
     int rc, n = 0;
+    apr_time_t start;
     apr_pool_t *pool;
     lua_State *L;
     const char *filename, *function_name;
@@ -804,6 +871,7 @@ static int lua_map_handler(request_rec *r)
                 }
                 else values[i] = "";
             }
+            start = apr_time_now();
             filename = ap_lua_interpolate_string(r->pool, hook_spec->file_name, values);
             function_name = ap_lua_interpolate_string(r->pool, hook_spec->function_name, values);
             spec = create_vm_spec(&pool, r, cfg, server_cfg,
@@ -819,6 +887,7 @@ static int lua_map_handler(request_rec *r)
                                 "lua: Failed to obtain Lua interpreter for entry function '%s' in %s",
                                 function_name, filename);
                 ap_lua_release_state(L, spec, r);
+                update_handler_stats(hook_spec->stats, start, 1);
                 return HTTP_INTERNAL_SERVER_ERROR;
             }
 
@@ -830,6 +899,7 @@ static int lua_map_handler(request_rec *r)
                                     function_name,
                                     filename);
                     ap_lua_release_state(L, spec, r);
+                    update_handler_stats(hook_spec->stats, start, 1);
                     return HTTP_INTERNAL_SERVER_ERROR;
                 }
 
@@ -847,8 +917,10 @@ static int lua_map_handler(request_rec *r)
             if (lua_pcall(L, 1, 1, 0)) {
                 report_lua_error(L, r);
                 ap_lua_release_state(L, spec, r);
+                update_handler_stats(hook_spec->stats, start, 1);
                 return HTTP_INTERNAL_SERVER_ERROR;
             }
+            update_handler_stats(hook_spec->stats, start, 0);
             rc = DECLINED;
             if (lua_isnumber(L, -1)) {
                 rc = lua_tointeger(L, -1);
@@ -1057,6 +1129,8 @@ static const char *register_named_block_function_hook(const char *name,
         else {
             function = NULL;
         }
+        spec->stats = make_handler_stats(cmd, name, spec->file_name,
+                                         spec->function_name);
 
         ctx.cmd = cmd;
         tmp = apr_pstrdup(cmd->pool, cmd->err_directive->directive + 1);
@@ -1134,6 +1208,8 @@ static const char *register_named_file_function_hook(const char *name,
     spec->file_name = apr_pstrdup(cmd->pool, file);
     spec->function_name = apr_pstrdup(cmd->pool, function);
     spec->scope = cfg->vm_scope;
+    spec->stats = make_handler_stats(cmd, name, spec->file_name,
+                                     spec->function_name);
 
     *(ap_lua_mapped_handler_spec **) apr_array_push(hook_specs) = spec;
     return NULL;
@@ -1156,6 +1232,8 @@ static const char *register_mapped_file_function_hook(const char *pattern,
     spec->function_name = apr_pstrdup(cmd->pool, function);
     spec->scope = cfg->vm_scope;
     spec->uri_pattern = regex;
+    spec->stats = make_handler_stats(cmd, "handler", spec->file_name,
+                                     spec->function_name);
 
     *(ap_lua_mapped_handler_spec **) apr_array_push(cfg->mapped_handlers) = spec;
     return NULL;
@@ -1638,7 +1716,7 @@ static const char *register_lua_scope(cmd_parms *cmd,
 #endif
         cfg->vm_scope = AP_LUA_SCOPE_THREAD;
     }
-    else if (strcmp("server", scope) == 0) {
+    else if (strcmp("server", scope) == 0 || strcmp("pool", scope) == 0) {
         unsigned int vmin, vmax;
 #if !APR_HAS_THREADS
         return apr_psprintf(cmd->pool,
@@ -1647,7 +1725,8 @@ static const char *register_lua_scope(cmd_parms *cmd,
                             "(APR_HAS_THREADS)" 
                             scope);
 #endif
-        cfg->vm_scope = AP_LUA_SCOPE_SERVER;
+        cfg->vm_scope = (scope[0] == 's') ? AP_LUA_SCOPE_SERVER
+                                          : AP_LUA_SCOPE_POOL;
         vmin = min ? atoi(min) : 1;
         vmax = max ? atoi(max) : 1;
         if (vmin == 0) {
@@ -1664,7 +1743,7 @@ static const char *register_lua_scope(cmd_parms *cmd,
                             "Invalid value for LuaScope, '%s', acceptable "
                             "values are: 'once', 'request', 'conn'"
 #if APR_HAS_THREADS
-                            ", 'thread', 'server'"
+                            ", 'thread', 'server', 'pool'"
 #endif
                             ,scope);
     }
@@ -1993,6 +2072,80 @@ static int lua_pre_config(apr_pool_t *pconf, apr_pool_t *plog,
                             apr_pool_t *ptemp)
 {
     ap_mutex_register(pconf, "lua-ivm-shm", NULL, APR_LOCK_DEFAULT, 0);
+    lua_handler_stats = apr_array_make(pconf, 8,
+                                       sizeof(ap_lua_handler_stats *));
+    return OK;
+}
+
+static void lua_child_init(apr_pool_t *p, server_rec *s)
+{
+    ap_lua_init_bytecode_cache(p, s);
+}
+
+static const char *stats_bucket_label(apr_pool_t *p, int i)
+{
+    apr_interval_time_t usec = (apr_interval_time_t)AP_LUA_STATS_MIN_USEC << i;
+
+    if (i == AP_LUA_STATS_BUCKETS - 1) {
+        return apr_psprintf(p, ">=%" APR_TIME_T_FMT "ms", (usec / 2) / 1000);
+    }
+    if (usec < 1000) {
+        return apr_psprintf(p, "<%" APR_TIME_T_FMT "us", usec);
+    }
+    return apr_psprintf(p, "<%" APR_TIME_T_FMT "ms", usec / 1000);
+}
+
+static int lua_status_hook(request_rec *r, int flags)
+{
+    int i, j;
+
+    if (!lua_handler_stats || !lua_handler_stats->nelts) {
+        return OK;
+    }
+
+    if (flags & AP_STATUS_SHORT) {
+        for (i = 0; i < lua_handler_stats->nelts; ++i) {
+            ap_lua_handler_stats *stats =
+                APR_ARRAY_IDX(lua_handler_stats, i, ap_lua_handler_stats *);
+
+            ap_rprintf(r, "LuaHandler%d: %s %s %s calls=%u errors=%u",
+                       i, stats->phase, stats->file_name,
+                       stats->function_name ? stats->function_name : "-",
+                       apr_atomic_read32(&stats->calls),
+                       apr_atomic_read32(&stats->errors));
+            for (j = 0; j < AP_LUA_STATS_BUCKETS; ++j) {
+                ap_rprintf(r, " %u", apr_atomic_read32(&stats->buckets[j]));
+            }
+            ap_rputs("\n", r);
+        }
+        return OK;
+    }
+
+    ap_rputs("<hr />\n<h2>mod_lua handlers (this child)</h2>\n"
+             "<table border=\"0\"><tr><th>Phase</th><th>File</th>"
+             "<th>Function</th><th>Calls</th><th>Errors</th>", r);
+    for (j = 0; j < AP_LUA_STATS_BUCKETS; ++j) {
+        ap_rprintf(r, "<th>%s</th>", stats_bucket_label(r->pool, j));
+    }
+    ap_rputs("</tr>\n", r);
+    for (i = 0; i < lua_handler_stats->nelts; ++i) {
+        ap_lua_handler_stats *stats =
+            APR_ARRAY_IDX(lua_handler_stats, i, ap_lua_handler_stats *);
+
+        ap_rprintf(r, "<tr><td>%s</td><td>%s</td><td>%s</td>"
+                   "<td>%u</td><td>%u</td>",
+                   stats->phase, ap_escape_html(r->pool, stats->file_name),
+                   stats->function_name
+                       ? ap_escape_html(r->pool, stats->function_name) : "-",
+                   apr_atomic_read32(&stats->calls),
+                   apr_atomic_read32(&stats->errors));
+        for (j = 0; j < AP_LUA_STATS_BUCKETS; ++j) {
+            ap_rprintf(r, "<td>%u</td>",
+                       apr_atomic_read32(&stats->buckets[j]));
+        }
+        ap_rputs("</tr>\n", r);
+    }
+    ap_rputs("</table>\n", r);
     return OK;
 }
 
@@ -2157,6 +2310,9 @@ static void lua_register_hooks(apr_pool_t *p)
 #if APR_HAS_THREADS
     ap_hook_child_init(ap_lua_init_mutex, NULL, NULL, APR_HOOK_MIDDLE);
 #endif
+    ap_hook_child_init(lua_child_init, NULL, NULL, APR_HOOK_MIDDLE);
+    APR_OPTIONAL_HOOK(ap, status_hook, lua_status_hook, NULL, NULL,
+                      APR_HOOK_MIDDLE);
     /* providers */
     lua_authz_providers = apr_hash_make(p);
     
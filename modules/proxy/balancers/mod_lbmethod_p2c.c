@@ -0,0 +1,281 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Power of two choices load balancing: two workers are picked at random
+ * and the least loaded one is elected, which needs neither a scan of all
+ * the workers nor the balancer lock.
+ *
+ * "p2c" weighs the number of active requests of the workers (busy) by
+ * their lbfactor, "peakewma" multiplies it by the peak EWMA of their
+ * response times, which is raised immediately by a slower response and
+ * decays towards the faster ones (and while the worker is not used).
+ */
+
+#include "mod_proxy.h"
+#include "scoreboard.h"
+#include "ap_mpm.h"
+#include "apr_version.h"
+#include "apr_atomic.h"
+#include "ap_hooks.h"
+
+#if APR_HAVE_UNISTD_H
+#include <unistd.h>         /* for getpid() */
+#endif
+
+module AP_MODULE_DECLARE_DATA lbmethod_p2c_module;
+
+static APR_OPTIONAL_FN_TYPE(proxy_balancer_get_best_worker)
+                            *ap_proxy_balancer_get_best_worker_fn = NULL;
+
+/* Decay time of the response time EWMA (msec) */
+#ifndef PEAK_EWMA_DECAY
+#define PEAK_EWMA_DECAY 10000
+#endif
+
+/* Cost of a worker with requests in flight but no response time yet */
+#define PEAK_EWMA_PENALTY 1.0e9
+
+/* Random draws before falling back to a scan of the workers */
+#define P2C_DRAWS 4
+
+static apr_uint32_t p2c_seq;
+
+/* Lock-free pseudo random numbers, from a shared sequence */
+static apr_uint32_t p2c_random(void)
+{
+    apr_uint32_t x = apr_atomic_add32(&p2c_seq, 0x9e3779b9);
+
+    /* murmur3 finalizer */
+    x ^= x >> 16;
+    x *= 0x85ebca6b;
+    x ^= x >> 13;
+    x *= 0xc2b2ae35;
+    x ^= x >> 16;
+    return x;
+}
+
+static APR_INLINE apr_uint32_t now_msec(void)
+{
+    return (apr_uint32_t)apr_time_as_msec(apr_time_now());
+}
+
+static double lbfactor_of(proxy_worker *worker)
+{
+    return worker->s->lbfactor > 0 ? worker->s->lbfactor : 1;
+}
+
+static double cost_p2c(proxy_worker *worker)
+{
+    return (double)(worker->s->busy + 1) / lbfactor_of(worker);
+}
+
+/* The EWMA decayed since its last update, as if responses took no time */
+static double peak_ewma(proxy_worker *worker)
+{
+    double ewma = apr_atomic_read32(&worker->s->response_ewma);
+    apr_uint32_t elapsed = now_msec()
+                           - apr_atomic_read32(&worker->s->response_stamp);
+
+    return ewma * PEAK_EWMA_DECAY / (PEAK_EWMA_DECAY + (double)elapsed);
+}
+
+static double cost_peakewma(proxy_worker *worker)
+{
+    double ewma = peak_ewma(worker);
+
+    if (ewma == 0 && worker->s->busy) {
+        return PEAK_EWMA_PENALTY + worker->s->busy;
+    }
+    return ewma * (worker->s->busy + 1) / lbfactor_of(worker);
+}
+
+typedef double p2c_cost_fn(proxy_worker *worker);
+
+static int is_best_p2c(proxy_worker *current, proxy_worker *prev_best,
+                       void *baton)
+{
+    p2c_cost_fn *cost = (p2c_cost_fn *)baton;
+
+    return !prev_best || cost(current) < cost(prev_best);
+}
+
+/* A worker which can be elected without considering lbsets, spares or
+ * standbys.
+ */
+static APR_INLINE int is_candidate(proxy_worker *worker)
+{
+    return PROXY_WORKER_IS_USABLE(worker)
+           && !PROXY_WORKER_IS_DRAINING(worker)
+           && !PROXY_WORKER_IS_SPARE(worker)
+           && !PROXY_WORKER_IS_STANDBY(worker)
+           && worker->s->lbset == 0;
+}
+
+static proxy_worker *find_best_p2c_cost(proxy_balancer *balancer,
+                                        request_rec *r, p2c_cost_fn *cost)
+{
+    proxy_worker **workers = (proxy_worker **)balancer->workers->elts;
+    apr_uint32_t n = balancer->workers->nelts;
+    int i;
+
+    if (n == 1) {
+        if (is_candidate(workers[0])) {
+            return workers[0];
+        }
+    }
+    else if (n > 1) {
+        for (i = 0; i < P2C_DRAWS; ++i) {
+            apr_uint32_t x = p2c_random();
+            proxy_worker *a = workers[x % n];
+            proxy_worker *b = workers[(x % n + 1 + (x / n) % (n - 1)) % n];
+
+            if (is_candidate(a) && is_candidate(b)) {
+                return cost(b) < cost(a) ? b : a;
+            }
+        }
+    }
+
+    /* Too many unusable workers (or lbsets), do it the long way */
+    return ap_proxy_balancer_get_best_worker_fn(balancer, r, is_best_p2c,
+                                                (void *)cost);
+}
+
+static proxy_worker *find_best_p2c(proxy_balancer *balancer, request_rec *r)
+{
+    return find_best_p2c_cost(balancer, r, cost_p2c);
+}
+
+static proxy_worker *find_best_peakewma(proxy_balancer *balancer,
+                                        request_rec *r)
+{
+    return find_best_p2c_cost(balancer, r, cost_peakewma);
+}
+
+static void response_time_peakewma(proxy_balancer *balancer,
+                                   proxy_worker *worker,
+                                   apr_interval_time_t elapsed,
+                                   request_rec *r)
+{
+    double rtt = elapsed > 0 ? (double)elapsed : 1, ewma, w;
+    apr_uint32_t now = now_msec();
+
+    /* Lost updates from concurrent requests don't matter much here */
+    ewma = apr_atomic_read32(&worker->s->response_ewma);
+    if (rtt > ewma) {
+        ewma = rtt;
+    }
+    else {
+        w = (double)PEAK_EWMA_DECAY / (PEAK_EWMA_DECAY + (double)(now -
+                apr_atomic_read32(&worker->s->response_stamp)));
+        ewma = ewma * w + rtt * (1 - w);
+    }
+    if (ewma > APR_UINT32_MAX) {
+        ewma = APR_UINT32_MAX;
+    }
+    apr_atomic_set32(&worker->s->response_stamp, now);
+    apr_atomic_set32(&worker->s->response_ewma, (apr_uint32_t)ewma);
+}
+
+/* assumed to be mutex protected by caller */
+static apr_status_t reset(proxy_balancer *balancer, server_rec *s)
+{
+    int i;
+    proxy_worker **worker;
+    worker = (proxy_worker **)balancer->workers->elts;
+    for (i = 0; i < balancer->workers->nelts; i++, worker++) {
+        (*worker)->s->lbstatus = 0;
+        (*worker)->s->busy = 0;
+        (*worker)->s->response_ewma = 0;
+        (*worker)->s->response_stamp = 0;
+    }
+    return APR_SUCCESS;
+}
+
+static apr_status_t age(proxy_balancer *balancer, server_rec *s)
+{
+    return APR_SUCCESS;
+}
+
+static const proxy_balancer_method p2c =
+{
+    "p2c",
+    &find_best_p2c,
+    NULL,
+    &reset,
+    &age,
+    NULL,
+    NULL,
+    PROXY_LBMETHOD_LOCKLESS
+};
+
+static const proxy_balancer_method peakewma =
+{
+    "peakewma",
+    &find_best_peakewma,
+    NULL,
+    &reset,
+    &age,
+    NULL,
+    &response_time_peakewma,
+    PROXY_LBMETHOD_LOCKLESS
+};
+
+/* post_config hook: */
+static int lbmethod_p2c_post_config(apr_pool_t *pconf, apr_pool_t *plog,
+        apr_pool_t *ptemp, server_rec *s)
+{
+
+    /* lbmethod_p2c_post_config() will be called twice during startup.  So, don't
+     * set up the static data the 1st time through. */
+    if (ap_state_query(AP_SQ_MAIN_STATE) == AP_SQ_MS_CREATE_PRE_CONFIG) {
+        return OK;
+    }
+
+    ap_proxy_balancer_get_best_worker_fn =
+                 APR_RETRIEVE_OPTIONAL_FN(proxy_balancer_get_best_worker);
+    if (!ap_proxy_balancer_get_best_worker_fn) {
+        ap_log_error(APLOG_MARK, APLOG_EMERG, 0, s, APLOGNO(10294)
+                     "mod_proxy must be loaded for mod_lbmethod_p2c");
+        return !OK;
+    }
+
+    return OK;
+}
+
+static void lbmethod_p2c_child_init(apr_pool_t *p, server_rec *s)
+{
+    /* Don't make the same choices in all the children */
+    p2c_seq = (apr_uint32_t)apr_time_now() ^ ((apr_uint32_t)getpid() << 16);
+}
+
+static void register_hook(apr_pool_t *p)
+{
+    ap_register_provider(p, PROXY_LBMETHOD, "p2c", "0", &p2c);
+    ap_register_provider(p, PROXY_LBMETHOD, "peakewma", "0", &peakewma);
+    ap_hook_post_config(lbmethod_p2c_post_config, NULL, NULL, APR_HOOK_MIDDLE);
+    ap_hook_child_init(lbmethod_p2c_child_init, NULL, NULL, APR_HOOK_MIDDLE);
+}
+
+AP_DECLARE_MODULE(lbmethod_p2c) = {
+    STANDARD20_MODULE_STUFF,
+    NULL,       /* create per-directory config structure */
+    NULL,       /* merge per-directory config structures */
+    NULL,       /* create per-server config structure */
+    NULL,       /* merge per-server config structures */
+    NULL,       /* command apr_table_t */
+    register_hook /* register hooks */
+};
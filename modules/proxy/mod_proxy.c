@@ -77,6 +77,12 @@ proxy_wstat_t PROXY_DECLARE_DATA proxy_wstat_tbl[] = {
 static const char * const proxy_id = "proxy";
 apr_global_mutex_t *proxy_mutex = NULL;
 
+/* ProxyDNSCache, for the whole server */
+#define PROXY_DNS_NEGATIVE_TTL_DEFAULT apr_time_from_sec(5)
+static apr_interval_time_t proxy_dns_ttl = 0;
+static apr_interval_time_t proxy_dns_negative_ttl =
+    PROXY_DNS_NEGATIVE_TTL_DEFAULT;
+
 /*
  * A Web proxy module. Stages:
  *
@@ -1320,6 +1326,14 @@ static int proxy_handler(request_rec *r)
         goto cleanup;
     }
 cleanup:
+    if (access_status == SUSPENDED) {
+        /* The scheme handler completes the request asynchronously, and
+         * runs the post_request and request_status hooks then, with the
+         * worker still in use until that.
+         */
+        return SUSPENDED;
+    }
+
     /*
      * Save current r->status and set it to the value of access_status which
      * might be different (e.g. r->status could be HTTP_OK if e.g. we override
@@ -1593,6 +1607,8 @@ static void *create_proxy_dir_config(apr_pool_t *p, char *dummy)
     new->add_forwarded_headers_set = 0;
     new->forward_100_continue = 1;
     new->forward_100_continue_set = 0;
+    new->async_delay = -1;
+    new->async_delay_set = 0;
 
     return (void *) new;
 }
@@ -1650,6 +1666,9 @@ static void *merge_proxy_dir_config(apr_pool_t *p, void *basev, void *addv)
                                              : add->forward_100_continue;
     new->forward_100_continue_set = add->forward_100_continue_set
                                     || base->forward_100_continue_set;
+    new->async_delay = (add->async_delay_set == 0) ? base->async_delay
+                                                   : add->async_delay;
+    new->async_delay_set = add->async_delay_set || base->async_delay_set;
     
     return new;
 }
@@ -2210,6 +2229,49 @@ static const char *
    return NULL;
 }
 
+static const char *
+    set_async_delay(cmd_parms *parms, void *dconf, const char *arg)
+{
+    proxy_dir_conf *conf = dconf;
+
+    if (strcasecmp(arg, "off") == 0) {
+        conf->async_delay = -1;
+    }
+    else if (ap_timeout_parameter_parse(arg, &conf->async_delay, "s")
+                 != APR_SUCCESS || conf->async_delay < 0) {
+        return "ProxyAsyncDelay must be off or a positive or zero timeout";
+    }
+    conf->async_delay_set = 1;
+    return NULL;
+}
+
+static const char *
+    set_dns_cache(cmd_parms *parms, void *dummy, const char *arg1,
+                  const char *arg2)
+{
+    apr_interval_time_t ttl, negative_ttl = PROXY_DNS_NEGATIVE_TTL_DEFAULT;
+    const char *err = ap_check_cmd_context(parms, GLOBAL_ONLY);
+
+    if (err) {
+        return err;
+    }
+    if (strcasecmp(arg1, "off") == 0) {
+        ttl = 0;
+    }
+    else if (ap_timeout_parameter_parse(arg1, &ttl, "s") != APR_SUCCESS
+             || ttl <= 0) {
+        return "ProxyDNSCache TTL must be off or a positive timeout";
+    }
+    if (arg2 && (ap_timeout_parameter_parse(arg2, &negative_ttl, "s")
+                     != APR_SUCCESS || negative_ttl < 0)) {
+        return "ProxyDNSCache negative TTL must be a positive or zero "
+               "timeout";
+    }
+    proxy_dns_ttl = ttl;
+    proxy_dns_negative_ttl = negative_ttl;
+    return NULL;
+}
+
 static const char *
     set_recv_buffer_size(cmd_parms *parms, void *dummy, const char *arg)
 {
@@ -2799,6 +2861,12 @@ static const command_rec proxy_cmds[] =
     AP_INIT_FLAG("Proxy100Continue", forward_100_continue, NULL, RSRC_CONF|ACCESS_CONF,
      "on if 100-Continue should be forwarded to the origin server, off if the "
      "proxy should handle it by itself"),
+    AP_INIT_TAKE1("ProxyAsyncDelay", set_async_delay, NULL, RSRC_CONF|ACCESS_CONF,
+     "time to wait for the origin server before relaying the rest of the "
+     "response asynchronously, or off"),
+    AP_INIT_TAKE12("ProxyDNSCache", set_dns_cache, NULL, RSRC_CONF,
+     "how long resolved backend addresses are used before being refreshed "
+     "(or off), and how long failed lookups are cached"),
     {NULL}
 };
 
@@ -3048,6 +3116,8 @@ static void child_init(apr_pool_t *p, server_rec *s)
         exit(1); /* Ugly, but what else? */
     }
 
+    proxy_dns_cache_init(p, s, proxy_dns_ttl, proxy_dns_negative_ttl);
+
     /* TODO */
     while (s) {
         void *sconf = s->module_config;
@@ -3128,6 +3198,8 @@ static int proxy_pre_config(apr_pool_t *pconf, apr_pool_t *plog,
                       APR_HOOK_MIDDLE);
     /* Reset workers count on graceful restart */
     proxy_lb_workers = 0;
+    proxy_dns_ttl = 0;
+    proxy_dns_negative_ttl = PROXY_DNS_NEGATIVE_TTL_DEFAULT;
     set_worker_hc_param_f = APR_RETRIEVE_OPTIONAL_FN(set_worker_hc_param);
     return OK;
 }
@@ -243,6 +243,12 @@ typedef struct {
     unsigned int forward_100_continue_set:1;
 
     apr_array_header_t *error_override_codes;
+
+    /** Time to wait for the backend before suspending the relay of a
+     * response body (asynchronous MPMs), negative for never.
+     */
+    apr_interval_time_t async_delay;
+    unsigned int async_delay_set:1;
 } proxy_dir_conf;
 
 /* if we interpolate env vars per-request, we'll need a per-request
@@ -279,6 +285,8 @@ typedef struct {
                                 * and its scpool/bucket_alloc (NULL before),
                                 * must be left cleaned when used (locally).
                                 */
+    void         *dns_addrs;   /* Addresses of the resolver cache in use
+                                * (ProxyDNSCache), which addr points to */
 } proxy_conn_rec;
 
 typedef struct {
@@ -293,6 +301,7 @@ struct proxy_conn_pool {
     apr_reslist_t  *res;      /* Connection resource list */
     proxy_conn_rec *conn;     /* Single connection for prefork mpm */
     apr_pool_t     *dns_pool; /* The pool used for worker scoped DNS resolutions */
+    apr_uint32_t    idle;     /* Connected idle connections (this child) */
 };
 
 #define AP_VOLATILIZE_T(T, x) (*(T volatile *)&(x))
@@ -467,6 +476,16 @@ typedef struct {
     unsigned int     was_malloced:1;
     unsigned int     is_name_matchable:1;
     unsigned int     response_field_size_set:1;
+    apr_uint32_t    dns_hits;       /* Lookups served by the resolver cache */
+    apr_uint32_t    dns_misses;     /* Lookups which had to be resolved */
+    apr_uint32_t    dns_refreshes;  /* Background refreshes triggered */
+    apr_uint32_t    dns_failures;   /* Failed (or negatively cached) lookups */
+    apr_uint32_t    response_ewma;  /* Peak EWMA of the response time (usec) */
+    apr_uint32_t    response_stamp; /* Last update of response_ewma (msec) */
+    int             warm;           /* Idle connections kept open per child */
+    apr_uint32_t    conns_new;      /* Connections established for requests */
+    apr_uint32_t    conns_reused;   /* Requests served on an idle connection */
+    apr_uint32_t    conns_warmed;   /* Connections established by warm-up */
 } proxy_worker_shared;
 
 #define ALIGNED_PROXY_WORKER_SHARED_SIZE (APR_ALIGN_DEFAULT(sizeof(proxy_worker_shared)))
@@ -558,8 +577,16 @@ struct proxy_balancer_method {
     apr_status_t (*reset)(proxy_balancer *balancer, server_rec *s);
     apr_status_t (*age)(proxy_balancer *balancer, server_rec *s);
     apr_status_t (*updatelbstatus)(proxy_balancer *balancer, proxy_worker *elected, server_rec *s);
+    /* Optional, called with the response time of the worker after each
+     * request, without the balancer lock */
+    void (*response_time)(proxy_balancer *balancer, proxy_worker *worker,
+                          apr_interval_time_t elapsed, request_rec *r);
+    unsigned int flags;         /* PROXY_LBMETHOD_* */
 };
 
+/* The finder does not need the balancer lock */
+#define PROXY_LBMETHOD_LOCKLESS 0x1
+
 #if APR_HAS_THREADS
 #define PROXY_THREAD_LOCK(x)      ( (x) && (x)->tmutex ? apr_thread_mutex_lock((x)->tmutex) : APR_SUCCESS)
 #define PROXY_THREAD_UNLOCK(x)    ( (x) && (x)->tmutex ? apr_thread_mutex_unlock((x)->tmutex) : APR_SUCCESS)
@@ -1076,6 +1103,25 @@ PROXY_DECLARE(int) ap_proxy_connect_backend(const char *proxy_function,
                                             proxy_worker *worker,
                                             server_rec *s);
 
+/**
+ * Keep worker->s->warm idle connections of this child open to the backend
+ * @param proxy_function calling proxy scheme (for logging)
+ * @param worker  worker whose connection pool is warmed
+ * @param s       current server record
+ * @param p       temporary pool
+ * @return        number of connections established, or -1 if the
+ *                backend could not be reached
+ * @note The idle connections of the pool are checked (and replaced if
+ * they were closed by the backend), and new ones are established up to
+ * worker->s->warm, including the TLS handshake for https and wss workers.
+ * This works only with connection pools (threaded MPMs), and not for Unix
+ * domain sockets, ProxyRemote'd or HTTP/2 workers.
+ */
+PROXY_DECLARE(int) ap_proxy_warm_connections(const char *proxy_function,
+                                             proxy_worker *worker,
+                                             server_rec *s,
+                                             apr_pool_t *p);
+
 /**
  * Make a connection to a Unix Domain Socket (UDS) path
  * @param sock     UDS to connect
@@ -345,9 +345,10 @@ static proxy_worker *find_best_worker(proxy_balancer *balancer,
 {
     proxy_worker *candidate = NULL;
     apr_status_t rv;
+    int lock = !(balancer->lbmethod->flags & PROXY_LBMETHOD_LOCKLESS);
 
 #if APR_HAS_THREADS
-    if ((rv = PROXY_THREAD_LOCK(balancer)) != APR_SUCCESS) {
+    if (lock && (rv = PROXY_THREAD_LOCK(balancer)) != APR_SUCCESS) {
         ap_log_rerror(APLOG_MARK, APLOG_ERR, rv, r, APLOGNO(01163)
                       "%s: Lock failed for find_best_worker()",
                       balancer->s->name);
@@ -361,7 +362,7 @@ static proxy_worker *find_best_worker(proxy_balancer *balancer,
         candidate->s->elected++;
 
 #if APR_HAS_THREADS
-    if ((rv = PROXY_THREAD_UNLOCK(balancer)) != APR_SUCCESS) {
+    if (lock && (rv = PROXY_THREAD_UNLOCK(balancer)) != APR_SUCCESS) {
         ap_log_rerror(APLOG_MARK, APLOG_ERR, rv, r, APLOGNO(01164)
                       "%s: Unlock failed for find_best_worker()",
                       balancer->s->name);
@@ -614,6 +615,18 @@ static int proxy_balancer_pre_request(proxy_worker **worker,
     apr_pool_cleanup_register(r->pool, *worker, decrement_busy_count,
                               apr_pool_cleanup_null);
 
+    /* Time the response for the LB implementation */
+    if ((*balancer)->lbmethod && (*balancer)->lbmethod->response_time) {
+        apr_time_t *start = ap_get_module_config(r->request_config,
+                                                 &proxy_balancer_module);
+        if (!start) {
+            start = apr_palloc(r->pool, sizeof(*start));
+            ap_set_module_config(r->request_config, &proxy_balancer_module,
+                                 start);
+        }
+        *start = apr_time_now();
+    }
+
     /* Add balancer/worker info to env. */
     apr_table_setn(r->subprocess_env,
                    "BALANCER_NAME", (*balancer)->s->name);
@@ -699,6 +712,15 @@ static int proxy_balancer_post_request(proxy_worker *worker,
                       "%s: Unlock failed for post_request", balancer->s->name);
     }
 #endif
+    if (balancer->lbmethod && balancer->lbmethod->response_time) {
+        apr_time_t *start = ap_get_module_config(r->request_config,
+                                                 &proxy_balancer_module);
+        if (start) {
+            balancer->lbmethod->response_time(balancer, worker,
+                                              apr_time_now() - *start, r);
+        }
+    }
+
     ap_log_rerror(APLOG_MARK, APLOG_DEBUG, 0, r, APLOGNO(01176)
                   "proxy_balancer_post_request for (%s)", balancer->s->name);
 
@@ -1373,6 +1395,15 @@ static int balancer_process_balancer_worker(request_rec *r, proxy_server_conf *c
     return APR_SUCCESS;
 }
 
+/* Percentage of the backend connections which were idle connections */
+static unsigned int reuse_ratio(proxy_worker *worker)
+{
+    apr_uint64_t reused = worker->s->conns_reused;
+    apr_uint64_t total = reused + worker->s->conns_new;
+
+    return total ? (unsigned int)(reused * 100 / total) : 0;
+}
+
 /*
  * builds the page and links to configure via HTLM or XML.
  */
@@ -1500,6 +1531,23 @@ static void balancer_display_page(request_rec *r, proxy_server_conf *conf,
                 ap_rprintf(r,
                            "          <httpd:elected>%" APR_SIZE_T_FMT "</httpd:elected>\n",
                            worker->s->elected);
+                ap_rprintf(r,
+                           "          <httpd:dns_hits>%u</httpd:dns_hits>\n"
+                           "          <httpd:dns_misses>%u</httpd:dns_misses>\n"
+                           "          <httpd:dns_refreshes>%u</httpd:dns_refreshes>\n"
+                           "          <httpd:dns_failures>%u</httpd:dns_failures>\n",
+                           worker->s->dns_hits, worker->s->dns_misses,
+                           worker->s->dns_refreshes, worker->s->dns_failures);
+                ap_rprintf(r,
+                           "          <httpd:warm>%d</httpd:warm>\n"
+                           "          <httpd:conns_idle>%u</httpd:conns_idle>\n"
+                           "          <httpd:conns_new>%u</httpd:conns_new>\n"
+                           "          <httpd:conns_reused>%u</httpd:conns_reused>\n"
+                           "          <httpd:conns_warmed>%u</httpd:conns_warmed>\n",
+                           worker->s->warm,
+                           worker->cp ? worker->cp->idle : 0,
+                           worker->s->conns_new, worker->s->conns_reused,
+                           worker->s->conns_warmed);
                 ap_rvputs(r, "          <httpd:route>",
                           ap_escape_html(r->pool, worker->s->route),
                           "</httpd:route>\n", NULL);
@@ -1654,7 +1702,9 @@ static void balancer_display_page(request_rec *r, proxy_server_conf *conf,
                 "<th>Worker URL</th>"
                 "<th>Route</th><th>RouteRedir</th>"
                 "<th>Factor</th><th>Set</th><th>Status</th>"
-                "<th>Elected</th><th>Busy</th><th>Load</th><th>To</th><th>From</th>", r);
+                "<th>Elected</th><th>Busy</th><th>Load</th><th>To</th><th>From</th>"
+                "<th>DNS Hit/Miss/Refr/Fail</th>"
+                "<th>Conns Idle/Warm</th><th>Reuse</th>", r);
             if (set_worker_hc_param_f) {
                 ap_rputs("<th>HC Method</th><th>HC Interval</th><th>Passes</th><th>Fails</th><th>HC uri</th><th>HC Expr</th>", r);
             }
@@ -1686,6 +1736,13 @@ static void balancer_display_page(request_rec *r, proxy_server_conf *conf,
                 ap_rputs(apr_strfsize(worker->s->transferred, fbuf), r);
                 ap_rputs("</td><td>", r);
                 ap_rputs(apr_strfsize(worker->s->read, fbuf), r);
+                ap_rprintf(r, "</td><td>%u/%u/%u/%u",
+                           worker->s->dns_hits, worker->s->dns_misses,
+                           worker->s->dns_refreshes, worker->s->dns_failures);
+                ap_rprintf(r, "</td><td>%u/%d</td><td>%u%%",
+                           worker->cp ? worker->cp->idle : 0,
+                           worker->s->warm,
+                           reuse_ratio(worker));
                 if (set_worker_hc_param_f) {
                     ap_rprintf(r, "</td><td>%s</td>", ap_proxy_show_hcmethod(worker->s->method));
                     ap_rprintf(r, "<td>%" APR_TIME_T_FMT "ms</td>", apr_time_as_msec(worker->s->interval));
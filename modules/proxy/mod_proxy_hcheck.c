@@ -24,6 +24,7 @@
 module AP_MODULE_DECLARE_DATA proxy_hcheck_module;
 
 #define HCHECK_WATHCHDOG_NAME ("_proxy_hcheck_")
+#define HCHECK_WARM_WATHCHDOG_NAME ("_proxy_hcheck_warm_")
 #define HC_THREADPOOL_SIZE (16)
 
 /* Why? So we can easily set/clear HC_USE_THREADS during dev testing */
@@ -44,6 +45,7 @@ typedef struct {
     apr_interval_time_t interval;
     char *hurl;
     char *hcexpr;
+    int warm;
 } hc_template_t;
 
 typedef struct {
@@ -89,6 +91,7 @@ static void *hc_create_config(apr_pool_t *p, server_rec *s)
 }
 
 static ap_watchdog_t *watchdog;
+static ap_watchdog_t *warm_watchdog;
 static int tpsize = HC_THREADPOOL_SIZE;
 
 /*
@@ -127,6 +130,7 @@ static const char *set_worker_hc_param(apr_pool_t *p,
                     worker->s->fails = template->fails;
                     PROXY_STRNCPY(worker->s->hcuri, template->hurl);
                     PROXY_STRNCPY(worker->s->hcexpr, template->hcexpr);
+                    worker->s->warm = template->warm;
                 } else {
                     temp->method = template->method;
                     temp->interval = template->interval;
@@ -134,6 +138,7 @@ static const char *set_worker_hc_param(apr_pool_t *p,
                     temp->fails = template->fails;
                     temp->hurl = apr_pstrdup(p, template->hurl);
                     temp->hcexpr = apr_pstrdup(p, template->hcexpr);
+                    temp->warm = template->warm;
                 }
                 return NULL;
             }
@@ -219,6 +224,16 @@ static const char *set_worker_hc_param(apr_pool_t *p,
             temp->hcexpr = apr_pstrdup(p, val);
         }
     }
+    else if (!strcasecmp(key, "hcwarm")) {
+        ival = atoi(val);
+        if (ival < 0)
+            return "Warm must be a positive value";
+        if (worker) {
+            worker->s->warm = ival;
+        } else {
+            temp->warm = ival;
+        }
+    }
   else {
         return "unknown Worker hcheck parameter";
     }
@@ -294,6 +309,7 @@ static const char *set_hc_template(cmd_parms *cmd, void *dummy, const char *arg)
     template->interval = apr_time_from_sec(HCHECK_WATHCHDOG_DEFAULT_INTERVAL);
     template->hurl = NULL;
     template->hcexpr = NULL;
+    template->warm = 0;
     while (*arg) {
         word = ap_getword_conf(cmd->pool, &arg);
         val = strchr(word, '=');
@@ -1001,10 +1017,84 @@ static apr_status_t hc_watchdog_callback(int state, void *data,
     }
     return rv;
 }
+/*
+ * Unlike the health checks, the warm-up of the connection pools (hcwarm)
+ * runs in every child, for its own pools.
+ */
+static apr_status_t hc_warm_watchdog_callback(int state, void *data,
+                                              apr_pool_t *pool)
+{
+    sctx_t *ctx = (sctx_t *)data;
+    server_rec *s = ctx->s;
+    proxy_server_conf *conf;
+    proxy_balancer *balancer;
+    proxy_worker *worker;
+    apr_pool_t *ptemp;
+    int i, n;
+
+    if (state != AP_WATCHDOG_STATE_RUNNING) {
+        return APR_SUCCESS;
+    }
+
+    conf = (proxy_server_conf *) ap_get_module_config(s->module_config, &proxy_module);
+    apr_pool_create(&ptemp, pool);
+    apr_pool_tag(ptemp, "hc_warm");
+    worker = (proxy_worker *)conf->workers->elts;
+    for (i = 0; i < conf->workers->nelts; i++, worker++) {
+        ap_proxy_warm_connections("HCWARM", worker, s, ptemp);
+    }
+    balancer = (proxy_balancer *)conf->balancers->elts;
+    for (i = 0; i < conf->balancers->nelts; i++, balancer++) {
+        proxy_worker **workers;
+#if APR_HAS_THREADS
+        /* Warm the members added by the balancer-manager too */
+        if (balancer->tmutex
+                && apr_thread_mutex_lock(balancer->tmutex) == APR_SUCCESS) {
+            ap_proxy_sync_balancer(balancer, s, conf);
+            apr_thread_mutex_unlock(balancer->tmutex);
+        }
+#endif
+        workers = (proxy_worker **)balancer->workers->elts;
+        for (n = 0; n < balancer->workers->nelts; n++) {
+            ap_proxy_warm_connections("HCWARM", workers[n], s, ptemp);
+        }
+        apr_pool_clear(ptemp);
+    }
+    apr_pool_destroy(ptemp);
+    return APR_SUCCESS;
+}
+
+static int hc_need_warm(server_rec *s)
+{
+    proxy_server_conf *conf;
+    proxy_balancer *balancer;
+    proxy_worker *worker;
+    int i, n;
+
+    conf = (proxy_server_conf *) ap_get_module_config(s->module_config, &proxy_module);
+    worker = (proxy_worker *)conf->workers->elts;
+    for (i = 0; i < conf->workers->nelts; i++, worker++) {
+        if (worker->s->warm) {
+            return 1;
+        }
+    }
+    balancer = (proxy_balancer *)conf->balancers->elts;
+    for (i = 0; i < conf->balancers->nelts; i++, balancer++) {
+        proxy_worker **workers = (proxy_worker **)balancer->workers->elts;
+        for (n = 0; n < balancer->workers->nelts; n++) {
+            if (workers[n]->s->warm) {
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
 static int hc_pre_config(apr_pool_t *pconf, apr_pool_t *plog,
                          apr_pool_t *ptemp)
 {
     tpsize = HC_THREADPOOL_SIZE;
+    warm_watchdog = NULL;
     return OK;
 }
 static int hc_post_config(apr_pool_t *p, apr_pool_t *plog,
@@ -1058,6 +1148,29 @@ static int hc_post_config(apr_pool_t *p, apr_pool_t *plog,
         }
         ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, s, APLOGNO(03265)
                      "watchdog callback registered (%s for %s)", HCHECK_WATHCHDOG_NAME, s->server_hostname);
+        if (hc_need_warm(s)) {
+            if (!warm_watchdog) {
+                rv = hc_watchdog_get_instance(&warm_watchdog,
+                                              HCHECK_WARM_WATHCHDOG_NAME,
+                                              0, 0, p);
+                if (rv) {
+                    ap_log_error(APLOG_MARK, APLOG_CRIT, rv, s, APLOGNO(10298)
+                                 "Failed to create watchdog instance (%s)",
+                                 HCHECK_WARM_WATHCHDOG_NAME);
+                    return !OK;
+                }
+            }
+            rv = hc_watchdog_register_callback(warm_watchdog,
+                    AP_WD_TM_INTERVAL,
+                    ctx,
+                    hc_warm_watchdog_callback);
+            if (rv) {
+                ap_log_error(APLOG_MARK, APLOG_CRIT, rv, s, APLOGNO(10299)
+                             "Failed to register watchdog callback (%s)",
+                             HCHECK_WARM_WATHCHDOG_NAME);
+                return !OK;
+            }
+        }
         s = s->next;
     }
     return OK;
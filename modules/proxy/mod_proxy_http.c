@@ -18,12 +18,15 @@
 
 #include "mod_proxy.h"
 #include "ap_regex.h"
+#include "ap_mpm.h"
 
 module AP_MODULE_DECLARE_DATA proxy_http_module;
 
 static int (*ap_proxy_clear_connection_fn)(request_rec *r, apr_table_t *headers) =
         NULL;
 
+static int mpm_can_poll = 0;
+
 static apr_status_t ap_proxy_http_cleanup(const char *scheme,
                                           request_rec *r,
                                           proxy_conn_rec *backend);
@@ -249,7 +252,20 @@ typedef struct {
 
     int expecting_100;
     unsigned int do_100_continue:1,
-                 prefetch_nonblocking:1;
+                 prefetch_nonblocking:1,
+                 async:1,
+                 backend_broke:1;
+
+    /* Response body relaying */
+    apr_bucket_brigade *bb;
+    apr_bucket_brigade *pass_bb;
+    apr_interval_time_t async_delay;
+    apr_pool_t *async_pool;
+    enum {
+        RELAY_WAIT_NONE = 0,
+        RELAY_WAIT_ORIGIN,      /* readable backend */
+        RELAY_WAIT_CLIENT       /* writable client */
+    } relay_wait;
 } proxy_http_req_t;
 
 /* Read what's in the client pipe. If nonblocking is set and read is EAGAIN,
@@ -1206,6 +1222,370 @@ static int send_continue_body(proxy_http_req_t *req)
     return status;
 }
 
+/* Our backend bailed on us while relaying the response body. Given we're
+ * half way through the response, our only option is to disconnect the
+ * client too.
+ */
+static void relay_backend_broke(proxy_http_req_t *req)
+{
+    request_rec *r = req->r;
+    conn_rec *c = r->connection;
+    apr_bucket_brigade *bb = req->bb;
+    apr_bucket *e;
+
+    apr_brigade_cleanup(bb);
+    e = ap_bucket_error_create(HTTP_GATEWAY_TIME_OUT, NULL,
+            r->pool, c->bucket_alloc);
+    APR_BRIGADE_INSERT_TAIL(bb, e);
+    e = ap_bucket_eoc_create(c->bucket_alloc);
+    APR_BRIGADE_INSERT_TAIL(bb, e);
+    ap_pass_brigade(r->output_filters, bb);
+
+    req->backend_broke = 1;
+    req->backend->close = 1;
+}
+
+/* Wait for the backend to be readable, at most timeout */
+static int wait_origin(proxy_http_req_t *req, apr_interval_time_t timeout)
+{
+    apr_pollfd_t pfd;
+    apr_int32_t nfds;
+    apr_status_t rv;
+
+    memset(&pfd, 0, sizeof(pfd));
+    pfd.p = req->p;
+    pfd.desc_type = APR_POLL_SOCKET;
+    pfd.desc.s = req->backend->sock;
+    pfd.reqevents = APR_POLLIN;
+    do {
+        rv = apr_poll(&pfd, 1, &nfds, timeout);
+    } while (APR_STATUS_IS_EINTR(rv));
+
+    return rv == APR_SUCCESS && nfds > 0;
+}
+
+/* Relay the response body from the backend to the client, until the end
+ * or, in async mode, until either side would block.  In the latter case
+ * SUSPENDED is returned and req->relay_wait tells what to poll for.
+ */
+static int relay_response_body(proxy_http_req_t *req)
+{
+    request_rec *r = req->r;
+    conn_rec *c = r->connection;
+    proxy_conn_rec *backend = req->backend;
+    apr_bucket_brigade *bb = req->bb;
+    apr_bucket_brigade *pass_bb = req->pass_bb;
+    apr_read_type_e mode = APR_NONBLOCK_READ;
+    int finish = FALSE;
+    apr_bucket *e;
+
+    req->relay_wait = RELAY_WAIT_NONE;
+    do {
+        apr_off_t readbytes;
+        apr_status_t rv;
+
+        /* Don't read more than the client can take without blocking */
+        if (req->async && ap_filter_should_yield(r->output_filters)) {
+            int rc = ap_filter_output_pending(c);
+            if (rc == OK) {
+                req->relay_wait = RELAY_WAIT_CLIENT;
+                return SUSPENDED;
+            }
+            if (rc != DECLINED || c->aborted) {
+                backend->close = 1;
+                break;
+            }
+        }
+
+        rv = ap_get_brigade(backend->r->input_filters, bb,
+                            AP_MODE_READBYTES, mode,
+                            req->sconf->io_buffer_size);
+
+        /* ap_get_brigade will return success with an empty brigade
+         * for a non-blocking read which would block: */
+        if (mode == APR_NONBLOCK_READ
+            && (APR_STATUS_IS_EAGAIN(rv)
+                || (rv == APR_SUCCESS && APR_BRIGADE_EMPTY(bb)))) {
+            /* flush to the client and switch to blocking mode */
+            e = apr_bucket_flush_create(c->bucket_alloc);
+            APR_BRIGADE_INSERT_TAIL(bb, e);
+            if (ap_pass_brigade(r->output_filters, bb)
+                || c->aborted) {
+                backend->close = 1;
+                break;
+            }
+            apr_brigade_cleanup(bb);
+            if (req->async) {
+                /* or wait for the backend asynchronously, unless it
+                 * sends more within the delay.
+                 */
+                if (req->async_delay > 0
+                        && wait_origin(req, req->async_delay)) {
+                    continue;
+                }
+                req->relay_wait = RELAY_WAIT_ORIGIN;
+                return SUSPENDED;
+            }
+            mode = APR_BLOCK_READ;
+            continue;
+        }
+        else if (rv == APR_EOF) {
+            backend->close = 1;
+            break;
+        }
+        else if (rv != APR_SUCCESS) {
+            if (rv == APR_ENOSPC) {
+                ap_log_rerror(APLOG_MARK, APLOG_ERR, rv, r, APLOGNO(02475)
+                              "Response chunk/line was too large to parse");
+            }
+            else if (rv == APR_ENOTIMPL) {
+                ap_log_rerror(APLOG_MARK, APLOG_ERR, rv, r, APLOGNO(02476)
+                              "Response Transfer-Encoding was not recognised");
+            }
+            else {
+                ap_log_rerror(APLOG_MARK, APLOG_ERR, rv, r, APLOGNO(01110)
+                              "Network error reading response");
+            }
+
+            relay_backend_broke(req);
+            break;
+        }
+        /* next time try a non-blocking read */
+        mode = APR_NONBLOCK_READ;
+
+        if (!apr_is_empty_table(backend->r->trailers_in)) {
+            apr_table_do(add_trailers, r->trailers_out,
+                    backend->r->trailers_in, NULL);
+            apr_table_clear(backend->r->trailers_in);
+        }
+
+        apr_brigade_length(bb, 0, &readbytes);
+        backend->worker->s->read += readbytes;
+#if DEBUGGING
+        {
+        ap_log_rerror(APLOG_MARK, APLOG_DEBUG, 0, r, APLOGNO(01111)
+                      "readbytes: %#x", readbytes);
+        }
+#endif
+        /* sanity check */
+        if (APR_BRIGADE_EMPTY(bb)) {
+            break;
+        }
+
+        /* Switch the allocator lifetime of the buckets */
+        ap_proxy_buckets_lifetime_transform(r, bb, pass_bb);
+
+        /* found the last brigade? */
+        if (APR_BUCKET_IS_EOS(APR_BRIGADE_LAST(pass_bb))) {
+
+            /* signal that we must leave */
+            finish = TRUE;
+
+            /* the brigade may contain transient buckets that contain
+             * data that lives only as long as the backend connection.
+             * Force a setaside so these transient buckets become heap
+             * buckets that live as long as the request.
+             */
+            for (e = APR_BRIGADE_FIRST(pass_bb); e
+                    != APR_BRIGADE_SENTINEL(pass_bb); e
+                    = APR_BUCKET_NEXT(e)) {
+                apr_bucket_setaside(e, r->pool);
+            }
+
+            /* finally it is safe to clean up the brigade from the
+             * connection pool, as we have forced a setaside on all
+             * buckets.
+             */
+            apr_brigade_cleanup(bb);
+
+            /* make sure we release the backend connection as soon
+             * as we know we are done, so that the backend isn't
+             * left waiting for a slow client to eventually
+             * acknowledge the data.
+             */
+            proxy_run_detach_backend(r, backend);
+            ap_proxy_release_connection(backend->worker->s->scheme,
+                    backend, r->server);
+            /* Ensure that the backend is not reused */
+            req->backend = NULL;
+
+        }
+
+        /* try send what we read */
+        if (ap_pass_brigade(r->output_filters, pass_bb) != APR_SUCCESS
+            || c->aborted) {
+            /* Ack! Phbtt! Die! User aborted! */
+            /* Only close backend if we haven't got all from the
+             * backend. Furthermore if req->backend is NULL it is no
+             * longer safe to fiddle around with backend as it might
+             * be already in use by another thread.
+             */
+            if (req->backend) {
+                /* this causes socket close below */
+                req->backend->close = 1;
+            }
+            finish = TRUE;
+        }
+
+        /* make sure we always clean up after ourselves */
+        apr_brigade_cleanup(pass_bb);
+        apr_brigade_cleanup(bb);
+
+    } while (!finish);
+
+    return OK;
+}
+
+static void relay_response_async(void *baton);
+static void relay_response_timeout(void *baton);
+
+/* Have the MPM call us back when the relay can continue */
+static apr_status_t relay_response_suspend(proxy_http_req_t *req)
+{
+    apr_pollfd_t *pfd;
+    apr_array_header_t *pfds;
+    apr_interval_time_t timeout;
+
+    /* Each registration allocates from the pfds' pool, recycle it for
+     * long lived responses.
+     */
+    if (req->async_pool) {
+        apr_pool_clear(req->async_pool);
+    }
+    else {
+        apr_pool_create(&req->async_pool, req->p);
+        apr_pool_tag(req->async_pool, "proxy_http_async");
+    }
+
+    pfds = apr_array_make(req->async_pool, 1, sizeof(apr_pollfd_t));
+    pfd = apr_array_push(pfds);
+    memset(pfd, 0, sizeof(*pfd));
+    pfd->p = req->async_pool;
+    pfd->desc_type = APR_POLL_SOCKET;
+    if (req->relay_wait == RELAY_WAIT_CLIENT) {
+        pfd->desc.s = ap_get_conn_socket(req->r->connection);
+        pfd->reqevents = APR_POLLOUT;
+    }
+    else {
+        pfd->desc.s = req->backend->sock;
+        pfd->reqevents = APR_POLLIN;
+    }
+    apr_socket_timeout_get(pfd->desc.s, &timeout);
+
+    ap_log_rerror(APLOG_MARK, APLOG_TRACE3, 0, req->r,
+                  "suspend body send, waiting for the %s",
+                  req->relay_wait == RELAY_WAIT_CLIENT ? "client"
+                                                       : "origin");
+
+    return ap_mpm_register_poll_callback_timeout(pfds,
+                                                 relay_response_async,
+                                                 relay_response_timeout,
+                                                 req, timeout);
+}
+
+/* Relay the response body, suspended if it would block in async mode */
+static int relay_response(proxy_http_req_t *req)
+{
+    int status;
+
+    while ((status = relay_response_body(req)) == SUSPENDED) {
+        apr_status_t rv = relay_response_suspend(req);
+        if (rv == APR_SUCCESS) {
+            break;
+        }
+        if (APR_STATUS_IS_ENOTIMPL(rv)) {
+            ap_log_rerror(APLOG_MARK, APLOG_TRACE1, 0, req->r, APLOGNO(10287)
+                          "No async support");
+        }
+        else {
+            ap_log_rerror(APLOG_MARK, APLOG_ERR, rv, req->r, APLOGNO(10288)
+                          "error registering response body relay");
+        }
+        /* Finish synchronously */
+        req->async = 0;
+    }
+
+    return status;
+}
+
+/* Complete the request suspended by relay_response(), including what
+ * proxy_handler() does after the scheme handler for the requests it did
+ * not see complete.
+ */
+static void relay_response_finish(proxy_http_req_t *req)
+{
+    request_rec *r = req->r;
+    conn_rec *c = r->connection;
+    proxy_worker *worker = req->worker;
+    int status = OK;
+
+    ap_log_rerror(APLOG_MARK, APLOG_TRACE2, 0, r, "end body send");
+
+    if (req->backend) {
+        proxy_run_detach_backend(r, req->backend);
+        ap_proxy_release_connection(req->backend->worker->s->scheme,
+                                    req->backend, r->server);
+        req->backend = NULL;
+    }
+    apr_brigade_cleanup(req->bb);
+
+    ap_proxy_post_request(worker, worker->balancer, r, req->sconf);
+    proxy_run_request_status(&status, r);
+
+    ap_finalize_request_protocol(r);
+    ap_process_request_after_handler(r); /* don't touch req or r after here */
+    ap_mpm_resume_suspended(c);
+}
+
+/* Invoked by the MPM when the backend is readable or the client writable */
+static void relay_response_async(void *baton)
+{
+    proxy_http_req_t *req = baton;
+#if APR_HAS_THREADS
+    apr_thread_mutex_t *mtx = req->r->invoke_mtx;
+#endif
+    int status;
+
+#if APR_HAS_THREADS
+    apr_thread_mutex_lock(mtx);
+#endif
+    status = relay_response(req);
+#if APR_HAS_THREADS
+    apr_thread_mutex_unlock(mtx);
+#endif
+
+    if (status != SUSPENDED) {
+        relay_response_finish(req);
+    }
+}
+
+/* Invoked by the MPM when neither side was ready in time */
+static void relay_response_timeout(void *baton)
+{
+    proxy_http_req_t *req = baton;
+    request_rec *r = req->r;
+
+#if APR_HAS_THREADS
+    apr_thread_mutex_lock(r->invoke_mtx);
+#endif
+    if (req->relay_wait == RELAY_WAIT_CLIENT) {
+        ap_log_rerror(APLOG_MARK, APLOG_DEBUG, 0, r, APLOGNO(10289)
+                      "timeout writing the response to the client");
+        r->connection->aborted = 1;
+        req->backend->close = 1;
+    }
+    else {
+        ap_log_rerror(APLOG_MARK, APLOG_ERR, APR_TIMEUP, r, APLOGNO(10290)
+                      "Network error reading response");
+        relay_backend_broke(req);
+    }
+#if APR_HAS_THREADS
+    apr_thread_mutex_unlock(r->invoke_mtx);
+#endif
+
+    relay_response_finish(req);
+}
+
 static
 int ap_proxy_http_process_response(proxy_http_req_t *req)
 {
@@ -1818,8 +2198,6 @@ int ap_proxy_http_process_response(proxy_http_req_t *req)
 
         /* send body - but only if a body is expected */
         if (!r->header_only && !AP_STATUS_IS_HEADER_ONLY(proxy_status)) {
-            apr_read_type_e mode;
-            int finish;
 
             /* We need to copy the output headers and treat them as input
              * headers as well.  BUT, we need to do this before we remove
@@ -1852,150 +2230,14 @@ int ap_proxy_http_process_response(proxy_http_req_t *req)
                 r->status_line = original_status_line;
             }
 
-            mode = APR_NONBLOCK_READ;
-            finish = FALSE;
-            do {
-                apr_off_t readbytes;
-                apr_status_t rv;
-
-                rv = ap_get_brigade(backend->r->input_filters, bb,
-                                    AP_MODE_READBYTES, mode,
-                                    req->sconf->io_buffer_size);
-
-                /* ap_get_brigade will return success with an empty brigade
-                 * for a non-blocking read which would block: */
-                if (mode == APR_NONBLOCK_READ
-                    && (APR_STATUS_IS_EAGAIN(rv)
-                        || (rv == APR_SUCCESS && APR_BRIGADE_EMPTY(bb)))) {
-                    /* flush to the client and switch to blocking mode */
-                    e = apr_bucket_flush_create(c->bucket_alloc);
-                    APR_BRIGADE_INSERT_TAIL(bb, e);
-                    if (ap_pass_brigade(r->output_filters, bb)
-                        || c->aborted) {
-                        backend->close = 1;
-                        break;
-                    }
-                    apr_brigade_cleanup(bb);
-                    mode = APR_BLOCK_READ;
-                    continue;
-                }
-                else if (rv == APR_EOF) {
-                    backend->close = 1;
-                    break;
-                }
-                else if (rv != APR_SUCCESS) {
-                    if (rv == APR_ENOSPC) {
-                        ap_log_rerror(APLOG_MARK, APLOG_ERR, rv, r, APLOGNO(02475)
-                                      "Response chunk/line was too large to parse");
-                    }
-                    else if (rv == APR_ENOTIMPL) {
-                        ap_log_rerror(APLOG_MARK, APLOG_ERR, rv, r, APLOGNO(02476)
-                                      "Response Transfer-Encoding was not recognised");
-                    }
-                    else {
-                        ap_log_rerror(APLOG_MARK, APLOG_ERR, rv, r, APLOGNO(01110)
-                                      "Network error reading response");
-                    }
-
-                    /* In this case, we are in real trouble because
-                     * our backend bailed on us. Given we're half way
-                     * through a response, our only option is to
-                     * disconnect the client too.
-                     */
-                    apr_brigade_cleanup(bb);
-                    e = ap_bucket_error_create(HTTP_GATEWAY_TIME_OUT, NULL,
-                            r->pool, c->bucket_alloc);
-                    APR_BRIGADE_INSERT_TAIL(bb, e);
-                    e = ap_bucket_eoc_create(c->bucket_alloc);
-                    APR_BRIGADE_INSERT_TAIL(bb, e);
-                    ap_pass_brigade(r->output_filters, bb);
-
-                    backend_broke = 1;
-                    backend->close = 1;
-                    break;
-                }
-                /* next time try a non-blocking read */
-                mode = APR_NONBLOCK_READ;
-
-                if (!apr_is_empty_table(backend->r->trailers_in)) {
-                    apr_table_do(add_trailers, r->trailers_out,
-                            backend->r->trailers_in, NULL);
-                    apr_table_clear(backend->r->trailers_in);
-                }
-
-                apr_brigade_length(bb, 0, &readbytes);
-                backend->worker->s->read += readbytes;
-#if DEBUGGING
-                {
-                ap_log_rerror(APLOG_MARK, APLOG_DEBUG, 0, r, APLOGNO(01111)
-                              "readbytes: %#x", readbytes);
-                }
-#endif
-                /* sanity check */
-                if (APR_BRIGADE_EMPTY(bb)) {
-                    break;
-                }
-
-                /* Switch the allocator lifetime of the buckets */
-                ap_proxy_buckets_lifetime_transform(r, bb, pass_bb);
-
-                /* found the last brigade? */
-                if (APR_BUCKET_IS_EOS(APR_BRIGADE_LAST(pass_bb))) {
-
-                    /* signal that we must leave */
-                    finish = TRUE;
-
-                    /* the brigade may contain transient buckets that contain
-                     * data that lives only as long as the backend connection.
-                     * Force a setaside so these transient buckets become heap
-                     * buckets that live as long as the request.
-                     */
-                    for (e = APR_BRIGADE_FIRST(pass_bb); e
-                            != APR_BRIGADE_SENTINEL(pass_bb); e
-                            = APR_BUCKET_NEXT(e)) {
-                        apr_bucket_setaside(e, r->pool);
-                    }
-
-                    /* finally it is safe to clean up the brigade from the
-                     * connection pool, as we have forced a setaside on all
-                     * buckets.
-                     */
-                    apr_brigade_cleanup(bb);
-
-                    /* make sure we release the backend connection as soon
-                     * as we know we are done, so that the backend isn't
-                     * left waiting for a slow client to eventually
-                     * acknowledge the data.
-                     */
-                    proxy_run_detach_backend(r, backend);
-                    ap_proxy_release_connection(backend->worker->s->scheme,
-                            backend, r->server);
-                    /* Ensure that the backend is not reused */
-                    req->backend = NULL;
-
-                }
-
-                /* try send what we read */
-                if (ap_pass_brigade(r->output_filters, pass_bb) != APR_SUCCESS
-                    || c->aborted) {
-                    /* Ack! Phbtt! Die! User aborted! */
-                    /* Only close backend if we haven't got all from the
-                     * backend. Furthermore if req->backend is NULL it is no
-                     * longer safe to fiddle around with backend as it might
-                     * be already in use by another thread.
-                     */
-                    if (req->backend) {
-                        /* this causes socket close below */
-                        req->backend->close = 1;
-                    }
-                    finish = TRUE;
-                }
-
-                /* make sure we always clean up after ourselves */
-                apr_brigade_cleanup(pass_bb);
-                apr_brigade_cleanup(bb);
-
-            } while (!finish);
+            req->bb = bb;
+            req->pass_bb = pass_bb;
+            if (relay_response(req) == SUSPENDED) {
+                return SUSPENDED;
+            }
+            if (req->backend_broke) {
+                backend_broke = 1;
+            }
 
             ap_log_rerror(APLOG_MARK, APLOG_TRACE2, 0, r, "end body send");
         }
@@ -2136,6 +2378,15 @@ static int proxy_http_handler(request_rec *r, proxy_worker *worker,
 
     dconf = ap_get_module_config(r->per_dir_config, &proxy_module);
 
+    /* Relay the response body asynchronously if configured and possible,
+     * that is for main requests on connections handled by the MPM.
+     */
+    if (dconf->async_delay >= 0 && mpm_can_poll && c->cs
+            && !c->master && !r->main && !r->prev) {
+        req->async = 1;
+        req->async_delay = dconf->async_delay;
+    }
+
     if (apr_table_get(r->subprocess_env, "force-proxy-request-1.0")) {
         req->force10 = 1;
     }
@@ -2297,6 +2548,10 @@ static int proxy_http_handler(request_rec *r, proxy_worker *worker,
 
         /* Step Five: Receive the Response... Fall thru to cleanup */
         status = ap_proxy_http_process_response(req);
+        if (status == SUSPENDED) {
+            /* The backend is released by relay_response_finish() */
+            return SUSPENDED;
+        }
         if (req->backend) {
             proxy_run_detach_backend(r, req->backend);
         }
@@ -2337,6 +2592,10 @@ static int proxy_http_post_config(apr_pool_t *pconf, apr_pool_t *plog,
         return !OK;
     }
 
+    if (ap_mpm_query(AP_MPMQ_CAN_POLL, &mpm_can_poll) != APR_SUCCESS) {
+        mpm_can_poll = 0;
+    }
+
     return OK;
 }
 
@@ -20,6 +20,8 @@
 #include "scoreboard.h"
 #include "apr_version.h"
 #include "apr_hash.h"
+#include "apr_atomic.h"
+#include "apr_thread_cond.h"
 #include "proxy_util.h"
 #include "ajp.h"
 #include "scgi.h"
@@ -41,6 +43,16 @@
 #if (APR_MAJOR_VERSION < 2)
 #include "apr_support.h"        /* for apr_wait_for_io_or_timeout() */
 #endif
+#if APR_HAVE_FCNTL_H
+#include <fcntl.h>              /* for splice() */
+#endif
+
+/* Zero-copy tunneling between plain sockets (Linux) */
+#if defined(__linux__) && defined(SPLICE_F_MOVE) && defined(SPLICE_F_NONBLOCK)
+#define PROXY_TUNNEL_SPLICE 1
+#else
+#define PROXY_TUNNEL_SPLICE 0
+#endif
 
 APLOG_USE_MODULE(proxy);
 
@@ -1540,6 +1552,9 @@ static apr_status_t connection_cleanup(void *theconn)
         ap_proxy_ssl_engine(conn->connection, worker->section_config, 1);
     }
 
+    if (conn->sock) {
+        apr_atomic_inc32(&worker->cp->idle);
+    }
     if (worker->s->hmax && worker->cp->res) {
         conn->inreslist = 1;
         apr_reslist_release(worker->cp->res, (void *)conn);
@@ -1628,10 +1643,13 @@ static apr_status_t connection_destructor(void *resource, void *params,
                                           apr_pool_t *pool)
 {
     proxy_worker *worker = params;
+    proxy_conn_rec *conn = resource;
 
+    if (conn->sock) {
+        apr_atomic_dec32(&worker->cp->idle);
+    }
     /* Destroy the pool only if not called from reslist_destroy */
     if (worker->cp) {
-        proxy_conn_rec *conn = resource;
         apr_pool_destroy(conn->pool);
     }
 
@@ -2411,6 +2429,9 @@ PROXY_DECLARE(int) ap_proxy_acquire_connection(const char *proxy_function,
                  "%s: has acquired connection for (%s)",
                  proxy_function, worker->s->hostname_ex);
 
+    if ((*conn)->sock) {
+        apr_atomic_dec32(&worker->cp->idle);
+    }
     (*conn)->worker = worker;
     (*conn)->close  = 0;
     (*conn)->inreslist = 0;
@@ -2430,6 +2451,448 @@ PROXY_DECLARE(int) ap_proxy_release_connection(const char *proxy_function,
     return OK;
 }
 
+/*
+ * Resolver cache, shared by all the workers of the child process.
+ *
+ * The addresses of each "hostname:port" are kept for ProxyDNSCache's TTL
+ * and then refreshed in the background (by the resolver thread, or by the
+ * first request which sees them expired if the MPM is not threaded) while
+ * the stale ones continue to be used. Failed lookups are cached for the
+ * negative TTL, and a failed refresh keeps the stale addresses until the
+ * next attempt. Successive connections start with a different address of
+ * the set (round-robin), the others being used as fallbacks by
+ * ap_proxy_connect_backend() as usual.
+ */
+#ifndef PROXY_DNS_CACHE_MAX
+#define PROXY_DNS_CACHE_MAX 1024
+#endif
+#ifndef PROXY_DNS_ADDRS_MAX
+#define PROXY_DNS_ADDRS_MAX 16
+#endif
+
+typedef struct {
+    apr_pool_t *pool;
+    apr_sockaddr_t **rotations; /* The list starting at each address */
+    int count;
+    apr_uint32_t next;          /* Round-robin cursor */
+    apr_uint32_t refcount;      /* Cache and connections using it */
+} proxy_dns_addrs;
+
+typedef struct proxy_dns_entry proxy_dns_entry;
+struct proxy_dns_entry {
+    char key[PROXY_RFC1035_HOSTNAME_SIZE + 8]; /* "hostname:port" */
+    char hostname[PROXY_RFC1035_HOSTNAME_SIZE];
+    apr_port_t port;
+    proxy_dns_addrs *addrs;     /* NULL if negative */
+    apr_status_t status;        /* Of the negative lookup */
+    apr_time_t expiry;
+    apr_time_t used;
+    unsigned int refreshing:1;
+    proxy_dns_entry *next_refresh;
+};
+
+typedef struct {
+    apr_pool_t *pool;
+    server_rec *s;
+    apr_hash_t *entries;
+    apr_interval_time_t ttl;
+    apr_interval_time_t negative_ttl;
+#if APR_HAS_THREADS
+    apr_thread_mutex_t *mutex;
+    apr_thread_cond_t *cond;
+    apr_thread_t *thread;
+    proxy_dns_entry *refresh_first;
+    proxy_dns_entry *refresh_last;
+    int stopping;
+#endif
+} proxy_dns_cache;
+
+static proxy_dns_cache *dns_cache;
+
+#if APR_HAS_THREADS
+#define DNS_CACHE_LOCK(c)   apr_thread_mutex_lock((c)->mutex)
+#define DNS_CACHE_UNLOCK(c) apr_thread_mutex_unlock((c)->mutex)
+#else
+#define DNS_CACHE_LOCK(c)
+#define DNS_CACHE_UNLOCK(c)
+#endif
+
+static apr_sockaddr_t *dns_addr_copy(apr_pool_t *p, const apr_sockaddr_t *sa)
+{
+    apr_sockaddr_t *copy = apr_pmemdup(p, sa, sizeof(*sa));
+
+    /* ipaddr_ptr points inside the struct */
+    copy->ipaddr_ptr = (char *)copy + ((char *)sa->ipaddr_ptr - (char *)sa);
+    copy->next = NULL;
+    return copy;
+}
+
+/* Must be called with the cache locked */
+static void dns_addrs_release(proxy_dns_cache *cache, proxy_dns_addrs *addrs)
+{
+    if (addrs && --addrs->refcount == 0) {
+        apr_pool_destroy(addrs->pool);
+    }
+}
+
+/* Resolve hostname:port into a new set of addresses (refcount 1) */
+static apr_status_t dns_addrs_create(proxy_dns_cache *cache,
+                                     const char *hostname, apr_port_t port,
+                                     proxy_dns_addrs **paddrs)
+{
+    proxy_dns_addrs *addrs;
+    apr_sockaddr_t *sa, *list, **tail;
+    apr_status_t rv;
+    apr_pool_t *p;
+    int i, j;
+
+    DNS_CACHE_LOCK(cache);
+    apr_pool_create(&p, cache->pool);
+    DNS_CACHE_UNLOCK(cache);
+    apr_pool_tag(p, "proxy_dns_addrs");
+
+    rv = apr_sockaddr_info_get(&list, hostname, APR_UNSPEC, port, 0, p);
+    if (rv != APR_SUCCESS) {
+        DNS_CACHE_LOCK(cache);
+        apr_pool_destroy(p);
+        DNS_CACHE_UNLOCK(cache);
+        return rv;
+    }
+
+    addrs = apr_pcalloc(p, sizeof(*addrs));
+    addrs->pool = p;
+    addrs->refcount = 1;
+    for (sa = list; sa && addrs->count < PROXY_DNS_ADDRS_MAX; sa = sa->next) {
+        addrs->count++;
+    }
+    addrs->rotations = apr_palloc(p, addrs->count * sizeof(apr_sockaddr_t *));
+    if (addrs->count == 1) {
+        list->next = NULL;
+        addrs->rotations[0] = list;
+    }
+    else {
+        apr_sockaddr_t **all = apr_palloc(p, addrs->count *
+                                             sizeof(apr_sockaddr_t *));
+        for (sa = list, i = 0; i < addrs->count; sa = sa->next, ++i) {
+            all[i] = sa;
+        }
+        for (i = 0; i < addrs->count; ++i) {
+            tail = &addrs->rotations[i];
+            for (j = 0; j < addrs->count; ++j) {
+                *tail = dns_addr_copy(p, all[(i + j) % addrs->count]);
+                tail = &(*tail)->next;
+            }
+        }
+    }
+
+    *paddrs = addrs;
+    return APR_SUCCESS;
+}
+
+/* Refresh an expired entry, keeping the stale addresses on failure */
+static void dns_entry_refresh(proxy_dns_cache *cache, proxy_dns_entry *entry)
+{
+    proxy_dns_addrs *addrs = NULL;
+    apr_status_t rv;
+
+    /* The entry can't be evicted while refreshing */
+    rv = dns_addrs_create(cache, entry->hostname, entry->port, &addrs);
+
+    DNS_CACHE_LOCK(cache);
+    if (rv == APR_SUCCESS) {
+        dns_addrs_release(cache, entry->addrs);
+        entry->addrs = addrs;
+        entry->expiry = apr_time_now() + cache->ttl;
+    }
+    else {
+        entry->expiry = apr_time_now() + cache->negative_ttl;
+    }
+    entry->refreshing = 0;
+    DNS_CACHE_UNLOCK(cache);
+
+    if (rv != APR_SUCCESS) {
+        ap_log_error(APLOG_MARK, APLOG_WARNING, rv, cache->s, APLOGNO(10292)
+                     "DNS refresh of %s failed, keeping the previous "
+                     "addresses", entry->key);
+    }
+}
+
+#if APR_HAS_THREADS
+static void * APR_THREAD_FUNC dns_cache_thread(apr_thread_t *thd, void *data)
+{
+    proxy_dns_cache *cache = data;
+    proxy_dns_entry *entry;
+
+    DNS_CACHE_LOCK(cache);
+    for (;;) {
+        while (!cache->stopping && !cache->refresh_first) {
+            apr_thread_cond_wait(cache->cond, cache->mutex);
+        }
+        if (cache->stopping) {
+            break;
+        }
+        entry = cache->refresh_first;
+        cache->refresh_first = entry->next_refresh;
+        if (!cache->refresh_first) {
+            cache->refresh_last = NULL;
+        }
+        entry->next_refresh = NULL;
+        DNS_CACHE_UNLOCK(cache);
+
+        dns_entry_refresh(cache, entry);
+
+        DNS_CACHE_LOCK(cache);
+    }
+    DNS_CACHE_UNLOCK(cache);
+
+    apr_thread_exit(thd, APR_SUCCESS);
+    return NULL;
+}
+#endif
+
+/* Must be called with the cache locked, returns 0 if not queued */
+static int dns_entry_queue(proxy_dns_cache *cache, proxy_dns_entry *entry)
+{
+#if APR_HAS_THREADS
+    if (cache->thread) {
+        if (cache->refresh_last) {
+            cache->refresh_last->next_refresh = entry;
+        }
+        else {
+            cache->refresh_first = entry;
+        }
+        cache->refresh_last = entry;
+        apr_thread_cond_signal(cache->cond);
+        return 1;
+    }
+#endif
+    return 0;
+}
+
+static apr_status_t dns_cache_cleanup(void *data)
+{
+    proxy_dns_cache *cache = data;
+#if APR_HAS_THREADS
+    apr_status_t rv;
+
+    if (cache->thread) {
+        DNS_CACHE_LOCK(cache);
+        cache->stopping = 1;
+        apr_thread_cond_signal(cache->cond);
+        DNS_CACHE_UNLOCK(cache);
+        apr_thread_join(&rv, cache->thread);
+    }
+#endif
+    /* The connections still referencing addresses are not used anymore */
+    dns_cache = NULL;
+    return APR_SUCCESS;
+}
+
+void proxy_dns_cache_init(apr_pool_t *p, server_rec *s,
+                          apr_interval_time_t ttl,
+                          apr_interval_time_t negative_ttl)
+{
+    proxy_dns_cache *cache;
+
+    dns_cache = NULL;
+    if (ttl <= 0) {
+        return;
+    }
+
+    cache = apr_pcalloc(p, sizeof(*cache));
+    apr_pool_create(&cache->pool, p);
+    apr_pool_tag(cache->pool, "proxy_dns_cache");
+    cache->s = s;
+    cache->entries = apr_hash_make(cache->pool);
+    cache->ttl = ttl;
+    cache->negative_ttl = negative_ttl;
+#if APR_HAS_THREADS
+    {
+        apr_status_t rv;
+        int threaded = 0;
+
+        rv = apr_thread_mutex_create(&cache->mutex,
+                                     APR_THREAD_MUTEX_DEFAULT, p);
+        if (rv != APR_SUCCESS) {
+            ap_log_error(APLOG_MARK, APLOG_ERR, rv, s, APLOGNO(10291)
+                         "could not create the DNS cache mutex, "
+                         "ProxyDNSCache disabled");
+            return;
+        }
+        ap_mpm_query(AP_MPMQ_IS_THREADED, &threaded);
+        if (threaded
+                && (rv = apr_thread_cond_create(&cache->cond,
+                                                p)) == APR_SUCCESS
+                && (rv = apr_thread_create(&cache->thread, NULL,
+                                           dns_cache_thread, cache,
+                                           p)) != APR_SUCCESS) {
+            cache->thread = NULL;
+        }
+        if (rv != APR_SUCCESS) {
+            ap_log_error(APLOG_MARK, APLOG_WARNING, rv, s, APLOGNO(10293)
+                         "could not create the DNS cache thread, expired "
+                         "entries will be refreshed by the requests");
+        }
+    }
+#endif
+    /* Stop the thread before the subpools are destroyed */
+    apr_pool_pre_cleanup_register(p, cache, dns_cache_cleanup);
+    dns_cache = cache;
+}
+
+static apr_status_t dns_conn_cleanup(void *theconn)
+{
+    proxy_conn_rec *conn = theconn;
+
+    if (conn->dns_addrs && dns_cache) {
+        DNS_CACHE_LOCK(dns_cache);
+        dns_addrs_release(dns_cache, conn->dns_addrs);
+        DNS_CACHE_UNLOCK(dns_cache);
+    }
+    conn->dns_addrs = NULL;
+    return APR_SUCCESS;
+}
+
+/* Must be called with the cache locked */
+static proxy_dns_entry *dns_entry_get(proxy_dns_cache *cache,
+                                      const char *key, apr_size_t klen,
+                                      const char *hostname, apr_port_t port,
+                                      apr_time_t now)
+{
+    proxy_dns_entry *entry, *lru = NULL;
+    apr_hash_index_t *hi;
+    void *val;
+
+    entry = apr_hash_get(cache->entries, key, klen);
+    if (entry) {
+        return entry;
+    }
+
+    if (apr_hash_count(cache->entries) < PROXY_DNS_CACHE_MAX) {
+        entry = apr_pcalloc(cache->pool, sizeof(*entry));
+    }
+    else {
+        /* Evict the least recently used entry */
+        for (hi = apr_hash_first(NULL, cache->entries); hi;
+                hi = apr_hash_next(hi)) {
+            apr_hash_this(hi, NULL, NULL, &val);
+            entry = val;
+            if (!entry->refreshing && (!lru || entry->used < lru->used)) {
+                lru = entry;
+            }
+        }
+        if (!lru) {
+            return NULL;
+        }
+        entry = lru;
+        apr_hash_set(cache->entries, entry->key, strlen(entry->key), NULL);
+        dns_addrs_release(cache, entry->addrs);
+        memset(entry, 0, sizeof(*entry));
+    }
+    memcpy(entry->key, key, klen + 1);
+    apr_cpystrn(entry->hostname, hostname, sizeof(entry->hostname));
+    entry->port = port;
+    entry->used = now;
+    apr_hash_set(cache->entries, entry->key, klen, entry);
+    return entry;
+}
+
+/*
+ * Set conn->addr from the cache for conn->hostname:conn->port, resolving
+ * it if needed.
+ */
+static apr_status_t proxy_dns_resolve(proxy_conn_rec *conn, server_rec *s)
+{
+    proxy_dns_cache *cache = dns_cache;
+    proxy_worker_shared *ws = conn->worker->s;
+    proxy_dns_entry *entry = NULL;
+    proxy_dns_addrs *addrs = NULL;
+    apr_status_t rv = APR_SUCCESS;
+    apr_size_t klen;
+    apr_time_t now;
+    char key[sizeof(entry->key)];
+    int refresh = 0;
+
+    if (strlen(conn->hostname) >= sizeof(entry->hostname)) {
+        /* Not a valid DNS name anyway */
+        return APR_EINVAL;
+    }
+    klen = apr_snprintf(key, sizeof(key), "%s:%d", conn->hostname,
+                        (int)conn->port);
+
+    now = apr_time_now();
+    DNS_CACHE_LOCK(cache);
+    entry = dns_entry_get(cache, key, klen, conn->hostname, conn->port, now);
+    if (entry) {
+        entry->used = now;
+        if (entry->addrs) {
+            addrs = entry->addrs;
+            addrs->refcount++;
+            if (now >= entry->expiry && !entry->refreshing) {
+                entry->refreshing = 1;
+                refresh = !dns_entry_queue(cache, entry);
+                apr_atomic_inc32(&ws->dns_refreshes);
+            }
+            apr_atomic_inc32(&ws->dns_hits);
+        }
+        else if (entry->status != APR_SUCCESS && now < entry->expiry) {
+            rv = entry->status;
+            apr_atomic_inc32(&ws->dns_hits);
+            apr_atomic_inc32(&ws->dns_failures);
+        }
+    }
+    DNS_CACHE_UNLOCK(cache);
+
+    if (refresh) {
+        dns_entry_refresh(cache, entry);
+    }
+    else if (!addrs && rv == APR_SUCCESS) {
+        /* Miss, resolve now */
+        apr_atomic_inc32(&ws->dns_misses);
+        rv = dns_addrs_create(cache, conn->hostname, conn->port, &addrs);
+        DNS_CACHE_LOCK(cache);
+        if (entry && !strcmp(entry->key, key) && !entry->refreshing) {
+            if (rv == APR_SUCCESS) {
+                dns_addrs_release(cache, entry->addrs);
+                entry->addrs = addrs;
+                addrs->refcount++;
+                entry->status = APR_SUCCESS;
+                entry->expiry = now + cache->ttl;
+            }
+            else if (!entry->addrs) {
+                entry->status = rv;
+                entry->expiry = now + cache->negative_ttl;
+            }
+        }
+        DNS_CACHE_UNLOCK(cache);
+        if (rv != APR_SUCCESS) {
+            apr_atomic_inc32(&ws->dns_failures);
+        }
+    }
+    if (rv != APR_SUCCESS) {
+        return rv;
+    }
+
+    /* Switch the connection to these addresses */
+    if (!conn->dns_addrs) {
+        apr_pool_cleanup_register(conn->pool, conn, dns_conn_cleanup,
+                                  apr_pool_cleanup_null);
+    }
+    else {
+        DNS_CACHE_LOCK(cache);
+        dns_addrs_release(cache, conn->dns_addrs);
+        DNS_CACHE_UNLOCK(cache);
+    }
+    conn->dns_addrs = addrs;
+    conn->addr = addrs->rotations[apr_atomic_inc32(&addrs->next)
+                                  % addrs->count];
+
+    ap_log_error(APLOG_MARK, APLOG_TRACE2, 0, s,
+                 "DNS cache: %s -> %pI (%d address%s)", key, conn->addr,
+                 addrs->count, addrs->count > 1 ? "es" : "");
+    return APR_SUCCESS;
+}
+
 PROXY_DECLARE(int)
 ap_proxy_determine_connection(apr_pool_t *p, request_rec *r,
                               proxy_server_conf *conf,
@@ -2561,7 +3024,7 @@ ap_proxy_determine_connection(apr_pool_t *p, request_rec *r,
                 conn->hostname = apr_pstrdup(conn->pool, uri->hostname);
                 conn->port = uri->port;
             }
-            if (!will_reuse) {
+            if (!will_reuse && !dns_cache) {
                 /*
                  * Only do a lookup if we should not reuse the backend address.
                  * Otherwise we will look it up once for the worker.
@@ -2574,7 +3037,11 @@ ap_proxy_determine_connection(apr_pool_t *p, request_rec *r,
             socket_cleanup(conn);
             conn->close = 0;
         }
-        if (will_reuse) {
+        if (dns_cache) {
+            /* Use the shared resolver cache (ProxyDNSCache) */
+            err = proxy_dns_resolve(conn, r->server);
+        }
+        else if (will_reuse) {
             /*
              * Looking up the backend address for the worker only makes sense if
              * we can reuse the address.
@@ -3000,10 +3467,10 @@ PROXY_DECLARE(apr_status_t) ap_proxy_check_connection(const char *scheme,
     return rv;
 }
 
-PROXY_DECLARE(int) ap_proxy_connect_backend(const char *proxy_function,
-                                            proxy_conn_rec *conn,
-                                            proxy_worker *worker,
-                                            server_rec *s)
+static int connect_backend(const char *proxy_function,
+                           proxy_conn_rec *conn,
+                           proxy_worker *worker,
+                           server_rec *s, int *reused)
 {
     apr_status_t rv;
     int loglevel;
@@ -3019,6 +3486,7 @@ PROXY_DECLARE(int) ap_proxy_connect_backend(const char *proxy_function,
     if (rv == APR_EINVAL) {
         return DECLINED;
     }
+    *reused = (rv == APR_SUCCESS);
 
     while (rv != APR_SUCCESS && (backend_addr || conn->uds_path)) {
 #if APR_HAVE_SYS_UN_H
@@ -3238,6 +3706,21 @@ PROXY_DECLARE(int) ap_proxy_connect_backend(const char *proxy_function,
     return rv == APR_SUCCESS ? OK : DECLINED;
 }
 
+PROXY_DECLARE(int) ap_proxy_connect_backend(const char *proxy_function,
+                                            proxy_conn_rec *conn,
+                                            proxy_worker *worker,
+                                            server_rec *s)
+{
+    int reused = 0;
+    int rc = connect_backend(proxy_function, conn, worker, s, &reused);
+
+    if (rc == OK) {
+        apr_atomic_inc32(reused ? &worker->s->conns_reused
+                                : &worker->s->conns_new);
+    }
+    return rc;
+}
+
 static apr_status_t connection_shutdown(void *theconn)
 {
     proxy_conn_rec *conn = (proxy_conn_rec *)theconn;
@@ -3267,10 +3750,9 @@ static apr_status_t connection_shutdown(void *theconn)
 
 static int proxy_connection_create(const char *proxy_function,
                                    proxy_conn_rec *conn,
-                                   request_rec *r, server_rec *s)
+                                   ap_conf_vector_t *per_dir_config,
+                                   server_rec *s)
 {
-    ap_conf_vector_t *per_dir_config = (r) ? r->per_dir_config
-                                           : conn->worker->section_config;
     apr_sockaddr_t *backend_addr = conn->addr;
     int rc;
     apr_interval_time_t current_timeout;
@@ -3367,7 +3849,8 @@ PROXY_DECLARE(int) ap_proxy_connection_create_ex(const char *proxy_function,
                                                  proxy_conn_rec *conn,
                                                  request_rec *r)
 {
-    return proxy_connection_create(proxy_function, conn, r, r->server);
+    return proxy_connection_create(proxy_function, conn, r->per_dir_config,
+                                   r->server);
 }
 
 PROXY_DECLARE(int) ap_proxy_connection_create(const char *proxy_function,
@@ -3375,7 +3858,163 @@ PROXY_DECLARE(int) ap_proxy_connection_create(const char *proxy_function,
                                               conn_rec *c, server_rec *s)
 {
     (void) c; /* unused */
-    return proxy_connection_create(proxy_function, conn, NULL, s);
+    return proxy_connection_create(proxy_function, conn,
+                                   conn->worker->section_config, s);
+}
+
+/*
+ * Warm-up of the connection pools: the idle connections are established
+ * (including the TLS handshake) before the requests need them, like
+ * ap_proxy_determine_connection() and the scheme handlers would do with
+ * the worker's own URL.
+ */
+static int warm_connection(const char *proxy_function, proxy_conn_rec *conn,
+                           proxy_worker *worker, server_rec *s, int *reused)
+{
+    ap_conf_vector_t *per_dir_config;
+    apr_status_t rv = APR_SUCCESS;
+    int rc;
+
+    if (!conn->hostname) {
+        conn->hostname = apr_pstrdup(conn->pool, worker->s->hostname_ex);
+        conn->port = (worker->s->port ? worker->s->port
+                      : ap_proxy_port_of_scheme(worker->s->scheme));
+    }
+    conn->is_ssl = (!ap_cstr_casecmp(worker->s->scheme, "https")
+                    || !ap_cstr_casecmp(worker->s->scheme, "wss"));
+    if (conn->is_ssl && !conn->ssl_hostname) {
+        conn->ssl_hostname = apr_pstrdup(conn->scpool, conn->hostname);
+    }
+
+    if (!conn->addr) {
+        if (dns_cache) {
+            rv = proxy_dns_resolve(conn, s);
+        }
+        else {
+            if (!worker->cp->addr) {
+                if ((rv = PROXY_THREAD_LOCK(worker)) != APR_SUCCESS) {
+                    return DECLINED;
+                }
+                if (!AP_VOLATILIZE_T(apr_sockaddr_t *, worker->cp->addr)) {
+                    apr_sockaddr_t *addr;
+
+                    rv = apr_sockaddr_info_get(&addr, conn->hostname,
+                                               APR_UNSPEC, conn->port, 0,
+                                               worker->cp->dns_pool);
+                    worker->cp->addr = addr;
+                }
+                PROXY_THREAD_UNLOCK(worker);
+            }
+            conn->addr = worker->cp->addr;
+        }
+        if (rv != APR_SUCCESS || !conn->addr) {
+            ap_log_error(APLOG_MARK, APLOG_DEBUG, rv, s, APLOGNO(10295)
+                         "%s: DNS lookup failure for %s (%s)",
+                         proxy_function, conn->hostname,
+                         worker->s->hostname_ex);
+            return DECLINED;
+        }
+    }
+
+    rc = connect_backend(proxy_function, conn, worker, s, reused);
+    if (rc != OK || *reused) {
+        return rc;
+    }
+
+    /* The handshake must use the SSLProxy* settings of the worker's
+     * <Proxy> section, as the requests will (merged like theirs, and
+     * like mod_proxy_hcheck's).
+     */
+    per_dir_config = worker->section_config;
+    if (conn->is_ssl && worker->section_config) {
+        per_dir_config = ap_merge_per_dir_configs(conn->scpool,
+                                                  s->lookup_defaults,
+                                                  worker->section_config);
+    }
+    rc = proxy_connection_create(proxy_function, conn, per_dir_config, s);
+    if (rc == OK && conn->is_ssl) {
+        /* Handshake now rather than with the first request */
+        rv = ap_get_brigade(conn->connection->input_filters, conn->tmp_bb,
+                            AP_MODE_INIT, APR_BLOCK_READ, 0);
+        apr_brigade_cleanup(conn->tmp_bb);
+        if (rv != APR_SUCCESS) {
+            ap_log_error(APLOG_MARK, APLOG_DEBUG, rv, s, APLOGNO(10296)
+                         "%s: TLS handshake with %pI (%s) failed",
+                         proxy_function, conn->addr, worker->s->hostname_ex);
+            rc = DECLINED;
+        }
+    }
+    return rc;
+}
+
+PROXY_DECLARE(int) ap_proxy_warm_connections(const char *proxy_function,
+                                             proxy_worker *worker,
+                                             server_rec *s,
+                                             apr_pool_t *p)
+{
+    proxy_conn_rec **conns, *conn;
+    int want = worker->s->warm, n, i, reused, rc = OK, warmed = 0;
+    apr_status_t rv;
+
+    if (want <= 0
+            || !(worker->local_status & PROXY_WORKER_INITIALIZED)
+            || !worker->cp || !worker->cp->res
+            || !worker->s->is_address_reusable || worker->s->disablereuse
+            || *worker->s->uds_path
+            || !ap_cstr_casecmpn(worker->s->scheme, "h2", 2)
+            || !PROXY_WORKER_IS_USABLE(worker)) {
+        return 0;
+    }
+
+    /* Never wait for the connections used by the requests */
+    n = worker->s->hmax - apr_reslist_acquired_count(worker->cp->res);
+    if (want > n) {
+        want = n;
+    }
+    if (want <= 0) {
+        return 0;
+    }
+
+    /* Take the (most recently used) idle connections out of the pool, or
+     * new ones, check or establish them, and put them all back.
+     */
+    conns = apr_palloc(p, want * sizeof(proxy_conn_rec *));
+    for (n = 0; n < want; ++n) {
+        rv = apr_reslist_acquire(worker->cp->res, (void **)&conn);
+        if (rv != APR_SUCCESS) {
+            break;
+        }
+        if (conn->sock) {
+            apr_atomic_dec32(&worker->cp->idle);
+        }
+        conn->worker = worker;
+        conn->close = 0;
+        conn->inreslist = 0;
+        conns[n] = conn;
+    }
+    for (i = 0; i < n; ++i) {
+        conn = conns[i];
+        if (rc == OK && !conn->forward && !conn->uds_path) {
+            reused = 0;
+            rc = warm_connection(proxy_function, conn, worker, s, &reused);
+            if (rc != OK) {
+                conn->close = 1;
+            }
+            else if (!reused) {
+                apr_atomic_inc32(&worker->s->conns_warmed);
+                warmed++;
+            }
+        }
+        connection_cleanup(conn);
+    }
+
+    if (warmed) {
+        ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, s, APLOGNO(10297)
+                     "%s: warmed %d connection%s (of %d) for (%s)",
+                     proxy_function, warmed, warmed > 1 ? "s" : "", n,
+                     worker->s->hostname_ex);
+    }
+    return rc == OK ? warmed : -1;
 }
 
 int ap_proxy_lb_workers(void)
@@ -4212,7 +4851,15 @@ struct proxy_tunnel_conn {
     apr_bucket_brigade *bb;
     struct proxy_tunnel_conn *other;
     unsigned int readable:1,
-                 drain:1;
+                 drain:1,
+                 splice:1,
+                 splice_init:1;
+#if PROXY_TUNNEL_SPLICE
+    int fd;             /* the socket's descriptor */
+    int pipe[2];        /* this side to the other side, through the kernel */
+    apr_size_t piped;   /* bytes in the pipe not written to the other side */
+    apr_size_t pipe_size;
+#endif
 };
 
 PROXY_DECLARE(apr_status_t) ap_proxy_tunnel_create(proxy_tunnel_rec **ptunnel,
@@ -4341,6 +4988,231 @@ static void del_pollset(apr_pollset_t *pollset, apr_pollfd_t *pfd,
     }
 }
 
+#if PROXY_TUNNEL_SPLICE
+
+/* Connection filters which can be bypassed when splicing */
+static const char * const tunnel_splice_input_filters[] = {
+    "CORE_IN", "reqtimeout", "LOG_INPUT_OUTPUT", NULL
+};
+static const char * const tunnel_splice_output_filters[] = {
+    "CORE", "reqtimeout", NULL
+};
+
+/* Maximum number of bytes spliced in a row before giving the other
+ * direction a chance.
+ */
+#define TUNNEL_SPLICE_BUDGET (1024 * 1024)
+
+static APR_OPTIONAL_FN_TYPE(ap_logio_add_bytes_in) *tunnel_logio_add_bytes_in;
+static APR_OPTIONAL_FN_TYPE(ap_logio_add_bytes_out) *tunnel_logio_add_bytes_out;
+
+static int tunnel_filters_bypassable(ap_filter_t *f,
+                                     const char * const *names)
+{
+    for (; f; f = f->next) {
+        const char * const *name;
+
+        for (name = names; *name; ++name) {
+            if (!strcasecmp(f->frec->name, *name)) {
+                break;
+            }
+        }
+        if (!*name) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* Whether the bytes can move from/to the socket directly, that is when
+ * no filter would transform them (e.g. TLS), nothing is buffered in the
+ * filters already, and the socket is non-blocking (i.e. has a timeout).
+ */
+static int tunnel_conn_spliceable(struct proxy_tunnel_conn *tc)
+{
+    apr_socket_t *s = tc->pfd->desc.s;
+    apr_interval_time_t t;
+    apr_os_sock_t fd;
+
+    if (!tunnel_filters_bypassable(tc->c->input_filters,
+                                   tunnel_splice_input_filters)
+            || !tunnel_filters_bypassable(tc->c->output_filters,
+                                          tunnel_splice_output_filters)) {
+        return 0;
+    }
+    if (!APR_BRIGADE_EMPTY(tc->bb)
+            || ap_filter_input_pending(tc->c) != DECLINED
+            || ap_filter_output_pending(tc->c) != DECLINED) {
+        return 0;
+    }
+    if (apr_socket_timeout_get(s, &t) != APR_SUCCESS || t < 0
+            || apr_os_sock_get(&fd, s) != APR_SUCCESS) {
+        return 0;
+    }
+    tc->fd = fd;
+    return 1;
+}
+
+static apr_status_t tunnel_pipe_cleanup(void *data)
+{
+    struct proxy_tunnel_conn *tc = data;
+
+    if (tc->pipe[0] >= 0) {
+        close(tc->pipe[0]);
+        close(tc->pipe[1]);
+        tc->pipe[0] = tc->pipe[1] = -1;
+    }
+    return APR_SUCCESS;
+}
+
+static apr_status_t tunnel_pipe_create(struct proxy_tunnel_conn *tc,
+                                       apr_pool_t *p)
+{
+    int size;
+
+    if (pipe2(tc->pipe, O_NONBLOCK | O_CLOEXEC) < 0) {
+        tc->pipe[0] = tc->pipe[1] = -1;
+        return errno;
+    }
+    apr_pool_cleanup_register(p, tc, tunnel_pipe_cleanup,
+                              apr_pool_cleanup_null);
+#ifdef F_GETPIPE_SZ
+    size = fcntl(tc->pipe[0], F_GETPIPE_SZ);
+#else
+    size = -1;
+#endif
+    tc->pipe_size = size > 0 ? size : 65536;
+    tc->piped = 0;
+    return APR_SUCCESS;
+}
+
+/* Use splice() for both directions of the tunnel if possible, one pipe
+ * per direction for the lifetime of the tunnel.  The tunnel may be run
+ * multiple times (asynchronously), the pipes and what's still in there
+ * are kept from one run to the next.
+ */
+static void tunnel_splice_init(proxy_tunnel_rec *tunnel)
+{
+    struct proxy_tunnel_conn *client = tunnel->client,
+                             *origin = tunnel->origin;
+    request_rec *r = tunnel->r;
+    apr_status_t rv;
+
+    if (client->splice_init) {
+        return;
+    }
+    client->splice_init = origin->splice_init = 1;
+
+    client->pipe[0] = client->pipe[1] = -1;
+    origin->pipe[0] = origin->pipe[1] = -1;
+    if (!tunnel_conn_spliceable(client) || !tunnel_conn_spliceable(origin)) {
+        return;
+    }
+
+    if ((rv = tunnel_pipe_create(client, r->pool)) != APR_SUCCESS
+            || (rv = tunnel_pipe_create(origin, r->pool)) != APR_SUCCESS) {
+        ap_log_rerror(APLOG_MARK, APLOG_DEBUG, rv, r, APLOGNO(10286)
+                      "proxy: %s: can't create splice pipes, "
+                      "falling back to buffered copy", tunnel->scheme);
+        tunnel_pipe_cleanup(client);
+        tunnel_pipe_cleanup(origin);
+        return;
+    }
+
+    tunnel_logio_add_bytes_in = APR_RETRIEVE_OPTIONAL_FN(ap_logio_add_bytes_in);
+    tunnel_logio_add_bytes_out = APR_RETRIEVE_OPTIONAL_FN(ap_logio_add_bytes_out);
+
+    client->splice = origin->splice = 1;
+    ap_log_rerror(APLOG_MARK, APLOG_TRACE1, 0, r,
+                  "proxy: %s: splicing (pipe sizes %" APR_SIZE_T_FMT
+                  "/%" APR_SIZE_T_FMT ")", tunnel->scheme,
+                  client->pipe_size, origin->pipe_size);
+}
+
+/* Write what's in the pipe of 'in' to 'out', APR_INCOMPLETE if it would
+ * block.
+ */
+static apr_status_t tunnel_splice_flush(struct proxy_tunnel_conn *in,
+                                        struct proxy_tunnel_conn *out)
+{
+    while (in->piped) {
+        ssize_t n = splice(in->pipe[0], NULL, out->fd, NULL, in->piped,
+                           SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return APR_INCOMPLETE;
+            }
+            return errno;
+        }
+        in->piped -= n;
+        if (tunnel_logio_add_bytes_out) {
+            tunnel_logio_add_bytes_out(out->c, n);
+        }
+    }
+    return APR_SUCCESS;
+}
+
+/* Same as ap_proxy_transfer_between_connections() with the
+ * AP_PROXY_TRANSFER_SHOULD_YIELD flag, without copying the data through
+ * user space: socket => pipe => socket.
+ */
+static apr_status_t tunnel_splice_transfer(struct proxy_tunnel_conn *in,
+                                           struct proxy_tunnel_conn *out,
+                                           int *sent)
+{
+    apr_size_t budget = TUNNEL_SPLICE_BUDGET;
+    apr_status_t rv;
+    ssize_t n;
+
+    for (;;) {
+        rv = tunnel_splice_flush(in, out);
+        if (rv != APR_SUCCESS || !budget) {
+            return rv;
+        }
+
+        n = splice(in->fd, NULL, in->pipe[1], NULL, in->pipe_size,
+                   SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return APR_SUCCESS;
+            }
+            return errno;
+        }
+        if (n == 0) {
+            return APR_EOF;
+        }
+        if (tunnel_logio_add_bytes_in) {
+            tunnel_logio_add_bytes_in(in->c, n);
+        }
+        in->piped = n;
+        budget -= (apr_size_t)n < budget ? (apr_size_t)n : budget;
+        *sent = 1;
+    }
+}
+
+#endif /* PROXY_TUNNEL_SPLICE */
+
+static int tunnel_output_pending(struct proxy_tunnel_conn *in,
+                                 struct proxy_tunnel_conn *out)
+{
+#if PROXY_TUNNEL_SPLICE
+    if (in->splice) {
+        apr_status_t rv = tunnel_splice_flush(in, out);
+        if (rv == APR_SUCCESS) {
+            return DECLINED;
+        }
+        return APR_STATUS_IS_INCOMPLETE(rv) ? OK : HTTP_INTERNAL_SERVER_ERROR;
+    }
+#endif
+    return ap_filter_output_pending(out->c);
+}
+
 PROXY_DECLARE(int) ap_proxy_tunnel_run(proxy_tunnel_rec *tunnel)
 {
     int rc = OK;
@@ -4358,6 +5230,10 @@ PROXY_DECLARE(int) ap_proxy_tunnel_run(proxy_tunnel_rec *tunnel)
                   scheme, timeout > 0 ? apr_time_sec(timeout) : timeout,
                           timeout > 0 ? timeout % APR_USEC_PER_SEC : 0);
 
+#if PROXY_TUNNEL_SPLICE
+    tunnel_splice_init(tunnel);
+#endif
+
     client->pfd->reqevents = 0;
     origin->pfd->reqevents = 0;
     add_pollset(pollset, client->pfd, APR_POLLIN);
@@ -4435,6 +5311,12 @@ PROXY_DECLARE(int) ap_proxy_tunnel_run(proxy_tunnel_rec *tunnel)
                               (revents & APR_POLLOUT) ? "draining"
                                                       : "readable");
 
+#if PROXY_TUNNEL_SPLICE
+                if (in->splice) {
+                    rv = tunnel_splice_transfer(in, out, &sent);
+                }
+                else
+#endif
                 rv = ap_proxy_transfer_between_connections(r,
                                                in->c, out->c,
                                                in->bb, out->bb,
@@ -4475,6 +5357,10 @@ PROXY_DECLARE(int) ap_proxy_tunnel_run(proxy_tunnel_rec *tunnel)
                 }
                 else {
                     in->drain = 0;
+                    if (in->splice) {
+                        /* Everything spliced is written already */
+                        sent = 0;
+                    }
                 }
 
                 if (sent) {
@@ -4487,7 +5373,7 @@ PROXY_DECLARE(int) ap_proxy_tunnel_run(proxy_tunnel_rec *tunnel)
                               "proxy: %s: %s is writable",
                               scheme, out->name);
 
-                rv = ap_filter_output_pending(out->c);
+                rv = tunnel_output_pending(in, out);
                 if (rv == DECLINED) {
                     /* No more pending data. If the 'in' side is not readable
                      * anymore it's time to shutdown for write (this direction
@@ -35,6 +35,18 @@ extern PROXY_DECLARE_DATA int proxy_lb_workers;
 extern PROXY_DECLARE_DATA const apr_strmatch_pattern *ap_proxy_strmatch_path;
 extern PROXY_DECLARE_DATA const apr_strmatch_pattern *ap_proxy_strmatch_domain;
 
+/**
+ * Create the resolver cache of the child process (ProxyDNSCache).
+ * @param p The child pool
+ * @param s The main server
+ * @param ttl How long resolved addresses are used before being refreshed,
+ *            the cache is disabled if not positive
+ * @param negative_ttl How long failed lookups are cached
+ */
+void proxy_dns_cache_init(apr_pool_t *p, server_rec *s,
+                          apr_interval_time_t ttl,
+                          apr_interval_time_t negative_ttl);
+
 /**
  * Register optional functions declared within proxy_util.c.
  */
@@ -175,6 +175,9 @@ static const command_rec ssl_config_cmds[] = {
     SSL_CMD_SRV(SessionTickets, FLAG,
                 "Enable or disable TLS session tickets"
                 "(`on', `off')")
+    SSL_CMD_SRV(KTLS, FLAG,
+                "Offload the encryption of the responses to the kernel "
+                "(`on', `off')")
     SSL_CMD_SRV(InsecureRenegotiation, FLAG,
                 "Enable support for insecure renegotiation")
     SSL_CMD_ALL(UserName, TAKE1,
@@ -240,6 +243,8 @@ static const command_rec ssl_config_cmds[] = {
     SSL_CMD_PXY(ProxyCheckPeerName, FLAG,
                 "SSL Proxy: check the peer certificate's name "
                 "(must be present in subjectAltName extension or CN")
+    SSL_CMD_PXY(ProxySessionCache, FLAG,
+                "SSL Proxy: resume the sessions of the backend connections")
 
     /*
      * Per-directory context configuration directives
@@ -183,6 +183,7 @@ static void modssl_ctx_init(modssl_ctx_t *mctx, apr_pool_t *p)
     mctx->ssl_check_peer_cn     = UNSET;
     mctx->ssl_check_peer_name   = UNSET;
     mctx->ssl_check_peer_expire = UNSET;
+    mctx->proxy_session_cache   = UNSET;
 }
 
 static void modssl_ctx_init_server(SSLSrvConfigRec *sc,
@@ -221,6 +222,7 @@ static SSLSrvConfigRec *ssl_config_server_new(apr_pool_t *p)
     sc->compression            = UNSET;
 #endif
     sc->session_tickets        = UNSET;
+    sc->ktls                   = UNSET;
 
     modssl_ctx_init_server(sc, p);
 
@@ -317,6 +319,7 @@ static void modssl_ctx_cfg_merge(apr_pool_t *p,
     cfgMergeBool(ssl_check_peer_cn);
     cfgMergeBool(ssl_check_peer_name);
     cfgMergeBool(ssl_check_peer_expire);
+    cfgMergeBool(proxy_session_cache);
 }
 
 static void modssl_ctx_cfg_merge_server(apr_pool_t *p,
@@ -355,6 +358,7 @@ void *ssl_config_server_merge(apr_pool_t *p, void *basev, void *addv)
     cfgMergeBool(compression);
 #endif
     cfgMergeBool(session_tickets);
+    cfgMergeBool(ktls);
 
     modssl_ctx_cfg_merge_server(p, base->server, add->server, mrg->server);
 
@@ -974,6 +978,18 @@ const char *ssl_cmd_SSLSessionTickets(cmd_parms *cmd, void *dcfg, int flag)
     return NULL;
 }
 
+const char *ssl_cmd_SSLKTLS(cmd_parms *cmd, void *dcfg, int flag)
+{
+#ifdef HAVE_SSL_KTLS
+    SSLSrvConfigRec *sc = mySrvConfig(cmd->server);
+    sc->ktls = flag ? TRUE : FALSE;
+    return NULL;
+#else
+    return "SSLKTLS unsupported; kernel TLS requires OpenSSL 3.x "
+           "on Linux";
+#endif
+}
+
 const char *ssl_cmd_SSLInsecureRenegotiation(cmd_parms *cmd, void *dcfg, int flag)
 {
 #ifdef SSL_OP_ALLOW_UNSAFE_LEGACY_RENEGOTIATION
@@ -1960,6 +1976,15 @@ const char *ssl_cmd_SSLProxyCheckPeerExpire(cmd_parms *cmd, void *dcfg, int flag
     return NULL;
 }
 
+const char *ssl_cmd_SSLProxySessionCache(cmd_parms *cmd, void *dcfg, int flag)
+{
+    SSLDirConfigRec *dc = (SSLDirConfigRec *)dcfg;
+
+    dc->proxy->proxy_session_cache = flag ? TRUE : FALSE;
+
+    return NULL;
+}
+
 const char *ssl_cmd_SSLProxyCheckPeerCN(cmd_parms *cmd, void *dcfg, int flag)
 {
     SSLDirConfigRec *dc = (SSLDirConfigRec *)dcfg;
@@ -2622,6 +2647,7 @@ static void modssl_ctx_dump(modssl_ctx_t *ctx, apr_pool_t *p, int proxy,
         DMP_ON_OFF("SSLProxyCheckPeerCN", ctx->ssl_check_peer_cn);
         DMP_ON_OFF("SSLProxyCheckPeerName", ctx->ssl_check_peer_cn);
         DMP_ON_OFF("SSLProxyCheckPeerExpire", ctx->ssl_check_peer_expire);
+        DMP_ON_OFF("SSLProxySessionCache", ctx->proxy_session_cache);
     }
 }
 
@@ -2641,6 +2667,7 @@ static void ssl_srv_dump(SSLSrvConfigRec *sc, apr_pool_t *p,
     DMP_ON_OFF("SSLInsecureRenegotiation", sc->insecure_reneg);
     DMP_ON_OFF("SSLStrictSNIVHostCheck", sc->strict_sni_vhost_check);
     DMP_ON_OFF("SSLSessionTickets", sc->session_tickets);
+    DMP_ON_OFF("SSLKTLS", sc->ktls);
 }
 
 static void ssl_policy_dump(SSLSrvConfigRec *policy, apr_pool_t *p, 
@@ -834,6 +834,16 @@ static apr_status_t ssl_init_ctx_protocol(server_rec *s,
     }
 #endif
 
+#ifdef HAVE_SSL_KTLS
+    /*
+     * Let OpenSSL hand the transmit keys to the kernel, through the
+     * output BIO (see bio_filter_out_ctrl()), when the cipher allows.
+     */
+    if (sc->ktls == TRUE && !mctx->pkp) {
+        SSL_CTX_set_options(ctx, SSL_OP_ENABLE_KTLS);
+    }
+#endif
+
     SSL_CTX_set_app_data(ctx, s);
 
     /*
@@ -889,6 +899,14 @@ static void ssl_init_ctx_session_cache(server_rec *s,
     SSL_CTX *ctx = mctx->ssl_ctx;
     SSLModConfigRec *mc = myModConfig(s);
 
+    if (mctx->pkp && mctx->proxy_session_cache != FALSE) {
+        /* Backend sessions are kept by each child (ssl_scache_proxy_*) */
+        SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_CLIENT
+                                       | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+        SSL_CTX_sess_set_new_cb(ctx, ssl_callback_NewProxySession);
+        return;
+    }
+
     SSL_CTX_set_session_cache_mode(ctx, mc->sesscache_mode);
 
     if (mc->sesscache) {
@@ -2299,6 +2317,7 @@ void ssl_init_Child(apr_pool_t *p, server_rec *s)
 
     /* open the mutex lockfile */
     ssl_mutex_reinit(s, p);
+    ssl_scache_proxy_init(s, p);
 #ifdef HAVE_OCSP_STAPLING
     ssl_stapling_mutex_reinit(s, p);
 #endif
@@ -32,6 +32,19 @@
 #include "mod_ssl_openssl.h"
 #include "apr_date.h"
 
+#ifdef HAVE_SSL_KTLS
+#include "apr_support.h"
+#include <sys/socket.h>
+#include <netinet/tcp.h>
+#include <linux/tls.h>
+#ifndef TCP_ULP
+#define TCP_ULP 31
+#endif
+#ifndef SOL_TLS
+#define SOL_TLS 282
+#endif
+#endif
+
 APR_IMPLEMENT_OPTIONAL_HOOK_RUN_ALL(ssl, SSL, int, proxy_post_handshake,
                                     (conn_rec *c,SSL *ssl),
                                     (c,ssl),OK,DECLINED);
@@ -116,6 +129,11 @@ typedef struct {
     conn_rec *c;
     apr_bucket_brigade *bb;    /* Brigade used as a buffer. */
     apr_status_t rc;
+#ifdef HAVE_SSL_KTLS
+    int ktls_send;             /* The kernel encrypts what we write */
+    int ktls_stale;            /* ... but with keys no longer current */
+    int ktls_record_type;      /* Type of the next record if not data */
+#endif
 } bio_filter_out_ctx_t;
 
 static bio_filter_out_ctx_t *bio_filter_out_ctx_new(ssl_filter_ctx_t *filter_ctx,
@@ -126,6 +144,11 @@ static bio_filter_out_ctx_t *bio_filter_out_ctx_new(ssl_filter_ctx_t *filter_ctx
     outctx->filter_ctx = filter_ctx;
     outctx->c = c;
     outctx->bb = apr_brigade_create(c->pool, c->bucket_alloc);
+#ifdef HAVE_SSL_KTLS
+    outctx->ktls_send = 0;
+    outctx->ktls_stale = 0;
+    outctx->ktls_record_type = 0;
+#endif
 
     return outctx;
 }
@@ -164,6 +187,136 @@ static int bio_filter_out_flush(BIO *bio)
     return bio_filter_out_pass(outctx);
 }
 
+#ifdef HAVE_SSL_KTLS
+/* Size of the (Linux) crypto info given by OpenSSL, per cipher */
+static apr_size_t bio_filter_out_ktls_info_len(
+    const struct tls_crypto_info *info)
+{
+    switch (info->cipher_type) {
+#ifdef TLS_CIPHER_AES_GCM_128
+    case TLS_CIPHER_AES_GCM_128:
+        return sizeof(struct tls12_crypto_info_aes_gcm_128);
+#endif
+#ifdef TLS_CIPHER_AES_GCM_256
+    case TLS_CIPHER_AES_GCM_256:
+        return sizeof(struct tls12_crypto_info_aes_gcm_256);
+#endif
+#ifdef TLS_CIPHER_AES_CCM_128
+    case TLS_CIPHER_AES_CCM_128:
+        return sizeof(struct tls12_crypto_info_aes_ccm_128);
+#endif
+#ifdef TLS_CIPHER_CHACHA20_POLY1305
+    case TLS_CIPHER_CHACHA20_POLY1305:
+        return sizeof(struct tls12_crypto_info_chacha20_poly1305);
+#endif
+    default:
+        return 0;
+    }
+}
+
+/* Called by OpenSSL when the transmit keys change, after it flushed what
+ * it wrote with the previous ones: hand them to the kernel (returning 0
+ * lets OpenSSL encrypt by itself, e.g. when the tls module is missing).
+ */
+static int bio_filter_out_ktls_start(bio_filter_out_ctx_t *outctx,
+                                     const struct tls_crypto_info *info)
+{
+    apr_socket_t *sock = ap_get_conn_socket(outctx->c);
+    apr_size_t len = bio_filter_out_ktls_info_len(info);
+    apr_os_sock_t fd;
+
+    if (outctx->ktls_send) {
+        /* New keys (TLSv1.3 KeyUpdate), which not all kernels take.  The
+         * offload can't be removed from the socket either, so refuse the
+         * rekey by failing the next writes rather than having the kernel
+         * encrypt with the old keys what OpenSSL would no longer encrypt.
+         */
+        if (len && apr_os_sock_get(&fd, sock) == APR_SUCCESS
+                && setsockopt(fd, SOL_TLS, TLS_TX, info, len) == 0) {
+            return 1;
+        }
+        ap_log_cerror(APLOG_MARK, APLOG_INFO, apr_get_netos_error(),
+                      outctx->c, APLOGNO(10306)
+                      "kernel TLS can't update the transmit keys, "
+                      "closing the connection");
+        outctx->ktls_stale = 1;
+        return 0;
+    }
+    if (!sock || !len || apr_os_sock_get(&fd, sock) != APR_SUCCESS) {
+        return 0;
+    }
+    if (setsockopt(fd, SOL_TCP, TCP_ULP, "tls", sizeof("tls")) < 0
+            || setsockopt(fd, SOL_TLS, TLS_TX, info, len) < 0) {
+        ap_log_cerror(APLOG_MARK, APLOG_DEBUG, apr_get_netos_error(),
+                      outctx->c, APLOGNO(10284)
+                      "kernel TLS not available, encrypting in userspace");
+        return 0;
+    }
+
+    ap_log_cerror(APLOG_MARK, APLOG_DEBUG, 0, outctx->c, APLOGNO(10285)
+                  "kernel TLS enabled for transmission");
+    outctx->ktls_send = 1;
+    return 1;
+}
+
+/* Non application data records (alerts, handshake) must be typed with a
+ * control message, hence sent by ourselves once what precedes is out.
+ */
+static int bio_filter_out_ktls_ctrl_msg(BIO *bio, bio_filter_out_ctx_t *outctx,
+                                        const char *in, int inl)
+{
+    apr_socket_t *sock = ap_get_conn_socket(outctx->c);
+    char cbuf[CMSG_SPACE(sizeof(unsigned char))];
+    struct cmsghdr *cmsg;
+    struct msghdr msg;
+    struct iovec iov;
+    apr_os_sock_t fd;
+    int sent = 0;
+
+    if (bio_filter_out_flush(bio) < 0) {
+        return -1;
+    }
+    apr_os_sock_get(&fd, sock);
+
+    while (sent < inl) {
+        ssize_t n;
+
+        memset(&msg, 0, sizeof(msg));
+        iov.iov_base = (char *)in + sent;
+        iov.iov_len = inl - sent;
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = cbuf;
+        msg.msg_controllen = sizeof(cbuf);
+        cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_TLS;
+        cmsg->cmsg_type = TLS_SET_RECORD_TYPE;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(unsigned char));
+        *CMSG_DATA(cmsg) = (unsigned char)outctx->ktls_record_type;
+
+        n = sendmsg(fd, &msg, 0);
+        if (n < 0) {
+            apr_status_t rv = apr_get_netos_error();
+
+            if (APR_STATUS_IS_EINTR(rv)) {
+                continue;
+            }
+            if (APR_STATUS_IS_EAGAIN(rv)) {
+                rv = apr_wait_for_io_or_timeout(NULL, sock, 0);
+                if (rv == APR_SUCCESS) {
+                    continue;
+                }
+            }
+            outctx->rc = rv;
+            return -1;
+        }
+        sent += n;
+    }
+
+    return inl;
+}
+#endif
+
 static int bio_filter_create(BIO *bio)
 {
     BIO_set_shutdown(bio, 1);
@@ -221,6 +374,16 @@ static int bio_filter_out_write(BIO *bio, const char *in, int inl)
     ap_log_cerror(APLOG_MARK, APLOG_TRACE6, 0, outctx->c,
                   "bio_filter_out_write: %i bytes", inl);
 
+#ifdef HAVE_SSL_KTLS
+    if (outctx->ktls_stale) {
+        outctx->rc = APR_ECONNABORTED;
+        return -1;
+    }
+    if (outctx->ktls_record_type) {
+        return bio_filter_out_ktls_ctrl_msg(bio, outctx, in, inl);
+    }
+#endif
+
     /* Use a transient bucket for the output data - any downstream
      * filter must setaside if necessary. */
     e = apr_bucket_transient_create(in, inl, outctx->bb->bucket_alloc);
@@ -283,6 +446,20 @@ static long bio_filter_out_ctrl(BIO *bio, int cmd, long num, void *ptr)
       case BIO_CTRL_DUP:
         ret = 1;
         break;
+#ifdef HAVE_SSL_KTLS
+      case MODSSL_BIO_CTRL_SET_KTLS:
+        ret = num ? bio_filter_out_ktls_start(outctx, ptr) : 0;
+        break;
+      case BIO_CTRL_GET_KTLS_SEND:
+        ret = outctx->ktls_send;
+        break;
+      case MODSSL_BIO_CTRL_SET_KTLS_TX_SEND_CTRL_MSG:
+        outctx->ktls_record_type = (int)num;
+        break;
+      case MODSSL_BIO_CTRL_CLEAR_KTLS_TX_CTRL_MSG:
+        outctx->ktls_record_type = 0;
+        break;
+#endif
         /* N/A */
       case BIO_C_SET_BUF_MEM:
       case BIO_C_GET_BUF_MEM_PTR:
@@ -1323,10 +1500,13 @@ static apr_status_t ssl_io_filter_handshake(ssl_filter_ctx_t *filter_ctx)
         }
 #endif /* defined HAVE_TLSEXT */
 
+        ssl_scache_proxy_resume(c, filter_ctx->pssl);
+
         if ((n = SSL_connect(filter_ctx->pssl)) <= 0) {
             ap_log_cerror(APLOG_MARK, APLOG_INFO, 0, c, APLOGNO(02003)
                           "SSL Proxy connect failed");
             ssl_log_ssl_error(SSLLOG_MARK, APLOG_INFO, server);
+            ssl_scache_proxy_remove(c, filter_ctx->pssl);
             /* ensure that the SSL structures etc are freed, etc: */
             ssl_filter_io_shutdown(filter_ctx, c, 1);
             apr_table_setn(c->notes, "SSL_connect_rv", "err");
@@ -1402,6 +1582,9 @@ static apr_status_t ssl_io_filter_handshake(ssl_filter_ctx_t *filter_ctx)
             return MODSSL_ERROR_BAD_GATEWAY;
         }
 
+        ap_log_cerror(APLOG_MARK, APLOG_TRACE2, 0, c,
+                      "SSL Proxy session %s", SSL_session_reused(filter_ctx->pssl)
+                      ? "resumed" : "negotiated");
         apr_table_setn(c->notes, "SSL_connect_rv", "ok");
         return APR_SUCCESS;
     }
@@ -1975,6 +2158,20 @@ static apr_status_t ssl_io_filter_output(ap_filter_t *f,
                 status = outctx->rc;
             }
         }
+#ifdef HAVE_SSL_KTLS
+        else if (outctx->ktls_send && !outctx->ktls_stale) {
+            /* The kernel encrypts whatever is written on the socket, so
+             * pass the data as is: FILE buckets can be sendfile()d by
+             * the core output filter instead of being read and copied
+             * through OpenSSL.
+             */
+            APR_BUCKET_REMOVE(bucket);
+            APR_BRIGADE_INSERT_TAIL(outctx->bb, bucket);
+            if (bio_filter_out_pass(outctx) < 0) {
+                status = outctx->rc;
+            }
+        }
+#endif
         else {
             /* Filter a data bucket. */
             const char *data;
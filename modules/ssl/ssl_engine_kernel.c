@@ -2120,6 +2120,24 @@ int ssl_callback_NewSessionCacheEntry(SSL *ssl, SSL_SESSION *session)
     return 0;
 }
 
+/*
+ *  This callback function is executed by OpenSSL whenever a new SSL_SESSION
+ *  is negotiated by a proxy (client) connection. We keep it to resume it
+ *  with the next connections to the same backend.
+ */
+int ssl_callback_NewProxySession(SSL *ssl, SSL_SESSION *session)
+{
+    conn_rec *conn = (conn_rec *)SSL_get_app_data(ssl);
+
+    ssl_scache_proxy_store(conn, ssl, session);
+
+    /*
+     * return 1 which means to OpenSSL that we own the reference on the
+     * SSL_SESSION now.
+     */
+    return 1;
+}
+
 /*
  *  This callback function is executed by OpenSSL whenever a
  *  SSL_SESSION is looked up in the internal OpenSSL cache and it
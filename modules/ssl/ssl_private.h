@@ -266,6 +266,35 @@ void free_bio_methods(void);
 #define HAVE_OPENSSL_KEYLOG
 #endif
 
+/* Kernel TLS transmit offload (OpenSSL 3.x on Linux), see SSLKTLS.
+ * OpenSSL configures it through BIO controls that our output BIO must
+ * implement.  Only BIO_CTRL_GET_KTLS_SEND is public, the others are in
+ * OpenSSL's include/internal/bio.h, with the same values in all the 3.x
+ * releases.
+ */
+#if defined(SSL_OP_ENABLE_KTLS) && !defined(OPENSSL_NO_KTLS) \
+    && defined(BIO_CTRL_GET_KTLS_SEND) \
+    && defined(__linux__) && !defined(LIBRESSL_VERSION_NUMBER) \
+    && OPENSSL_VERSION_NUMBER >= 0x30000000L \
+    && OPENSSL_VERSION_NUMBER < 0x40000000L
+#define HAVE_SSL_KTLS
+#ifdef BIO_CTRL_SET_KTLS
+#define MODSSL_BIO_CTRL_SET_KTLS                  BIO_CTRL_SET_KTLS
+#else
+#define MODSSL_BIO_CTRL_SET_KTLS                  72
+#endif
+#ifdef BIO_CTRL_SET_KTLS_TX_SEND_CTRL_MSG
+#define MODSSL_BIO_CTRL_SET_KTLS_TX_SEND_CTRL_MSG BIO_CTRL_SET_KTLS_TX_SEND_CTRL_MSG
+#else
+#define MODSSL_BIO_CTRL_SET_KTLS_TX_SEND_CTRL_MSG 74
+#endif
+#ifdef BIO_CTRL_CLEAR_KTLS_TX_CTRL_MSG
+#define MODSSL_BIO_CTRL_CLEAR_KTLS_TX_CTRL_MSG    BIO_CTRL_CLEAR_KTLS_TX_CTRL_MSG
+#else
+#define MODSSL_BIO_CTRL_CLEAR_KTLS_TX_CTRL_MSG    75
+#endif
+#endif
+
 /* mod_ssl headers */
 #include "ssl_util_ssl.h"
 
@@ -771,6 +800,7 @@ typedef struct {
     BOOL ssl_check_peer_cn;
     BOOL ssl_check_peer_name;
     BOOL ssl_check_peer_expire;
+    BOOL proxy_session_cache;
 } modssl_ctx_t;
 
 struct SSLSrvConfigRec {
@@ -789,7 +819,7 @@ struct SSLSrvConfigRec {
     BOOL             compression;
 #endif
     BOOL             session_tickets;
-    
+    BOOL             ktls;
 };
 
 /**
@@ -851,6 +881,7 @@ const char  *ssl_cmd_SSLCARevocationCheck(cmd_parms *, void *, const char *);
 const char  *ssl_cmd_SSLHonorCipherOrder(cmd_parms *cmd, void *dcfg, int flag);
 const char  *ssl_cmd_SSLCompression(cmd_parms *, void *, int flag);
 const char  *ssl_cmd_SSLSessionTickets(cmd_parms *, void *, int flag);
+const char  *ssl_cmd_SSLKTLS(cmd_parms *, void *, int flag);
 const char  *ssl_cmd_SSLVerifyClient(cmd_parms *, void *, const char *);
 const char  *ssl_cmd_SSLVerifyDepth(cmd_parms *, void *, const char *);
 const char  *ssl_cmd_SSLSessionCache(cmd_parms *, void *, const char *);
@@ -881,6 +912,7 @@ const char  *ssl_cmd_SSLProxyMachineCertificateChainFile(cmd_parms *, void *, co
 const char *ssl_cmd_SSLSessionTicketKeyFile(cmd_parms *cmd, void *dcfg, const char *arg);
 #endif
 const char  *ssl_cmd_SSLProxyCheckPeerExpire(cmd_parms *cmd, void *dcfg, int flag);
+const char  *ssl_cmd_SSLProxySessionCache(cmd_parms *cmd, void *dcfg, int flag);
 const char  *ssl_cmd_SSLProxyCheckPeerCN(cmd_parms *cmd, void *dcfg, int flag);
 const char  *ssl_cmd_SSLProxyCheckPeerName(cmd_parms *cmd, void *dcfg, int flag);
 
@@ -942,6 +974,7 @@ int          ssl_callback_SSLVerify(int, X509_STORE_CTX *);
 int          ssl_callback_SSLVerify_CRL(int, X509_STORE_CTX *, conn_rec *);
 int          ssl_callback_proxy_cert(SSL *ssl, X509 **x509, EVP_PKEY **pkey);
 int          ssl_callback_NewSessionCacheEntry(SSL *, SSL_SESSION *);
+int          ssl_callback_NewProxySession(SSL *, SSL_SESSION *);
 SSL_SESSION *ssl_callback_GetSessionCacheEntry(SSL *, IDCONST unsigned char *, int, int *);
 void         ssl_callback_DelSessionCacheEntry(SSL_CTX *, SSL_SESSION *);
 void         ssl_callback_Info(const SSL *, int, int);
@@ -979,6 +1012,10 @@ BOOL         ssl_scache_store(server_rec *, IDCONST UCHAR *, int,
 SSL_SESSION *ssl_scache_retrieve(server_rec *, IDCONST UCHAR *, int, apr_pool_t *);
 void         ssl_scache_remove(server_rec *, IDCONST UCHAR *, int,
                                apr_pool_t *);
+void         ssl_scache_proxy_init(server_rec *, apr_pool_t *);
+void         ssl_scache_proxy_store(conn_rec *, SSL *, SSL_SESSION *);
+int          ssl_scache_proxy_resume(conn_rec *, SSL *);
+void         ssl_scache_proxy_remove(conn_rec *, SSL *);
 
 /** OCSP Stapling Support */
 #ifdef HAVE_OCSP_STAPLING
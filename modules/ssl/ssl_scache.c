@@ -189,6 +189,179 @@ void ssl_scache_remove(server_rec *s, IDCONST UCHAR *id, int idlen,
     }
 }
 
+/*  _________________________________________________________________
+**
+**  Session Cache: Backend (SSLProxy) Sessions
+**  _________________________________________________________________
+*/
+
+/*
+ * The sessions negotiated by mod_proxy's connections are kept by each
+ * child, per SSL_CTX (i.e. SSLProxy* configuration), backend address and
+ * SNI, so that the next connections to the same backend can resume them
+ * instead of doing a full handshake (unless SSLProxySessionCache is off).
+ * When full, the least recently used session is dropped.
+ */
+#ifndef MODSSL_PROXY_SESSIONS_MAX
+#define MODSSL_PROXY_SESSIONS_MAX 1024
+#endif
+
+typedef struct ssl_proxy_session_t ssl_proxy_session_t;
+struct ssl_proxy_session_t {
+    APR_RING_ENTRY(ssl_proxy_session_t) link;
+    SSL_SESSION *session;
+    apr_time_t expiry;
+    apr_size_t klen;
+    char key[1];
+};
+
+static apr_hash_t *proxy_sessions;
+static APR_RING_HEAD(ssl_proxy_session_lru, ssl_proxy_session_t) proxy_lru;
+#if APR_HAS_THREADS
+static apr_thread_mutex_t *proxy_sessions_mutex;
+#endif
+
+/* Unlink (and free) an entry */
+static void proxy_session_free(ssl_proxy_session_t *entry)
+{
+    apr_hash_set(proxy_sessions, entry->key, entry->klen, NULL);
+    APR_RING_REMOVE(entry, link);
+    SSL_SESSION_free(entry->session);
+    free(entry);
+}
+
+static apr_status_t proxy_sessions_cleanup(void *data)
+{
+    while (!APR_RING_EMPTY(&proxy_lru, ssl_proxy_session_t, link)) {
+        proxy_session_free(APR_RING_FIRST(&proxy_lru));
+    }
+    proxy_sessions = NULL;
+    return APR_SUCCESS;
+}
+
+void ssl_scache_proxy_init(server_rec *s, apr_pool_t *p)
+{
+#if APR_HAS_THREADS
+    apr_status_t rv;
+
+    rv = apr_thread_mutex_create(&proxy_sessions_mutex,
+                                 APR_THREAD_MUTEX_DEFAULT, p);
+    if (rv != APR_SUCCESS) {
+        ap_log_error(APLOG_MARK, APLOG_WARNING, rv, s, APLOGNO(10300)
+                     "Cannot create the SSLProxy session cache mutex, "
+                     "backend sessions won't be resumed");
+        return;
+    }
+#endif
+    proxy_sessions = apr_hash_make(p);
+    APR_RING_INIT(&proxy_lru, ssl_proxy_session_t, link);
+    apr_pool_cleanup_register(p, NULL, proxy_sessions_cleanup,
+                              apr_pool_cleanup_null);
+}
+
+static apr_size_t proxy_session_key(conn_rec *c, SSL *ssl,
+                                    char *buf, apr_size_t len)
+{
+    const char *sni = apr_table_get(c->notes, "proxy-request-hostname");
+
+    return apr_snprintf(buf, len, "%pp|%pI|%s", SSL_get_SSL_CTX(ssl),
+                        c->client_addr, sni ? sni : "");
+}
+
+#if APR_HAS_THREADS
+#define PROXY_SESSIONS_LOCK()   apr_thread_mutex_lock(proxy_sessions_mutex)
+#define PROXY_SESSIONS_UNLOCK() apr_thread_mutex_unlock(proxy_sessions_mutex)
+#else
+#define PROXY_SESSIONS_LOCK()
+#define PROXY_SESSIONS_UNLOCK()
+#endif
+
+void ssl_scache_proxy_store(conn_rec *c, SSL *ssl, SSL_SESSION *session)
+{
+    ssl_proxy_session_t *entry, *old;
+    char key[MAX_STRING_LEN];
+    apr_size_t klen;
+
+    if (!proxy_sessions) {
+        SSL_SESSION_free(session);
+        return;
+    }
+    klen = proxy_session_key(c, ssl, key, sizeof(key));
+    entry = malloc(sizeof(*entry) + klen);
+    if (!entry) {
+        SSL_SESSION_free(session);
+        return;
+    }
+    entry->session = session;
+    entry->expiry = apr_time_from_sec(SSL_SESSION_get_time(session)
+                                      + SSL_SESSION_get_timeout(session));
+    entry->klen = klen;
+    memcpy(entry->key, key, klen + 1);
+
+    PROXY_SESSIONS_LOCK();
+    old = apr_hash_get(proxy_sessions, entry->key, klen);
+    if (!old && apr_hash_count(proxy_sessions) >= MODSSL_PROXY_SESSIONS_MAX) {
+        /* Full, make room with the least recently used */
+        old = APR_RING_LAST(&proxy_lru);
+    }
+    if (old) {
+        proxy_session_free(old);
+    }
+    apr_hash_set(proxy_sessions, entry->key, klen, entry);
+    APR_RING_INSERT_HEAD(&proxy_lru, entry, ssl_proxy_session_t, link);
+    PROXY_SESSIONS_UNLOCK();
+}
+
+int ssl_scache_proxy_resume(conn_rec *c, SSL *ssl)
+{
+    ssl_proxy_session_t *entry;
+    char key[MAX_STRING_LEN];
+    apr_size_t klen;
+    int rc = 0;
+
+    if (!proxy_sessions) {
+        return 0;
+    }
+    klen = proxy_session_key(c, ssl, key, sizeof(key));
+
+    PROXY_SESSIONS_LOCK();
+    entry = apr_hash_get(proxy_sessions, key, klen);
+    if (entry) {
+        if (entry->expiry > apr_time_now()) {
+            /* SSL_set_session() takes its own reference */
+            rc = SSL_set_session(ssl, entry->session);
+            APR_RING_REMOVE(entry, link);
+            APR_RING_INSERT_HEAD(&proxy_lru, entry, ssl_proxy_session_t,
+                                 link);
+        }
+        else {
+            proxy_session_free(entry);
+        }
+    }
+    PROXY_SESSIONS_UNLOCK();
+
+    return rc;
+}
+
+void ssl_scache_proxy_remove(conn_rec *c, SSL *ssl)
+{
+    ssl_proxy_session_t *entry;
+    char key[MAX_STRING_LEN];
+    apr_size_t klen;
+
+    if (!proxy_sessions) {
+        return;
+    }
+    klen = proxy_session_key(c, ssl, key, sizeof(key));
+
+    PROXY_SESSIONS_LOCK();
+    entry = apr_hash_get(proxy_sessions, key, klen);
+    if (entry) {
+        proxy_session_free(entry);
+    }
+    PROXY_SESSIONS_UNLOCK();
+}
+
 /*  _________________________________________________________________
 **
 **  SSL Extension to mod_status
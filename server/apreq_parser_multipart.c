@@ -19,7 +19,6 @@
 #include "apreq_error.h"
 #include "apreq_util.h"
 #include "apr_strings.h"
-#include "apr_strmatch.h"
 
 #ifndef CRLF
 #define CRLF    "\015\012"
@@ -45,7 +44,6 @@ struct mfd_ctx {
     apr_bucket_brigade          *bb;
     apreq_parser_t              *hdr_parser;
     apreq_parser_t              *next_parser;
-    const apr_strmatch_pattern  *pattern;
     char                        *bdry;
     enum {
         MFD_INIT,
@@ -111,7 +109,6 @@ static apr_status_t brigade_start_string(apr_bucket_brigade *bb,
 
 static apr_status_t split_on_bdry(apr_bucket_brigade *out,
                                   apr_bucket_brigade *in,
-                                  const apr_strmatch_pattern *pattern,
                                   const char *bdry)
 {
     apr_bucket *e = APR_BRIGADE_FIRST(in);
@@ -178,19 +175,7 @@ static apr_status_t split_on_bdry(apr_bucket_brigade *out,
             goto look_for_boundary_up_front;
         }
 
-        if (pattern != NULL && len >= blen) {
-            const char *match = apr_strmatch(pattern, buf, len);
-            if (match != NULL)
-                idx = match - buf;
-            else {
-                idx = apreq_index(buf + len-blen, blen, bdry, blen,
-                                  APREQ_MATCH_PARTIAL);
-                if (idx >= 0)
-                    idx += len-blen;
-            }
-        }
-        else
-            idx = apreq_index(buf, len, bdry, blen, APREQ_MATCH_PARTIAL);
+        idx = apreq_index(buf, len, bdry, blen, APREQ_MATCH_PARTIAL);
 
         /* Theoretically idx should never be 0 here, because we
          * already tested the front of the brigade for a potential match.
@@ -242,7 +227,6 @@ struct mfd_ctx * create_multipart_context(const char *content_type,
     *--ctx->bdry = '\r';
 
     ctx->status = MFD_INIT;
-    ctx->pattern = apr_strmatch_precompile(pool, ctx->bdry, 1);
     ctx->hdr_parser = apreq_parser_make(pool, ba, "",
                                         apreq_parse_headers,
                                         brigade_limit,
@@ -287,7 +271,7 @@ APREQ_DECLARE_PARSER(apreq_parse_multipart)
 
     case MFD_INIT:
         {
-            s = split_on_bdry(ctx->bb, ctx->in, NULL, ctx->bdry + 2);
+            s = split_on_bdry(ctx->bb, ctx->in, ctx->bdry + 2);
             if (s != APR_SUCCESS) {
                 apreq_brigade_setaside(ctx->in, pool);
                 apreq_brigade_setaside(ctx->bb, pool);
@@ -302,7 +286,7 @@ APREQ_DECLARE_PARSER(apreq_parse_multipart)
 
     case MFD_NEXTLINE:
         {
-            s = split_on_bdry(ctx->bb, ctx->in, NULL, CRLF);
+            s = split_on_bdry(ctx->bb, ctx->in, CRLF);
             if (s == APR_EOF) {
                 ctx->status = MFD_COMPLETE;
                 return APR_SUCCESS;
@@ -534,7 +518,7 @@ APREQ_DECLARE_PARSER(apreq_parse_multipart)
             apr_size_t len;
             apr_off_t off;
 
-            s = split_on_bdry(ctx->bb, ctx->in, ctx->pattern, ctx->bdry);
+            s = split_on_bdry(ctx->bb, ctx->in, ctx->bdry);
 
             switch (s) {
 
@@ -589,7 +573,7 @@ APREQ_DECLARE_PARSER(apreq_parse_multipart)
         {
             apreq_param_t *param = ctx->upload;
 
-            s = split_on_bdry(ctx->bb, ctx->in, ctx->pattern, ctx->bdry);
+            s = split_on_bdry(ctx->bb, ctx->in, ctx->bdry);
             switch (s) {
 
             case APR_INCOMPLETE:
@@ -600,12 +584,20 @@ APREQ_DECLARE_PARSER(apreq_parse_multipart)
                         return s;
                     }
                 }
-                apreq_brigade_setaside(ctx->bb, pool);
+                /* Once spooled, the data go straight to the file from the
+                 * incoming buckets, no need to set them aside first.
+                 */
+                if (apreq_brigade_spoolfile(param->upload) == NULL)
+                    apreq_brigade_setaside(ctx->bb, pool);
                 apreq_brigade_setaside(ctx->in, pool);
                 s = apreq_brigade_concat(pool, parser->temp_dir,
                                          parser->brigade_limit,
                                          param->upload, ctx->bb);
-                return (s == APR_SUCCESS) ? APR_INCOMPLETE : s;
+                if (s != APR_SUCCESS) {
+                    ctx->status = MFD_ERROR;
+                    return s;
+                }
+                return APR_INCOMPLETE;
 
             case APR_SUCCESS:
                 if (parser->hook != NULL) {
@@ -618,13 +610,16 @@ APREQ_DECLARE_PARSER(apreq_parse_multipart)
                     }
                 }
                 apreq_value_table_add(&param->v, t);
-                apreq_brigade_setaside(ctx->bb, pool);
+                if (apreq_brigade_spoolfile(param->upload) == NULL)
+                    apreq_brigade_setaside(ctx->bb, pool);
                 s = apreq_brigade_concat(pool, parser->temp_dir,
                                          parser->brigade_limit,
                                          param->upload, ctx->bb);
 
-                if (s != APR_SUCCESS)
+                if (s != APR_SUCCESS) {
+                    ctx->status = MFD_ERROR;
                     return s;
+                }
 
                 ctx->status = MFD_NEXTLINE;
                 goto mfd_parse_brigade;
@@ -89,28 +89,104 @@ APREQ_DECLARE(apr_int64_t) apreq_atoi64t(const char *s)
 }
 
 
+#if defined(__GNUC__) && defined(__AVX2__)
+#include <immintrin.h>
+#define INDEX_VEC_LEN 32
+typedef __m256i index_vec_t;
+#define INDEX_VEC_SPLAT(c) _mm256_set1_epi8(c)
+#define INDEX_VEC_LOAD(p)  _mm256_loadu_si256((const __m256i *)(p))
+#define INDEX_VEC_MATCH(a, x, b, y) \
+    (apr_uint32_t)_mm256_movemask_epi8(_mm256_and_si256( \
+        _mm256_cmpeq_epi8(a, x), _mm256_cmpeq_epi8(b, y)))
+#elif defined(__GNUC__) && defined(__SSE2__)
+#include <emmintrin.h>
+#define INDEX_VEC_LEN 16
+typedef __m128i index_vec_t;
+#define INDEX_VEC_SPLAT(c) _mm_set1_epi8(c)
+#define INDEX_VEC_LOAD(p)  _mm_loadu_si128((const __m128i *)(p))
+#define INDEX_VEC_MATCH(a, x, b, y) \
+    (apr_uint32_t)_mm_movemask_epi8(_mm_and_si128( \
+        _mm_cmpeq_epi8(a, x), _mm_cmpeq_epi8(b, y)))
+#else
+#define INDEX_VEC_LEN 0
+#endif
+
+/*
+ * Offset of the first full match of ndl (nlen > 0) in hay, or -1.  The
+ * first and last bytes of ndl are compared at 16 (SSE2) or 32 (AVX2)
+ * offsets at once, and only the offsets where both match are memcmp()ed,
+ * which skips most of the '\r' of binary uploads for a CRLF boundary.
+ */
+static apr_ssize_t index_full(const char *hay, apr_size_t hlen,
+                              const char *ndl, apr_size_t nlen)
+{
+    apr_size_t i = 0, end;
+
+    if (hlen < nlen)
+        return -1;
+    end = hlen - nlen + 1;      /* offsets where ndl fits */
+
+#if INDEX_VEC_LEN
+    {
+        const index_vec_t first = INDEX_VEC_SPLAT(ndl[0]);
+        const index_vec_t last = INDEX_VEC_SPLAT(ndl[nlen - 1]);
+
+        while (end - i >= INDEX_VEC_LEN) {
+            apr_uint32_t mask = INDEX_VEC_MATCH(INDEX_VEC_LOAD(hay + i), first,
+                                                INDEX_VEC_LOAD(hay + i + nlen - 1),
+                                                last);
+            while (mask) {
+                apr_size_t at = i + __builtin_ctz(mask);
+
+                if (nlen <= 2 || memcmp(hay + at + 1, ndl + 1, nlen - 2) == 0)
+                    return at;
+                mask &= mask - 1;
+            }
+            i += INDEX_VEC_LEN;
+        }
+    }
+#endif
+
+    while (i < end) {
+        const char *p = memchr(hay + i, ndl[0], end - i);
+
+        if (p == NULL)
+            return -1;
+        i = p - hay;
+        if (memcmp(p + 1, ndl + 1, nlen - 1) == 0)
+            return i;
+        ++i;
+    }
+    return -1;
+}
+
 APREQ_DECLARE(apr_ssize_t ) apreq_index(const char* hay, apr_size_t hlen,
                                         const char* ndl, apr_size_t nlen,
                                         const apreq_match_t type)
 {
-    apr_size_t len = hlen;
-    const char *end = hay + hlen;
-    const char *begin = hay;
+    apr_ssize_t idx;
+    apr_size_t i;
 
-    while ( (hay = memchr(hay, ndl[0], len)) ) {
-        len = end - hay;
+    if (nlen == 0)
+        return 0;
 
-        /* done if matches up to capacity of buffer */
-        if ( memcmp(hay, ndl, MIN(nlen, len)) == 0 ) {
-            if (type == APREQ_MATCH_FULL && len < nlen)
-                hay = NULL;     /* insufficient room for match */
-            break;
-        }
-        --len;
-        ++hay;
+    idx = index_full(hay, hlen, ndl, nlen);
+    if (idx >= 0 || type == APREQ_MATCH_FULL)
+        return idx;
+
+    /* partial match: a prefix of ndl ending the buffer */
+    i = (hlen >= nlen) ? hlen - nlen + 1 : 0;
+    while (i < hlen) {
+        const char *p = memchr(hay + i, ndl[0], hlen - i);
+
+        if (p == NULL)
+            return -1;
+        i = p - hay;
+        if (memcmp(p, ndl, hlen - i) == 0)
+            return i;
+        ++i;
     }
-
-    return hay ? hay - begin : -1;
+    return -1;
 }
 
 
@@ -141,6 +141,9 @@ AP_DECLARE_DATA int ap_config_generation = 0;
 
 static const char *core_state_dir;
 
+#define DEFAULT_WALK_CACHE_SIZE 1024
+static int walk_cache_size = DEFAULT_WALK_CACHE_SIZE;
+
 typedef struct {
     apr_ipsubnet_t *subnet;
     struct ap_logconf log;
@@ -1499,6 +1502,7 @@ static apr_status_t reset_config(void *dummy)
     saved_server_config_defines = NULL;
     server_config_defined_vars = NULL;
     core_state_dir = NULL;
+    walk_cache_size = DEFAULT_WALK_CACHE_SIZE;
 
     return APR_SUCCESS;
 }
@@ -4296,6 +4300,23 @@ static const char *set_async_filter(cmd_parms *cmd, void *dummy,
     return NULL;
 }
 
+static const char *set_walk_cache_size(cmd_parms *cmd, void *dummy,
+                                       const char *arg)
+{
+    const char *err = ap_check_cmd_context(cmd, GLOBAL_ONLY);
+
+    if (err != NULL) {
+        return err;
+    }
+
+    walk_cache_size = atoi(arg);
+    if (walk_cache_size < 0) {
+        return "WalkCacheSize must be a positive number of merges, "
+               "or 0 to disable the cache";
+    }
+    return NULL;
+}
+
 static const char *set_http_method(cmd_parms *cmd, void *conf, const char *arg)
 {
     const char *err = ap_check_cmd_context(cmd, GLOBAL_ONLY);
@@ -4946,6 +4967,9 @@ AP_INIT_TAKE1("ProtocolsHonorOrder", set_protocols_honor_order, NULL, RSRC_CONF,
 AP_INIT_TAKE1("AsyncFilter", set_async_filter, NULL, RSRC_CONF,
               "'network', 'connection' (default) or 'request' to limit the "
               "types of filters that support asynchronous handling"),
+AP_INIT_TAKE1("WalkCacheSize", set_walk_cache_size, NULL, RSRC_CONF,
+              "Maximum number of merged configuration sections cached by "
+              "each child, 0 to disable"),
 AP_INIT_FLAG("MergeSlashes", set_core_server_flag, 
              (void *)APR_OFFSETOF(core_server_config, merge_slashes),  
              RSRC_CONF,
@@ -5651,6 +5675,8 @@ static void core_child_init(apr_pool_t *pchild, server_rec *s)
      */
     proc.pid = getpid();
     apr_random_after_fork(&proc);
+
+    ap_init_walk_cache(pchild, s, walk_cache_size);
 }
 
 static void core_optional_fn_retrieve(void)
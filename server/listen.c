@@ -39,6 +39,19 @@
 #include <systemd/sd-daemon.h>
 #endif
 
+#if defined(__linux__) && defined(HAVE_SCHED_SETAFFINITY)
+#include <sched.h>
+#define LISTEN_HAVE_AFFINITY 1
+#if defined(SO_ATTACH_REUSEPORT_CBPF)
+#include <linux/filter.h>
+#define LISTEN_HAVE_STEERING 1
+#if defined(HAVE_REUSEPORT_EBPF)
+#include <sys/syscall.h>
+#include <linux/bpf.h>
+#endif
+#endif
+#endif
+
 /* we know core's module_index is 0 */
 #undef APLOG_MODULE_INDEX
 #define APLOG_MODULE_INDEX AP_CORE_MODULE_INDEX
@@ -65,8 +78,18 @@ AP_DECLARE_DATA int ap_accept_errors_nonfatal = 0;
 static ap_listen_rec *old_listeners;
 static int ap_listenbacklog;
 static int ap_listencbratio;
+static int ap_listencbaffinity;
+#define LISTEN_AFFINITY_OFF     0
+#define LISTEN_AFFINITY_CPU     1
+#define LISTEN_AFFINITY_NUMA    2
 static int send_buffer_size;
 static int receive_buffer_size;
+#ifdef LISTEN_HAVE_AFFINITY
+/* The CPUs each listeners bucket is bound to (ListenCoresBucketsAffinity),
+ * or NULL if the buckets are not bound.
+ */
+static cpu_set_t *listen_buckets_cpus;
+#endif
 #ifdef HAVE_SYSTEMD
 static int use_systemd = -1;
 #endif
@@ -833,6 +856,356 @@ AP_DECLARE(int) ap_setup_listeners(server_rec *s)
     return num_listeners;
 }
 
+#ifdef LISTEN_HAVE_AFFINITY
+typedef struct {
+    int id;
+    cpu_set_t cpus;
+} numa_node_t;
+
+static void parse_cpulist(const char *str, cpu_set_t *set)
+{
+    while (apr_isdigit(*str)) {
+        char *end;
+        long lo, hi;
+
+        lo = hi = strtol(str, &end, 10);
+        if (*end == '-') {
+            str = end + 1;
+            hi = strtol(str, &end, 10);
+        }
+        for (; lo <= hi && lo < CPU_SETSIZE; ++lo) {
+            CPU_SET(lo, set);
+        }
+        str = end;
+        if (*str != ',') {
+            break;
+        }
+        ++str;
+    }
+}
+
+static int numa_node_cmp(const void *a, const void *b)
+{
+    return ((const numa_node_t *)a)->id - ((const numa_node_t *)b)->id;
+}
+
+/* Read the CPUs of each NUMA node from sysfs, ordered by node id */
+static apr_array_header_t *get_numa_nodes(apr_pool_t *p)
+{
+    static const char *nodes_dir = "/sys/devices/system/node";
+    apr_array_header_t *nodes = apr_array_make(p, 4, sizeof(numa_node_t));
+    apr_finfo_t dirent;
+    apr_dir_t *dir;
+
+    if (apr_dir_open(&dir, nodes_dir, p) != APR_SUCCESS) {
+        return nodes;
+    }
+    while (apr_dir_read(&dirent, APR_FINFO_NAME, dir) == APR_SUCCESS) {
+        char buf[HUGE_STRING_LEN];
+        numa_node_t *node;
+        apr_file_t *f;
+        const char *fname;
+
+        if (strncmp(dirent.name, "node", 4) || !apr_isdigit(dirent.name[4])) {
+            continue;
+        }
+        fname = apr_pstrcat(p, nodes_dir, "/", dirent.name, "/cpulist", NULL);
+        if (apr_file_open(&f, fname, APR_FOPEN_READ, APR_OS_DEFAULT,
+                          p) != APR_SUCCESS) {
+            continue;
+        }
+        if (apr_file_gets(buf, sizeof buf, f) == APR_SUCCESS) {
+            node = apr_array_push(nodes);
+            node->id = atoi(dirent.name + 4);
+            CPU_ZERO(&node->cpus);
+            parse_cpulist(buf, &node->cpus);
+        }
+        apr_file_close(f);
+    }
+    apr_dir_close(dir);
+
+    qsort(nodes->elts, nodes->nelts, nodes->elt_size, numa_node_cmp);
+    return nodes;
+}
+
+#ifdef LISTEN_HAVE_STEERING
+#ifdef HAVE_REUSEPORT_EBPF
+#define STEERING_INSN(c, d, s, o, i) \
+    ((struct bpf_insn){ .code = (c), .dst_reg = (d), .src_reg = (s), \
+                        .off = (o), .imm = (i) })
+
+static int steering_bpf(int cmd, union bpf_attr *attr)
+{
+    return syscall(SYS_bpf, cmd, attr, sizeof(*attr));
+}
+
+/* Attach to each reuseport group an eBPF program which selects, in a
+ * REUSEPORT_SOCKARRAY map of the group's listeners indexed by bucket, the
+ * listener of the bucket bound to the CPU that received the connection.
+ * Unlike the classic BPF program below, this does not depend on the order
+ * of the sockets in the group, which changes when the listeners of the
+ * previous generation are closed after a graceful restart.
+ * Returns nonzero if all the groups got it.
+ */
+static int attach_buckets_steering_ebpf(apr_pool_t *p, const int *cpus,
+                                        const int *cpu_bucket, int ncpus,
+                                        int num_buckets)
+{
+    struct bpf_insn *code;
+    ap_listen_rec **lrs, *lr;
+    union bpf_attr attr;
+    int i, b, n = 0, map_insn;
+
+    /* r7 = bucket of the CPU in r0 (CPU % buckets if unknown) */
+    code = apr_palloc(p, (2 * ncpus + 16) * sizeof(struct bpf_insn));
+    code[n++] = STEERING_INSN(BPF_ALU64 | BPF_MOV | BPF_X,
+                              BPF_REG_6, BPF_REG_1, 0, 0);
+    code[n++] = STEERING_INSN(BPF_JMP | BPF_CALL, 0, 0, 0,
+                              BPF_FUNC_get_smp_processor_id);
+    code[n++] = STEERING_INSN(BPF_ALU64 | BPF_MOV | BPF_X,
+                              BPF_REG_7, BPF_REG_0, 0, 0);
+    code[n++] = STEERING_INSN(BPF_ALU64 | BPF_MOD | BPF_K,
+                              BPF_REG_7, 0, 0, num_buckets);
+    for (i = 0; i < ncpus; ++i) {
+        code[n++] = STEERING_INSN(BPF_JMP | BPF_JNE | BPF_K,
+                                  BPF_REG_0, 0, 1, cpus[i]);
+        code[n++] = STEERING_INSN(BPF_ALU64 | BPF_MOV | BPF_K,
+                                  BPF_REG_7, 0, 0, cpu_bucket[i]);
+    }
+    /* bpf_sk_select_reuseport(ctx, map, &bucket, 0), the kernel falls
+     * back to its hash if the bucket has no listener in the map.
+     */
+    code[n++] = STEERING_INSN(BPF_STX | BPF_MEM | BPF_W,
+                              BPF_REG_10, BPF_REG_7, -4, 0);
+    code[n++] = STEERING_INSN(BPF_ALU64 | BPF_MOV | BPF_X,
+                              BPF_REG_1, BPF_REG_6, 0, 0);
+    map_insn = n;
+    code[n++] = STEERING_INSN(BPF_LD | BPF_DW | BPF_IMM,
+                              BPF_REG_2, BPF_PSEUDO_MAP_FD, 0, -1);
+    code[n++] = STEERING_INSN(0, 0, 0, 0, 0);
+    code[n++] = STEERING_INSN(BPF_ALU64 | BPF_MOV | BPF_X,
+                              BPF_REG_3, BPF_REG_10, 0, 0);
+    code[n++] = STEERING_INSN(BPF_ALU64 | BPF_ADD | BPF_K,
+                              BPF_REG_3, 0, 0, -4);
+    code[n++] = STEERING_INSN(BPF_ALU64 | BPF_MOV | BPF_K,
+                              BPF_REG_4, 0, 0, 0);
+    code[n++] = STEERING_INSN(BPF_JMP | BPF_CALL, 0, 0, 0,
+                              BPF_FUNC_sk_select_reuseport);
+    code[n++] = STEERING_INSN(BPF_ALU64 | BPF_MOV | BPF_K,
+                              BPF_REG_0, 0, 0, SK_PASS);
+    code[n++] = STEERING_INSN(BPF_JMP | BPF_EXIT, 0, 0, 0, 0);
+
+    /* The buckets' listeners lists are in the same order */
+    lrs = apr_palloc(p, num_buckets * sizeof(ap_listen_rec *));
+    for (b = 0; b < num_buckets; ++b) {
+        lrs[b] = ap_listen_buckets[b];
+    }
+    for (lr = ap_listeners; lr; lr = lr->next) {
+        int map, prog, thesock, ok = 1;
+
+        memset(&attr, 0, sizeof attr);
+        attr.map_type = BPF_MAP_TYPE_REUSEPORT_SOCKARRAY;
+        attr.key_size = sizeof(apr_uint32_t);
+        attr.value_size = sizeof(apr_uint64_t);
+        attr.max_entries = num_buckets;
+        map = steering_bpf(BPF_MAP_CREATE, &attr);
+        if (map < 0) {
+            return 0;
+        }
+        for (b = 0; b < num_buckets; ++b) {
+            apr_uint32_t key = b;
+            apr_uint64_t value;
+
+            apr_os_sock_get(&thesock, lrs[b]->sd);
+            value = thesock;
+            memset(&attr, 0, sizeof attr);
+            attr.map_fd = map;
+            attr.key = (apr_uintptr_t)&key;
+            attr.value = (apr_uintptr_t)&value;
+            attr.flags = BPF_ANY;
+            if (steering_bpf(BPF_MAP_UPDATE_ELEM, &attr) < 0) {
+                ok = 0;
+            }
+            lrs[b] = lrs[b]->next;
+        }
+
+        code[map_insn].imm = map;
+        memset(&attr, 0, sizeof attr);
+        attr.prog_type = BPF_PROG_TYPE_SK_REUSEPORT;
+        attr.insns = (apr_uintptr_t)code;
+        attr.insn_cnt = n;
+        attr.license = (apr_uintptr_t)"Apache-2.0";
+        prog = ok ? steering_bpf(BPF_PROG_LOAD, &attr) : -1;
+        close(map);
+        if (prog < 0) {
+            return 0;
+        }
+
+        apr_os_sock_get(&thesock, lr->sd);
+        ok = (setsockopt(thesock, SOL_SOCKET, SO_ATTACH_REUSEPORT_EBPF,
+                         &prog, sizeof prog) == 0);
+        close(prog);
+        if (!ok) {
+            return 0;
+        }
+    }
+    return 1;
+}
+#endif /* HAVE_REUSEPORT_EBPF */
+
+/* Attach the steering program to each reuseport group, the eBPF one if
+ * possible, otherwise a classic BPF program which selects the listener
+ * of the bucket bound to the CPU that received the connection by its
+ * index in the group.  That is the bucket's index only as long as the
+ * group has no other listeners than the current generation's, which were
+ * bound in buckets' order.
+ * Unknown CPUs (e.g. outside of our cpuset) fall back to CPU % buckets.
+ */
+static void attach_buckets_steering(apr_pool_t *p, const int *cpus,
+                                    const int *cpu_bucket, int ncpus,
+                                    int num_buckets)
+{
+    struct sock_filter *code;
+    struct sock_fprog prog;
+    ap_listen_rec *lr;
+    int i, n = 0;
+
+#ifdef HAVE_REUSEPORT_EBPF
+    if (attach_buckets_steering_ebpf(p, cpus, cpu_bucket, ncpus,
+                                     num_buckets)) {
+        return;
+    }
+    ap_log_perror(APLOG_MARK, APLOG_INFO, errno, p, APLOGNO(10307)
+                  "ap_duplicate_listeners: cannot attach the buckets' "
+                  "eBPF steering program, using the classic BPF one "
+                  "(inaccurate after graceful restarts)");
+#endif
+
+    code = apr_palloc(p, (2 * ncpus + 3) * sizeof(struct sock_filter));
+    code[n++] = (struct sock_filter)BPF_STMT(BPF_LD | BPF_W | BPF_ABS,
+                                             SKF_AD_OFF + SKF_AD_CPU);
+    if (2 * ncpus + 3 <= BPF_MAXINSNS) {
+        for (i = 0; i < ncpus; ++i) {
+            code[n++] = (struct sock_filter)BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K,
+                                                     cpus[i], 0, 1);
+            code[n++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_K,
+                                                     cpu_bucket[i]);
+        }
+    }
+    code[n++] = (struct sock_filter)BPF_STMT(BPF_ALU | BPF_MOD | BPF_K,
+                                             num_buckets);
+    code[n++] = (struct sock_filter)BPF_STMT(BPF_RET | BPF_A, 0);
+    prog.len = n;
+    prog.filter = code;
+
+    for (lr = ap_listeners; lr; lr = lr->next) {
+        int thesock;
+
+        apr_os_sock_get(&thesock, lr->sd);
+        if (setsockopt(thesock, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF,
+                       &prog, sizeof prog) < 0) {
+            ap_log_perror(APLOG_MARK, APLOG_WARNING, errno, p, APLOGNO(10250)
+                          "ap_duplicate_listeners: for address %pI, "
+                          "cannot attach the buckets' steering program "
+                          "(SO_ATTACH_REUSEPORT_CBPF)", lr->bind_addr);
+        }
+    }
+}
+#endif /* LISTEN_HAVE_STEERING */
+
+/* Split the CPUs we are allowed to run on in contiguous ranges, one per
+ * listeners bucket (ordered by NUMA node in "numa" mode so that a bucket
+ * spans a single node whenever possible), then bind each bucket to its
+ * CPUs ("cpu" mode) or to all the CPUs of its NUMA node(s) ("numa" mode).
+ */
+static void setup_buckets_affinity(apr_pool_t *p, int num_buckets)
+{
+    apr_array_header_t *nodes = NULL;
+    cpu_set_t allowed, seen;
+    int *cpus, *cpu_bucket;
+    int ncpus = 0, cpu, i, b;
+
+    listen_buckets_cpus = NULL;
+
+    if (sched_getaffinity(0, sizeof allowed, &allowed) != 0) {
+        ap_log_perror(APLOG_MARK, APLOG_WARNING, errno, p, APLOGNO(10251)
+                      "ListenCoresBucketsAffinity ignored: "
+                      "can't get the CPU affinity of the process");
+        return;
+    }
+
+    cpus = apr_palloc(p, CPU_SETSIZE * sizeof(int));
+    CPU_ZERO(&seen);
+    if (ap_listencbaffinity == LISTEN_AFFINITY_NUMA) {
+        nodes = get_numa_nodes(p);
+        for (i = 0; i < nodes->nelts; ++i) {
+            numa_node_t *node = &APR_ARRAY_IDX(nodes, i, numa_node_t);
+            for (cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+                if (CPU_ISSET(cpu, &node->cpus) && CPU_ISSET(cpu, &allowed)
+                        && !CPU_ISSET(cpu, &seen)) {
+                    CPU_SET(cpu, &seen);
+                    cpus[ncpus++] = cpu;
+                }
+            }
+        }
+    }
+    for (cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+        if (CPU_ISSET(cpu, &allowed) && !CPU_ISSET(cpu, &seen)) {
+            cpus[ncpus++] = cpu;
+        }
+    }
+    if (!ncpus) {
+        return;
+    }
+
+    listen_buckets_cpus = apr_pcalloc(p, num_buckets * sizeof(cpu_set_t));
+    cpu_bucket = apr_palloc(p, ncpus * sizeof(int));
+    for (i = 0; i < ncpus; ++i) {
+        if (ncpus >= num_buckets) {
+            b = (int)((apr_int64_t)i * num_buckets / ncpus);
+        }
+        else {
+            b = i;
+        }
+        cpu_bucket[i] = b;
+        CPU_SET(cpus[i], &listen_buckets_cpus[b]);
+    }
+    /* More buckets than CPUs, share them */
+    for (b = ncpus; b < num_buckets; ++b) {
+        CPU_SET(cpus[b % ncpus], &listen_buckets_cpus[b]);
+    }
+
+    if (nodes) {
+        for (b = 0; b < num_buckets; ++b) {
+            cpu_set_t node_cpus, widened;
+
+            CPU_ZERO(&widened);
+            for (i = 0; i < nodes->nelts; ++i) {
+                numa_node_t *node = &APR_ARRAY_IDX(nodes, i, numa_node_t);
+                CPU_AND(&node_cpus, &node->cpus, &listen_buckets_cpus[b]);
+                if (CPU_COUNT(&node_cpus)) {
+                    CPU_AND(&node_cpus, &node->cpus, &allowed);
+                    CPU_OR(&widened, &widened, &node_cpus);
+                }
+            }
+            if (CPU_COUNT(&widened)) {
+                listen_buckets_cpus[b] = widened;
+            }
+        }
+    }
+
+    for (b = 0; b < num_buckets; ++b) {
+        ap_log_perror(APLOG_MARK, APLOG_INFO, 0, p, APLOGNO(10252)
+                      "Listeners bucket %i bound to CPU(s) %s",
+                      b, ap_listen_bucket_cpus(p, b));
+    }
+
+#ifdef LISTEN_HAVE_STEERING
+    attach_buckets_steering(p, cpus, cpu_bucket, ncpus, num_buckets);
+#endif
+}
+#endif /* LISTEN_HAVE_AFFINITY */
+
 AP_DECLARE(apr_status_t) ap_duplicate_listeners(apr_pool_t *p, server_rec *s,
                                                 ap_listen_rec ***buckets,
                                                 int *num_buckets)
@@ -938,9 +1311,86 @@ AP_DECLARE(apr_status_t) ap_duplicate_listeners(apr_pool_t *p, server_rec *s,
 
     ap_listen_buckets = *buckets;
     ap_num_listen_buckets = *num_buckets;
+
+#ifdef LISTEN_HAVE_AFFINITY
+    listen_buckets_cpus = NULL;
+    if (*num_buckets > 1) {
+        if (ap_listencbaffinity != LISTEN_AFFINITY_OFF) {
+            setup_buckets_affinity(p, *num_buckets);
+        }
+#if defined(LISTEN_HAVE_STEERING) && defined(SO_DETACH_REUSEPORT_BPF)
+        else {
+            /* The program attached by a previous generation is bound
+             * to the listeners (preserved across restarts).
+             */
+            for (lr = ap_listeners; lr; lr = lr->next) {
+                int thesock, dummy = 0;
+                apr_os_sock_get(&thesock, lr->sd);
+                (void)setsockopt(thesock, SOL_SOCKET, SO_DETACH_REUSEPORT_BPF,
+                                 &dummy, sizeof dummy);
+            }
+        }
+#endif
+    }
+#else
+    if (*num_buckets > 1 && ap_listencbaffinity != LISTEN_AFFINITY_OFF
+            && !warn_once) {
+        ap_log_perror(APLOG_MARK, APLOG_WARNING, 0, p, APLOGNO(10253)
+                      "ListenCoresBucketsAffinity ignored without "
+                      "sched_setaffinity() support");
+        warn_once = 1;
+    }
+#endif
+
+    return APR_SUCCESS;
+}
+
+AP_DECLARE(apr_status_t) ap_listen_bucket_set_affinity(int bucket)
+{
+#ifdef LISTEN_HAVE_AFFINITY
+    if (listen_buckets_cpus && bucket >= 0 && bucket < ap_num_listen_buckets
+            && sched_setaffinity(0, sizeof(cpu_set_t),
+                                 &listen_buckets_cpus[bucket]) != 0) {
+        return errno;
+    }
+#endif
     return APR_SUCCESS;
 }
 
+AP_DECLARE(const char *) ap_listen_bucket_cpus(apr_pool_t *p, int bucket)
+{
+#ifdef LISTEN_HAVE_AFFINITY
+    const cpu_set_t *set;
+    char *cpus = NULL;
+    int cpu, last;
+
+    if (!listen_buckets_cpus || bucket < 0 || bucket >= ap_num_listen_buckets) {
+        return NULL;
+    }
+    set = &listen_buckets_cpus[bucket];
+    for (cpu = 0; cpu < CPU_SETSIZE; cpu = last + 1) {
+        if (!CPU_ISSET(cpu, set)) {
+            last = cpu;
+            continue;
+        }
+        for (last = cpu; last + 1 < CPU_SETSIZE && CPU_ISSET(last + 1, set);) {
+            ++last;
+        }
+        if (last > cpu) {
+            cpus = apr_psprintf(p, "%s%s%i-%i", cpus ? cpus : "",
+                                cpus ? "," : "", cpu, last);
+        }
+        else {
+            cpus = apr_psprintf(p, "%s%s%i", cpus ? cpus : "",
+                                cpus ? "," : "", cpu);
+        }
+    }
+    return cpus;
+#else
+    return NULL;
+#endif
+}
+
 AP_DECLARE_NONSTD(void) ap_close_listeners(void)
 {
     int i;
@@ -990,6 +1440,7 @@ AP_DECLARE(void) ap_listen_pre_config(void)
     ap_num_listen_buckets = 0;
     ap_listenbacklog = DEFAULT_LISTENBACKLOG;
     ap_listencbratio = 0;
+    ap_listencbaffinity = LISTEN_AFFINITY_OFF;
 
     /* Check once whether or not SO_REUSEPORT is supported. */
     if (ap_have_so_reuseport < 0) {
@@ -1198,6 +1649,31 @@ AP_DECLARE_NONSTD(const char *) ap_set_listencbratio(cmd_parms *cmd,
     return NULL;
 }
 
+AP_DECLARE_NONSTD(const char *) ap_set_listencbaffinity(cmd_parms *cmd,
+                                                        void *dummy,
+                                                        const char *arg)
+{
+    const char *err = ap_check_cmd_context(cmd, GLOBAL_ONLY);
+
+    if (err != NULL) {
+        return err;
+    }
+
+    if (!ap_cstr_casecmp(arg, "off")) {
+        ap_listencbaffinity = LISTEN_AFFINITY_OFF;
+    }
+    else if (!ap_cstr_casecmp(arg, "cpu")) {
+        ap_listencbaffinity = LISTEN_AFFINITY_CPU;
+    }
+    else if (!ap_cstr_casecmp(arg, "numa")) {
+        ap_listencbaffinity = LISTEN_AFFINITY_NUMA;
+    }
+    else {
+        return "ListenCoresBucketsAffinity must be off, cpu or numa";
+    }
+    return NULL;
+}
+
 AP_DECLARE_NONSTD(const char *) ap_set_send_buffer_size(cmd_parms *cmd,
                                                         void *dummy,
                                                         const char *arg)
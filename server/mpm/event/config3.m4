@@ -6,6 +6,10 @@ APACHE_CHECK_SERF
 if test "$ac_cv_serf" = yes ; then
     APR_ADDTO(MOD_MPM_EVENT_LDADD,[\$(SERF_LIBS)])
 fi
+APACHE_CHECK_LIBURING
+if test "$ac_cv_liburing" = yes ; then
+    APR_ADDTO(MOD_MPM_EVENT_LDADD,[\$(LIBURING_LIBS)])
+fi
 APACHE_SUBST(MOD_MPM_EVENT_LDADD)
 
 APACHE_MPM_MODULE(event, $enable_mpm_event, event.lo,[
@@ -94,7 +94,6 @@
 #include "mpm_default.h"
 #include "http_vhost.h"
 #include "unixd.h"
-#include "apr_skiplist.h"
 #include "util_time.h"
 
 #include <signal.h>
@@ -106,6 +105,10 @@
 #include "serf.h"
 #endif
 
+#if HAVE_LIBURING
+#include <liburing.h>
+#endif
+
 /* Limit on the total --- clients will be locked out if more servers than
  * this are needed.  It is intended solely to keep the server from crashing
  * when things get out of hand.
@@ -184,6 +187,7 @@ static volatile int workers_may_exit = 0;
 static volatile int start_thread_may_exit = 0;
 static volatile int listener_may_exit = 0;
 static int listener_is_wakeable = 0;        /* Pollset supports APR_POLLSET_WAKEABLE */
+static int event_engine = 0;                /* EventEngine */
 static int num_listensocks = 0;
 static apr_int32_t conns_this_child;        /* MaxConnectionsPerChild, only access
                                                in listener thread */
@@ -370,6 +374,9 @@ typedef enum
     PT_ACCEPT
 #if HAVE_SERF
     , PT_SERF
+#endif
+#if HAVE_LIBURING
+    , PT_URING
 #endif
     , PT_USER
 } poll_type_e;
@@ -444,6 +451,32 @@ struct event_srv_cfg_s {
 
 #define ID_FROM_CHILD_THREAD(c, t)    ((c * thread_limit) + t)
 
+/* Engines usable by the listener to accept connections (EventEngine) */
+#define EVENT_ENGINE_POLLSET    0
+#define EVENT_ENGINE_IO_URING   1
+
+#if HAVE_LIBURING
+/* With EventEngine io_uring, each listening socket of this child has a
+ * multishot accept request pending in accept_ring (as long as listeners
+ * are enabled), and the ring's fd is in event_pollset so that accepted
+ * connections show up as a PT_URING event.  The ring is only used by the
+ * listener thread, other threads simply flip listensocks_disabled and wake
+ * it up (see sync_accept_ring()).
+ */
+typedef struct {
+    ap_listen_rec *lr;
+    apr_int32_t family;
+    int type;
+    int protocol;
+    unsigned int armed :1;      /* multishot accept pending */
+    unsigned int canceling :1;  /* cancel submitted, not completed yet */
+} uring_acceptor_t;
+
+static struct io_uring accept_ring;
+static uring_acceptor_t *uring_acceptors;
+static apr_pollfd_t *uring_pollfd;
+#endif
+
 /* The event MPM respects a couple of runtime flags that can aid
  * in debugging. Setting the -DNO_DETACH flag will prevent the root process
  * from detaching from its controlling terminal. Additionally, setting
@@ -495,7 +528,8 @@ static void disable_listensocks(void)
     if (apr_atomic_cas32(&listensocks_disabled, 1, 0) != 0) {
         return;
     }
-    if (event_pollset) {
+    /* With io_uring, pending accepts are canceled by the listener itself */
+    if (event_pollset && event_engine != EVENT_ENGINE_IO_URING) {
         for (i = 0; i < num_listensocks; i++) {
             apr_pollset_remove(event_pollset, &listener_pollfd[i]);
         }
@@ -519,8 +553,10 @@ static void enable_listensocks(void)
                  apr_atomic_read32(&clogged_count),
                  apr_atomic_read32(&suspended_count),
                  ap_queue_info_num_idlers(worker_queue_info));
-    for (i = 0; i < num_listensocks; i++)
-        apr_pollset_add(event_pollset, &listener_pollfd[i]);
+    if (event_engine != EVENT_ENGINE_IO_URING) {
+        for (i = 0; i < num_listensocks; i++)
+            apr_pollset_add(event_pollset, &listener_pollfd[i]);
+    }
     /*
      * XXX: This is not yet optimal. If many workers suddenly become available,
      * XXX: the parent may kill some processes off too soon.
@@ -725,6 +761,9 @@ static int event_query(int query_code, int *result, apr_status_t *rv)
     case AP_MPMQ_CAN_POLL:
         *result = 1;
         break;
+    case AP_MPMQ_CAN_DISPATCH:
+        *result = 1;
+        break;
     default:
         *rv = APR_ENOTIMPL;
         break;
@@ -1303,10 +1342,17 @@ static void check_infinite_requests(void)
     }
 }
 
+#if HAVE_LIBURING
+static void close_accept_ring(void);
+#endif
+
 static void close_listeners(int *closed)
 {
     if (!*closed) {
         int i;
+#if HAVE_LIBURING
+        close_accept_ring();
+#endif
         ap_close_listeners_ex(my_bucket->listeners);
         *closed = 1;
         dying = 1;
@@ -1466,8 +1512,9 @@ static void get_worker(int *have_idle_worker_p, int blocking, int *all_busy)
 
 /* Structures to reuse */
 static APR_RING_HEAD(timer_free_ring_t, timer_event_t) timer_free_ring;
+static apr_thread_mutex_t *g_timer_free_mtx;
+static apr_pool_t *timers_pool;
 
-static apr_skiplist *timer_skiplist;
 static volatile apr_time_t timers_next_expiry;
 
 /* Same goal as for TIMEOUT_FUDGE_FACTOR (avoid extra poll calls), but applied
@@ -1476,28 +1523,212 @@ static volatile apr_time_t timers_next_expiry;
  */
 #define EVENT_FUDGE_FACTOR apr_time_from_msec(10)
 
-/* The following compare function is used by apr_skiplist_insert() to keep the
- * elements (timers) sorted and provide O(log n) complexity (this is also true
- * for apr_skiplist_{find,remove}(), but those are not used in MPM event where
- * inserted timers are not searched nor removed, but with apr_skiplist_pop()
- * which does use any compare function).  It is meant to return 0 when a == b,
- * <0 when a < b, and >0 when a > b.  However apr_skiplist_insert() will not
- * add duplicates (i.e. a == b), and apr_skiplist_add() is only available in
- * APR 1.6, yet multiple timers could possibly be created in the same micro-
- * second (duplicates with regard to apr_time_t); therefore we implement the
- * compare function to return +1 instead of 0 when compared timers are equal,
- * thus duplicates are still added after each other (in order of insertion).
+/* Timers are kept by the listener in a hierarchical timing wheel, with a
+ * resolution of EVENT_FUDGE_FACTOR (one tick).  Level 0 has one slot per
+ * tick for the next TIMER_WHEEL_SLOTS ticks, and each next level has one
+ * slot per TIMER_WHEEL_SLOTS slots of the previous level.  Entries of a
+ * level are cascaded (re-inserted) down when the lower level wraps, so that
+ * they end up in level 0 for their expiry tick.  Insertion and removal are
+ * O(1), and expiry is amortized O(1) per timer.  Timers beyond the range
+ * of the last level are put in its farthest slot and cascaded again.
+ *
+ * The wheel is private to the listener thread, hence not locked.  The
+ * other threads hand their new timers over through timers_pending, a
+ * lock-free (LIFO) list which the listener empties at each loop.
  */
-static int timer_comp(void *a, void *b)
+#define TIMER_WHEEL_BITS    6
+#define TIMER_WHEEL_SLOTS   (1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_MASK    (TIMER_WHEEL_SLOTS - 1)
+#define TIMER_WHEEL_LEVELS  4
+#define TIMER_WHEEL_LEVEL_SHIFT(l) ((l) * TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_MAX_DELTA \
+    (((apr_uint64_t)1 << TIMER_WHEEL_LEVEL_SHIFT(TIMER_WHEEL_LEVELS)) - 1)
+
+APR_RING_HEAD(timer_slot_t, timer_event_t);
+
+struct timer_wheel {
+    struct timer_slot_t slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+    apr_uint32_t count[TIMER_WHEEL_LEVELS];
+    apr_uint32_t total;
+    apr_uint64_t tick;          /* next tick to expire */
+};
+static struct timer_wheel *timers_wheel;
+
+static timer_event_t *volatile timers_pending;
+
+#define TIMER_TICK(t) ((apr_uint64_t)(t) / EVENT_FUDGE_FACTOR)
+
+static void timer_wheel_init(struct timer_wheel *w, apr_time_t now)
 {
-    apr_time_t t1 = (apr_time_t) ((timer_event_t *)a)->when;
-    apr_time_t t2 = (apr_time_t) ((timer_event_t *)b)->when;
-    AP_DEBUG_ASSERT(t1);
-    AP_DEBUG_ASSERT(t2);
-    return ((t1 < t2) ? -1 : 1);
+    int l, i;
+
+    for (l = 0; l < TIMER_WHEEL_LEVELS; ++l) {
+        for (i = 0; i < TIMER_WHEEL_SLOTS; ++i) {
+            APR_RING_INIT(&w->slots[l][i], timer_event_t, link);
+        }
+        w->count[l] = 0;
+    }
+    w->total = 0;
+    w->tick = TIMER_TICK(now);
 }
 
-static apr_thread_mutex_t *g_timer_skiplist_mtx;
+static void timer_wheel_insert(struct timer_wheel *w, timer_event_t *te)
+{
+    apr_uint64_t expires = TIMER_TICK(te->when), delta;
+    int level, slot;
+
+    if (expires < w->tick) {
+        expires = w->tick;
+    }
+    delta = expires - w->tick;
+    if (delta > TIMER_WHEEL_MAX_DELTA) {
+        delta = TIMER_WHEEL_MAX_DELTA;
+        expires = w->tick + delta;
+    }
+    for (level = 0; level < TIMER_WHEEL_LEVELS - 1; ++level) {
+        if (delta < ((apr_uint64_t)1 << TIMER_WHEEL_LEVEL_SHIFT(level + 1))) {
+            break;
+        }
+    }
+    slot = (int)(expires >> TIMER_WHEEL_LEVEL_SHIFT(level)) & TIMER_WHEEL_MASK;
+
+    APR_RING_INSERT_TAIL(&w->slots[level][slot], te, timer_event_t, link);
+    te->wheel_level = level;
+    w->count[level]++;
+    w->total++;
+}
+
+static void timer_wheel_remove(struct timer_wheel *w, timer_event_t *te)
+{
+    AP_DEBUG_ASSERT(te->wheel_level >= 0);
+    APR_RING_REMOVE(te, link);
+    APR_RING_ELEM_INIT(te, link);
+    w->count[te->wheel_level]--;
+    w->total--;
+    te->wheel_level = -1;
+}
+
+/* Move the timers of the given slot to their (lower) level from now */
+static void timer_wheel_cascade(struct timer_wheel *w, int level, int slot)
+{
+    struct timer_slot_t head;
+    timer_event_t *te;
+
+    if (APR_RING_EMPTY(&w->slots[level][slot], timer_event_t, link)) {
+        return;
+    }
+    APR_RING_INIT(&head, timer_event_t, link);
+    APR_RING_CONCAT(&head, &w->slots[level][slot], timer_event_t, link);
+    while (!APR_RING_EMPTY(&head, timer_event_t, link)) {
+        te = APR_RING_FIRST(&head);
+        APR_RING_REMOVE(te, link);
+        w->count[level]--;
+        w->total--;
+        timer_wheel_insert(w, te);
+    }
+}
+
+/* Advance the wheel up to the given time, moving the expired timers to the
+ * 'expired' ring (in order of expiry).
+ */
+static void timer_wheel_expire(struct timer_wheel *w, apr_time_t now,
+                               struct timer_slot_t *expired)
+{
+    apr_uint64_t target = TIMER_TICK(now);
+
+    while (w->tick <= target) {
+        int level, slot;
+
+        if (!w->total) {
+            w->tick = target + 1;
+            break;
+        }
+
+        /* Cascade the upper levels which wrap at this tick */
+        for (level = 1; level < TIMER_WHEEL_LEVELS; ++level) {
+            apr_uint64_t low = w->tick & (((apr_uint64_t)1 <<
+                                           TIMER_WHEEL_LEVEL_SHIFT(level)) - 1);
+            if (low) {
+                break;
+            }
+            slot = (int)(w->tick >> TIMER_WHEEL_LEVEL_SHIFT(level))
+                   & TIMER_WHEEL_MASK;
+            timer_wheel_cascade(w, level, slot);
+        }
+
+        slot = (int)w->tick & TIMER_WHEEL_MASK;
+        if (!APR_RING_EMPTY(&w->slots[0][slot], timer_event_t, link)) {
+            timer_event_t *te;
+            APR_RING_FOREACH(te, &w->slots[0][slot], timer_event_t, link) {
+                te->wheel_level = -1;
+                w->count[0]--;
+                w->total--;
+            }
+            APR_RING_CONCAT(expired, &w->slots[0][slot], timer_event_t, link);
+        }
+        w->tick++;
+
+        /* Skip the ticks where nothing can expire nor cascade, that is up
+         * to the next wrap of the first non-empty level.
+         */
+        for (level = 0; level < TIMER_WHEEL_LEVELS - 1; ++level) {
+            if (w->count[level]) {
+                break;
+            }
+        }
+        if (level) {
+            apr_uint64_t span = (apr_uint64_t)1 << TIMER_WHEEL_LEVEL_SHIFT(level);
+            apr_uint64_t next = (w->tick + span - 1) & ~(span - 1);
+            w->tick = (next <= target) ? next : target + 1;
+        }
+    }
+}
+
+/* Time of the next expiry or cascade in the wheel, 0 if it's empty.  The
+ * listener may thus wake up earlier than needed for far timers, but never
+ * later: the timers of the upper levels are not placed precisely until
+ * they cascade, so the next cascade counts as much as the next level 0
+ * expiry.
+ */
+static apr_time_t timer_wheel_next_expiry(struct timer_wheel *w)
+{
+    apr_uint64_t next = 0, span;
+    int level, i;
+
+    if (!w->total) {
+        return 0;
+    }
+    if (w->count[0]) {
+        for (i = 0; i < TIMER_WHEEL_SLOTS; ++i) {
+            int slot = (int)(w->tick + i) & TIMER_WHEEL_MASK;
+            if (!APR_RING_EMPTY(&w->slots[0][slot], timer_event_t, link)) {
+                next = w->tick + i;
+                break;
+            }
+        }
+    }
+    /* The lowest non-empty upper level cascades first */
+    for (level = 1; level < TIMER_WHEEL_LEVELS; ++level) {
+        if (w->count[level]) {
+            apr_uint64_t cascade;
+
+            span = (apr_uint64_t)1 << TIMER_WHEEL_LEVEL_SHIFT(level);
+            cascade = (w->tick + span - 1) & ~(span - 1);
+            if (!next || cascade < next) {
+                next = cascade;
+            }
+            break;
+        }
+    }
+    return (apr_time_t)(next * EVENT_FUDGE_FACTOR);
+}
+
+static void timer_event_recycle(timer_event_t *te)
+{
+    apr_thread_mutex_lock(g_timer_free_mtx);
+    APR_RING_INSERT_TAIL(&timer_free_ring, te, timer_event_t, link);
+    apr_thread_mutex_unlock(g_timer_free_mtx);
+}
 
 static timer_event_t * event_get_timer_event(apr_time_t t,
                                              ap_mpm_callback_fn_t *cbfn,
@@ -1508,33 +1739,39 @@ static timer_event_t * event_get_timer_event(apr_time_t t,
     timer_event_t *te;
     apr_time_t now = (t < 0) ? 0 : apr_time_now();
 
-    /* oh yeah, and make locking smarter/fine grained. */
-
-    apr_thread_mutex_lock(g_timer_skiplist_mtx);
-
+    apr_thread_mutex_lock(g_timer_free_mtx);
     if (!APR_RING_EMPTY(&timer_free_ring, timer_event_t, link)) {
         te = APR_RING_FIRST(&timer_free_ring);
         APR_RING_REMOVE(te, link);
     }
     else {
-        te = apr_skiplist_alloc(timer_skiplist, sizeof(timer_event_t));
-        APR_RING_ELEM_INIT(te, link);
+        te = apr_palloc(timers_pool, sizeof(timer_event_t));
     }
+    apr_thread_mutex_unlock(g_timer_free_mtx);
+    APR_RING_ELEM_INIT(te, link);
 
     te->cbfunc = cbfn;
+    te->wkfunc = NULL;
     te->baton = baton;
     te->canceled = 0;
     te->when = now + t;
     te->remove = remove;
+    te->wheel_level = -1;
 
     if (insert) { 
+        timer_event_t *head;
         apr_time_t next_expiry;
 
-        /* Okay, add sorted by when.. */
-        apr_skiplist_insert(timer_skiplist, te);
+        /* Hand it over to the listener */
+        do {
+            head = timers_pending;
+            te->next = head;
+        } while (apr_atomic_casptr((void *)&timers_pending, te, head) != head);
 
         /* Cheaply update the overall timers' next expiry according to
-         * this event, if necessary.
+         * this event, if necessary.  The listener rechecks timers_pending
+         * after updating timers_next_expiry, so either it sees this timer or
+         * we see its update (both sides use a full barrier in between).
          */
         next_expiry = timers_next_expiry;
         if (!next_expiry || next_expiry > te->when + EVENT_FUDGE_FACTOR) {
@@ -1545,11 +1782,35 @@ static timer_event_t * event_get_timer_event(apr_time_t t,
             }
         }
     }
-    apr_thread_mutex_unlock(g_timer_skiplist_mtx);
 
     return te;
 }
 
+/* Move the timers handed over by the other threads to the wheel, returns
+ * whether there were some.  Only to be called by the listener.
+ */
+static int timers_pending_to_wheel(void)
+{
+    timer_event_t *te, *next;
+
+    te = apr_atomic_xchgptr((void *)&timers_pending, NULL);
+    if (!te) {
+        return 0;
+    }
+    do {
+        next = te->next;
+        te->next = NULL;
+        if (te->canceled) {
+            timer_event_recycle(te);
+        }
+        else {
+            timer_wheel_insert(timers_wheel, te);
+        }
+        te = next;
+    } while (te);
+    return 1;
+}
+
 static apr_status_t event_register_timed_callback_ex(apr_time_t t,
                                                   ap_mpm_callback_fn_t *cbfn,
                                                   void *baton, 
@@ -1567,6 +1828,23 @@ static apr_status_t event_register_timed_callback(apr_time_t t,
     return APR_SUCCESS;
 }
 
+/* Queue the callback to the workers directly, without the listener's
+ * timers, it's run by the first worker available (in queue order).
+ */
+static apr_status_t event_register_worker_callback(
+                                        ap_mpm_worker_callback_fn_t *cbfn,
+                                        void *baton)
+{
+    timer_event_t *te;
+
+    if (!worker_queue || workers_may_exit) {
+        return APR_EOF;
+    }
+    te = event_get_timer_event(-1, NULL, baton, 0, NULL);
+    te->wkfunc = cbfn;
+    return push_timer2worker(te);
+}
+
 static apr_status_t event_cleanup_poll_callback(void *data)
 {
     apr_status_t final_rc = APR_SUCCESS;
@@ -1790,6 +2068,214 @@ static void process_keepalive_queue(apr_time_t timeout_time)
                           start_lingering_close_nonblocking);
 }
 
+/* Get a recycled transaction pool or create a new one for an accepted
+ * connection.  On failure the process is asked to stop gracefully and
+ * NULL is returned.
+ */
+static apr_pool_t *get_transaction_pool(void)
+{
+    apr_pool_t *ptrans;
+    apr_allocator_t *allocator = NULL;
+    apr_status_t rc;
+
+    ap_queue_info_pop_pool(worker_queue_info, &ptrans);
+    if (ptrans) {
+        return ptrans;
+    }
+
+    /* create a new transaction pool for each accepted socket */
+    rc = apr_allocator_create(&allocator);
+    if (rc == APR_SUCCESS) {
+        apr_allocator_max_free_set(allocator, ap_max_mem_free);
+        rc = apr_pool_create_ex(&ptrans, pconf, NULL, allocator);
+        if (rc == APR_SUCCESS) {
+            apr_pool_tag(ptrans, "transaction");
+            apr_allocator_owner_set(allocator, ptrans);
+        }
+    }
+    if (rc != APR_SUCCESS) {
+        ap_log_error(APLOG_MARK, APLOG_CRIT, rc, ap_server_conf, APLOGNO(03097)
+                     "Failed to create transaction pool");
+        if (allocator) {
+            apr_allocator_destroy(allocator);
+        }
+        resource_shortage = 1;
+        signal_threads(ST_GRACEFUL);
+        return NULL;
+    }
+    return ptrans;
+}
+
+#if HAVE_LIBURING
+/* Submit the multishot accepts or their cancellations so that the ring
+ * matches the current state of the listeners (enabled or not).
+ * Only to be called by the listener thread.
+ */
+static void sync_accept_ring(void)
+{
+    int i, submit = 0, accepting;
+
+    if (!uring_acceptors) {
+        return;
+    }
+
+    accepting = !listener_may_exit && !listeners_disabled();
+    for (i = 0; i < num_listensocks; i++) {
+        uring_acceptor_t *ua = &uring_acceptors[i];
+        struct io_uring_sqe *sqe;
+
+        if (accepting ? ua->armed : (!ua->armed || ua->canceling)) {
+            continue;
+        }
+
+        sqe = io_uring_get_sqe(&accept_ring);
+        if (!sqe) {
+            /* ring full, catch up on the next pass */
+            break;
+        }
+        if (accepting) {
+            apr_os_sock_t sd;
+
+            apr_os_sock_get(&sd, ua->lr->sd);
+            io_uring_prep_multishot_accept(sqe, sd, NULL, NULL, SOCK_CLOEXEC);
+            io_uring_sqe_set_data(sqe, ua);
+            ua->armed = 1;
+        }
+        else {
+            io_uring_prep_cancel(sqe, ua, 0);
+            io_uring_sqe_set_data(sqe, NULL);
+            ua->canceling = 1;
+        }
+        submit = 1;
+    }
+
+    if (submit) {
+        int ret = io_uring_submit(&accept_ring);
+        if (ret < 0) {
+            ap_log_error(APLOG_MARK, APLOG_CRIT, APR_FROM_OS_ERROR(-ret),
+                         ap_server_conf, APLOGNO(10244)
+                         "io_uring_submit failed.  Attempting to "
+                         "shutdown process gracefully");
+            signal_threads(ST_GRACEFUL);
+        }
+    }
+}
+
+/* Hand a connection accepted by the ring to a worker, like the PT_ACCEPT
+ * case of the listener does for the pollset engine.
+ */
+static void uring_push_accepted(uring_acceptor_t *ua, int fd,
+                                int *have_idle_worker_p, int *all_busy)
+{
+    apr_os_sock_info_t info;
+    apr_socket_t *csd = NULL;
+    apr_pool_t *ptrans;
+    apr_status_t rc;
+
+    ptrans = get_transaction_pool();
+    if (ptrans == NULL) {
+        close(fd);
+        return;
+    }
+
+    /* The peer and local addresses are resolved lazily by APR */
+    memset(&info, 0, sizeof(info));
+    info.os_sock = &fd;
+    info.family = ua->family;
+    info.type = ua->type;
+    info.protocol = ua->protocol;
+    rc = apr_os_sock_make(&csd, &info, ptrans);
+    if (rc != APR_SUCCESS) {
+        ap_log_error(APLOG_MARK, APLOG_ERR, rc, ap_server_conf, APLOGNO(10245)
+                     "apr_os_sock_make failed for accepted connection");
+        close(fd);
+        ap_queue_info_push_pool(worker_queue_info, ptrans);
+        return;
+    }
+
+    get_worker(have_idle_worker_p, 1, all_busy);
+    conns_this_child--;
+    if (push2worker(NULL, csd, ptrans) == APR_SUCCESS) {
+        *have_idle_worker_p = 0;
+    }
+}
+
+/* Reap the completions of accept_ring, pushing accepted connections to
+ * workers and noting the multishot accepts which terminated (so that
+ * sync_accept_ring() re-arms them if needed).
+ */
+static void process_accept_ring(int *have_idle_worker_p, int *all_busy)
+{
+    struct io_uring_cqe *cqe;
+    unsigned int head, count = 0;
+
+    io_uring_for_each_cqe(&accept_ring, head, cqe) {
+        uring_acceptor_t *ua = io_uring_cqe_get_data(cqe);
+
+        count++;
+        if (!ua) {
+            /* completion of a cancel request, nothing to do */
+            continue;
+        }
+        if (!(cqe->flags & IORING_CQE_F_MORE)) {
+            ua->armed = ua->canceling = 0;
+        }
+
+        if (cqe->res >= 0) {
+            if (listener_may_exit) {
+                close(cqe->res);
+            }
+            else {
+                uring_push_accepted(ua, cqe->res, have_idle_worker_p,
+                                    all_busy);
+            }
+        }
+        else if (cqe->res != -ECANCELED) {
+            apr_status_t rc = APR_FROM_OS_ERROR(-cqe->res);
+
+            if (ap_accept_error_is_nonfatal(rc)) {
+                ap_log_error(APLOG_MARK, APLOG_DEBUG, rc, ap_server_conf,
+                             "accept() on client socket failed");
+            }
+            else {
+                /* E[NM]FILE, ENOMEM, etc */
+                ap_log_error(APLOG_MARK, APLOG_EMERG, rc, ap_server_conf,
+                             APLOGNO(10246)
+                             "io_uring accept() on %pI failed",
+                             ua->lr->bind_addr);
+                resource_shortage = 1;
+                signal_threads(ST_GRACEFUL);
+            }
+        }
+    }
+    io_uring_cq_advance(&accept_ring, count);
+}
+
+/* Stop accepting with the ring for good; connections accepted but not
+ * reaped yet are closed.
+ */
+static void close_accept_ring(void)
+{
+    struct io_uring_cqe *cqe;
+    unsigned int head, count = 0;
+
+    if (!uring_acceptors) {
+        return;
+    }
+
+    apr_pollset_remove(event_pollset, uring_pollfd);
+    io_uring_for_each_cqe(&accept_ring, head, cqe) {
+        if (io_uring_cqe_get_data(cqe) && cqe->res >= 0) {
+            close(cqe->res);
+        }
+        count++;
+    }
+    io_uring_cq_advance(&accept_ring, count);
+    io_uring_queue_exit(&accept_ring);
+    uring_acceptors = NULL;
+}
+#endif /* HAVE_LIBURING */
+
 static void * APR_THREAD_FUNC listener_thread(apr_thread_t * thd, void *dummy)
 {
     apr_status_t rc;
@@ -1813,6 +2299,10 @@ static void * APR_THREAD_FUNC listener_thread(apr_thread_t * thd, void *dummy)
     unblock_signal(LISTENER_SIGNAL);
     apr_signal(LISTENER_SIGNAL, dummy_signal_handler);
 
+#if HAVE_LIBURING
+    sync_accept_ring();
+#endif
+
     for (;;) {
         timer_event_t *te;
         const apr_pollfd_t *out_pfd;
@@ -1874,18 +2364,20 @@ static void * APR_THREAD_FUNC listener_thread(apr_thread_t * thd, void *dummy)
         timeout_interval = -1;
 
         /* Push expired timers to a worker, the first remaining one determines
-         * the maximum time to poll() below, if any.
+         * the maximum time to poll() below, if any.  Recheck timers_pending
+         * once timers_next_expiry is updated, see event_get_timer_event().
          */
-        timeout_time = timers_next_expiry;
-        if (timeout_time && timeout_time < now + EVENT_FUDGE_FACTOR) {
-            apr_thread_mutex_lock(g_timer_skiplist_mtx);
-            while ((te = apr_skiplist_peek(timer_skiplist))) {
-                if (te->when > now + EVENT_FUDGE_FACTOR) {
-                    timers_next_expiry = te->when;
-                    timeout_interval = te->when - now;
-                    break;
-                }
-                apr_skiplist_pop(timer_skiplist, NULL);
+        do {
+            struct timer_slot_t expired;
+
+            timers_pending_to_wheel();
+
+            APR_RING_INIT(&expired, timer_event_t, link);
+            timer_wheel_expire(timers_wheel, now, &expired);
+            while (!APR_RING_EMPTY(&expired, timer_event_t, link)) {
+                te = APR_RING_FIRST(&expired);
+                APR_RING_REMOVE(te, link);
+                APR_RING_ELEM_INIT(te, link);
                 if (!te->canceled) { 
                     if (te->remove) {
                         int i;
@@ -1898,15 +2390,17 @@ static void * APR_THREAD_FUNC listener_thread(apr_thread_t * thd, void *dummy)
                     push_timer2worker(te);
                 }
                 else {
-                    APR_RING_INSERT_TAIL(&timer_free_ring, te,
-                                         timer_event_t, link);
+                    timer_event_recycle(te);
                 }
             }
-            if (!te) {
-                timers_next_expiry = 0;
+
+            timeout_time = timer_wheel_next_expiry(timers_wheel);
+            timers_next_expiry = timeout_time;
+            if (timeout_time) {
+                timeout_interval = (timeout_time > now) ? timeout_time - now
+                                                        : 1;
             }
-            apr_thread_mutex_unlock(g_timer_skiplist_mtx);
-        }
+        } while (apr_atomic_casptr((void *)&timers_pending, NULL, NULL));
 
         /* Same for queues, use their next expiry, if any. */
         timeout_time = queues_next_expiry;
@@ -2058,34 +2552,10 @@ static void * APR_THREAD_FUNC listener_thread(apr_thread_t * thd, void *dummy)
                     void *csd = NULL;
                     ap_listen_rec *lr = (ap_listen_rec *) pt->baton;
                     apr_pool_t *ptrans;         /* Pool for per-transaction stuff */
-                    ap_queue_info_pop_pool(worker_queue_info, &ptrans);
 
+                    ptrans = get_transaction_pool();
                     if (ptrans == NULL) {
-                        /* create a new transaction pool for each accepted socket */
-                        apr_allocator_t *allocator = NULL;
-
-                        rc = apr_allocator_create(&allocator);
-                        if (rc == APR_SUCCESS) {
-                            apr_allocator_max_free_set(allocator,
-                                                       ap_max_mem_free);
-                            rc = apr_pool_create_ex(&ptrans, pconf, NULL,
-                                                    allocator);
-                            if (rc == APR_SUCCESS) {
-                                apr_pool_tag(ptrans, "transaction");
-                                apr_allocator_owner_set(allocator, ptrans);
-                            }
-                        }
-                        if (rc != APR_SUCCESS) {
-                            ap_log_error(APLOG_MARK, APLOG_CRIT, rc,
-                                         ap_server_conf, APLOGNO(03097)
-                                         "Failed to create transaction pool");
-                            if (allocator) {
-                                apr_allocator_destroy(allocator);
-                            }
-                            resource_shortage = 1;
-                            signal_threads(ST_GRACEFUL);
-                            continue;
-                        }
+                        continue;
                     }
 
                     get_worker(&have_idle_worker, 1, &workers_were_busy);
@@ -2124,13 +2594,34 @@ static void * APR_THREAD_FUNC listener_thread(apr_thread_t * thd, void *dummy)
                 serf_event_trigger(g_serf, pt->baton, out_pfd);
             }
 
+#endif
+#if HAVE_LIBURING
+            else if (pt->type == PT_URING) {
+                /* Connections accepted by the ring, same limits as above
+                 * apply to the next ones.
+                 */
+                process_accept_ring(&have_idle_worker, &workers_were_busy);
+                if (workers_were_busy || connections_above_limit()) {
+                    disable_listensocks();
+                }
+            }
 #endif
             else if (pt->type == PT_USER) {
                 /* masquerade as a timer event that is firing */
                 int i = 0;
                 socket_callback_baton_t *baton = (socket_callback_baton_t *) pt->baton;
                 if (baton->cancel_event) {
-                    baton->cancel_event->canceled = 1;
+                    te = baton->cancel_event;
+                    te->canceled = 1;
+                    /* Cancel in O(1) if the listener owns it already,
+                     * otherwise it's still pending and will be recycled
+                     * from there.
+                     */
+                    if (te->wheel_level >= 0) {
+                        timer_wheel_remove(timers_wheel, te);
+                        timer_event_recycle(te);
+                    }
+                    baton->cancel_event = NULL;
                 }
 
                 /* We only signal once per N sockets with this baton */
@@ -2226,6 +2717,11 @@ static void * APR_THREAD_FUNC listener_thread(apr_thread_t * thd, void *dummy)
                 && !connections_above_limit()) {
             enable_listensocks();
         }
+
+#if HAVE_LIBURING
+        /* (Re)arm or cancel the ring's accepts according to the above */
+        sync_accept_ring();
+#endif
     } /* listener main loop */
 
     close_listeners(&closed);
@@ -2348,12 +2844,13 @@ static void *APR_THREAD_FUNC worker_thread(apr_thread_t * thd, void *dummy)
             continue;
         }
         if (te != NULL) {
-            te->cbfunc(te->baton);
-            {
-                apr_thread_mutex_lock(g_timer_skiplist_mtx);
-                APR_RING_INSERT_TAIL(&timer_free_ring, te, timer_event_t, link);
-                apr_thread_mutex_unlock(g_timer_skiplist_mtx);
+            if (te->wkfunc) {
+                te->wkfunc(thd, te->baton);
+            }
+            else {
+                te->cbfunc(te->baton);
             }
+            timer_event_recycle(te);
         }
         else {
             is_idle = 0;
@@ -2429,11 +2926,83 @@ static void create_listener_thread(thread_starter * ts)
     apr_os_thread_get(&listener_os_thread, ts->listener);
 }
 
+#if HAVE_LIBURING
+/* Create the accept ring for EventEngine io_uring and register its fd in
+ * event_pollset.  Returns non-zero on success, zero if the pollset engine
+ * should be used instead.
+ */
+static int setup_accept_ring(void)
+{
+    struct io_uring_params params;
+    listener_poll_type *pt;
+    apr_file_t *ring_file = NULL;
+    apr_os_file_t ring_fd;
+    ap_listen_rec *lr;
+    apr_status_t rv;
+    int ret, i;
+
+    /* Two SQEs per listener (accept and cancel) at most, and room for all
+     * the connections accepted between two passes of the listener.
+     */
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = (unsigned int)threads_per_child * 2;
+    if (params.cq_entries < 64) {
+        params.cq_entries = 64;
+    }
+    ret = io_uring_queue_init_params((unsigned int)num_listensocks * 2,
+                                     &accept_ring, &params);
+    if (ret < 0) {
+        ap_log_error(APLOG_MARK, APLOG_WARNING, APR_FROM_OS_ERROR(-ret),
+                     ap_server_conf, APLOGNO(10247)
+                     "io_uring_queue_init failed, falling back to the "
+                     "pollset engine");
+        return 0;
+    }
+
+    ring_fd = accept_ring.ring_fd;
+    rv = apr_os_file_put(&ring_file, &ring_fd, APR_FOPEN_READ, pruntime);
+    if (rv == APR_SUCCESS) {
+        uring_pollfd = apr_pcalloc(pruntime, sizeof(*uring_pollfd));
+        uring_pollfd->reqevents = APR_POLLIN;
+        uring_pollfd->desc_type = APR_POLL_FILE;
+        uring_pollfd->desc.f = ring_file;
+        pt = apr_pcalloc(pruntime, sizeof(*pt));
+        pt->type = PT_URING;
+        uring_pollfd->client_data = pt;
+        rv = apr_pollset_add(event_pollset, uring_pollfd);
+    }
+    if (rv != APR_SUCCESS) {
+        ap_log_error(APLOG_MARK, APLOG_WARNING, rv, ap_server_conf,
+                     APLOGNO(10248)
+                     "Can't poll the io_uring accept ring, falling back to "
+                     "the pollset engine");
+        io_uring_queue_exit(&accept_ring);
+        return 0;
+    }
+
+    uring_acceptors = apr_pcalloc(pruntime, num_listensocks *
+                                            sizeof(uring_acceptor_t));
+    for (i = 0, lr = my_bucket->listeners; lr; lr = lr->next, i++) {
+        uring_acceptor_t *ua = &uring_acceptors[i];
+
+        ua->lr = lr;
+        ua->family = lr->bind_addr->family;
+        apr_socket_type_get(lr->sd, &ua->type);
+        apr_socket_protocol_get(lr->sd, &ua->protocol);
+    }
+
+    ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, ap_server_conf, APLOGNO(10249)
+                 "Using io_uring to accept connections (%d listeners)",
+                 num_listensocks);
+    return 1;
+}
+#endif
+
 static void setup_threads_runtime(void)
 {
     apr_status_t rv;
     ap_listen_rec *lr;
-    apr_pool_t *pskip = NULL;
     int max_recycled_pools = -1, i;
     const int good_methods[] = { APR_POLLSET_KQUEUE,
                                  APR_POLLSET_PORT,
@@ -2445,20 +3014,24 @@ static void setup_threads_runtime(void)
                                       (async_factor > 2 ? async_factor : 2);
     int pollset_flags;
 
-    /* Event's skiplist operations will happen concurrently with other modules'
+    /* Event's timers operations will happen concurrently with other modules'
      * runtime so they need their own pool for allocations, and its lifetime
-     * should be at least the one of the connections (ptrans). Thus pskip is
-     * created as a subpool of pconf like/before ptrans (before so that it's
-     * destroyed after). In forked mode pconf is never destroyed so we are good
-     * anyway, but in ONE_PROCESS mode this ensures that the skiplist works
-     * from connection/ptrans cleanups (even after pchild is destroyed).
+     * should be at least the one of the connections (ptrans). Thus
+     * timers_pool is created as a subpool of pconf like/before ptrans (before
+     * so that it's destroyed after). In forked mode pconf is never destroyed
+     * so we are good anyway, but in ONE_PROCESS mode this ensures that the
+     * timers work from connection/ptrans cleanups (even after pchild is
+     * destroyed).
      */
-    apr_pool_create(&pskip, pconf);
-    apr_pool_tag(pskip, "mpm_skiplist");
-    apr_thread_mutex_create(&g_timer_skiplist_mtx, APR_THREAD_MUTEX_DEFAULT, pskip);
+    apr_pool_create(&timers_pool, pconf);
+    apr_pool_tag(timers_pool, "mpm_timers");
+    apr_thread_mutex_create(&g_timer_free_mtx, APR_THREAD_MUTEX_DEFAULT,
+                            timers_pool);
     APR_RING_INIT(&timer_free_ring, timer_event_t, link);
-    apr_skiplist_init(&timer_skiplist, pskip);
-    apr_skiplist_set_compare(timer_skiplist, timer_comp, timer_comp);
+    timers_wheel = apr_palloc(timers_pool, sizeof(*timers_wheel));
+    timer_wheel_init(timers_wheel, apr_time_now());
+    timers_pending = NULL;
+    timers_next_expiry = 0;
 
     /* All threads (listener, workers) and synchronization objects (queues,
      * pollset, mutexes...) created here should have at least the lifetime of
@@ -2540,7 +3113,13 @@ static void setup_threads_runtime(void)
         clean_child_exit(APEXIT_CHILDFATAL);
     }
 
-    /* Add listeners to the main pollset */
+#if HAVE_LIBURING
+    if (event_engine == EVENT_ENGINE_IO_URING && !setup_accept_ring()) {
+        event_engine = EVENT_ENGINE_POLLSET;
+    }
+#endif
+
+    /* Add listeners to the main pollset (unless the ring accepts for them) */
     listener_pollfd = apr_pcalloc(pruntime, num_listensocks *
                                             sizeof(apr_pollfd_t));
     for (i = 0, lr = my_bucket->listeners; lr; lr = lr->next, i++) {
@@ -2560,7 +3139,9 @@ static void setup_threads_runtime(void)
         pt->baton = lr;
 
         apr_socket_opt_set(pfd->desc.s, APR_SO_NONBLOCK, 1);
-        apr_pollset_add(event_pollset, pfd);
+        if (event_engine != EVENT_ENGINE_IO_URING) {
+            apr_pollset_add(event_pollset, pfd);
+        }
 
         lr->accept_func = ap_unixd_accept;
     }
@@ -2908,6 +3489,7 @@ static void child_main(int child_num_arg, int child_bucket)
 static int make_child(server_rec * s, int slot, int bucket)
 {
     int pid;
+    apr_status_t rv;
 
     if (slot + 1 > retained->max_daemons_limit) {
         retained->max_daemons_limit = slot + 1;
@@ -2924,6 +3506,7 @@ static int make_child(server_rec * s, int slot, int bucket)
 
     if (one_process) {
         my_bucket = &all_buckets[0];
+        ap_scoreboard_image->parent[slot].bucket = 0;
 
         event_note_child_started(slot, getpid());
         child_main(slot, 0);
@@ -2965,6 +3548,12 @@ static int make_child(server_rec * s, int slot, int bucket)
                          ap_server_conf, APLOGNO(00482)
                          "processor unbind failed");
 #endif
+        rv = ap_listen_bucket_set_affinity(bucket);
+        if (rv != APR_SUCCESS) {
+            ap_log_error(APLOG_MARK, APLOG_WARNING, rv, ap_server_conf,
+                         APLOGNO(10254) "unable to bind the process to the "
+                         "CPUs of listeners bucket %d", bucket);
+        }
         RAISE_SIGSTOP(MAKE_CHILD);
 
         apr_signal(SIGTERM, just_die);
@@ -2975,6 +3564,7 @@ static int make_child(server_rec * s, int slot, int bucket)
     }
 
     ap_scoreboard_image->parent[slot].quiescing = 0;
+    ap_scoreboard_image->parent[slot].bucket = bucket;
     ap_scoreboard_image->parent[slot].not_accepting = 0;
     event_note_child_started(slot, pid);
     active_daemons++;
@@ -3638,8 +4228,6 @@ static int event_open_logs(apr_pool_t * p, apr_pool_t * plog,
     }
     retained->mpm->num_buckets = num_buckets;
 
-    /* for skiplist */
-    srand((unsigned int)apr_time_now());
     return OK;
 }
 
@@ -3738,6 +4326,7 @@ static int event_pre_config(apr_pool_t * pconf, apr_pool_t * plog,
     listener_os_thread = NULL;
     listensocks_disabled = 0;
     listener_is_wakeable = 0;
+    event_engine = EVENT_ENGINE_POLLSET;
 
     return OK;
 }
@@ -4041,6 +4630,8 @@ static void event_hooks(apr_pool_t * p)
     ap_hook_mpm_query(event_query, NULL, NULL, APR_HOOK_MIDDLE);
     ap_hook_mpm_register_timed_callback(event_register_timed_callback, NULL, NULL,
                                         APR_HOOK_MIDDLE);
+    ap_hook_mpm_register_worker_callback(event_register_worker_callback,
+                                         NULL, NULL, APR_HOOK_MIDDLE);
     ap_hook_mpm_register_poll_callback(event_register_poll_callback, NULL, NULL,
                                         APR_HOOK_MIDDLE);
     ap_hook_mpm_register_poll_callback_timeout(event_register_poll_callback_ex, NULL, NULL,
@@ -4167,6 +4758,31 @@ static const char *set_worker_factor(cmd_parms * cmd, void *dummy,
 }
 
 
+static const char *set_event_engine(cmd_parms *cmd, void *dummy,
+                                    const char *arg)
+{
+    const char *err = ap_check_cmd_context(cmd, GLOBAL_ONLY);
+    if (err != NULL) {
+        return err;
+    }
+
+    if (!strcasecmp(arg, "pollset")) {
+        event_engine = EVENT_ENGINE_POLLSET;
+    }
+    else if (!strcasecmp(arg, "io_uring")) {
+#if HAVE_LIBURING
+        event_engine = EVENT_ENGINE_IO_URING;
+#else
+        return "EventEngine io_uring is not supported by this build "
+               "(liburing not available)";
+#endif
+    }
+    else {
+        return "EventEngine must be one of 'pollset' or 'io_uring'";
+    }
+    return NULL;
+}
+
 static const command_rec event_cmds[] = {
     LISTEN_COMMANDS,
     AP_INIT_TAKE1("StartServers", set_daemons_to_start, NULL, RSRC_CONF,
@@ -4189,6 +4805,9 @@ static const command_rec event_cmds[] = {
     AP_INIT_TAKE1("AsyncRequestWorkerFactor", set_worker_factor, NULL, RSRC_CONF,
                   "How many additional connects will be accepted per idle "
                   "worker thread"),
+    AP_INIT_TAKE1("EventEngine", set_event_engine, NULL, RSRC_CONF,
+                  "Engine used by the listener to accept connections, "
+                  "'pollset' (default) or 'io_uring'"),
     AP_GRACEFUL_SHUTDOWN_TIMEOUT_COMMAND,
     {NULL}
 };
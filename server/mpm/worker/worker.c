@@ -1280,6 +1280,7 @@ static void child_main(int child_num_arg, int child_bucket)
 static int make_child(server_rec *s, int slot, int bucket)
 {
     int pid;
+    apr_status_t rv;
 
     if (slot + 1 > retained->max_daemons_limit) {
         retained->max_daemons_limit = slot + 1;
@@ -1287,6 +1288,7 @@ static int make_child(server_rec *s, int slot, int bucket)
 
     if (one_process) {
         my_bucket = &all_buckets[0];
+        ap_scoreboard_image->parent[slot].bucket = 0;
 
         worker_note_child_started(slot, getpid());
         child_main(slot, 0);
@@ -1327,6 +1329,12 @@ static int make_child(server_rec *s, int slot, int bucket)
                          ap_server_conf, APLOGNO(00284)
                          "processor unbind failed");
 #endif
+        rv = ap_listen_bucket_set_affinity(bucket);
+        if (rv != APR_SUCCESS) {
+            ap_log_error(APLOG_MARK, APLOG_WARNING, rv, ap_server_conf,
+                         APLOGNO(10255) "unable to bind the process to the "
+                         "CPUs of listeners bucket %d", bucket);
+        }
         RAISE_SIGSTOP(MAKE_CHILD);
 
         apr_signal(SIGTERM, just_die);
@@ -1344,6 +1352,7 @@ static int make_child(server_rec *s, int slot, int bucket)
         worker_note_child_lost_slot(slot, pid);
     }
     ap_scoreboard_image->parent[slot].quiescing = 0;
+    ap_scoreboard_image->parent[slot].bucket = bucket;
     worker_note_child_started(slot, pid);
     return 0;
 }
@@ -68,6 +68,7 @@
     APR_HOOK_LINK(mpm) \
     APR_HOOK_LINK(mpm_query) \
     APR_HOOK_LINK(mpm_register_timed_callback) \
+    APR_HOOK_LINK(mpm_register_worker_callback) \
     APR_HOOK_LINK(mpm_register_poll_callback) \
     APR_HOOK_LINK(mpm_register_poll_callback_timeout) \
     APR_HOOK_LINK(mpm_unregister_poll_callback) \
@@ -107,6 +108,9 @@ AP_IMPLEMENT_HOOK_RUN_FIRST(int, mpm_query,
 AP_IMPLEMENT_HOOK_RUN_FIRST(apr_status_t, mpm_register_timed_callback,
                             (apr_time_t t, ap_mpm_callback_fn_t *cbfn, void *baton),
                             (t, cbfn, baton), APR_ENOTIMPL)
+AP_IMPLEMENT_HOOK_RUN_FIRST(apr_status_t, mpm_register_worker_callback,
+                            (ap_mpm_worker_callback_fn_t *cbfn, void *baton),
+                            (cbfn, baton), APR_ENOTIMPL)
 AP_IMPLEMENT_HOOK_RUN_FIRST(apr_status_t, mpm_resume_suspended,
                             (conn_rec *c),
                             (c), APR_ENOTIMPL)
@@ -571,6 +575,12 @@ AP_DECLARE(apr_status_t) ap_mpm_register_timed_callback(apr_time_t t,
     return ap_run_mpm_register_timed_callback(t, cbfn, baton);
 }
 
+AP_DECLARE(apr_status_t) ap_mpm_register_worker_callback(
+        ap_mpm_worker_callback_fn_t *cbfn, void *baton)
+{
+    return ap_run_mpm_register_worker_callback(cbfn, baton);
+}
+
 AP_DECLARE(apr_status_t) ap_mpm_register_poll_callback(apr_array_header_t *pfds,
         ap_mpm_callback_fn_t *cbfn, void *baton)
 {
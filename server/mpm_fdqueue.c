@@ -20,8 +20,124 @@
 
 #include <apr_atomic.h>
 
+#if AP_FDQUEUE_LOCKFREE && defined(__linux__) && defined(HAVE_LINUX_FUTEX_H)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <limits.h>
+#define FD_QUEUE_HAVE_FUTEX 1
+#else
+#define FD_QUEUE_HAVE_FUTEX 0
+#endif
+
 static const apr_uint32_t zero_pt = APR_UINT32_MAX/2;
 
+#if AP_FDQUEUE_LOCKFREE
+
+/* Eventcount, to park threads until a condition (checked by the caller) may
+ * have changed, without any lock on the notifier side when nobody waits:
+ *
+ *   waiter:   key = ec_prepare_wait(ec);
+ *             if (!condition) ec_wait(ec, key);
+ *             ec_cancel_wait(ec);
+ *   notifier: make condition true (atomically);
+ *             ec_notify(ec, all);
+ *
+ * Both ec_prepare_wait() and the notifier's atomic update imply a full
+ * barrier, so either the waiter sees the condition or the notifier sees
+ * the waiter.  Like a condition variable, ec_wait() may return spuriously.
+ */
+typedef struct fd_eventcount_t
+{
+    apr_uint32_t volatile seq;
+    apr_uint32_t volatile waiters;
+#if !FD_QUEUE_HAVE_FUTEX
+    apr_thread_mutex_t *mutex;
+    apr_thread_cond_t *cond;
+#endif
+} fd_eventcount_t;
+
+static apr_status_t ec_init(fd_eventcount_t *ec, apr_pool_t *p)
+{
+    ec->seq = 0;
+    ec->waiters = 0;
+#if !FD_QUEUE_HAVE_FUTEX
+    {
+        apr_status_t rv;
+        rv = apr_thread_mutex_create(&ec->mutex, APR_THREAD_MUTEX_DEFAULT, p);
+        if (rv != APR_SUCCESS) {
+            return rv;
+        }
+        rv = apr_thread_cond_create(&ec->cond, p);
+        if (rv != APR_SUCCESS) {
+            return rv;
+        }
+    }
+#endif
+    return APR_SUCCESS;
+}
+
+static APR_INLINE apr_uint32_t ec_prepare_wait(fd_eventcount_t *ec)
+{
+    apr_atomic_inc32(&ec->waiters);
+    return apr_atomic_read32(&ec->seq);
+}
+
+static APR_INLINE void ec_cancel_wait(fd_eventcount_t *ec)
+{
+    apr_atomic_dec32(&ec->waiters);
+}
+
+static void ec_wait(fd_eventcount_t *ec, apr_uint32_t key)
+{
+#if FD_QUEUE_HAVE_FUTEX
+    /* Returns immediately if seq != key already (EAGAIN) */
+    syscall(SYS_futex, &ec->seq, FUTEX_WAIT_PRIVATE, key, NULL, NULL, 0);
+#else
+    apr_thread_mutex_lock(ec->mutex);
+    if (ec->seq == key) {
+        apr_thread_cond_wait(ec->cond, ec->mutex);
+    }
+    apr_thread_mutex_unlock(ec->mutex);
+#endif
+}
+
+static void ec_wakeup(fd_eventcount_t *ec, int all)
+{
+#if FD_QUEUE_HAVE_FUTEX
+    apr_atomic_inc32(&ec->seq);
+    syscall(SYS_futex, &ec->seq, FUTEX_WAKE_PRIVATE, all ? INT_MAX : 1,
+            NULL, NULL, 0);
+#else
+    apr_thread_mutex_lock(ec->mutex);
+    ec->seq++;
+    if (all) {
+        apr_thread_cond_broadcast(ec->cond);
+    }
+    else {
+        apr_thread_cond_signal(ec->cond);
+    }
+    apr_thread_mutex_unlock(ec->mutex);
+#endif
+}
+
+static APR_INLINE void ec_notify(fd_eventcount_t *ec, int all)
+{
+    if (apr_atomic_read32(&ec->waiters)) {
+        ec_wakeup(ec, all);
+    }
+}
+
+static void ec_destroy(fd_eventcount_t *ec)
+{
+#if !FD_QUEUE_HAVE_FUTEX
+    apr_thread_cond_destroy(ec->cond);
+    apr_thread_mutex_destroy(ec->mutex);
+#endif
+}
+
+#endif /* AP_FDQUEUE_LOCKFREE */
+
 struct recycled_pool
 {
     apr_pool_t *pool;
@@ -35,27 +151,28 @@ struct fd_queue_info_t
                                    * <  zero_pt: number of threads blocked,
                                    *             waiting for an idle worker
                                    */
+#if AP_FDQUEUE_LOCKFREE
+    fd_eventcount_t wait_for_idler;
+#else
     apr_thread_mutex_t *idlers_mutex;
     apr_thread_cond_t *wait_for_idler;
-    int terminated;
+#endif
+    int volatile terminated;
     int max_idlers;
     int max_recycled_pools;
     apr_uint32_t recycled_pools_count;
     struct recycled_pool *volatile recycled_pools;
 };
 
-struct fd_queue_elem_t
-{
-    apr_socket_t *sd;
-    void *sd_baton;
-    apr_pool_t *p;
-};
-
 static apr_status_t queue_info_cleanup(void *data_)
 {
     fd_queue_info_t *qi = data_;
+#if AP_FDQUEUE_LOCKFREE
+    ec_destroy(&qi->wait_for_idler);
+#else
     apr_thread_cond_destroy(qi->wait_for_idler);
     apr_thread_mutex_destroy(qi->idlers_mutex);
+#endif
 
     /* Clean up any pools in the recycled list */
     for (;;) {
@@ -81,6 +198,12 @@ apr_status_t ap_queue_info_create(fd_queue_info_t **queue_info,
 
     qi = apr_pcalloc(pool, sizeof(*qi));
 
+#if AP_FDQUEUE_LOCKFREE
+    rv = ec_init(&qi->wait_for_idler, pool);
+    if (rv != APR_SUCCESS) {
+        return rv;
+    }
+#else
     rv = apr_thread_mutex_create(&qi->idlers_mutex, APR_THREAD_MUTEX_DEFAULT,
                                  pool);
     if (rv != APR_SUCCESS) {
@@ -90,6 +213,7 @@ apr_status_t ap_queue_info_create(fd_queue_info_t **queue_info,
     if (rv != APR_SUCCESS) {
         return rv;
     }
+#endif
     qi->recycled_pools = NULL;
     qi->max_recycled_pools = max_recycled_pools;
     qi->max_idlers = max_idlers;
@@ -105,6 +229,16 @@ apr_status_t ap_queue_info_create(fd_queue_info_t **queue_info,
 apr_status_t ap_queue_info_set_idle(fd_queue_info_t *queue_info,
                                     apr_pool_t *pool_to_recycle)
 {
+#if AP_FDQUEUE_LOCKFREE
+    ap_queue_info_push_pool(queue_info, pool_to_recycle);
+
+    /* If other threads are waiting on a worker, wake one up */
+    if (apr_atomic_inc32(&queue_info->idlers) < zero_pt) {
+        ec_notify(&queue_info->wait_for_idler, 0);
+    }
+
+    return APR_SUCCESS;
+#else
     apr_status_t rv;
 
     ap_queue_info_push_pool(queue_info, pool_to_recycle);
@@ -128,6 +262,7 @@ apr_status_t ap_queue_info_set_idle(fd_queue_info_t *queue_info,
     }
 
     return APR_SUCCESS;
+#endif
 }
 
 apr_status_t ap_queue_info_try_get_idler(fd_queue_info_t *queue_info)
@@ -148,6 +283,22 @@ apr_status_t ap_queue_info_try_get_idler(fd_queue_info_t *queue_info)
 apr_status_t ap_queue_info_wait_for_idler(fd_queue_info_t *queue_info,
                                           int *had_to_block)
 {
+#if AP_FDQUEUE_LOCKFREE
+    /* Block if there isn't any idle worker (see below for the mutex
+     * version, the eventcount provides the same guarantees).
+     */
+    if (apr_atomic_add32(&queue_info->idlers, -1) <= zero_pt) {
+        apr_uint32_t key = ec_prepare_wait(&queue_info->wait_for_idler);
+        if (apr_atomic_read32(&queue_info->idlers) < zero_pt
+                && !queue_info->terminated) {
+            if (had_to_block) {
+                *had_to_block = 1;
+            }
+            ec_wait(&queue_info->wait_for_idler, key);
+        }
+        ec_cancel_wait(&queue_info->wait_for_idler);
+    }
+#else
     apr_status_t rv;
 
     /* Block if there isn't any idle worker.
@@ -198,6 +349,7 @@ apr_status_t ap_queue_info_wait_for_idler(fd_queue_info_t *queue_info,
             return rv;
         }
     }
+#endif
 
     if (queue_info->terminated) {
         return APR_EOF;
@@ -298,6 +450,11 @@ void ap_queue_info_free_idle_pools(fd_queue_info_t *queue_info)
 
 apr_status_t ap_queue_info_term(fd_queue_info_t *queue_info)
 {
+#if AP_FDQUEUE_LOCKFREE
+    queue_info->terminated = 1;
+    ec_wakeup(&queue_info->wait_for_idler, 1);
+    return APR_SUCCESS;
+#else
     apr_status_t rv;
 
     rv = apr_thread_mutex_lock(queue_info->idlers_mutex);
@@ -309,8 +466,319 @@ apr_status_t ap_queue_info_term(fd_queue_info_t *queue_info)
     apr_thread_cond_broadcast(queue_info->wait_for_idler);
 
     return apr_thread_mutex_unlock(queue_info->idlers_mutex);
+#endif
+}
+
+#if AP_FDQUEUE_LOCKFREE
+
+/*
+ * Lock-free implementation: a bounded multi-producer/multi-consumer ring
+ * where each cell has a sequence number telling whether it's ready to be
+ * pushed or popped for a given position (D. Vyukov's algorithm), so that
+ * producers and consumers only contend on their respective position with
+ * a CAS.  Workers park on an eventcount when the ring is empty.
+ *
+ * The ring is sized for twice the capacity so that timers (which unlike
+ * sockets are not bounded by the number of idle workers) usually fit in
+ * too, provided that they leave room for 'capacity' sockets.  Otherwise
+ * they go to a mutex protected overflow list, which the workers drain once
+ * the ring is empty (later timers also go there until it's empty, so that
+ * they remain in order).
+ */
+
+#define FD_QUEUE_CACHELINE 64
+
+struct fd_queue_elem_t
+{
+    apr_uint32_t volatile seq;
+    apr_socket_t *sd;
+    void *sd_baton;
+    apr_pool_t *p;
+    timer_event_t *te;
+};
+
+struct fd_queue_t
+{
+    fd_queue_elem_t *data;
+    apr_uint32_t mask;
+    apr_uint32_t capacity;
+    char pad0[FD_QUEUE_CACHELINE];
+    apr_uint32_t volatile in;
+    char pad1[FD_QUEUE_CACHELINE];
+    apr_uint32_t volatile out;
+    char pad2[FD_QUEUE_CACHELINE];
+    fd_eventcount_t not_empty;
+    int volatile terminated;
+    apr_uint32_t volatile overflow_count;
+    apr_thread_mutex_t *overflow_mutex;
+    APR_RING_HEAD(timers_t, timer_event_t) overflow;
+};
+
+static apr_status_t ap_queue_destroy(void *data)
+{
+    fd_queue_t *queue = data;
+
+    ec_destroy(&queue->not_empty);
+    apr_thread_mutex_destroy(queue->overflow_mutex);
+
+    return APR_SUCCESS;
+}
+
+apr_status_t ap_queue_create(fd_queue_t **pqueue, int capacity, apr_pool_t *p)
+{
+    apr_status_t rv;
+    fd_queue_t *queue;
+    apr_uint32_t size, i;
+
+    queue = apr_pcalloc(p, sizeof *queue);
+
+    if ((rv = ec_init(&queue->not_empty, p)) != APR_SUCCESS) {
+        return rv;
+    }
+    if ((rv = apr_thread_mutex_create(&queue->overflow_mutex,
+                                      APR_THREAD_MUTEX_DEFAULT,
+                                      p)) != APR_SUCCESS) {
+        return rv;
+    }
+    APR_RING_INIT(&queue->overflow, timer_event_t, link);
+
+    for (size = 2; size < (apr_uint32_t)capacity * 2; size <<= 1)
+        ;
+    queue->data = apr_pcalloc(p, size * sizeof(fd_queue_elem_t));
+    for (i = 0; i < size; ++i) {
+        queue->data[i].seq = i;
+    }
+    queue->mask = size - 1;
+    queue->capacity = capacity;
+
+    apr_pool_cleanup_register(p, queue, ap_queue_destroy,
+                              apr_pool_cleanup_null);
+    *pqueue = queue;
+
+    return APR_SUCCESS;
 }
 
+static apr_status_t queue_push(fd_queue_t *queue, apr_socket_t *sd,
+                               void *sd_baton, apr_pool_t *p,
+                               timer_event_t *te)
+{
+    fd_queue_elem_t *elem;
+    apr_uint32_t pos = apr_atomic_read32(&queue->in);
+
+    for (;;) {
+        apr_int32_t dif;
+
+        elem = &queue->data[pos & queue->mask];
+        dif = (apr_int32_t)(apr_atomic_read32(&elem->seq) - pos);
+        if (dif == 0) {
+            apr_uint32_t cur = apr_atomic_cas32(&queue->in, pos + 1, pos);
+            if (cur == pos) {
+                break;
+            }
+            pos = cur;
+        }
+        else if (dif < 0) {
+            return APR_EAGAIN; /* full */
+        }
+        else {
+            pos = apr_atomic_read32(&queue->in);
+        }
+    }
+
+    elem->sd = sd;
+    elem->sd_baton = sd_baton;
+    elem->p = p;
+    elem->te = te;
+    /* publish (full barrier) */
+    apr_atomic_xchg32(&elem->seq, pos + 1);
+
+    ec_notify(&queue->not_empty, 0);
+    return APR_SUCCESS;
+}
+
+static int queue_pop_overflow(fd_queue_t *queue, timer_event_t **te_out)
+{
+    timer_event_t *te = NULL;
+
+    if (!apr_atomic_read32(&queue->overflow_count)) {
+        return 0;
+    }
+
+    apr_thread_mutex_lock(queue->overflow_mutex);
+    if (!APR_RING_EMPTY(&queue->overflow, timer_event_t, link)) {
+        te = APR_RING_FIRST(&queue->overflow);
+        APR_RING_REMOVE(te, link);
+        apr_atomic_dec32(&queue->overflow_count);
+    }
+    apr_thread_mutex_unlock(queue->overflow_mutex);
+    if (!te) {
+        return 0;
+    }
+
+    *te_out = te;
+    return 1;
+}
+
+static int queue_pop(fd_queue_t *queue, apr_socket_t **sd, void **sd_baton,
+                     apr_pool_t **p, timer_event_t **te_out)
+{
+    fd_queue_elem_t *elem;
+    apr_uint32_t pos;
+
+    pos = apr_atomic_read32(&queue->out);
+    for (;;) {
+        apr_int32_t dif;
+
+        elem = &queue->data[pos & queue->mask];
+        dif = (apr_int32_t)(apr_atomic_read32(&elem->seq) - (pos + 1));
+        if (dif == 0) {
+            apr_uint32_t cur = apr_atomic_cas32(&queue->out, pos + 1, pos);
+            if (cur == pos) {
+                break;
+            }
+            pos = cur;
+        }
+        else if (dif < 0) {
+            return te_out && queue_pop_overflow(queue, te_out); /* empty */
+        }
+        else {
+            pos = apr_atomic_read32(&queue->out);
+        }
+    }
+
+    if (te_out) {
+        *te_out = elem->te;
+    }
+    else {
+        AP_DEBUG_ASSERT(elem->te == NULL);
+    }
+    if (!elem->te) {
+        *sd = elem->sd;
+        if (sd_baton) {
+            *sd_baton = elem->sd_baton;
+        }
+        *p = elem->p;
+    }
+#ifdef AP_DEBUG
+    elem->sd = NULL;
+    elem->p = NULL;
+#endif /* AP_DEBUG */
+    /* release the cell for the next round (full barrier) */
+    apr_atomic_xchg32(&elem->seq, pos + queue->mask + 1);
+
+    return 1;
+}
+
+/**
+ * Push a new socket onto the queue.
+ *
+ * precondition: ap_queue_info_wait_for_idler has already been called
+ *               to reserve an idle worker thread
+ */
+apr_status_t ap_queue_push_socket(fd_queue_t *queue,
+                                  apr_socket_t *sd, void *sd_baton,
+                                  apr_pool_t *p)
+{
+    apr_status_t rv;
+
+    AP_DEBUG_ASSERT(!queue->terminated);
+
+    rv = queue_push(queue, sd, sd_baton, p, NULL);
+    AP_DEBUG_ASSERT(rv == APR_SUCCESS);
+    return rv;
+}
+
+apr_status_t ap_queue_push_timer(fd_queue_t *queue, timer_event_t *te)
+{
+    apr_uint32_t used;
+
+    AP_DEBUG_ASSERT(!queue->terminated);
+
+    used = apr_atomic_read32(&queue->in) - apr_atomic_read32(&queue->out);
+    if (used + queue->capacity > queue->mask
+            || apr_atomic_read32(&queue->overflow_count)
+            || queue_push(queue, NULL, NULL, NULL, te) != APR_SUCCESS) {
+        apr_thread_mutex_lock(queue->overflow_mutex);
+        APR_RING_INSERT_TAIL(&queue->overflow, te, timer_event_t, link);
+        apr_atomic_inc32(&queue->overflow_count);
+        apr_thread_mutex_unlock(queue->overflow_mutex);
+
+        ec_notify(&queue->not_empty, 0);
+    }
+
+    return APR_SUCCESS;
+}
+
+/**
+ * Retrieves the next available socket from the queue. If there are no
+ * sockets available, it will block until one becomes available.
+ * Once retrieved, the socket is placed into the address specified by
+ * 'sd'.
+ */
+apr_status_t ap_queue_pop_something(fd_queue_t *queue,
+                                    apr_socket_t **sd, void **sd_baton,
+                                    apr_pool_t **p, timer_event_t **te_out)
+{
+    if (te_out) {
+        *te_out = NULL;
+    }
+    if (queue_pop(queue, sd, sd_baton, p, te_out)) {
+        return APR_SUCCESS;
+    }
+
+    /* Same semantics as the mutex implementation: wait once, and if it's
+     * still empty then we were interrupted (or terminated).
+     */
+    {
+        apr_uint32_t key = ec_prepare_wait(&queue->not_empty);
+        if (!queue_pop(queue, sd, sd_baton, p, te_out)) {
+            if (!queue->terminated) {
+                ec_wait(&queue->not_empty, key);
+            }
+            ec_cancel_wait(&queue->not_empty);
+            if (!queue_pop(queue, sd, sd_baton, p, te_out)) {
+                return queue->terminated ? APR_EOF : APR_EINTR;
+            }
+            return APR_SUCCESS;
+        }
+        ec_cancel_wait(&queue->not_empty);
+    }
+
+    return APR_SUCCESS;
+}
+
+static apr_status_t queue_interrupt(fd_queue_t *queue, int all, int term)
+{
+    if (term) {
+        queue->terminated = 1;
+    }
+    ec_wakeup(&queue->not_empty, all);
+
+    return APR_SUCCESS;
+}
+
+#else /* AP_FDQUEUE_LOCKFREE */
+
+struct fd_queue_elem_t
+{
+    apr_socket_t *sd;
+    void *sd_baton;
+    apr_pool_t *p;
+};
+
+struct fd_queue_t
+{
+    APR_RING_HEAD(timers_t, timer_event_t) timers;
+    fd_queue_elem_t *data;
+    unsigned int nelts;
+    unsigned int bounds;
+    unsigned int in;
+    unsigned int out;
+    apr_thread_mutex_t *one_big_mutex;
+    apr_thread_cond_t *not_empty;
+    int terminated;
+};
+
 /**
  * Detects when the fd_queue_t is full. This utility function is expected
  * to be called from within critical sections, and is not threadsafe.
@@ -512,6 +980,8 @@ static apr_status_t queue_interrupt(fd_queue_t *queue, int all, int term)
     return apr_thread_mutex_unlock(queue->one_big_mutex);
 }
 
+#endif /* AP_FDQUEUE_LOCKFREE */
+
 apr_status_t ap_queue_interrupt_all(fd_queue_t *queue)
 {
     return queue_interrupt(queue, 1, 0);
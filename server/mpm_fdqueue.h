@@ -67,24 +67,17 @@ struct timer_event_t
     APR_RING_ENTRY(timer_event_t) link;
     apr_time_t when;
     ap_mpm_callback_fn_t *cbfunc;
+    ap_mpm_worker_callback_fn_t *wkfunc;
     void *baton;
     int canceled;
     apr_array_header_t *remove;
+    /* private to the MPM (e.g. event's timers wheel) */
+    struct timer_event_t *next;
+    int wheel_level;
 };
 typedef struct timer_event_t timer_event_t;
 
-struct fd_queue_t
-{
-    APR_RING_HEAD(timers_t, timer_event_t) timers;
-    fd_queue_elem_t *data;
-    unsigned int nelts;
-    unsigned int bounds;
-    unsigned int in;
-    unsigned int out;
-    apr_thread_mutex_t *one_big_mutex;
-    apr_thread_cond_t *not_empty;
-    int terminated;
-};
+struct fd_queue_t; /* opaque */
 typedef struct fd_queue_t fd_queue_t;
 
 AP_DECLARE(apr_status_t) ap_queue_create(fd_queue_t **pqueue,
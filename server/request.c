@@ -28,6 +28,10 @@
 #include "apr_strings.h"
 #include "apr_file_io.h"
 #include "apr_fnmatch.h"
+#include "apr_hash.h"
+#if APR_HAS_THREADS
+#include "apr_thread_rwlock.h"
+#endif
 
 #define APR_WANT_STRFUNC
 #include "apr_want.h"
@@ -41,6 +45,7 @@
 #include "http_protocol.h"
 #include "http_log.h"
 #include "http_main.h"
+#include "ap_mpm.h"
 #include "util_filter.h"
 #include "util_charset.h"
 #include "util_script.h"
@@ -454,6 +459,167 @@ static walk_cache_t *prep_walk_cache(apr_size_t t, request_rec *r)
     return cache;
 }
 
+/* The walk caches above only live as long as a request (and its subrequests
+ * and redirects), so each request merges again the sections it matches.
+ * Since the sections, and the results of their merges, are the same for all
+ * the requests matching them, the merges are also cached per child, keyed
+ * by the pair of configurations merged.
+ *
+ * Only the configurations living as long as the child are cached: those of
+ * the sections read at startup and the merged results, not the .htaccess
+ * ones (merged in the request pool as usual).  The cache lives in pchild,
+ * hence it is dropped with the configuration generation, and is bounded by
+ * WalkCacheSize (merges are no longer cached once it's full).
+ *
+ * The cached r->per_dir_config is thus shared by concurrent requests, the
+ * module configurations in there must be treated as read only.  It is
+ * always locked when threads are available, whatever the MPM, since
+ * modules like mod_http2 run requests on their own threads in prefork too.
+ */
+
+typedef struct walk_merge_t {
+    const ap_conf_vector_t *base;
+    const ap_conf_vector_t *add;
+    ap_conf_vector_t *merged;
+} walk_merge_t;
+
+static apr_pool_t *walk_merge_pool;
+static apr_hash_t *walk_merges;  /* (base, add) => walk_merge_t */
+static apr_hash_t *walk_stable;  /* configurations living as long as pchild */
+static int walk_merge_max;
+#if APR_HAS_THREADS
+static apr_thread_rwlock_t *walk_merge_lock;
+#endif
+
+#define WALK_MERGE_KEY_LEN (2 * sizeof(ap_conf_vector_t *))
+
+static void walk_stable_add_sections(apr_array_header_t *secs);
+
+static void walk_stable_add(ap_conf_vector_t *conf)
+{
+    ap_conf_vector_t **key;
+    core_dir_config *dconf;
+
+    if (!conf || apr_hash_get(walk_stable, &conf, sizeof(conf))) {
+        return;
+    }
+    key = apr_palloc(walk_merge_pool, sizeof(*key));
+    *key = conf;
+    apr_hash_set(walk_stable, key, sizeof(*key), conf);
+
+    /* The <Files > and <If > sections nested in this one */
+    dconf = ap_get_core_module_config(conf);
+    if (dconf) {
+        walk_stable_add_sections(dconf->sec_file);
+        walk_stable_add_sections(dconf->sec_if);
+    }
+}
+
+static void walk_stable_add_sections(apr_array_header_t *secs)
+{
+    int i;
+
+    if (secs) {
+        for (i = 0; i < secs->nelts; ++i) {
+            walk_stable_add(((ap_conf_vector_t **)secs->elts)[i]);
+        }
+    }
+}
+
+AP_DECLARE(void) ap_init_walk_cache(apr_pool_t *pchild, server_rec *s,
+                                    int size)
+{
+    walk_merges = NULL;
+    if (size <= 0) {
+        return;
+    }
+
+    apr_pool_create(&walk_merge_pool, pchild);
+    apr_pool_tag(walk_merge_pool, "walk_merge_cache");
+#if APR_HAS_THREADS
+    if (apr_thread_rwlock_create(&walk_merge_lock,
+                                 pchild) != APR_SUCCESS) {
+        ap_log_error(APLOG_MARK, APLOG_ERR, 0, s, APLOGNO(10283)
+                     "Could not create the walk cache lock, "
+                     "merged configurations won't be cached");
+        return;
+    }
+#endif
+    walk_merge_max = size;
+    walk_stable = apr_hash_make(walk_merge_pool);
+
+    for (; s; s = s->next) {
+        core_server_config *sconf =
+            ap_get_core_module_config(s->module_config);
+
+        walk_stable_add(s->lookup_defaults);
+        walk_stable_add_sections(sconf->sec_dir);
+        walk_stable_add_sections(sconf->sec_url);
+    }
+
+    walk_merges = apr_hash_make(walk_merge_pool);
+}
+
+#if APR_HAS_THREADS
+#define WALK_MERGE_RDLOCK() apr_thread_rwlock_rdlock(walk_merge_lock)
+#define WALK_MERGE_WRLOCK() apr_thread_rwlock_wrlock(walk_merge_lock)
+#define WALK_MERGE_UNLOCK() apr_thread_rwlock_unlock(walk_merge_lock)
+#else
+#define WALK_MERGE_RDLOCK() 0
+#define WALK_MERGE_WRLOCK() 0
+#define WALK_MERGE_UNLOCK() 0
+#endif
+
+/* ap_merge_per_dir_configs(), cached across requests when possible */
+static ap_conf_vector_t *walk_merge(request_rec *r, ap_conf_vector_t *base,
+                                    ap_conf_vector_t *add)
+{
+    walk_merge_t key, *entry;
+    int stable;
+
+    /* Internal requests rely on distinct merges for distinct URIs to run
+     * the access control hooks again, unless it's done per configuration.
+     */
+    if (!walk_merges
+        || (!auth_internal_per_conf && (r->main || r->prev))) {
+        return ap_merge_per_dir_configs(r->pool, base, add);
+    }
+
+    key.base = base;
+    key.add = add;
+    if (WALK_MERGE_RDLOCK() != APR_SUCCESS) {
+        return ap_merge_per_dir_configs(r->pool, base, add);
+    }
+    /* A hit is always safe, both keys living as long as the cache */
+    entry = apr_hash_get(walk_merges, &key, WALK_MERGE_KEY_LEN);
+    stable = (!entry
+              && apr_hash_count(walk_merges) < (unsigned int)walk_merge_max
+              && apr_hash_get(walk_stable, &base, sizeof(base))
+              && apr_hash_get(walk_stable, &add, sizeof(add)));
+    WALK_MERGE_UNLOCK();
+    if (entry) {
+        return entry->merged;
+    }
+    if (!stable || WALK_MERGE_WRLOCK() != APR_SUCCESS) {
+        return ap_merge_per_dir_configs(r->pool, base, add);
+    }
+
+    /* Another thread may have been faster */
+    entry = apr_hash_get(walk_merges, &key, WALK_MERGE_KEY_LEN);
+    if (!entry) {
+        entry = apr_palloc(walk_merge_pool, sizeof(*entry));
+        entry->base = base;
+        entry->add = add;
+        entry->merged = ap_merge_per_dir_configs(walk_merge_pool, base, add);
+        apr_hash_set(walk_merges, entry, WALK_MERGE_KEY_LEN, entry);
+        apr_hash_set(walk_stable, &entry->merged, sizeof(entry->merged),
+                     entry->merged);
+    }
+    WALK_MERGE_UNLOCK();
+
+    return entry->merged;
+}
+
 /*****************************************************************
  *
  * Getting and checking directory configuration.  Also checks the
@@ -1005,9 +1171,7 @@ AP_DECLARE(int) ap_directory_walk(request_rec *r)
                 }
 
                 if (now_merged) {
-                    now_merged = ap_merge_per_dir_configs(r->pool,
-                                                          now_merged,
-                                                          sec_ent[sec_idx]);
+                    now_merged = walk_merge(r, now_merged, sec_ent[sec_idx]);
                 }
                 else {
                     now_merged = sec_ent[sec_idx];
@@ -1075,9 +1239,7 @@ AP_DECLARE(int) ap_directory_walk(request_rec *r)
                 }
 
                 if (now_merged) {
-                    now_merged = ap_merge_per_dir_configs(r->pool,
-                                                          now_merged,
-                                                          htaccess_conf);
+                    now_merged = walk_merge(r, now_merged, htaccess_conf);
                 }
                 else {
                     now_merged = htaccess_conf;
@@ -1314,9 +1476,7 @@ AP_DECLARE(int) ap_directory_walk(request_rec *r)
             }
 
             if (now_merged) {
-                now_merged = ap_merge_per_dir_configs(r->pool,
-                                                      now_merged,
-                                                      sec_ent[sec_idx]);
+                now_merged = walk_merge(r, now_merged, sec_ent[sec_idx]);
             }
             else {
                 now_merged = sec_ent[sec_idx];
@@ -1393,9 +1553,7 @@ AP_DECLARE(int) ap_directory_walk(request_rec *r)
      * and note the end result to (potentially) skip this step next time.
      */
     if (now_merged) {
-        r->per_dir_config = ap_merge_per_dir_configs(r->pool,
-                                                     r->per_dir_config,
-                                                     now_merged);
+        r->per_dir_config = walk_merge(r, r->per_dir_config, now_merged);
     }
     cache->per_dir_result = r->per_dir_config;
 
@@ -1541,9 +1699,7 @@ AP_DECLARE(int) ap_location_walk(request_rec *r)
             }
 
             if (now_merged) {
-                now_merged = ap_merge_per_dir_configs(r->pool,
-                                                      now_merged,
-                                                      sec_ent[sec_idx]);
+                now_merged = walk_merge(r, now_merged, sec_ent[sec_idx]);
             }
             else {
                 now_merged = sec_ent[sec_idx];
@@ -1584,9 +1740,7 @@ AP_DECLARE(int) ap_location_walk(request_rec *r)
      * and note the end result to (potentially) skip this step next time.
      */
     if (now_merged) {
-        r->per_dir_config = ap_merge_per_dir_configs(r->pool,
-                                                     r->per_dir_config,
-                                                     now_merged);
+        r->per_dir_config = walk_merge(r, r->per_dir_config, now_merged);
     }
     cache->per_dir_result = r->per_dir_config;
 
@@ -1738,9 +1892,7 @@ AP_DECLARE(int) ap_file_walk(request_rec *r)
             }
 
             if (now_merged) {
-                now_merged = ap_merge_per_dir_configs(r->pool,
-                                                      now_merged,
-                                                      sec_ent[sec_idx]);
+                now_merged = walk_merge(r, now_merged, sec_ent[sec_idx]);
             }
             else {
                 now_merged = sec_ent[sec_idx];
@@ -1781,9 +1933,7 @@ AP_DECLARE(int) ap_file_walk(request_rec *r)
      * and note the end result to (potentially) skip this step next time.
      */
     if (now_merged) {
-        r->per_dir_config = ap_merge_per_dir_configs(r->pool,
-                                                     r->per_dir_config,
-                                                     now_merged);
+        r->per_dir_config = walk_merge(r, r->per_dir_config, now_merged);
     }
     cache->per_dir_result = r->per_dir_config;
 
@@ -1874,9 +2024,7 @@ static int ap_if_walk_sub(request_rec *r, core_dir_config* dconf)
         }
 
         if (now_merged) {
-            now_merged = ap_merge_per_dir_configs(r->pool,
-                                                  now_merged,
-                                                  sec_ent[sec_idx]);
+            now_merged = walk_merge(r, now_merged, sec_ent[sec_idx]);
         }
         else {
             now_merged = sec_ent[sec_idx];
@@ -1912,9 +2060,7 @@ static int ap_if_walk_sub(request_rec *r, core_dir_config* dconf)
      * and note the end result to (potentially) skip this step next time.
      */
     if (now_merged) {
-        r->per_dir_config = ap_merge_per_dir_configs(r->pool,
-                                                     r->per_dir_config,
-                                                     now_merged);
+        r->per_dir_config = walk_merge(r, r->per_dir_config, now_merged);
     }
     cache->per_dir_result = r->per_dir_config;
 
@@ -2256,6 +2256,59 @@ AP_DECLARE(apr_size_t) ap_escape_errorlog_item(char *dest, const char *source,
     return (d - (unsigned char *)dest);
 }
 
+AP_DECLARE(apr_size_t) ap_escape_logitem_buf(char *dest, const char *source,
+                                             apr_size_t buflen)
+{
+    unsigned char *d, *ep;
+    const unsigned char *s;
+
+    d = (unsigned char *)dest;
+    s = (const unsigned char *)source;
+    ep = d + buflen;
+
+    for (; *s; ++s) {
+        if (TEST_CHAR(*s, T_ESCAPE_LOGITEM)) {
+            /* Up to 4 bytes per escaped character (0 --> \x00) */
+            if (ep - d < 4) {
+                return (apr_size_t)-1;
+            }
+            *d++ = '\\';
+            switch(*s) {
+            case '\b':
+                *d++ = 'b';
+                break;
+            case '\n':
+                *d++ = 'n';
+                break;
+            case '\r':
+                *d++ = 'r';
+                break;
+            case '\t':
+                *d++ = 't';
+                break;
+            case '\v':
+                *d++ = 'v';
+                break;
+            case '\\':
+            case '"':
+                *d++ = *s;
+                break;
+            default:
+                c2x(*s, 'x', d);
+                d += 3;
+            }
+        }
+        else {
+            if (d >= ep) {
+                return (apr_size_t)-1;
+            }
+            *d++ = *s;
+        }
+    }
+
+    return (d - (unsigned char *)dest);
+}
+
 AP_DECLARE(void) ap_bin2hex(const void *src, apr_size_t srclen, char *dest)
 {
     const unsigned char *in = src;
@@ -77,6 +77,45 @@ POSSIBILITY OF SUCH DAMAGE.
 #define POSIX_MALLOC_THRESHOLD (10)
 #endif
 
+#ifdef HAVE_PCRE2
+/* Match data are reused by each thread, in size classes of
+ * POSIX_MALLOC_THRESHOLD << (2 * n) captures.
+ */
+#define MATCH_DATA_CLASSES 3
+
+/* The JIT stack of each thread */
+#ifndef AP_PCRE_JIT_STACK_MIN
+#define AP_PCRE_JIT_STACK_MIN (32 * 1024)
+#endif
+#ifndef AP_PCRE_JIT_STACK_MAX
+#define AP_PCRE_JIT_STACK_MAX (512 * 1024)
+#endif
+
+/* Don't keep match data whose backtracking frames grew above this */
+#ifndef AP_PCRE_HEAPFRAMES_MAX
+#define AP_PCRE_HEAPFRAMES_MAX (64 * 1024)
+#endif
+
+/* Thread local state freed on thread exit, with pthread keys or Windows
+ * fiber local storage (whose callback is also run when threads exit).
+ */
+#if APR_HAS_THREADS && APR_HAVE_PTHREAD_H
+#include <pthread.h>
+#define MATCH_STATE_PTHREAD 1
+#elif APR_HAS_THREADS && defined(WIN32)
+#define MATCH_STATE_FLS 1
+#elif !APR_HAS_THREADS
+#define MATCH_STATE_STATIC 1
+#endif
+
+typedef struct {
+    pcre2_match_data *match_data[MATCH_DATA_CLASSES];
+    pcre2_match_context *mcontext;
+    pcre2_jit_stack *jit_stack;
+    int initialized;
+} match_state_t;
+#endif /* HAVE_PCRE2 */
+
 /* Table of error strings corresponding to POSIX error codes; must be
  * kept in synch with include/ap_regex.h's AP_REG_E* definitions.
  */
@@ -185,6 +224,9 @@ AP_DECLARE(int) ap_regcomp_default_cflag_by_name(const char *name)
     else if (ap_cstr_casecmp(name, "EXTENDED") == 0) {
         cflag = AP_REG_EXTENDED;
     }
+    else if (ap_cstr_casecmp(name, "JIT") == 0) {
+        cflag = AP_REG_JIT;
+    }
 
     return cflag;
 }
@@ -212,6 +254,8 @@ AP_DECLARE(int) ap_regcomp(ap_regex_t * preg, const char *pattern, int cflags)
 
     if ((cflags & AP_REG_NO_DEFAULT) == 0)
         cflags |= default_cflags;
+    else
+        cflags |= default_cflags & AP_REG_JIT;
 
     if ((cflags & AP_REG_ICASE) != 0)
         options |= PCREn(CASELESS);
@@ -240,6 +284,10 @@ AP_DECLARE(int) ap_regcomp(ap_regex_t * preg, const char *pattern, int cflags)
     }
 
 #ifdef HAVE_PCRE2
+    /* Falls back to the interpreter if JIT is not available */
+    if ((cflags & AP_REG_JIT) != 0)
+        pcre2_jit_compile(preg->re_pcre, PCRE2_JIT_COMPLETE);
+
     pcre2_pattern_info((const pcre2_code *)preg->re_pcre,
                        PCRE2_INFO_CAPTURECOUNT, &capcount);
     preg->re_nsub = capcount;
@@ -257,12 +305,197 @@ AP_DECLARE(int) ap_regcomp(ap_regex_t * preg, const char *pattern, int cflags)
  *              Match a regular expression       *
  *************************************************/
 
+#ifdef HAVE_PCRE2
+
+#if defined(MATCH_STATE_PTHREAD) || defined(MATCH_STATE_FLS)
+
+static void match_state_free(match_state_t *state)
+{
+    int i;
+
+    for (i = 0; i < MATCH_DATA_CLASSES; i++) {
+        pcre2_match_data_free(state->match_data[i]);
+    }
+    pcre2_match_context_free(state->mcontext);
+    pcre2_jit_stack_free(state->jit_stack);
+    free(state);
+}
+
+#endif
+
+#if defined(MATCH_STATE_PTHREAD)
+
+static pthread_key_t match_state_key;
+static pthread_once_t match_state_once = PTHREAD_ONCE_INIT;
+static int match_state_key_created;
+
+/* Thread exit */
+static void match_state_destroy(void *data)
+{
+    match_state_free(data);
+}
+
+static void match_state_key_create(void)
+{
+    match_state_key_created =
+        (pthread_key_create(&match_state_key, match_state_destroy) == 0);
+}
+
+static match_state_t *match_state_get(void)
+{
+    match_state_t *state;
+
+    pthread_once(&match_state_once, match_state_key_create);
+    if (!match_state_key_created) {
+        return NULL;
+    }
+    state = pthread_getspecific(match_state_key);
+    if (state == NULL) {
+        state = calloc(1, sizeof(*state));
+        if (state && pthread_setspecific(match_state_key, state) != 0) {
+            free(state);
+            state = NULL;
+        }
+    }
+    return state;
+}
+
+#elif defined(MATCH_STATE_FLS)
+
+static INIT_ONCE match_state_once = INIT_ONCE_STATIC_INIT;
+static DWORD match_state_index = FLS_OUT_OF_INDEXES;
+
+/* Thread (or fiber) exit */
+static void NTAPI match_state_destroy(void *data)
+{
+    if (data) {
+        match_state_free(data);
+    }
+}
+
+static BOOL CALLBACK match_state_index_create(INIT_ONCE *once, void *param,
+                                              void **context)
+{
+    match_state_index = FlsAlloc(match_state_destroy);
+    return TRUE;
+}
+
+static match_state_t *match_state_get(void)
+{
+    match_state_t *state;
+
+    InitOnceExecuteOnce(&match_state_once, match_state_index_create,
+                        NULL, NULL);
+    if (match_state_index == FLS_OUT_OF_INDEXES) {
+        return NULL;
+    }
+    state = FlsGetValue(match_state_index);
+    if (state == NULL) {
+        state = calloc(1, sizeof(*state));
+        if (state && !FlsSetValue(match_state_index, state)) {
+            free(state);
+            state = NULL;
+        }
+    }
+    return state;
+}
+
+#elif defined(MATCH_STATE_STATIC)
+
+static match_state_t match_state;
+
+static match_state_t *match_state_get(void)
+{
+    return &match_state;
+}
+
+#else
+
+static match_state_t *match_state_get(void)
+{
+    return NULL;
+}
+
+#endif
+
+/* Get the match data (of at least nlim captures) and match context of the
+ * current thread. If no reusable match data is available, one is created
+ * which the caller must free (*reused = 0).
+ */
+static pcre2_match_data *match_data_get(apr_size_t *nlim, int *reused,
+                                        pcre2_match_context **mcontext)
+{
+    match_state_t *state = match_state_get();
+    apr_size_t size = POSIX_MALLOC_THRESHOLD;
+    int i;
+
+    *mcontext = NULL;
+    *reused = 0;
+    if (state == NULL) {
+        return pcre2_match_data_create(*nlim, NULL);
+    }
+
+    if (!state->initialized) {
+        state->initialized = 1;
+        state->mcontext = pcre2_match_context_create(NULL);
+        state->jit_stack = pcre2_jit_stack_create(AP_PCRE_JIT_STACK_MIN,
+                                                  AP_PCRE_JIT_STACK_MAX,
+                                                  NULL);
+        if (state->mcontext && state->jit_stack) {
+            pcre2_jit_stack_assign(state->mcontext, NULL, state->jit_stack);
+        }
+    }
+    *mcontext = state->mcontext;
+
+    for (i = 0; i < MATCH_DATA_CLASSES; i++, size <<= 2) {
+        if (*nlim <= size) {
+            if (state->match_data[i] == NULL) {
+                state->match_data[i] = pcre2_match_data_create(size, NULL);
+                if (state->match_data[i] == NULL) {
+                    break;
+                }
+            }
+            *nlim = size;
+            *reused = 1;
+            return state->match_data[i];
+        }
+    }
+
+    return pcre2_match_data_create(*nlim, NULL);
+}
+
+static void match_data_put(pcre2_match_data *matchdata, int reused)
+{
+    if (!reused) {
+        pcre2_match_data_free(matchdata);
+    }
+#if PCRE2_MAJOR > 10 || (PCRE2_MAJOR == 10 && PCRE2_MINOR >= 44)
+    else if (pcre2_get_match_data_heapframes_size(matchdata)
+                 > AP_PCRE_HEAPFRAMES_MAX) {
+        /* Don't hold on to the memory of a deep backtracking match */
+        match_state_t *state = match_state_get();
+        int i;
+
+        for (i = 0; i < MATCH_DATA_CLASSES; i++) {
+            if (state->match_data[i] == matchdata) {
+                state->match_data[i] = NULL;
+                break;
+            }
+        }
+        pcre2_match_data_free(matchdata);
+    }
+#endif
+}
+
+#endif /* HAVE_PCRE2 */
+
 /* Unfortunately, PCRE requires 3 ints of working space for each captured
  * substring, so we have to get and release working store instead of just using
  * the POSIX structures as was done in earlier releases when PCRE needed only 2
  * ints. However, if the number of possible capturing brackets is small, use a
  * block of store on the stack, to reduce the use of malloc/free. The threshold
  * is in a macro that can be changed at configure time.
+ * With PCRE2, the match data are reused by each thread instead.
  */
 AP_DECLARE(int) ap_regexec(const ap_regex_t *preg, const char *string,
                            apr_size_t nmatch, ap_regmatch_t *pmatch,
@@ -281,6 +514,8 @@ AP_DECLARE(int) ap_regexec_len(const ap_regex_t *preg, const char *buff,
     apr_size_t nlim;
 #ifdef HAVE_PCRE2
     pcre2_match_data *matchdata;
+    pcre2_match_context *mcontext;
+    int reused;
     size_t *ovector;
 #else
     int small_ovector[POSIX_MALLOC_THRESHOLD * 3];
@@ -298,19 +533,21 @@ AP_DECLARE(int) ap_regexec_len(const ap_regex_t *preg, const char *buff,
         options |= PCREn(ANCHORED);
 
 #ifdef HAVE_PCRE2
-    /* TODO: create a generic TLS matchdata buffer of some nmatch limit,
-     * e.g. 10 matches, to avoid a malloc-per-call. If it must be allocated,
-     * implement a general context using palloc and no free implementation.
-     */
     nlim = ((apr_size_t)preg->re_nsub + 1) > nmatch
          ? ((apr_size_t)preg->re_nsub + 1) : nmatch;
-    matchdata = pcre2_match_data_create(nlim, NULL);
+    matchdata = match_data_get(&nlim, &reused, &mcontext);
     if (matchdata == NULL)
         return AP_REG_ESPACE;
     ovector = pcre2_get_ovector_pointer(matchdata);
     rc = pcre2_match((const pcre2_code *)preg->re_pcre,
                      (const unsigned char *)buff, len,
-                     0, options, matchdata, NULL);
+                     0, options, matchdata, mcontext);
+    if (rc == PCRE2_ERROR_JIT_STACKLIMIT) {
+        /* Retry with the interpreter, limited by the heap instead */
+        rc = pcre2_match((const pcre2_code *)preg->re_pcre,
+                         (const unsigned char *)buff, len,
+                         0, options | PCRE2_NO_JIT, matchdata, mcontext);
+    }
     if (rc == 0)
         rc = nlim;            /* All captured slots were filled in */
 #else
@@ -343,7 +580,7 @@ AP_DECLARE(int) ap_regexec_len(const ap_regex_t *preg, const char *buff,
     }
 
 #ifdef HAVE_PCRE2
-    pcre2_match_data_free(matchdata);
+    match_data_put(matchdata, reused);
 #else
     if (allocated_ovector)
         free(ovector);
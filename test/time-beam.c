@@ -0,0 +1,338 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+time-beam: measure the throughput of a stream's response through the
+h2_bucket_beam of modules/http2/h2_bucket_beam.c, and the latency of its
+frames.
+
+usage: time-beam [-s megabytes] [-b block] [-m buffer] [-f] [-t tmpdir]
+
+A sender thread, like a h2 worker, writes the response in heap buckets
+of the given block size (8192 bytes by default) to a beam limited to
+the given buffer size (32KB by default, like H2StreamMaxMemSize).  The
+main thread, like the master connection, receives at most a DATA frame
+(16KB) at a time, reads and destroys the buckets.  Each block carries
+the time it was sent, the average and maximum latencies until it is
+received are printed.
+
+With -f the response is a file in tmpdir instead, sent as a single file
+bucket which is handed over to the receiver.
+
+compile from the top of an httpd tree with:
+
+gcc -O2 -o time-beam test/time-beam.c modules/http2/h2_bucket_beam.c \
+    -Iinclude -Ios/unix -Imodules/http2 \
+    `apr-1-config --cflags --cppflags --includes --link-ld` \
+    `apu-1-config --includes --link-ld` -lnghttp2
+*/
+
+#include "apr.h"
+#include "apr_buckets.h"
+#include "apr_file_io.h"
+#include "apr_general.h"
+#include "apr_pools.h"
+#include "apr_strings.h"
+#include "apr_thread_proc.h"
+#include "apr_time.h"
+
+#include "httpd.h"
+#include "http_config.h"
+#include "http_log.h"
+#include "http_protocol.h"
+
+#include "h2_bucket_beam.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define FRAME_SIZE (16 * 1024)
+
+/* What h2_bucket_beam.c uses from libhttpd */
+module AP_MODULE_DECLARE_DATA http2_module;
+
+const apr_bucket_type_t ap_bucket_type_error = {
+    "ERROR", 5, APR_BUCKET_METADATA,
+    apr_bucket_destroy_noop,
+    NULL,
+    apr_bucket_setaside_notimpl,
+    apr_bucket_split_notimpl,
+    apr_bucket_simple_copy
+};
+
+apr_bucket *ap_bucket_error_create(int error, const char *buf,
+                                   apr_pool_t *p, apr_bucket_alloc_t *list)
+{
+    return NULL;
+}
+
+void ap_log_perror_(const char *file, int line, int module_index,
+                    int level, apr_status_t status, apr_pool_t *p,
+                    const char *fmt, ...)
+{
+    va_list ap;
+
+    va_start(ap, fmt);
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+    fputc('\n', stderr);
+}
+
+void ap_log_cerror_(const char *file, int line, int module_index,
+                    int level, apr_status_t status, const conn_rec *c,
+                    const char *fmt, ...)
+{
+    va_list ap;
+
+    va_start(ap, fmt);
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+    fputc('\n', stderr);
+}
+
+void ap_log_assert(const char *szExp, const char *szFile, int nLine)
+{
+    fprintf(stderr, "assertion \"%s\" failed at %s line %d\n",
+            szExp, szFile, nLine);
+    abort();
+}
+
+typedef struct {
+    h2_bucket_beam *beam;
+    apr_pool_t *pool;
+    apr_bucket_alloc_t *ba;
+    apr_size_t size;
+    apr_size_t block;
+    apr_file_t *file;
+    apr_status_t rv;
+} sender;
+
+static void fill_random(char *buf, apr_size_t len)
+{
+    apr_uint64_t x = 88172645463325252ULL;
+    apr_size_t i;
+
+    for (i = 0; i < len; ++i) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        buf[i] = (char)(x >> 32);
+    }
+}
+
+static void * APR_THREAD_FUNC send_run(apr_thread_t *thd, void *baton)
+{
+    sender *snd = baton;
+    apr_bucket_brigade *bb = apr_brigade_create(snd->pool, snd->ba);
+    char *buf = apr_palloc(snd->pool, snd->block);
+    apr_size_t off;
+    apr_status_t rv = APR_SUCCESS;
+
+    fill_random(buf, snd->block);
+    if (snd->file) {
+        apr_brigade_insert_file(bb, snd->file, 0, snd->size, snd->pool);
+    }
+    else {
+        for (off = 0; off < snd->size && rv == APR_SUCCESS;
+             off += snd->block) {
+            apr_size_t len = snd->size - off;
+            apr_time_t now = apr_time_now();
+
+            if (len > snd->block) {
+                len = snd->block;
+            }
+            if (len >= sizeof(now)) {
+                memcpy(buf, &now, sizeof(now));
+            }
+            /* copies the data, like a handler's write */
+            APR_BRIGADE_INSERT_TAIL(bb,
+                apr_bucket_heap_create(buf, len, NULL, snd->ba));
+            rv = h2_beam_send(snd->beam, bb, APR_BLOCK_READ);
+        }
+    }
+    if (rv == APR_SUCCESS) {
+        APR_BRIGADE_INSERT_TAIL(bb, apr_bucket_eos_create(snd->ba));
+        rv = h2_beam_send(snd->beam, bb, APR_BLOCK_READ);
+    }
+    if (rv == APR_SUCCESS) {
+        rv = h2_beam_wait_empty(snd->beam, APR_BLOCK_READ);
+    }
+    snd->rv = rv;
+    apr_thread_exit(thd, rv);
+    return NULL;
+}
+
+static apr_file_t *make_file(apr_pool_t *pool, const char *tmpdir,
+                             apr_size_t size)
+{
+    apr_file_t *file;
+    char *name = apr_pstrcat(pool, tmpdir, "/time-beam.XXXXXX", NULL);
+    char *buf = apr_palloc(pool, 1024 * 1024);
+    apr_size_t off, len;
+
+    if (apr_file_mktemp(&file, name, APR_FOPEN_CREATE | APR_FOPEN_READ
+                        | APR_FOPEN_WRITE | APR_FOPEN_EXCL
+                        | APR_FOPEN_DELONCLOSE, pool) != APR_SUCCESS) {
+        fprintf(stderr, "can't create a file in %s\n", tmpdir);
+        exit(1);
+    }
+    fill_random(buf, 1024 * 1024);
+    for (off = 0; off < size; off += len) {
+        len = size - off < 1024 * 1024 ? size - off : 1024 * 1024;
+        apr_file_write_full(file, buf, len, NULL);
+    }
+    return file;
+}
+
+int main(int argc, const char * const argv[])
+{
+    apr_pool_t *pool, *send_pool, *recv_pool;
+    apr_bucket_alloc_t *recv_ba;
+    apr_bucket_brigade *bb;
+    apr_thread_t *thd;
+    apr_status_t rv, trv;
+    apr_time_t start, elapsed, lat_sum = 0, lat_max = 0;
+    apr_size_t size = 256, block = 8192, buffer = 32 * 1024;
+    apr_size_t received = 0, frames = 0, samples = 0;
+    const char *tmpdir = "/tmp";
+    sender snd;
+    int i, use_file = 0, eos = 0;
+    double secs;
+
+    for (i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "-s") && i + 1 < argc) {
+            size = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-b") && i + 1 < argc) {
+            block = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-m") && i + 1 < argc) {
+            buffer = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-f")) {
+            use_file = 1;
+        }
+        else if (!strcmp(argv[i], "-t") && i + 1 < argc) {
+            tmpdir = argv[++i];
+        }
+        else {
+            fprintf(stderr, "usage: %s [-s megabytes] [-b block] "
+                    "[-m buffer] [-f] [-t tmpdir]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (!size || block < sizeof(apr_time_t) || !buffer) {
+        fprintf(stderr, "%s: invalid argument\n", argv[0]);
+        return 1;
+    }
+    size *= 1024 * 1024;
+
+    apr_app_initialize(&argc, &argv, NULL);
+    apr_pool_create(&pool, NULL);
+    apr_pool_create(&send_pool, pool);
+    apr_pool_create(&recv_pool, pool);
+    recv_ba = apr_bucket_alloc_create(recv_pool);
+    bb = apr_brigade_create(recv_pool, recv_ba);
+
+    memset(&snd, 0, sizeof(snd));
+    snd.pool = send_pool;
+    snd.ba = apr_bucket_alloc_create(send_pool);
+    snd.size = size;
+    snd.block = block;
+    if (use_file) {
+        snd.file = make_file(send_pool, tmpdir, size);
+    }
+    rv = h2_beam_create(&snd.beam, send_pool, 1, "output",
+                        H2_BEAM_OWNER_SEND, buffer, 0);
+    if (rv != APR_SUCCESS) {
+        fprintf(stderr, "can't create the beam (%d)\n", rv);
+        return 1;
+    }
+    h2_beam_send_from(snd.beam, send_pool);
+
+    printf("%d MB %s, %d bytes blocks, %d bytes buffer\n",
+           (int)(size / (1024 * 1024)), use_file ? "file" : "heap",
+           (int)block, (int)buffer);
+
+    start = apr_time_now();
+    apr_thread_create(&thd, NULL, send_run, &snd, pool);
+
+    while (!eos) {
+        apr_bucket *b;
+
+        rv = h2_beam_receive(snd.beam, bb, APR_BLOCK_READ, FRAME_SIZE);
+        if (rv != APR_SUCCESS) {
+            break;
+        }
+        ++frames;
+        while (!APR_BRIGADE_EMPTY(bb)) {
+            const char *data;
+            apr_size_t len, off;
+
+            b = APR_BRIGADE_FIRST(bb);
+            if (APR_BUCKET_IS_EOS(b)) {
+                eos = 1;
+            }
+            else if (!APR_BUCKET_IS_METADATA(b)) {
+                rv = apr_bucket_read(b, &data, &len, APR_BLOCK_READ);
+                if (rv != APR_SUCCESS) {
+                    break;
+                }
+                if (!use_file) {
+                    apr_time_t now = apr_time_now();
+
+                    for (off = (block - received % block) % block;
+                         off + sizeof(apr_time_t) <= len; off += block) {
+                        apr_time_t sent;
+
+                        memcpy(&sent, data + off, sizeof(sent));
+                        if (now - sent > lat_max) {
+                            lat_max = now - sent;
+                        }
+                        lat_sum += now - sent;
+                        ++samples;
+                    }
+                }
+                received += len;
+            }
+            apr_bucket_delete(b);
+        }
+    }
+    elapsed = apr_time_now() - start;
+    apr_brigade_cleanup(bb);
+    apr_thread_join(&trv, thd);
+
+    if (rv != APR_SUCCESS || trv != APR_SUCCESS || received != size) {
+        printf("transfer failed (%d/%d), got %ld of %ld bytes\n",
+               rv, trv, (long)received, (long)size);
+        return 1;
+    }
+    secs = (double)(elapsed ? elapsed : 1) / APR_USEC_PER_SEC;
+    printf("%-12s %8.3fs, %10.1f MB/s, %ld frames\n", "throughput", secs,
+           (double)size / (1024 * 1024) / secs, (long)frames);
+    if (samples) {
+        printf("%-12s %8.1fus avg, %8.1fus max\n", "latency",
+               (double)lat_sum / samples, (double)lat_max);
+    }
+
+    apr_pool_destroy(recv_pool);
+    apr_pool_destroy(send_pool);
+    apr_pool_destroy(pool);
+    apr_terminate();
+    return 0;
+}
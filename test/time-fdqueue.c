@@ -0,0 +1,224 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+time-fdqueue: measure the push/pop throughput of the MPMs' fd queue
+(server/mpm_fdqueue.c), using the same protocol as the event and worker
+MPMs: workers mark themselves idle with ap_queue_info_set_idle() and then
+pop the queue, while the "listener" threads reserve an idle worker with
+ap_queue_info_wait_for_idler() before each push.
+
+usage: time-fdqueue [-p producers] [-n pushes] [threads ...]
+
+where threads is the number of workers (popping threads) for each run,
+8 16 32 64 by default, and pushes is the total number of sockets pushed
+per run (1000000 by default) by the producers (1 by default, like the
+MPMs' listener).  More than one producer is only supported by the lock-free
+implementation, the mutex one assumes a single thread waiting for idlers.
+
+compile from the top of a configured httpd tree with (the second one for
+the lock-free implementation):
+
+gcc -O2 -o time-fdqueue test/time-fdqueue.c server/mpm_fdqueue.c \
+    -Iinclude -Ios/unix -Iserver `apr-1-config --cflags --cppflags \
+    --includes --link-ld`
+gcc -O2 -o time-fdqueue-lockfree test/time-fdqueue.c server/mpm_fdqueue.c \
+    -DAP_FDQUEUE_LOCKFREE=1 -Iinclude -Ios/unix -Iserver \
+    `apr-1-config --cflags --cppflags --includes --link-ld`
+*/
+
+#include "apr.h"
+#include "apr_general.h"
+#include "apr_atomic.h"
+#include "apr_thread_proc.h"
+#include "apr_time.h"
+
+#include "mpm_fdqueue.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static fd_queue_t *queue;
+static fd_queue_info_t *queue_info;
+static apr_uint32_t volatile popped;
+static int pushes_per_producer;
+
+static void * APR_THREAD_FUNC consumer(apr_thread_t *thd, void *data)
+{
+    apr_socket_t *sd;
+    apr_pool_t *p;
+    apr_status_t rv;
+
+    for (;;) {
+        rv = ap_queue_info_set_idle(queue_info, NULL);
+        if (rv != APR_SUCCESS) {
+            break;
+        }
+        do {
+            rv = ap_queue_pop_something(queue, &sd, NULL, &p, NULL);
+        } while (APR_STATUS_IS_EINTR(rv));
+        if (rv != APR_SUCCESS) {
+            break;
+        }
+        apr_atomic_inc32(&popped);
+    }
+
+    apr_thread_exit(thd, APR_SUCCESS);
+    return NULL;
+}
+
+static void * APR_THREAD_FUNC producer(apr_thread_t *thd, void *data)
+{
+    apr_socket_t *sd = data;
+    apr_status_t rv;
+    int i;
+
+    for (i = 0; i < pushes_per_producer; ++i) {
+        rv = ap_queue_info_wait_for_idler(queue_info, NULL);
+        if (rv != APR_SUCCESS) {
+            break;
+        }
+        rv = ap_queue_push_socket(queue, sd, NULL, NULL);
+        if (rv != APR_SUCCESS) {
+            fprintf(stderr, "ap_queue_push_socket failed (%d)\n", rv);
+            exit(1);
+        }
+    }
+
+    apr_thread_exit(thd, APR_SUCCESS);
+    return NULL;
+}
+
+static void run(apr_pool_t *pool, int nthreads, int nproducers)
+{
+    apr_thread_t **consumers, **producers;
+    apr_pool_t *p;
+    apr_status_t rv, thread_rv;
+    apr_time_t start, elapsed;
+    int i;
+
+    apr_pool_create(&p, pool);
+
+    rv = ap_queue_create(&queue, nthreads, p);
+    if (rv == APR_SUCCESS) {
+        rv = ap_queue_info_create(&queue_info, p, nthreads, -1);
+    }
+    if (rv != APR_SUCCESS) {
+        fprintf(stderr, "can't create the queue (%d)\n", rv);
+        exit(1);
+    }
+    popped = 0;
+
+    consumers = apr_pcalloc(p, nthreads * sizeof(apr_thread_t *));
+    producers = apr_pcalloc(p, nproducers * sizeof(apr_thread_t *));
+
+    for (i = 0; i < nthreads; ++i) {
+        apr_thread_create(&consumers[i], NULL, consumer, NULL, p);
+    }
+    /* let the workers get idle */
+    while (ap_queue_info_num_idlers(queue_info) < (apr_uint32_t)nthreads) {
+        apr_sleep(apr_time_from_msec(1));
+    }
+
+    start = apr_time_now();
+    for (i = 0; i < nproducers; ++i) {
+        /* any non-NULL socket will do */
+        apr_thread_create(&producers[i], NULL, producer, (void *)&queue, p);
+    }
+    for (i = 0; i < nproducers; ++i) {
+        apr_thread_join(&thread_rv, producers[i]);
+    }
+    while (apr_atomic_read32(&popped)
+           < (apr_uint32_t)(pushes_per_producer * nproducers)) {
+        apr_thread_yield();
+    }
+    elapsed = apr_time_now() - start;
+
+    ap_queue_term(queue);
+    ap_queue_info_term(queue_info);
+    for (i = 0; i < nthreads; ++i) {
+        apr_thread_join(&thread_rv, consumers[i]);
+    }
+
+    printf("%3d workers, %2d producers: %8d pushes in %7.3fs, "
+           "%10.0f ops/s\n", nthreads, nproducers,
+           pushes_per_producer * nproducers,
+           (double)elapsed / APR_USEC_PER_SEC,
+           (double)pushes_per_producer * nproducers * APR_USEC_PER_SEC
+           / (elapsed ? elapsed : 1));
+
+    apr_pool_destroy(p);
+}
+
+int main(int argc, const char * const argv[])
+{
+    static const int default_threads[] = { 8, 16, 32, 64 };
+    apr_pool_t *pool;
+    int nproducers = 1, npushes = 1000000;
+    int i, first;
+
+    for (i = 1; i < argc && argv[i][0] == '-'; ++i) {
+        if (!strcmp(argv[i], "-p") && i + 1 < argc) {
+            nproducers = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-n") && i + 1 < argc) {
+            npushes = atoi(argv[++i]);
+        }
+        else {
+            fprintf(stderr, "usage: %s [-p producers] [-n pushes] "
+                    "[threads ...]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (nproducers < 1 || npushes < nproducers) {
+        fprintf(stderr, "invalid number of producers or pushes\n");
+        return 1;
+    }
+#if !AP_FDQUEUE_LOCKFREE
+    if (nproducers > 1) {
+        fprintf(stderr, "the mutex implementation supports one producer\n");
+        return 1;
+    }
+#endif
+    pushes_per_producer = npushes / nproducers;
+    first = i;
+
+    apr_app_initialize(&argc, &argv, NULL);
+    apr_pool_create(&pool, NULL);
+
+    printf("fd queue implementation: %s\n",
+#if AP_FDQUEUE_LOCKFREE
+           "lock-free"
+#else
+           "mutex"
+#endif
+           );
+
+    if (first < argc) {
+        for (i = first; i < argc; ++i) {
+            run(pool, atoi(argv[i]), nproducers);
+        }
+    }
+    else {
+        for (i = 0; i < sizeof(default_threads) / sizeof(int); ++i) {
+            run(pool, default_threads[i], nproducers);
+        }
+    }
+
+    apr_terminate();
+    return 0;
+}
@@ -0,0 +1,286 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+time-log-json: compare the cost of formatting mod_log_json's default line
+(the fields of LogJSONFields' default) with a jansson object tree dumped
+into a brigade, as mod_log_json used to, and with the streaming writer of
+modules/loggers/log_json_writer.c into a stack buffer.
+
+usage: time-log-json [-n lines] [-u user-agent]
+
+Each line is formatted in a pool cleared after every line, like the
+request pool.  The output of both is printed once for comparison.
+
+compile from the top of a configured httpd tree with:
+
+gcc -O2 -o time-log-json test/time-log-json.c \
+    modules/loggers/log_json_writer.c -Imodules/loggers \
+    `apr-1-config --cflags --cppflags --includes --link-ld` \
+    `apu-1-config --includes --link-ld` -ljansson
+
+or add -DNO_JANSSON (and drop apu-1-config and -ljansson) to time the
+streaming writer only.
+*/
+
+#include "apr.h"
+#include "apr_general.h"
+#include "apr_pools.h"
+#include "apr_strings.h"
+#include "apr_time.h"
+
+#include "log_json_writer.h"
+
+#ifndef NO_JANSSON
+#include "apr_buckets.h"
+#include <jansson.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    const char *log_id;
+    const char *vhost;
+    int status;
+    const char *proto;
+    const char *method;
+    const char *uri;
+    const char *srcip;
+    apr_off_t bytes_sent;
+    const char *user;
+    const char *user_agent;
+    const char *tls_v;
+    const char *tls_cipher;
+    const char *tls_client_verify;
+    const char *tls_sni;
+} log_record;
+
+#ifndef NO_JANSSON
+static int dump_bb(const char *buffer, size_t size, void *baton)
+{
+    apr_bucket_brigade *bb = baton;
+    apr_brigade_write(bb, NULL, NULL, buffer, size);
+    return 0;
+}
+
+static const char *format_jansson(const log_record *rec, apr_pool_t *p,
+                                  apr_bucket_alloc_t *ba)
+{
+    apr_bucket_brigade *bb;
+    apr_size_t olen;
+    char *out;
+    json_t *obj, *hdrs, *tls;
+
+    obj = json_object();
+    json_object_set_new_nocheck(obj, "log_id",
+        rec->log_id != NULL ? json_string(rec->log_id) : json_null());
+    json_object_set_new_nocheck(obj, "vhost", json_string(rec->vhost));
+    json_object_set_new_nocheck(obj, "status",
+        json_string(apr_itoa(p, rec->status)));
+    json_object_set_new_nocheck(obj, "proto", json_string(rec->proto));
+    json_object_set_new_nocheck(obj, "method", json_string(rec->method));
+    json_object_set_new_nocheck(obj, "uri", json_string(rec->uri));
+    json_object_set_new_nocheck(obj, "srcip", json_string(rec->srcip));
+    json_object_set_new_nocheck(obj, "bytes_sent",
+        json_integer(rec->bytes_sent));
+    if (rec->user != NULL) {
+        json_object_set_new_nocheck(obj, "user", json_string(rec->user));
+    }
+    hdrs = json_object();
+    json_object_set_new_nocheck(hdrs, "user-agent",
+        json_string(rec->user_agent));
+    json_object_set_new_nocheck(obj, "hdrs", hdrs);
+    tls = json_object();
+    json_object_set_new_nocheck(tls, "v", json_string(rec->tls_v));
+    json_object_set_new_nocheck(tls, "cipher", json_string(rec->tls_cipher));
+    json_object_set_new_nocheck(tls, "client_verify",
+        json_string(rec->tls_client_verify));
+    json_object_set_new_nocheck(tls, "sni", json_string(rec->tls_sni));
+    json_object_set_new_nocheck(obj, "tls", tls);
+
+    bb = apr_brigade_create(p, ba);
+    json_dump_callback(obj, dump_bb, bb, JSON_ENSURE_ASCII | JSON_COMPACT);
+    json_decref(obj);
+    apr_brigade_pflatten(bb, &out, &olen, p);
+    apr_brigade_destroy(bb);
+    return out;
+}
+#endif
+
+#define KEY(b, k) log_json_add_raw(b, "\"" k "\":", sizeof(k) + 2)
+
+static void add_str(log_json_buf *b, const char *s)
+{
+    log_json_add_string(b, s, strlen(s));
+}
+
+static const char *format_stream(const log_record *rec, apr_pool_t *p)
+{
+    char mem[8192];
+    log_json_buf b;
+
+    log_json_buf_init(&b, mem, sizeof(mem), p);
+    log_json_add_raw(&b, "{", 1);
+    KEY(&b, "log_id");
+    add_str(&b, rec->log_id);
+    log_json_add_raw(&b, ",", 1);
+    KEY(&b, "vhost");
+    add_str(&b, rec->vhost);
+    log_json_add_raw(&b, ",", 1);
+    KEY(&b, "status");
+    log_json_add_raw(&b, "\"", 1);
+    log_json_add_int(&b, rec->status);
+    log_json_add_raw(&b, "\",", 2);
+    KEY(&b, "proto");
+    add_str(&b, rec->proto);
+    log_json_add_raw(&b, ",", 1);
+    KEY(&b, "method");
+    add_str(&b, rec->method);
+    log_json_add_raw(&b, ",", 1);
+    KEY(&b, "uri");
+    add_str(&b, rec->uri);
+    log_json_add_raw(&b, ",", 1);
+    KEY(&b, "srcip");
+    add_str(&b, rec->srcip);
+    log_json_add_raw(&b, ",", 1);
+    KEY(&b, "bytes_sent");
+    log_json_add_int(&b, rec->bytes_sent);
+    if (rec->user) {
+        log_json_add_raw(&b, ",", 1);
+        KEY(&b, "user");
+        add_str(&b, rec->user);
+    }
+    log_json_add_raw(&b, ",", 1);
+    KEY(&b, "hdrs");
+    log_json_add_raw(&b, "{", 1);
+    KEY(&b, "user-agent");
+    add_str(&b, rec->user_agent);
+    log_json_add_raw(&b, "},", 2);
+    KEY(&b, "tls");
+    log_json_add_raw(&b, "{", 1);
+    KEY(&b, "v");
+    add_str(&b, rec->tls_v);
+    log_json_add_raw(&b, ",", 1);
+    KEY(&b, "cipher");
+    add_str(&b, rec->tls_cipher);
+    log_json_add_raw(&b, ",", 1);
+    KEY(&b, "client_verify");
+    add_str(&b, rec->tls_client_verify);
+    log_json_add_raw(&b, ",", 1);
+    KEY(&b, "sni");
+    add_str(&b, rec->tls_sni);
+    log_json_add_raw(&b, "}}", 2);
+
+    return apr_pstrmemdup(p, b.data, b.len);
+}
+
+typedef const char *format_fn(const log_record *rec, apr_pool_t *p,
+                              void *baton);
+
+static const char *stream_fn(const log_record *rec, apr_pool_t *p,
+                             void *baton)
+{
+    return format_stream(rec, p);
+}
+
+#ifndef NO_JANSSON
+static const char *jansson_fn(const log_record *rec, apr_pool_t *p,
+                              void *baton)
+{
+    return format_jansson(rec, p, baton);
+}
+#endif
+
+static void run(const char *name, format_fn *fn, void *baton,
+                const log_record *rec, apr_pool_t *pool, int n)
+{
+    apr_pool_t *p;
+    apr_time_t start, elapsed;
+    apr_size_t total = 0;
+    int i;
+
+    apr_pool_create(&p, pool);
+    printf("%s: %s\n", name, fn(rec, p, baton));
+    apr_pool_clear(p);
+
+    start = apr_time_now();
+    for (i = 0; i < n; ++i) {
+        total += strlen(fn(rec, p, baton));
+        apr_pool_clear(p);
+    }
+    elapsed = apr_time_now() - start;
+
+    printf("%-8s %8d lines (%" APR_SIZE_T_FMT " bytes) in %7.3fs, "
+           "%10.0f lines/s\n\n", name, n, total,
+           (double)elapsed / APR_USEC_PER_SEC,
+           (double)n * APR_USEC_PER_SEC / (elapsed ? elapsed : 1));
+    apr_pool_destroy(p);
+}
+
+int main(int argc, const char * const argv[])
+{
+    apr_pool_t *pool;
+    log_record rec;
+    int i, n = 1000000;
+
+    memset(&rec, 0, sizeof(rec));
+    rec.log_id = "YJ2wYX8AAQEAAAABgOYAAAAA";
+    rec.vhost = "www.example.com";
+    rec.status = 200;
+    rec.proto = "HTTP/1.1";
+    rec.method = "GET";
+    rec.uri = "/static/images/2020/04/some-picture-name.jpg";
+    rec.srcip = "192.0.2.123";
+    rec.bytes_sent = 123456;
+    rec.user = "jdoe";
+    rec.user_agent = "Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 "
+                     "(KHTML, like Gecko) Chrome/81.0.4044.122 "
+                     "Safari/537.36";
+    rec.tls_v = "TLSv1.3";
+    rec.tls_cipher = "TLS_AES_256_GCM_SHA384";
+    rec.tls_client_verify = "NONE";
+    rec.tls_sni = "www.example.com";
+
+    for (i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "-n") && i + 1 < argc) {
+            n = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-u") && i + 1 < argc) {
+            rec.user_agent = argv[++i];
+        }
+        else {
+            fprintf(stderr, "usage: %s [-n lines] [-u user-agent]\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+
+    apr_app_initialize(&argc, &argv, NULL);
+    apr_pool_create(&pool, NULL);
+
+#ifndef NO_JANSSON
+    {
+        apr_bucket_alloc_t *ba = apr_bucket_alloc_create(pool);
+        run("jansson", jansson_fn, ba, &rec, pool, n);
+    }
+#endif
+    run("stream", stream_fn, NULL, &rec, pool, n);
+
+    apr_terminate();
+    return 0;
+}
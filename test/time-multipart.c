@@ -0,0 +1,256 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+time-multipart: measure the throughput of the multipart/form-data parser
+of server/apreq_parser_multipart.c on a binary file upload.
+
+usage: time-multipart [-s megabytes] [-n rounds] [-b block] [-t tmpdir]
+
+First the boundary scan alone, over the (random) upload data: with
+memchr() and memcmp() like apreq_index() did, with apr_strmatch()
+(Boyer-Moore-Horspool) like split_on_bdry() did for the long buckets,
+and with the current apreq_index().  Then the whole body is parsed, fed
+to apreq_parse_multipart() in transient buckets of the given block size
+(8000 bytes by default, like the core input filter), with the default
+brigade limit so the upload gets spooled to a file in tmpdir.
+
+compile from the top of an httpd tree with:
+
+gcc -O2 -o time-multipart test/time-multipart.c \
+    server/apreq_parser.c server/apreq_parser_header.c \
+    server/apreq_parser_multipart.c server/apreq_parser_urlencoded.c \
+    server/apreq_param.c server/apreq_util.c server/apreq_error.c \
+    server/apreq_cookie.c -Iinclude -Ios/unix \
+    `apr-1-config --cflags --cppflags --includes --link-ld` \
+    `apu-1-config --includes --link-ld`
+
+and add -mavx2 (or -march=native) for the AVX2 scanner.
+*/
+
+#include "apr.h"
+#include "apr_general.h"
+#include "apr_pools.h"
+#include "apr_strings.h"
+#include "apr_strmatch.h"
+#include "apr_tables.h"
+#include "apr_time.h"
+
+#include "apreq_parser.h"
+#include "apreq_param.h"
+#include "apreq_util.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BOUNDARY "----WebKitFormBoundary7MA4YWxkTrZu0gW"
+
+static const char head[] =
+    "--" BOUNDARY "\r\n"
+    "Content-Disposition: form-data; name=\"title\"\r\n"
+    "\r\n"
+    "Holiday video\r\n"
+    "--" BOUNDARY "\r\n"
+    "Content-Disposition: form-data; name=\"file\"; filename=\"video.mp4\"\r\n"
+    "Content-Type: video/mp4\r\n"
+    "\r\n";
+
+static const char tail[] = "\r\n--" BOUNDARY "--\r\n";
+
+/* apreq_index() as it was */
+static apr_ssize_t index_memchr(const char *hay, apr_size_t hlen,
+                                const char *ndl, apr_size_t nlen)
+{
+    apr_size_t len = hlen;
+    const char *end = hay + hlen;
+    const char *begin = hay;
+
+    while ((hay = memchr(hay, ndl[0], len))) {
+        len = end - hay;
+        if (memcmp(hay, ndl, nlen < len ? nlen : len) == 0) {
+            break;
+        }
+        --len;
+        ++hay;
+    }
+    return hay ? hay - begin : -1;
+}
+
+static void fill_random(char *buf, apr_size_t len)
+{
+    apr_uint64_t x = 88172645463325252ULL;
+    apr_size_t i;
+
+    for (i = 0; i < len; ++i) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        buf[i] = (char)(x >> 32);
+    }
+}
+
+static void report(const char *name, apr_size_t bytes, int rounds,
+                   apr_time_t elapsed)
+{
+    double secs = (double)(elapsed ? elapsed : 1) / APR_USEC_PER_SEC;
+
+    printf("%-12s %8.3fs, %10.1f MB/s\n", name, secs,
+           (double)bytes * rounds / (1024 * 1024) / secs);
+}
+
+static void time_scan(apr_pool_t *pool, const char *data, apr_size_t len,
+                      int rounds)
+{
+    const char *bdry = "\r\n--" BOUNDARY;
+    apr_size_t blen = strlen(bdry);
+    const apr_strmatch_pattern *pattern;
+    apr_time_t start;
+    apr_ssize_t found = 0;
+    int n;
+
+    start = apr_time_now();
+    for (n = 0; n < rounds; ++n) {
+        found += index_memchr(data, len, bdry, blen);
+    }
+    report("memchr", len, rounds, apr_time_now() - start);
+
+    pattern = apr_strmatch_precompile(pool, bdry, 1);
+    start = apr_time_now();
+    for (n = 0; n < rounds; ++n) {
+        found += apr_strmatch(pattern, data, len) != NULL;
+    }
+    report("strmatch", len, rounds, apr_time_now() - start);
+
+    start = apr_time_now();
+    for (n = 0; n < rounds; ++n) {
+        found += apreq_index(data, len, bdry, blen, APREQ_MATCH_PARTIAL);
+    }
+    report("apreq_index", len, rounds, apr_time_now() - start);
+
+    /* keep the calls, -1 each since the boundary is not in the data */
+    if (found != -2 * rounds) {
+        printf("unexpected matches: %ld\n", (long)found);
+    }
+}
+
+static void time_parse(apr_pool_t *parent, const char *body, apr_size_t len,
+                       apr_size_t upload_len, apr_size_t block, int rounds,
+                       const char *tmpdir)
+{
+    apr_time_t start = apr_time_now();
+    int n;
+
+    for (n = 0; n < rounds; ++n) {
+        apr_pool_t *pool;
+        apr_bucket_alloc_t *ba;
+        apr_bucket_brigade *bb;
+        apreq_parser_t *parser;
+        apr_table_t *t;
+        const char *v;
+        apr_off_t got = -1;
+        apr_status_t s = APR_INCOMPLETE;
+        apr_size_t off;
+
+        apr_pool_create(&pool, parent);
+        ba = apr_bucket_alloc_create(pool);
+        bb = apr_brigade_create(pool, ba);
+        t = apr_table_make(pool, 4);
+        parser = apreq_parser_make(pool, ba,
+                                   "multipart/form-data; boundary=" BOUNDARY,
+                                   apreq_parse_multipart,
+                                   APREQ_DEFAULT_BRIGADE_LIMIT, tmpdir,
+                                   NULL, NULL);
+
+        for (off = 0; off < len && s == APR_INCOMPLETE; off += block) {
+            apr_size_t chunk = len - off < block ? len - off : block;
+
+            APR_BRIGADE_INSERT_TAIL(bb,
+                apr_bucket_transient_create(body + off, chunk, ba));
+            if (off + chunk == len) {
+                APR_BRIGADE_INSERT_TAIL(bb, apr_bucket_eos_create(ba));
+            }
+            s = apreq_parser_run(parser, t, bb);
+            apr_brigade_cleanup(bb);
+        }
+
+        v = apr_table_get(t, "file");
+        if (s == APR_SUCCESS && v != NULL) {
+            apr_brigade_length(apreq_value_to_param(v)->upload, 1, &got);
+        }
+        if (got != (apr_off_t)upload_len) {
+            printf("parse failed (%d), got %ld of %ld upload bytes\n",
+                   s, (long)got, (long)upload_len);
+            exit(1);
+        }
+        apr_pool_destroy(pool);
+    }
+    report("parse", len, rounds, apr_time_now() - start);
+}
+
+int main(int argc, const char * const argv[])
+{
+    apr_pool_t *pool;
+    apr_size_t size = 64, block = 8000, hlen, tlen, len;
+    const char *tmpdir = "/tmp";
+    char *body;
+    int i, rounds = 10;
+
+    for (i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "-s") && i + 1 < argc) {
+            size = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-n") && i + 1 < argc) {
+            rounds = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-b") && i + 1 < argc) {
+            block = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "-t") && i + 1 < argc) {
+            tmpdir = argv[++i];
+        }
+        else {
+            fprintf(stderr, "usage: %s [-s megabytes] [-n rounds] "
+                    "[-b block] [-t tmpdir]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (!size || !block || rounds <= 0) {
+        fprintf(stderr, "%s: invalid argument\n", argv[0]);
+        return 1;
+    }
+    size *= 1024 * 1024;
+
+    apr_app_initialize(&argc, &argv, NULL);
+    apr_pool_create(&pool, NULL);
+
+    hlen = sizeof(head) - 1;
+    tlen = sizeof(tail) - 1;
+    len = hlen + size + tlen;
+    body = apr_palloc(pool, len);
+    memcpy(body, head, hlen);
+    fill_random(body + hlen, size);
+    memcpy(body + hlen + size, tail, tlen);
+
+    printf("%d MB upload, %d rounds, %d bytes blocks\n",
+           (int)(size / (1024 * 1024)), rounds, (int)block);
+    time_scan(pool, body + hlen, size, rounds);
+    time_parse(pool, body, len, size, block, rounds, tmpdir);
+
+    apr_pool_destroy(pool);
+    apr_terminate();
+    return 0;
+}
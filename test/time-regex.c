@@ -0,0 +1,275 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+time-regex: compare the cost of matching a set of RewriteRule patterns
+against request URIs the way ap_regexec() did with PCRE2 (match data
+created and freed for each call, interpreter only), with ap_regexec() of
+server/util_pcre.c (match data reused by each thread), and with the
+patterns also JIT compiled as ap_regcomp() does by default (AP_REG_JIT).
+
+usage: time-regex [-n rounds]
+
+Each round matches every URI of the corpus against every pattern, with
+the options of RegexDefaultOptions' default (DOTALL DOLLAR_ENDONLY) and
+ten captures like mod_rewrite.  The number of matches is printed for each
+mode so they can be checked to be the same.
+
+compile from the top of a configured httpd tree (with PCRE2) with:
+
+gcc -O2 -o time-regex test/time-regex.c server/util_pcre.c \
+    -Iinclude -Ios/unix `pcre2-config --cflags --libs8` \
+    `apr-1-config --cflags --cppflags --includes --link-ld`
+*/
+
+#include "apr.h"
+#include "apr_general.h"
+#include "apr_lib.h"
+#include "apr_time.h"
+
+#include "httpd.h"
+#include "ap_regex.h"
+
+#define PCRE2_CODE_UNIT_WIDTH 8
+#include <pcre2.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NMATCH 10
+
+static const char *const patterns[] = {
+    "^/?$",
+    "^/index\\.(html?|php)$",
+    "^/(.*)/$",
+    "^/([a-z]{2})/(.*)$",
+    "^/blog/([0-9]{4})/([0-9]{2})/([^/]+)/?$",
+    "^/blog/tag/([^/]+)(/page/([0-9]+))?/?$",
+    "^/product/([0-9]+)-([a-z0-9-]+)\\.html$",
+    "^/category/([^/]+)/([^/]+)/?$",
+    "^/api/v([12])/(users|groups)/([0-9]+)(/.*)?$",
+    "^/api/v[12]/search\\?q=(.+)$",
+    "^/static/(css|js|img|fonts)/(.+)\\.([a-f0-9]{8})\\.(css|js|png|jpg|woff2?)$",
+    "^/(wp-admin|wp-login\\.php|xmlrpc\\.php)",
+    "\\.(bak|old|orig|swp|~)$",
+    "(^|/)\\.(git|svn|hg|env|htaccess)(/|$)",
+    "^/download/([^/]+)/([^/]+\\.(zip|tar\\.gz|tgz))$",
+    "^/user/([A-Za-z0-9_.-]{3,32})/?$",
+    "^/user/([A-Za-z0-9_.-]+)/(posts|likes|followers)/?$",
+    "^/(images|media)/([0-9]+)x([0-9]+)/(.+)$",
+    "^/feed/?(rss|atom)?$",
+    "^/sitemap(-[a-z]+)?\\.xml(\\.gz)?$",
+    "^/old-section/(.*)$",
+    "^/shop/cart/(add|remove)/([0-9]+)$",
+    "^/(.+)\\.php$",
+    "^/docs/([0-9]+\\.[0-9]+)/(.+)\\.html$",
+    "^/docs/(?!current/)(.+)$",
+    "(?i)^/(cgi-bin|scripts)/.*\\.(pl|cgi|sh)$",
+    "^/([^/]+)/([^/]+)/([^/]+)/([^/]+)/?$",
+    "/(\\d+)/comments/?(\\?.*)?$",
+    "^/redirect\\?url=(https?://[^&]+)",
+    "^/[^.]*$",
+};
+
+static const char *const uris[] = {
+    "/",
+    "/index.html",
+    "/en/about-us/",
+    "/fr/produits/catalogue/chaussures",
+    "/blog/2020/04/announcing-the-new-release/",
+    "/blog/tag/performance/page/3/",
+    "/product/123456-red-running-shoes-size-42.html",
+    "/category/men/shoes/",
+    "/api/v2/users/987654/preferences/notifications",
+    "/api/v1/search?q=apache+httpd+regex+jit",
+    "/static/js/vendor.bundle.3fa9c1d2.js",
+    "/static/img/hero-banner-homepage-large.5d41402a.jpg",
+    "/wp-login.php",
+    "/config.php.bak",
+    "/project/.git/HEAD",
+    "/download/httpd/httpd-2.5.1.tar.gz",
+    "/user/john.doe_1984/",
+    "/user/jane-smith/followers",
+    "/images/640x480/gallery/2020/summer/beach.jpg",
+    "/feed/atom",
+    "/sitemap-posts.xml.gz",
+    "/old-section/some/deep/legacy/path/page.html",
+    "/shop/cart/add/4242",
+    "/admin/settings/general.php",
+    "/docs/2.4/mod/mod_rewrite.html",
+    "/docs/trunk/howto/htaccess.html",
+    "/CGI-BIN/test/printenv.pl",
+    "/a/b/c/d/",
+    "/news/2020/some-article-title/98765/comments/?sort=newest",
+    "/redirect?url=https://www.example.com/landing&utm_source=mail",
+    "/this/is/a/fairly/long/uri/without/any/extension/that/matches/late",
+    "/favicon.ico",
+};
+
+#define NPATTERNS (sizeof(patterns) / sizeof(patterns[0]))
+#define NURIS     (sizeof(uris) / sizeof(uris[0]))
+
+/* The only functions of server/util.c used by server/util_pcre.c */
+AP_DECLARE(int) ap_cstr_casecmp(const char *s1, const char *s2)
+{
+    while (apr_tolower(*s1) == apr_tolower(*s2)) {
+        if (!*s1++) {
+            return 0;
+        }
+        s2++;
+    }
+    return apr_tolower(*s1) - apr_tolower(*s2);
+}
+
+AP_DECLARE(void) ap_str_toupper(char *str)
+{
+    for (; *str; ++str) {
+        *str = apr_toupper(*str);
+    }
+}
+
+typedef struct {
+    pcre2_code *re[NPATTERNS];
+    ap_regex_t preg[NPATTERNS];
+    int api;
+} bench;
+
+static void compile(bench *b, int api, int jit)
+{
+    apr_size_t i;
+    int err;
+    PCRE2_SIZE off;
+
+    b->api = api;
+    for (i = 0; i < NPATTERNS; ++i) {
+        if (api) {
+            err = ap_regcomp(&b->preg[i], patterns[i],
+                             AP_REG_NO_DEFAULT | AP_REG_DOTALL
+                             | AP_REG_DOLLAR_ENDONLY | (jit ? AP_REG_JIT : 0));
+            if (err) {
+                fprintf(stderr, "can't compile %s (%d)\n", patterns[i], err);
+                exit(1);
+            }
+            continue;
+        }
+        b->re[i] = pcre2_compile((PCRE2_SPTR)patterns[i],
+                                 PCRE2_ZERO_TERMINATED,
+                                 PCRE2_DOTALL | PCRE2_DOLLAR_ENDONLY,
+                                 &err, &off, NULL);
+        if (!b->re[i]) {
+            fprintf(stderr, "can't compile %s (%d at %d)\n",
+                    patterns[i], err, (int)off);
+            exit(1);
+        }
+    }
+}
+
+static void release(bench *b)
+{
+    apr_size_t i;
+
+    for (i = 0; i < NPATTERNS; ++i) {
+        if (b->api) {
+            ap_regfree(&b->preg[i]);
+        }
+        else {
+            pcre2_code_free(b->re[i]);
+        }
+    }
+}
+
+static int match(bench *b, apr_size_t i, const char *uri, apr_size_t len)
+{
+    pcre2_match_data *md;
+    int rc;
+
+    if (b->api) {
+        ap_regmatch_t pmatch[NMATCH];
+
+        return ap_regexec_len(&b->preg[i], uri, len, NMATCH, pmatch, 0) == 0;
+    }
+
+    md = pcre2_match_data_create(NMATCH, NULL);
+    rc = pcre2_match(b->re[i], (PCRE2_SPTR)uri, len, 0, 0, md, NULL);
+    pcre2_match_data_free(md);
+    return rc >= 0;
+}
+
+static void run(const char *name, int api, int jit, int rounds)
+{
+    bench b;
+    apr_size_t lens[NURIS];
+    apr_time_t start, elapsed;
+    apr_size_t i, j;
+    long matches = 0, calls;
+    int n;
+
+    memset(&b, 0, sizeof(b));
+    compile(&b, api, jit);
+    for (j = 0; j < NURIS; ++j) {
+        lens[j] = strlen(uris[j]);
+    }
+
+    start = apr_time_now();
+    for (n = 0; n < rounds; ++n) {
+        for (j = 0; j < NURIS; ++j) {
+            for (i = 0; i < NPATTERNS; ++i) {
+                matches += match(&b, i, uris[j], lens[j]);
+            }
+        }
+    }
+    elapsed = apr_time_now() - start;
+    calls = (long)rounds * NURIS * NPATTERNS;
+
+    printf("%-14s %10ld matches/%ld calls in %7.3fs, %12.0f calls/s\n",
+           name, matches, calls, (double)elapsed / APR_USEC_PER_SEC,
+           (double)calls * APR_USEC_PER_SEC / (elapsed ? elapsed : 1));
+    release(&b);
+}
+
+int main(int argc, const char * const argv[])
+{
+    int i, rounds = 20000;
+    apr_uint32_t jit = 0;
+
+    for (i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "-n") && i + 1 < argc) {
+            rounds = atoi(argv[++i]);
+        }
+        else {
+            fprintf(stderr, "usage: %s [-n rounds]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    apr_app_initialize(&argc, &argv, NULL);
+
+    printf("%d patterns, %d URIs, %d rounds\n",
+           (int)NPATTERNS, (int)NURIS, rounds);
+    run("per-call", 0, 0, rounds);
+    run("ap_regexec", 1, 0, rounds);
+    pcre2_config(PCRE2_CONFIG_JIT, &jit);
+    if (jit) {
+        run("ap_regexec+jit", 1, 1, rounds);
+    }
+    else {
+        printf("no JIT support in this PCRE2 library\n");
+    }
+
+    apr_terminate();
+    return 0;
+}
@@ -0,0 +1,177 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "../httpdunit.h"
+
+#include "httpd.h"
+#include "apreq_util.h"
+
+/*
+ * apreq_index()
+ *
+ * The haystacks are filled with a byte that matches neither end of any
+ * needle, and the needle (or a prefix of it) is copied in at offsets
+ * around the 16 (SSE2) and 32 (AVX2) byte vector widths, so that both the
+ * vector loop and the scalar tail see the match.
+ */
+
+#define HAY_FILL 'x'
+
+static const char needle[] = "\r\n--0123456789abcdef0123456789ab\r\n";
+
+/* needle lengths: 1, 2 and the vector widths */
+static const apr_size_t nlens[] = { 1, 2, 16, 32 };
+static const size_t nlens_len = sizeof(nlens) / sizeof(nlens[0]);
+
+/* haystack lengths around the vector widths */
+static const apr_size_t hlens[] = { 15, 16, 17, 31, 32, 33, 63, 64, 65 };
+static const size_t hlens_len = sizeof(hlens) / sizeof(hlens[0]);
+
+static void fill_hay(char *hay, apr_size_t hlen)
+{
+    memset(hay, HAY_FILL, hlen);
+}
+
+HTTPD_START_LOOP_TEST(index_finds_full_match_at_every_offset, nlens_len * hlens_len)
+{
+    apr_size_t nlen = nlens[_i % nlens_len];
+    apr_size_t hlen = hlens[_i / nlens_len];
+    char hay[128];
+    apr_size_t at;
+
+    if (nlen > hlen)
+        return;
+
+    for (at = 0; at + nlen <= hlen; ++at) {
+        fill_hay(hay, hlen);
+        memcpy(hay + at, needle, nlen);
+
+        ck_assert_int_eq(apreq_index(hay, hlen, needle, nlen,
+                                     APREQ_MATCH_FULL), at);
+        ck_assert_int_eq(apreq_index(hay, hlen, needle, nlen,
+                                     APREQ_MATCH_PARTIAL), at);
+    }
+}
+END_TEST
+
+HTTPD_START_LOOP_TEST(index_returns_first_of_two_full_matches, nlens_len * hlens_len)
+{
+    apr_size_t nlen = nlens[_i % nlens_len];
+    apr_size_t hlen = hlens[_i / nlens_len];
+    char hay[128];
+    apr_size_t at;
+
+    if (2 * nlen > hlen)
+        return;
+
+    for (at = 0; at + 2 * nlen <= hlen; ++at) {
+        fill_hay(hay, hlen);
+        memcpy(hay + at, needle, nlen);
+        memcpy(hay + hlen - nlen, needle, nlen);
+
+        ck_assert_int_eq(apreq_index(hay, hlen, needle, nlen,
+                                     APREQ_MATCH_FULL), at);
+    }
+}
+END_TEST
+
+HTTPD_START_LOOP_TEST(index_finds_partial_match_ending_the_buffer, nlens_len * hlens_len)
+{
+    apr_size_t nlen = nlens[_i % nlens_len];
+    apr_size_t hlen = hlens[_i / nlens_len];
+    char hay[128];
+    apr_size_t plen;
+
+    /* every proper prefix of the needle, as the last bytes of the hay */
+    for (plen = 1; plen < nlen && plen <= hlen; ++plen) {
+        fill_hay(hay, hlen);
+        memcpy(hay + hlen - plen, needle, plen);
+
+        ck_assert_int_eq(apreq_index(hay, hlen, needle, nlen,
+                                     APREQ_MATCH_FULL), -1);
+        ck_assert_int_eq(apreq_index(hay, hlen, needle, nlen,
+                                     APREQ_MATCH_PARTIAL), hlen - plen);
+    }
+}
+END_TEST
+
+HTTPD_START_LOOP_TEST(index_ignores_match_of_first_and_last_byte_only, hlens_len)
+{
+    apr_size_t nlen = 16;
+    apr_size_t hlen = hlens[_i];
+    char hay[128];
+    apr_size_t at;
+
+    if (nlen > hlen)
+        return;
+
+    /* same first and last bytes as the needle, a different middle */
+    for (at = 0; at + nlen <= hlen; ++at) {
+        fill_hay(hay, hlen);
+        memcpy(hay + at, needle, nlen);
+        hay[at + nlen / 2] = HAY_FILL;
+
+        ck_assert_int_eq(apreq_index(hay, hlen, needle, nlen,
+                                     APREQ_MATCH_FULL), -1);
+        ck_assert_int_eq(apreq_index(hay, hlen, needle, nlen,
+                                     APREQ_MATCH_PARTIAL), -1);
+    }
+}
+END_TEST
+
+HTTPD_START_LOOP_TEST(index_returns_minus_one_without_match, nlens_len * hlens_len)
+{
+    apr_size_t nlen = nlens[_i % nlens_len];
+    apr_size_t hlen = hlens[_i / nlens_len];
+    char hay[128];
+
+    fill_hay(hay, hlen);
+
+    ck_assert_int_eq(apreq_index(hay, hlen, needle, nlen,
+                                 APREQ_MATCH_FULL), -1);
+    ck_assert_int_eq(apreq_index(hay, hlen, needle, nlen,
+                                 APREQ_MATCH_PARTIAL), -1);
+}
+END_TEST
+
+HTTPD_START_LOOP_TEST(index_rejects_prefix_not_ending_the_buffer, hlens_len)
+{
+    apr_size_t nlen = 32;
+    apr_size_t hlen = hlens[_i];
+    char hay[128];
+
+    /* "\r\n--" followed by filler is no partial match */
+    fill_hay(hay, hlen);
+    memcpy(hay + hlen - 5, needle, 4);
+
+    ck_assert_int_eq(apreq_index(hay, hlen, needle, nlen,
+                                 APREQ_MATCH_PARTIAL), -1);
+}
+END_TEST
+
+START_TEST(index_with_empty_needle_returns_zero)
+{
+    ck_assert_int_eq(apreq_index("abc", 3, "", 0, APREQ_MATCH_FULL), 0);
+    ck_assert_int_eq(apreq_index("abc", 3, "", 0, APREQ_MATCH_PARTIAL), 0);
+}
+END_TEST
+
+/*
+ * Test Case Boilerplate
+ */
+HTTPD_BEGIN_TEST_CASE(apreq_util)
+#include "test/unit/apreq_util.tests"
+HTTPD_END_TEST_CASE